@@ -0,0 +1,181 @@
+/**
+ * Map-reduce aggregators over all vertices, after GraphLab's aggregators.
+ * An aggregator maps every vertex to a ReductionType, sums the results with
+ * ReductionType::operator+= and passes the total to a finalize function:
+ *
+ * \code
+ * engine.add_vertex_aggregator<double>("residual",
+ *     [](icontext_type& context, const vertex_type& vertex) { return ...; },
+ *     [](icontext_type& context, const double& total) {
+ *         if (total < tolerance) context.stop();
+ *     });
+ * engine.aggregate_periodic("residual", 0.1);
+ * \endcode
+ *
+ * finalize can stop the engine (icontext::stop) or just report the total.
+ * Aggregators run on num_threads workers of thread_pool::global() (other
+ * ones than those of the paused engine), each mapping a contiguous range of
+ * vertex ids; the partial sums are added in the order of the ranges. They run
+ * while no vertex program does, so they see a consistent state of the graph:
+ *  - synchronous_engine runs periodic aggregators between iterations, at the
+ *    first end of an iteration after they are due (every iteration for a
+ *    period of 0).
+ *  - async_engine runs them on a background thread, which pauses the
+ *    worker threads for the time of the aggregation. Periods are at least
+ *    a millisecond there.
+ * Both engines also run all periodic aggregators once at the end of every
+ * start(), and aggregate_now runs one right away between runs.
+ */
+
+#ifndef __AGGREGATOR_H
+#define __AGGREGATOR_H
+
+#include "thread_pool.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+template<typename Engine>
+class aggregator {
+public:
+    typedef typename Engine::graph_type graph_type;
+    typedef typename graph_type::vertex_type vertex_type;
+    typedef typename graph_type::vertex_id_type vertex_id_type;
+    typedef typename Engine::context_type context_type;
+    typedef typename context_type::icontext_type icontext_type;
+
+    // periods shorter than min_period seconds are rounded up to it.
+    aggregator(graph_type& g, context_type& context, int num_threads, double min_period = 0)
+        : g(g), context(context), num_threads(std::max(1, num_threads)), min_period(min_period) {}
+
+    /**
+     * Adds an aggregator named key. Returns false if there already is one.
+     * ReductionType needs a default constructor and operator+=.
+     */
+    template<typename ReductionType>
+    bool add_vertex_aggregator(const std::string& key,
+                               std::function<ReductionType(icontext_type&, const vertex_type&)> map_fn,
+                               std::function<void(icontext_type&, const ReductionType&)> finalize_fn) {
+        if (aggregators.count(key) > 0) {
+            return false;
+        }
+        entry& e = aggregators[key];
+        e.run = [this, map_fn, finalize_fn] {
+            std::vector<ReductionType> partial(num_threads);
+            std::vector<char> is_set(num_threads, 0);
+            const vertex_id_type num_v = g.num_vertices();
+            thread_pool::global().run(num_threads, [&](int t) {
+                const vertex_id_type begin = (long) num_v * t / num_threads;
+                const vertex_id_type end = (long) num_v * (t + 1) / num_threads;
+                for (vertex_id_type vid = begin; vid < end; vid++) {
+                    auto&& v = g.vertex(vid);
+                    if (is_set[t]) {
+                        partial[t] += map_fn(context, v);
+                    } else {
+                        partial[t] = map_fn(context, v);
+                        is_set[t] = 1;
+                    }
+                }
+            });
+            ReductionType total = ReductionType();
+            bool total_is_set = false;
+            for (int t = 0; t < num_threads; t++) {
+                if (!is_set[t]) {
+                    continue;
+                }
+                if (total_is_set) {
+                    total += partial[t];
+                } else {
+                    total = partial[t];
+                    total_is_set = true;
+                }
+            }
+            finalize_fn(context, total);
+        };
+        return true;
+    }
+
+    // runs key every seconds from now on. Returns false if there is no such aggregator or seconds is negative.
+    bool aggregate_periodic(const std::string& key, double seconds) {
+        typename std::map<std::string, entry>::iterator it = aggregators.find(key);
+        if (it == aggregators.end() || seconds < 0) {
+            return false;
+        }
+        it->second.period = std::max(seconds, min_period);
+        return true;
+    }
+
+    // runs key right away. Returns false if there is no such aggregator.
+    bool aggregate_now(const std::string& key) {
+        typename std::map<std::string, entry>::iterator it = aggregators.find(key);
+        if (it == aggregators.end()) {
+            return false;
+        }
+        it->second.run();
+        return true;
+    }
+
+    // ---- called by the engines ---- //
+
+    bool has_periodic() const {
+        for (const auto& it : aggregators) {
+            if (it.second.period >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // start of a run, at elapsed seconds since the engine's start(). The periods count from here.
+    void start(double now) {
+        for (auto& it : aggregators) {
+            it.second.next_due = now + it.second.period;
+        }
+    }
+
+    // seconds since the engine's start() at which the next periodic aggregator is due, -1 if there is none.
+    double next_due() const {
+        double ret = -1;
+        for (const auto& it : aggregators) {
+            const entry& e = it.second;
+            if (e.period >= 0) {
+                ret = ret < 0 ? e.next_due : std::min(ret, e.next_due);
+            }
+        }
+        return ret;
+    }
+
+    // runs the periodic aggregators that are due at now (all of them if all). Returns the number run.
+    int run_due(double now, bool all = false) {
+        int ret = 0;
+        for (auto& it : aggregators) {
+            entry& e = it.second;
+            if (e.period >= 0 && (all || now >= e.next_due)) {
+                e.run();
+                e.next_due = now + e.period;
+                ret++;
+            }
+        }
+        return ret;
+    }
+
+private:
+    struct entry {
+        std::function<void()> run;
+        double period;      // seconds, negative if not periodic
+        double next_due;    // seconds since the engine's start()
+
+        entry(): period(-1), next_due(0) {}
+    };
+
+    graph_type& g;
+    context_type& context;
+    const int num_threads;
+    const double min_period;
+    std::map<std::string, entry> aggregators;   // by key, run in key order
+};
+
+#endif
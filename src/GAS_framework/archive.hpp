@@ -0,0 +1,72 @@
+/**
+ * Byte buffers for the messages of distributed_engine, named after GraphLab's
+ * oarchive and iarchive but much simpler: values are copied as they are, so
+ * only trivially copyable types can be written (vertex and edge data, gather
+ * and message types of the sample programs). Both sides must be the same
+ * binary on machines of the same endianness. graphlab::empty takes no bytes.
+ *
+ * Vertex programs with state write and read it in save and load:
+ *
+ * \code
+ * void save(oarchive& oarc) const { oarc << delta; }
+ * void load(iarchive& iarc) { iarc >> delta; }
+ * \endcode
+ */
+
+#ifndef __ARCHIVE_H
+#define __ARCHIVE_H
+
+#include "../graphlab/util/empty.hpp"
+
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+class oarchive {
+public:
+    explicit oarchive(std::vector<char>& buf): buf(buf) {}
+
+    template<typename T>
+    oarchive& operator<<(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "oarchive only writes trivially copyable types");
+        const std::size_t pos = buf.size();
+        buf.resize(pos + sizeof(T));
+        std::memcpy(buf.data() + pos, &value, sizeof(T));
+        return *this;
+    }
+
+    oarchive& operator<<(const graphlab::empty& value) { return *this; }
+
+private:
+    std::vector<char>& buf;
+};
+
+class iarchive {
+public:
+    iarchive(const char *begin, const char *end): pos(begin), end(end) {}
+
+    explicit iarchive(const std::vector<char>& buf): pos(buf.data()), end(buf.data() + buf.size()) {}
+
+    template<typename T>
+    iarchive& operator>>(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "iarchive only reads trivially copyable types");
+        if (end - pos < (std::ptrdiff_t) sizeof(T)) {
+            throw std::runtime_error("iarchive: read past the end of the buffer");
+        }
+        std::memcpy(&value, pos, sizeof(T));
+        pos += sizeof(T);
+        return *this;
+    }
+
+    iarchive& operator>>(graphlab::empty& value) { return *this; }
+
+    bool empty() const { return pos == end; }
+
+private:
+    const char *pos;
+    const char *end;
+};
+
+#endif
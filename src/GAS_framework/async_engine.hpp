@@ -1,15 +1,68 @@
 /**
- * Right now, access to vertex and edge data is synchronized with a mechanism
- * based on the monitor solution to the dining philosophers problem described 
- * in Operating System Concepts (9th Edition) by Silberschatz, Galvin & Gagne.
+ * Access to vertex and edge data is synchronized according to the consistency
+ * model chosen in engine_options:
+ *  - EDGE_CONSISTENCY (default) uses the Chandy-Misra solution to the dining
+ *    philosophers problem, which is used by GraphLab as well (see chandy_misra.hpp).
+ *  - MONITOR_EDGE_CONSISTENCY takes the locks of a vertex and all its
+ *    neighbours at once, as the monitor solution described in Operating
+ *    System Concepts (9th Edition) by Silberschatz, Galvin & Gagne does, but
+ *    with a lock word per vertex instead of a global mutex (see
+ *    neighbourhood_locks.hpp).
+ *  - VERTEX_CONSISTENCY only locks the executing vertex. Vertex programs that
+ *    tolerate reading neighbours while they change (e.g. PageRank with delta
+ *    caching) can use it to avoid any locking of neighbourhoods.
  * 
- * In the near future, it may be replaced with the Chandy-Misra solution, 
- * which is used by GraphLab as well.
- * 
- * ! For the sake of simplicity, everything that needs synchronization uses
- * ! the same mutex. They all access vertex_states so that is to some degreee 
- * ! necessary. Think about how this might be resolved. Using a lock for
- * ! each element in vertex_states might allow deadlocks. 
+ * The gather cache (see gather_cache.hpp) is locked per vertex, so post_delta
+ * may be called by concurrent scatters. With VERTEX_CONSISTENCY, a delta that
+ * a neighbour posts while a vertex gathers from scratch may be lost, if the
+ * gather read the neighbour's old value.
+ *
+ * Every thread has its own SPM (see spm_interface.hpp), as every core of the
+ * target architecture does, so SPM accesses do not lock anything either.
+ * Each thread also simulates the cycles of its core (see new_arch.hpp):
+ * gathers and scatters cost op_cycles, SPM misses the latency of main memory,
+ * and the core stalls on loads that have not arrived by the time their data
+ * is needed. simulated_cycles and stall_cycles show how much of the memory
+ * latency a load_ahead_distance hides.
+ * The load ahead distance of every vertex is picked by the prefetch policy of
+ * engine_options (see prefetch_policy.hpp).
+ *
+ * Vertices with at least engine_options::hub_degree edges (hubs of power-law
+ * graphs) are executed by execute_hub: their gathers and scatters are split
+ * into chunks, which the threads without a job of their own take over, as
+ * PowerGraph does across machines. The thread that runs the hub reduces the
+ * partial gathers in chunk order. The helpers work under the locks of the
+ * hub's thread, on their own SPMs, and only call the const gather and
+ * scatter of the hub's vertex program.
+ *
+ * Active vertices are kept by a scheduler (see ischeduler.hpp), which does
+ * not share any lock with the consistency models. Signalling a vertex does not
+ * lock anything, unless it goes to the inbox of another thread's partition
+ * (see engine_options::partition_vertices).
+ *
+ * An engine that has finished can be started again. After the edges of the
+ * graph were changed with graph_mutations.hpp, graph_changed() signals the
+ * affected vertices, so only those and what they signal run again.
+ *
+ * A run ends early on context.stop() or once a budget of engine_options
+ * (max_seconds, max_updates) is used up. The threads finish the vertices they
+ * hold and leave the others scheduled, so the next start() resumes. Periodic
+ * aggregators (see aggregator.hpp) run on a background thread while the
+ * workers are paused; their finalize may call stop, but not signal.
+ *
+ * The worker threads count vertex updates, edges, lock failures and SPM
+ * hits, misses and evictions in their own thread_metrics; see
+ * engine_metrics.hpp for the totals in metrics.
+ *
+ * The workers are those of thread_pool::global() (see thread_pool.hpp), so a
+ * start() does not create any thread, except the aggregators' one. A worker
+ * without a job spins for a while, then sleeps in idle until a vertex is
+ * activated, a hub task is posted, the run ends or the aggregators pause it.
+ *
+ * With engine_options::checkpoint_prefix, the vertex and edge data, the active
+ * vertices, their messages and the cached gathers are checkpointed while the
+ * workers run (see checkpoint.hpp). restore_checkpoint() takes the place of
+ * signal_all(), and start() continues from the saved frontier.
  * 
  * ! Think about limiting the duration of the locks to specific parts of the
  * ! functions.
@@ -21,16 +74,35 @@
 #include "simple_graph.hpp"
 #include "../graphlab/graphlab.hpp"
 #include "spm_interface.hpp"
+#include "engine_options.hpp"
+#include "ischeduler.hpp"
+#include "work_stealing_scheduler.hpp"
+#include "multiqueue_scheduler.hpp"
+#include "chandy_misra.hpp"
+#include "neighbourhood_locks.hpp"
+#include "message_combiner.hpp"
+#include "gather_cache.hpp"
+#include "prefetch_policy.hpp"
+#include "vertex_order.hpp"
+#include "aggregator.hpp"
+#include "engine_metrics.hpp"
+#include "thread_pool.hpp"
+#include "checkpoint.hpp"
 
-#include <unordered_set>
 #include <vector>
+#include <memory>
 #include <type_traits>  //for is_base_of
 #include <iostream>
 #include <algorithm>    //min()
+#include <functional>
 
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <exception>
 
 // #define load_ahead_distance 50
 // #define NUM_THREADS 2
@@ -52,40 +124,130 @@ public:
     typedef typename graph_type::edge_type edge_type;
     typedef typename graph_type::vertex_id_type vertex_id_type;
     typedef graphlab::context<async_engine> context_type;
+    typedef typename context_type::icontext_type icontext_type;
     typedef graphlab::edge_dir_type edge_dir_type;   
+    typedef engine_snapshot<graph_type, gather_type, message_type> snapshot_type;
+    typedef typename snapshot_type::vertex_state vertex_state;
 
     // ---------------------------------------- //
     // -------------- FUNCTIONS --------------- //
     // ---------------------------------------- //
 
-    // constructor
-    async_engine(graph_type& g, int load_ahead_distance, int num_threads, bool enable_caching = false): g(g), 
-                                                                caching_enabled(enable_caching),
+    // constructors
+    async_engine(graph_type& g, int load_ahead_distance, int num_threads, bool enable_caching = false)
+        : async_engine(g, make_options(load_ahead_distance, num_threads, enable_caching)) {}
+
+    async_engine(graph_type& g, const engine_options& opts): g(g), 
+                                                                caching_enabled(opts.enable_caching),
+                                                                cache(opts.enable_caching ? g.num_vertices() : 0),
+                                                                messages(g.num_vertices()),
                                                                 context(*this, g),
-                                                                num_threads(num_threads),
-                                                                load_ahead_distance(load_ahead_distance), 
-                                                                num_idle_threads(0) {
-        if (!std::is_base_of<graphlab::ivertex_program<graph_type, gather_type>, VertexProgram>::value) {
+                                                                aggregators(g, context, opts.num_threads, MIN_AGGREGATOR_PERIOD),
+                                                                max_seconds(opts.max_seconds),
+                                                                max_updates(opts.max_updates),
+                                                                stop_requested(false),
+                                                                num_updates(0),
+                                                                pause_requested(false),
+                                                                num_parked(0),
+                                                                num_exited(0),
+                                                                checkpoint_interval(opts.checkpoint_interval),
+                                                                num_threads(opts.num_threads),
+                                                                pin_threads(opts.pin_threads),
+                                                                consistency(opts.consistency),
+                                                                hub_degree(opts.hub_degree),
+                                                                hub_chunk_size(std::max(1, opts.hub_chunk_size)),
+                                                                num_hub_tasks(0),
+                                                                time_metrics(opts.time_metrics) {
+        if (!std::is_base_of<graphlab::ivertex_program<graph_type, gather_type, message_type>, VertexProgram>::value) {
             throw "type parameter for async egnine is not derived from graphlab::ivertex_program";
         }
-        vertex_states.resize(g.num_vertices(), vertex_state_type::FREE);
-        in_use.resize(g.num_vertices(), false);
-        gather_cache.resize(g.num_vertices());
-        has_cache.resize(g.num_vertices(), false);
+        switch (opts.scheduler) {
+        case PRIORITY:
+            scheduler.reset(new multiqueue_scheduler<vertex_id_type>(g.num_vertices(), num_threads));
+            break;
+        case WORK_STEALING:
+        default:
+            if (opts.partition_vertices) {
+                partition_begin = partition_vertices(g, num_threads);
+                scheduler.reset(new work_stealing_scheduler<vertex_id_type>(g.num_vertices(), num_threads,
+                                                                            partition_begin));
+            } else {
+                scheduler.reset(new work_stealing_scheduler<vertex_id_type>(g.num_vertices(), num_threads));
+            }
+        }
+        switch (opts.prefetch) {
+        case DEGREE_PREFETCH:
+            prefetch.reset(new degree_prefetch_policy(opts.load_ahead_distance));
+            break;
+        case ADAPTIVE_PREFETCH:
+            prefetch.reset(new adaptive_prefetch_policy(num_threads, opts.load_ahead_distance));
+            break;
+        case FIXED_PREFETCH:
+        default:
+            prefetch.reset(new fixed_prefetch_policy(opts.load_ahead_distance));
+        }
+        switch (consistency) {
+        case EDGE_CONSISTENCY:
+            forks.reset(new chandy_misra<graph_type>(g));
+            break;
+        case VERTEX_CONSISTENCY:
+            // This cannot be resized since spinlock is not copyable.
+            vertex_locks = std::vector<spinlock>(g.num_vertices());
+            break;
+        case MONITOR_EDGE_CONSISTENCY:
+            monitor.reset(new neighbourhood_locks<graph_type>(g, num_threads));
+            break;
+        }
 
-        // This cannot be resized since the copy constructor for std::condition_variable is deleted.
-        cv_exclusive_access = std::vector<std::condition_variable>(g.num_vertices());
+        for (int i = 0; i < num_threads; i++) {
+            spms.emplace_back(new thread_spm(opts.spm_size, opts.timing));
+        }
+        if (!opts.checkpoint_prefix.empty()) {
+            snapshot.reset(new snapshot_type(g, num_threads, opts.checkpoint_prefix, caching_enabled,
+                                             [this](vertex_id_type vid, vertex_state& s) {
+                s.active = scheduler->is_active(vid);
+                s.has_message = messages.peek(vid, s.message);
+                s.has_cache = caching_enabled && cache.get(vid, s.cache);
+            }));
+        }
 
         spm_hits = 0;
         spm_misses = 0;
+        simulated_cycles = 0;
+        stall_cycles = 0;
+        num_executed = 0;
+        num_checkpoints = 0;
     }
 
     // called by the application programmer
     void signal_all();
     void start();
+    void graph_changed(const std::vector<vertex_id_type>& affected);
+    void save_checkpoint();
+    void restore_checkpoint(const std::string& filename);
+
+    // map-reduce over the vertices, see aggregator.hpp. Periodic ones run on a background thread.
+    template<typename ReductionType>
+    bool add_vertex_aggregator(const std::string& key,
+                               std::function<ReductionType(icontext_type&, const vertex_type&)> map_fn,
+                               std::function<void(icontext_type&, const ReductionType&)> finalize_fn) {
+        return aggregators.template add_vertex_aggregator<ReductionType>(key, map_fn, finalize_fn);
+    }
+    bool aggregate_periodic(const std::string& key, double seconds) { return aggregators.aggregate_periodic(key, seconds); }
+    bool aggregate_now(const std::string& key) { return aggregators.aggregate_now(key); }     // between runs
 
     // called by the context
-    void internal_signal(const vertex_type& vertex);
+    int iteration() const { return -1; }    // there are no iterations in asynchronous execution
+    std::size_t procid() const { return 0; }
+    std::size_t num_procs() const { return 1; }
+    float elapsed_seconds() const {
+        return std::chrono::duration<float>(std::chrono::steady_clock::now() - start_time).count();
+    }
+    void internal_stop() {
+        stop_requested.store(true, std::memory_order_relaxed);
+        idle.notify_all();
+    }
+    void internal_signal(const vertex_type& vertex, const message_type& message = message_type());
     void internal_post_delta(const vertex_type& vertex, const gather_type& delta);
     void internal_clear_gather_cache(const vertex_type& vertex);
 
@@ -94,104 +256,218 @@ public:
     // ------------- DATA MEMBERS ------------- //
     // ---------------------------------------- //
 
-    // test-purpose counters
+    // test-purpose counters, summed over the threads' SPMs once start() returns
     long int spm_hits;
     long int spm_misses;
-
-    spm_interface<graph_type> spmi;
+    long int simulated_cycles;          // of the slowest core
+    long int stall_cycles;              // waiting for memory, summed over the cores
+    std::atomic<long> num_executed;     // vertex programs
+    long num_checkpoints;               // written, by start() and save_checkpoint()
+    engine_metrics metrics;             // of the worker threads, merged at the end of every start()
 
 private:
     graph_type& g;  // A reference to the input graph.
 
-    /**  
-     * TODO: Possibly replace later with better data structure.
-     * * A bitset could be useful now that vid's are restricted to be consecutive.
-     * * Though it would make an empty-check and the retrival of any acitve vertex slower.
+    /**
+     * graphlab::empty data is not brought to SPM. spm_interface compiles its
+     * functions for it to nothing, these only skip the hit checks.
      */
-    std::unordered_set<vertex_id_type> active_list; // The collection of vertices that have not converged yet.
+    static constexpr bool has_vdata = !std::is_same<vertex_data_type, graphlab::empty>::value;
+    static constexpr bool has_edata = !std::is_same<edge_data_type, graphlab::empty>::value;
+
+    std::unique_ptr<ischeduler<vertex_id_type> > scheduler;  // The collection of vertices that have not converged yet.
+
+    // the vertex id range of each thread with engine_options::partition_vertices, empty otherwise.
+    std::vector<vertex_id_type> partition_begin;
 
     /**
      * Indicates whether the application programmer has enabled gather caching.
      */
     bool caching_enabled;
 
-    std::vector<gather_type> gather_cache;  
-    std::vector<bool> has_cache;
+    gather_cache<gather_type> cache;    // empty unless caching is enabled
+
+    /**
+     * The combined messages of the signals since each vertex last ran. Taken
+     * right before init, so signals that arrive while a vertex runs go to
+     * its next execution.
+     */
+    message_combiner<message_type> messages;
 
     // creating a separate context for each vertex program is not necessary. This one is used by all of them.
     context_type context;
 
+    // ---- AGGREGATORS AND STOPPING ---- //
+    static constexpr double MIN_AGGREGATOR_PERIOD = 0.001;  // seconds
+    aggregator<async_engine> aggregators;
+
+    const double max_seconds;   // of a start(), negative for no limit
+    const long max_updates;
+    std::chrono::steady_clock::time_point start_time;
+    std::atomic<bool> stop_requested;   // by the context or a budget, reset by start()
+    std::atomic<long> num_updates;      // of the current start(), only counted with max_updates
+
+    /**
+     * The background thread of the periodic aggregators sets pause_requested
+     * and waits until every worker thread is parked (in park()) or has exited.
+     * Workers only park between vertex programs, when they have no ready
+     * vertex, so no lock is held that another thread waits for.
+     */
+    std::atomic<bool> pause_requested;
+    std::mutex pause_mutex;
+    std::condition_variable pause_cv;
+    int num_parked;     // protected by pause_mutex
+    int num_exited;     // workers that have left thread_start, protected by pause_mutex
+
+    bool should_stop();
+    void park();
+    void run_aggregators();    // the background thread
+
+    // ---- CHECKPOINTS ---- //
+    std::unique_ptr<snapshot_type> snapshot;    // null without engine_options::checkpoint_prefix
+    const double checkpoint_interval;           // seconds, 0 for none during start()
+    std::exception_ptr checkpoint_error;        // of the checkpoint thread, rethrown by start()
+
+    /**
+     * The phase of the job that runs on this thread (see engine_snapshot::begin_job),
+     * also set while helping a hub. 0 outside of jobs.
+     */
+    static thread_local uint64_t job_phase;
+
+    void run_checkpoints();    // the background thread
+
+    // runs mutate, which changes the state of vid. Checkpoints that copied the state already apply mirror to the copy.
+    template<typename Mutate, typename Mirror>
+    void update_state(vertex_id_type vid, Mutate mutate, Mirror mirror) {
+        if (snapshot) {
+            snapshot->update(vid, job_phase, mutate, mirror);
+        } else {
+            mutate();
+        }
+    }
+
 
 
     // --------------------------------------------------------------------------- //
     // --- MULTITHREADING & SYNCHRONIZATION RELATED INTERNAL DATA & FUNCTIONS ---- //
     // --------------------------------------------------------------------------- //
     const int num_threads;
-    int num_idle_threads;
+    const bool pin_threads;
+    idle_waiter idle;   // of the workers that found no job, see get_next_job
 
-    enum vertex_state_type {
-        FREE,       // the vertex program for the vertex is not scheduled to any thread.
-        SCHEDULED,  // the vprog is assigned to a thread, which is waiting to acquire lock to begin running
-        RUNNING
-    };
-    std::vector<vertex_state_type> vertex_states;
-    
     /**
-     * ! See the comments at the very top of the file. Right now this mutex is used for all synchronization.
+     * Id of the worker thread (0 .. num_threads - 1) that is running on the current thread.
+     * internal_signal passes it to the scheduler. It is 0 on any other thread.
      */
-    std::mutex scheduling_mutex;
+    static thread_local int worker_id;
 
-    /**
-     * When a thread tries to get a job, job_queue is empty, and there exists at least one
-     * busy thread, the thread asking for a job waits on cv_no_jobs. It is waken up when 
-     * a vertex is signalled. 
-     * Alternatively, it may be waken up when the last busy thread finds active_list empty. 
-     * In that case, no futher activation is possible. Each idle thread is waken up and they 
-     * all fail to get jobs. After that they all quit. 
-     */
-    std::condition_variable cv_no_jobs;
+    const consistency_model consistency;
 
-    /** 
-     * Used in the dining philosophers-based synchronization of vertex programs.
-     * A thread that can not get the exclusive access required for its job (see 
-     * get_exclusive_access below) will wait on cv_exclusive_access[vid] where vid 
-     * is the id of the vertex whose program the thread is scheduled to execute.
-     */
-    std::vector<std::condition_variable> cv_exclusive_access;
+    // EDGE_CONSISTENCY
+    std::unique_ptr<chandy_misra<graph_type> > forks;
+
+    // VERTEX_CONSISTENCY
+    std::vector<spinlock> vertex_locks;
+
+    // MONITOR_EDGE_CONSISTENCY
+    std::unique_ptr<neighbourhood_locks<graph_type> > monitor;
+
+    std::unique_ptr<iprefetch_policy> prefetch;    // picks the load ahead distance of every vertex
+
+    // ---- HUB VERTICES ---- //
+    const int hub_degree;       // 0 if disabled
+    const int hub_chunk_size;
+
+    // the chunks of the gather or scatter of a hub over its in or out edges.
+    struct hub_task {
+        std::function<void(int, int)> run_chunk;    // (thread_id, chunk)
+        int num_chunks;
+        int next_chunk;                             // protected by hub_lock
+        std::atomic<int> chunks_done;
+    };
+
+    spinlock hub_lock;
+    std::vector<hub_task*> hub_tasks;               // protected by hub_lock, the tasks live on their owner's stack
+    std::atomic<int> num_hub_tasks;                 // hub_tasks.size(), read without the lock
+
+    // the SPM of a worker thread and its counters. Aligned so that the counters of different threads do not share a line.
+    struct alignas(64) thread_spm {
+        spm_interface<graph_type> spmi;
+        thread_metrics metrics;     // of the current run, see engine_metrics.hpp
+
+        thread_spm(new_arch::size_t spm_size, const new_arch::timing_model& timing)
+            : spmi(spm_size, timing) {}
+    };
+
+    const bool time_metrics;    // measure LOCK_WAIT_NS and IDLE_NS
+
+    std::vector<std::unique_ptr<thread_spm> > spms;     // indexed by thread id
+
+    // what the prefetch policy gets to know about spmi.
+    static spm_occupancy occupancy(const spm_interface<graph_type>& spmi) {
+        spm_occupancy ret;
+        ret.capacity_bytes = spmi.capacity_bytes();
+        ret.free_bytes = ret.capacity_bytes - spmi.used_bytes();
+        ret.pair_bytes = spmi.edge_slot_size() + spmi.vertex_slot_size();   // 0 for empty data
+        return ret;
+    }
+
+    static engine_options make_options(int load_ahead_distance, int num_threads, bool enable_caching) {
+        engine_options opts;
+        opts.load_ahead_distance = load_ahead_distance;
+        opts.num_threads = num_threads;
+        opts.enable_caching = enable_caching;
+        return opts;
+    }
+
+    void thread_start(int thread_id);
+    // distance is the load ahead distance picked for the vertex, see prefetch_policy.hpp
+    void execute_vprog(int thread_id, vertex_id_type vid, int distance);
+    void execute_hub(int thread_id, vertex_id_type vid, int distance);
+
+    int num_chunks(int num_edges) const { return (num_edges + hub_chunk_size - 1) / hub_chunk_size; }
 
     /**
-     * Has an entry for each vertex that is true if a neighbour or the vertex itself
-     * is currently executing. Analogous to the forks in the dining phil. analogy.
+     * Calls f(edge, chunk) for every in (or out) edge of cur, in chunks that the
+     * idle threads take as well. Returns once all the chunks are done.
      */
-    std::vector<bool> in_use;
+    template<typename EdgeFunction>
+    void for_edges_chunked(int thread_id, const vertex_type& cur, bool in_edges, int distance, EdgeFunction f);
 
-    int load_ahead_distance;
+    // runs f on the in (or out) edges begin .. end - 1 of cur, with their data in the SPM of thread_id.
+    template<typename EdgeFunction>
+    void process_chunk(int thread_id, const vertex_type& cur, bool in_edges, int begin, int end,
+                       int distance, EdgeFunction& f);
 
-    void thread_start();
-    void execute_vprog(vertex_id_type vid);
-    bool get_next_job(vertex_id_type& ret_vid);
+    // runs a chunk of some hub's task. Returns false if there is no chunk left to run.
+    bool help_hub(int thread_id);
+    bool claim_chunk(hub_task& task, int& ret_chunk);   // with hub_lock held
 
     /**
-     * Blocks current thread until it has exclusive access to the vertex at vid, all its
-     * neighbours and the edges in between. Equiavalent to pickup(...) in the 
-     * above-mentioned dining philosophers analogy.
+     * Returns false once no vertex is active or executing. Until then, spins
+     * on the scheduler while no job can be found, then sleeps in idle.
      */
-    void get_exclusive_access(vertex_id_type vid);
+    bool get_next_job(int thread_id, vertex_id_type& ret_vid);
 
     /**
-     * Equiavalent to test(...) in the above-mentioned dining philosophers analogy.
-     * block is a return argument that holds a vid which can not be accesssed exclusively
-     * if the return value is false.
+     * Acquires what the consistency model requires to execute the vertex at vid.
+     * Returns false if that is not possible yet (EDGE_CONSISTENCY only). The vertex
+     * is then handed to the thread that releases the last fork it is waiting for,
+     * through the ready argument of release_exclusive_access.
      */
-    bool exclusive_access_possible(vertex_id_type vid, vertex_id_type &block);
+    bool get_exclusive_access(vertex_id_type vid);
 
     /**
-     * Equiavalent to putdown(...) in the above-mentioned dining philosophers analogy.
+     * Releases what get_exclusive_access acquired. Vertices that can execute
+     * now because of the release are appended to ready.
      */
-    void release_exclusive_access(vertex_id_type vid);
+    void release_exclusive_access(vertex_id_type vid, std::vector<vertex_id_type>& ready);
 
-    // a test-purpose function that increments hit & miss counts. 
-    void check_spm_hit(const edge_type &e, const vertex_type &v);
+    /**
+     * a test-purpose function that increments hit & miss counts. Also charges the
+     * core of spm for a gather or scatter over e: a miss goes to main memory.
+     */
+    void check_spm_hit(thread_spm &spm, const edge_type &e, const vertex_type &v);
 };
 
 /**
@@ -201,125 +477,185 @@ private:
 using namespace std;
 
 template<typename VertexProgram>
-void async_engine<VertexProgram>::get_exclusive_access(vertex_id_type vid) {
-    std::unique_lock<std::mutex> lock(scheduling_mutex);
+thread_local int async_engine<VertexProgram>::worker_id = 0;
 
-    vertex_id_type block;
-    while (!exclusive_access_possible(vid, block)) {
-        cv_exclusive_access[block].wait(lock);
-    }
-
-    in_use[vid] = true; // acquire vid
-    vertex_type v = g.vertex(vid);
-    for (edge_type *e : v.in_edges) {   // acquire in_neigbours
-        in_use[e->source().id()] = true;
-    }
-    for (edge_type *e : v.out_edges) {   // acquire out_neigbours
-        in_use[e->target().id()] = true;
-    }
-
-
-    vertex_states[vid] = vertex_state_type::RUNNING;
-}
+template<typename VertexProgram>
+thread_local uint64_t async_engine<VertexProgram>::job_phase = 0;
 
 template<typename VertexProgram>
-bool async_engine<VertexProgram>::exclusive_access_possible(vertex_id_type vid, vertex_id_type &block) {
-    // always called by get_exclusive_access, which readily holds mutex_exclusive access
-    
-    vertex_type v = g.vertex(vid);
-    if (in_use[v.id()]) {
-        block = v.id();
-        return false;
-    }
-    for (edge_type *e : v.in_edges) {   // can't get access if any in_neighbour is in use
-        if (in_use[e->source().id()]) {
-            block = e->source().id();
-            return false;
-        }
-    }
-    for (edge_type *e : v.out_edges) {   // can't get access if any out_neighbour is in use
-        if (in_use[e->target().id()]) {
-            block = e->target().id();
-            return false;
-        }
+bool async_engine<VertexProgram>::get_exclusive_access(vertex_id_type vid) {
+    switch (consistency) {
+    case EDGE_CONSISTENCY:
+        return forks->make_hungry(vid);
+    case VERTEX_CONSISTENCY:
+        vertex_locks[vid].lock();
+        return true;
+    case MONITOR_EDGE_CONSISTENCY:
+    default:
+        monitor->lock(worker_id, vid);    // blocks until the whole neighbourhood is free
+        return true;
     }
-    return true;
 }
 
 template<typename VertexProgram>
-void async_engine<VertexProgram>::release_exclusive_access(vertex_id_type vid) {
-    std::unique_lock<std::mutex> lock(scheduling_mutex);
-
-    vertex_states[vid] = vertex_state_type::FREE;
-    vertex_type v = g.vertex(vid);
-
-    in_use[vid] = false;    // release executed vertex
-    cv_exclusive_access[vid].notify_all();
-
-    for (edge_type *e : v.in_edges) {   // release in neighbours
-        in_use[e->source().id()] = false;
-        cv_exclusive_access[e->source().id()].notify_all();
-    }
-    for (edge_type *e : v.out_edges) {   // release out neighbours
-        in_use[e->target().id()] = false;
-        cv_exclusive_access[e->target().id()].notify_all();
+void async_engine<VertexProgram>::release_exclusive_access(vertex_id_type vid, vector<vertex_id_type>& ready) {
+    switch (consistency) {
+    case EDGE_CONSISTENCY:
+        forks->stop_eating(vid, ready);
+        break;
+    case VERTEX_CONSISTENCY:
+        vertex_locks[vid].unlock();
+        break;
+    case MONITOR_EDGE_CONSISTENCY:
+    default:
+        monitor->unlock(worker_id, vid);
+        break;
     }
-
 }
 
 /**
- * TODO: Might get rid of the need to check if the vertex is SCHEDUELED by 
- * TODO: moving removal from active_list to after exclusive_access is obtained.
- * TODO: then, internal_signal would not have to access vertex_states.
+ * A vertex stays active until the thread that took it has exclusive access (see
+ * thread_start). Signals before that are dropped by the scheduler, as the thread
+ * will access the latest data anyway.
+ * The message is combined with the vertex's pending message even if the
+ * signal is dropped.
  */
 template<typename VertexProgram>
-void async_engine<VertexProgram>::internal_signal(const vertex_type& vertex) {
-    // lock scheduling_mutex within the whole function body.
-    std::unique_lock<std::mutex> lock_AL(scheduling_mutex);
-
-    const vertex_id_type vid = vertex.id();
-
-    if (active_list.count(vid) == 0) {  // if vertex is not already active
-        if (vertex_states[vid] == vertex_state_type::FREE) {
-            active_list.insert(vid);
-            cv_no_jobs.notify_one();  // an idle thread may wake up and find a job.
-        } else if (vertex_states[vid] == vertex_state_type::SCHEDULED) {
-            // skip activation.. the thread that has the vertex will access the latest data anyway.
-        } else {
-            // TODO: throw a proper exception.
-            throw std::runtime_error("running vertex signalled. A neighbour must have been running also");
-        }
+void async_engine<VertexProgram>::internal_signal(const vertex_type& vertex, const message_type& message) {
+    bool scheduled = false;
+    update_state(vertex.id(), [&]{
+        messages.add(vertex.id(), message);     // before the vertex can be taken
+        scheduled = scheduler->schedule(worker_id, vertex.id(), message_priority(message));
+    }, [&](vertex_state& s){
+        s.add_message(message);
+        s.active = true;
+    });
+    if (scheduled) {
+        idle.notify_all();
     }
 }
 
 template<typename VertexProgram>
 void async_engine<VertexProgram>::
 internal_post_delta(const vertex_type& vertex, const gather_type& delta) {
-    if(caching_enabled && has_cache[vertex.id()]) {
-        gather_cache[vertex.id()] += delta;
+    if (caching_enabled) {
+        update_state(vertex.id(), [&]{ cache.post_delta(vertex.id(), delta); }, [&](vertex_state& s){
+            if (s.has_cache) {
+                s.cache += delta;
+            }
+        });
     }
 }
 
 template<typename VertexProgram>
 void async_engine<VertexProgram>::
 internal_clear_gather_cache(const vertex_type& vertex) {
-    if(caching_enabled && has_cache[vertex.id()]) {
-        has_cache[vertex.id()] == false;
+    if (caching_enabled) {
+        update_state(vertex.id(), [&]{ cache.invalidate(vertex.id()); }, [](vertex_state& s){ s.has_cache = false; });
     }
 }
 
 
 /**
- * singal_all() currently accesses active_list without synchronization.
- * ?: Does it need to?  Vertex programs can not call singal_all() anyway.
+ * Must be called before start(). Vertices are spread over the threads' queues
+ * round-robin, or go to the threads whose partitions they are in, which only
+ * works while the worker threads are not running. As with graph_changed, the
+ * vertices get message_type(), which is combined with the messages sent to
+ * them before they first run.
  */
 template<typename VertexProgram>
 void async_engine<VertexProgram>::signal_all() {
-    for (int i = 0; i < g.vertices.size(); i++) {
-        if (active_list.count(i) == 0) {
-            active_list.insert(i);
+    if (!partition_begin.empty()) {
+        for (int p = 0; p < num_threads; p++) {
+            for (vertex_id_type vid = partition_begin[p]; vid < partition_begin[p + 1]; vid++) {
+                messages.add(vid, message_type());
+                scheduler->schedule(p, vid, 0);
+            }
         }
+        return;
+    }
+    for (vertex_id_type i = 0; i < g.num_vertices(); i++) {
+        messages.add(i, message_type());
+        scheduler->schedule(i % num_threads, i, 0);
+    }
+}
+
+/**
+ * Resumes after the structure of the graph changed (see graph_mutations.hpp):
+ * the next start() runs the affected vertices, with their cached gathers
+ * invalidated, and whatever they signal. The affected vertices are signalled
+ * with message_type(), which is combined with the messages they get before
+ * they run. The forks of EDGE_CONSISTENCY are per edge and are set up again
+ * for the new edges. Must not be called while the engine is running, and the
+ * number of vertices must be the same.
+ */
+template<typename VertexProgram>
+void async_engine<VertexProgram>::graph_changed(const vector<vertex_id_type>& affected) {
+    if (consistency == EDGE_CONSISTENCY) {
+        forks.reset(new chandy_misra<graph_type>(g));
+    }
+    for (std::size_t i = 0; i < affected.size(); i++) {
+        internal_clear_gather_cache(g.vertex(affected[i]));
+        messages.add(affected[i], message_type());
+        const int owner = partition_begin.empty()
+            ? i % num_threads
+            : upper_bound(partition_begin.begin(), partition_begin.end(), affected[i]) - partition_begin.begin() - 1;
+        scheduler->schedule(owner, affected[i], 0);
+    }
+    if (snapshot) {
+        snapshot->graph_changed();
+    }
+}
+
+/**
+ * Writes a checkpoint now, between runs. Throws std::runtime_error if the
+ * engine has no engine_options::checkpoint_prefix or the checkpoint can not
+ * be written.
+ */
+template<typename VertexProgram>
+void async_engine<VertexProgram>::save_checkpoint() {
+    if (!snapshot) {
+        throw runtime_error("save_checkpoint needs engine_options::checkpoint_prefix");
     }
+    snapshot->checkpoint();
+    num_checkpoints++;
+}
+
+/**
+ * Called instead of signal_all() before start(): sets the vertex and edge
+ * data, the active vertices, their messages and the cached gathers to those
+ * of the checkpoint filename (e.g. engine_snapshot::latest() of the prefix),
+ * so that start() continues the run that wrote it. Pending messages and
+ * cached gathers of this engine are replaced; vertices that are still active
+ * stay active. Throws std::runtime_error if the engine has no
+ * engine_options::checkpoint_prefix or filename is not a complete checkpoint
+ * of this graph and vertex program.
+ */
+template<typename VertexProgram>
+void async_engine<VertexProgram>::restore_checkpoint(const string& filename) {
+    if (!snapshot) {
+        throw runtime_error("restore_checkpoint needs engine_options::checkpoint_prefix");
+    }
+    snapshot->restore(filename, [this](vertex_id_type vid, const vertex_state& s) {
+        message_type dropped = message_type();
+        messages.take(vid, dropped);
+        if (s.has_message) {
+            messages.add(vid, s.message);
+        }
+        if (caching_enabled) {
+            if (s.has_cache) {
+                cache.set(vid, s.cache);
+            } else {
+                cache.invalidate(vid);
+            }
+        }
+        if (s.active) {
+            const int owner = partition_begin.empty()
+                ? vid % num_threads
+                : upper_bound(partition_begin.begin(), partition_begin.end(), vid) - partition_begin.begin() - 1;
+            scheduler->schedule(owner, vid, message_priority(s.message));
+        }
+    });
 }
 
 /**
@@ -327,115 +663,303 @@ void async_engine<VertexProgram>::signal_all() {
  */
 template<typename VertexProgram>
 void async_engine<VertexProgram>::start() {
-    thread threads[num_threads];
-    for (int i = 0; i < num_threads; i++) {
-        threads[i] = thread([&]{ this->thread_start(); });
+    start_time = chrono::steady_clock::now();
+    stop_requested = false;
+    num_updates = 0;
+    num_exited = 0;
+    aggregators.start(0);
+    thread aggregator_thread;
+    if (aggregators.has_periodic()) {
+        aggregator_thread = thread([this]{ this->run_aggregators(); });
     }
-
+    thread checkpoint_thread;
+    if (snapshot && checkpoint_interval > 0) {
+        checkpoint_thread = thread([this]{ this->run_checkpoints(); });
+    }
+    thread_pool::global().run(num_threads, [this](int i){ this->thread_start(i); }, pin_threads);
+    if (aggregator_thread.joinable()) {
+        aggregator_thread.join();
+    }
+    if (checkpoint_thread.joinable()) {
+        checkpoint_thread.join();
+    }
+    aggregators.run_due(elapsed_seconds(), true);   // the final values
     for (int i = 0; i < num_threads; i++) {
-        threads[i].join();
-        cout << "Thread " << i << " is done" << endl;
+        spm_interface<graph_type>& spmi = spms[i]->spmi;
+        thread_metrics& m = spms[i]->metrics;
+        m[SPM_FAILED_LOADS] = spmi.num_failed_loads;
+        m[SPM_EVICTIONS] = spmi.num_evictions;
+        m[SPM_COMPACTIONS] = spmi.num_compactions;
+        spmi.num_failed_loads = spmi.num_evictions = spmi.num_compactions = 0;
+        spm_hits += m[SPM_HITS];
+        spm_misses += m[SPM_MISSES];
+        simulated_cycles = max(simulated_cycles, spmi.get_core().get_cycles());
+        stall_cycles += spmi.get_core().get_stall_cycles();
+        metrics.merge(i, m);
+        m.clear();
+    }
+    if (checkpoint_error) {
+        exception_ptr error = checkpoint_error;
+        checkpoint_error = nullptr;
+        rethrow_exception(error);
     }
-    cout << "Engine has finished running.." << endl;
 }
 
 template<typename VertexProgram>
-bool async_engine<VertexProgram>::get_next_job(vertex_id_type& ret_vid) {
-    // lock scheduling_mutex within the whole function body.
-    std::unique_lock<std::mutex> lock_AL(scheduling_mutex);
-    num_idle_threads++;
-    while (active_list.empty() && (num_idle_threads < num_threads)) {
-        // wait until some other thread, which may activate new vertices and create jobs, finishes running.
-        cv_no_jobs.wait(lock_AL);
-    }
-    if (active_list.empty()) {   // all other threads are idle, no further activation is possible.
-        cv_no_jobs.notify_all();  // all idle threads should wake up and fail to get a job.
-        // num_idle_threads is not decremented so that the other threads can properly fail.
-        return false;
-    } else {
-        ret_vid = *(active_list.begin());
-        active_list.erase(ret_vid);
-        num_idle_threads--; // the thread is no longer idle
-        vertex_states[ret_vid] = vertex_state_type::SCHEDULED;
+bool async_engine<VertexProgram>::get_next_job(int thread_id, vertex_id_type& ret_vid) {
+    if (scheduler->get_next(thread_id, ret_vid)) {
         return true;
     }
+    const long idle_start = time_metrics ? metrics_clock_ns() : 0;
+    bool found = false;
+    for (int spins = 0; !found; spins++) {
+        if (scheduler->finished()) {   // no further activation is possible.
+            break;
+        }
+        park();
+        if (should_stop()) {
+            break;      // the active vertices stay scheduled for the next start()
+        }
+        // some other thread is still running and may activate new vertices.
+        if (num_hub_tasks.load(memory_order_relaxed) > 0 && help_hub(thread_id)) {
+            spins = 0;
+        } else if (spins < idle_waiter::SPIN_PAUSES) {
+            cpu_relax();
+        } else if (spins < idle_waiter::SPIN_PAUSES + idle_waiter::SPIN_YIELDS) {
+            this_thread::yield();
+        } else {
+            // whatever ends the wait notifies idle after it became visible to the checks here.
+            const uint64_t key = idle.prepare_wait();
+            found = scheduler->get_next(thread_id, ret_vid);
+            if (found || scheduler->finished() || pause_requested.load(memory_order_acquire)
+                || stop_requested.load(memory_order_relaxed) || num_hub_tasks.load(memory_order_relaxed) > 0) {
+                idle.cancel_wait();
+            } else {
+                idle.wait(key);
+            }
+            continue;
+        }
+        found = scheduler->get_next(thread_id, ret_vid);
+    }
+    if (time_metrics) {
+        spms[thread_id]->metrics[IDLE_NS] += metrics_clock_ns() - idle_start;
+    }
+    return found;
 }
 
 template<typename VertexProgram>
-void async_engine<VertexProgram>::thread_start() {
+void async_engine<VertexProgram>::thread_start(int thread_id) {
+    worker_id = thread_id;
+    spm_interface<graph_type>& spmi = spms[thread_id]->spmi;
     vertex_id_type job_vid;
-    while (get_next_job(job_vid)) {
-        get_exclusive_access(job_vid);
+    vector<vertex_id_type> ready;   // vertices this thread has acquired on their behalf, run them first.
+    thread_metrics& m = spms[thread_id]->metrics;
+    long executed = 0;
+    while (true) {
+        if (num_hub_tasks.load(memory_order_relaxed) > 0 && help_hub(thread_id)) {
+            continue;   // hubs keep their whole neighbourhood locked, help them first.
+        }
+        if (!ready.empty()) {
+            job_vid = ready.back();
+            ready.pop_back();
+        } else {
+            park();     // if the periodic aggregators are due
+            if (should_stop() || !get_next_job(thread_id, job_vid)) {
+                num_executed += executed;
+                break;
+            }
+            const long wait_start = time_metrics ? metrics_clock_ns() : 0;
+            const bool acquired = get_exclusive_access(job_vid);
+            if (time_metrics) {
+                m[LOCK_WAIT_NS] += metrics_clock_ns() - wait_start;
+            }
+            if (!acquired) {
+                m[LOCK_FAILURES]++;
+                continue;   // another thread will run it once it is possible.
+            }
+        }
+        if (snapshot) {
+            job_phase = snapshot->begin_job(thread_id, job_vid);
+        }
+        // signals from now on schedule job_vid again
+        update_state(job_vid, [&]{ scheduler->deactivate(job_vid); }, [](vertex_state& s){ s.active = false; });
         //cerr << "getexclac done v: " << job_vid << endl;
         // --- vertex-program-level load ahead ---
-        vertex_type& job_vertex = g.vertex(job_vid);
+        auto&& job_vertex = g.vertex(job_vid);
+        const int load_ahead_distance = prefetch->distance(thread_id, job_vertex.num_in_edges(),
+                                                           job_vertex.num_out_edges(), occupancy(spmi));
+        const long stalls_before = spmi.get_core().get_stall_cycles();
         for (int i = 0; i < min(load_ahead_distance, job_vertex.num_in_edges()); i++) {
-            if (!is_same<edge_data_type, graphlab::empty>::value) {
-                spmi.load_edata(*job_vertex.in_edges[i]);
-            }
-            if (!is_same<vertex_data_type, graphlab::empty>::value) {
-                spmi.load_vdata((job_vertex.in_edges[i])->source());
-            }
+            spmi.load_edata(job_vertex.in_edge(i));
+            spmi.load_vdata(job_vertex.in_edge(i).source());
         }
-        for (int i = 0;
-             i < min(load_ahead_distance - job_vertex.num_in_edges(),
-                     job_vertex.num_out_edges());
-                     i++) {
-            if (!is_same<edge_data_type, graphlab::empty>::value) {
-                spmi.load_edata(*job_vertex.out_edges[i]);
-            }
-            if (!is_same<vertex_data_type, graphlab::empty>::value) {
-                spmi.load_vdata((job_vertex.out_edges[i])->target());
-            }
+        // the data of out edges is contiguous, so it is loaded in one go.
+        const int num_out_preloaded = min(load_ahead_distance - job_vertex.num_in_edges(), job_vertex.num_out_edges());
+        spmi.load_edata_range(job_vertex, 0, num_out_preloaded);
+        for (int i = 0; i < num_out_preloaded; i++) {
+            spmi.load_vdata(job_vertex.out_edge(i).target());
         }
         //cerr << "vprog preload done v: " << job_vid << endl;
         // vertex-program-level load ahead done
-        // *** use the BARRIER INSTRUCTION here to suspend thread until vprog-level load ahead is done *** //
-        execute_vprog(job_vid);
+        spmi.barrier();     // suspend thread until vprog-level load ahead is done
+        if (hub_degree > 0 && job_vertex.num_in_edges() + job_vertex.num_out_edges() >= hub_degree) {
+            execute_hub(thread_id, job_vid, load_ahead_distance);
+        } else {
+            execute_vprog(thread_id, job_vid, load_ahead_distance);
+        }
+        executed++;
+        m[VERTEX_UPDATES]++;
+        if (max_updates >= 0) {
+            num_updates.fetch_add(1, memory_order_relaxed);
+        }
+        prefetch->record(thread_id, job_vertex.num_in_edges() + job_vertex.num_out_edges(),
+                         spmi.get_core().get_stall_cycles() - stalls_before);
         //cerr << "excv done v: " << job_vid << endl;
-        release_exclusive_access(job_vid);
-        // TODO: right after releasing the mutex, get_next_job tries to acquire it again.
-        // ?: can this be merged somehow to increase performance?
+        release_exclusive_access(job_vid, ready);
+        if (snapshot) {
+            snapshot->end_job(thread_id);
+            job_phase = 0;
+        }
+        scheduler->completed(thread_id, job_vid);
+        if (scheduler->finished()) {
+            idle.notify_all();  // the sleeping workers can exit
+        }
         //spmi.print_vslab_info();
         //spmi.print_eslab_info();
-        //string in;
-        //std::cin >> in;
     }
+    // the aggregators' thread does not wait for this one any more.
+    lock_guard<mutex> lock(pause_mutex);
+    num_exited++;
+    pause_cv.notify_all();
 }
 
+/**
+ * True once the context asked to stop or a budget of engine_options is used up.
+ */
 template<typename VertexProgram>
-void async_engine<VertexProgram>::check_spm_hit(const edge_type &e, const vertex_type &v) {
-    if (!is_same<edge_data_type, graphlab::empty>::value) {
+bool async_engine<VertexProgram>::should_stop() {
+    if (stop_requested.load(memory_order_relaxed)) {
+        return true;
+    }
+    if ((max_seconds >= 0 && elapsed_seconds() >= max_seconds)
+        || (max_updates >= 0 && num_updates.load(memory_order_relaxed) >= max_updates)) {
+        internal_stop();
+        return true;
+    }
+    return false;
+}
+
+// waits while the aggregators run, if they are about to.
+template<typename VertexProgram>
+void async_engine<VertexProgram>::park() {
+    if (!pause_requested.load(memory_order_acquire)) {
+        return;
+    }
+    unique_lock<mutex> lock(pause_mutex);
+    num_parked++;
+    pause_cv.notify_all();
+    pause_cv.wait(lock, [this]{ return !pause_requested.load(memory_order_relaxed); });
+    num_parked--;
+}
+
+/**
+ * Sleeps until the next periodic aggregator is due, pauses the workers and
+ * runs the aggregators that are due, until all the workers have exited.
+ */
+template<typename VertexProgram>
+void async_engine<VertexProgram>::run_aggregators() {
+    unique_lock<mutex> lock(pause_mutex);
+    while (num_exited < num_threads) {
+        const chrono::steady_clock::time_point due = start_time
+            + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(aggregators.next_due()));
+        if (pause_cv.wait_until(lock, due, [this]{ return num_exited == num_threads; })) {
+            break;
+        }
+        if (chrono::steady_clock::now() < due) {
+            continue;   // woken up early
+        }
+        pause_requested.store(true, memory_order_release);
+        idle.notify_all();  // so that sleeping workers park
+        pause_cv.wait(lock, [this]{ return num_parked + num_exited == num_threads; });
+        lock.unlock();
+        aggregators.run_due(elapsed_seconds());
+        lock.lock();
+        pause_requested.store(false, memory_order_relaxed);
+        pause_cv.notify_all();
+    }
+}
+
+/**
+ * Writes a checkpoint checkpoint_interval seconds after the start and after
+ * every checkpoint, until all the workers have exited. The first error ends
+ * the checkpoints of the run and is rethrown by start().
+ */
+template<typename VertexProgram>
+void async_engine<VertexProgram>::run_checkpoints() {
+    const chrono::steady_clock::duration interval
+        = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(checkpoint_interval));
+    chrono::steady_clock::time_point due = start_time + interval;
+    unique_lock<mutex> lock(pause_mutex);
+    while (!pause_cv.wait_until(lock, due, [this]{ return num_exited == num_threads; })) {
+        lock.unlock();
+        try {
+            snapshot->checkpoint();
+            num_checkpoints++;
+        } catch (...) {
+            checkpoint_error = current_exception();
+            return;
+        }
+        due = chrono::steady_clock::now() + interval;
+        lock.lock();
+    }
+}
+
+template<typename VertexProgram>
+void async_engine<VertexProgram>::check_spm_hit(thread_spm &spm, const edge_type &e, const vertex_type &v) {
+    if constexpr (has_edata) {
         edge_data_type edata;
-        if (spmi.read_edata(e, edata)) {
-            spm_hits++;
+        if (spm.spmi.read_edata(e, edata)) {
+            spm.metrics[SPM_HITS]++;
             //cerr << "-> edge hit, ";
         } else {
-            spm_misses++;
+            spm.metrics[SPM_MISSES]++;
+            spm.spmi.get_core().mm_access(sizeof(edge_data_type));
             //cerr << "-> edge miss, ";
         }
     }
-    if (!is_same<vertex_data_type, graphlab::empty>::value) {
+    if constexpr (has_vdata) {
         vertex_data_type vdata;
-        if (spmi.read_vdata(v, vdata)) {
-            spm_hits++;
+        if (spm.spmi.read_vdata(v, vdata)) {
+            spm.metrics[SPM_HITS]++;
             //cerr << "vertex hit\n";
         } else {
-            spm_misses++;
+            spm.metrics[SPM_MISSES]++;
+            spm.spmi.get_core().mm_access(sizeof(vertex_data_type));
             //cerr << "vertex miss\n";
         }
     }
+    spm.spmi.get_core().tick(spm.spmi.get_core().timings().op_cycles);
 }
 
 
 template<typename VertexProgram>
-void async_engine<VertexProgram>::execute_vprog(vertex_id_type vid) {
+void async_engine<VertexProgram>::execute_vprog(int thread_id, vertex_id_type vid, int distance) {
+    thread_spm& spm = *spms[thread_id];
+    spm_interface<graph_type>& spmi = spm.spmi;
 
     // instantiate vertex program
     VertexProgram vprog;
-    vertex_type& cur = g.vertex(vid);
+    auto&& cur = g.vertex(vid);
+    const int num_in = cur.num_in_edges();
+    const int num_out = cur.num_out_edges();
 
-    // init() phase is skipped for now along with anything message passsing-related.
+    /**
+     * -----  INIT PHASE  -----
+     * Vertices that were signalled without a message (e.g. by signal_all) get message_type().
+     */
+    message_type message = message_type();
+    update_state(vid, [&]{ messages.take(vid, message); }, [](vertex_state& s){ s.has_message = false; });
+    vprog.init(context, cur, message);
 
     /**
      * -----  GATHER PHASE  -----  
@@ -444,11 +968,16 @@ void async_engine<VertexProgram>::execute_vprog(vertex_id_type vid) {
     gather_type accum = gather_type();  // imporant to explicitly call the default constructor for basic data types
                                         // when gather_type is double, int, bool etc...
 
-    vector<vertex_type *> loaded_doubcon_neighs;  // used for the special treatment of doubly connected neighbours in SPM.
+    vector<vertex_id_type> loaded_doubcon_neighs;  // used for the special treatment of doubly connected neighbours in SPM.
 
-    if (caching_enabled && has_cache[vid]) {
-        accum = gather_cache[vid];
+    if (caching_enabled && cache.get(vid, accum)) {
         accum_is_set = true;
+        // the in edges that were loaded ahead are not needed. Remove them, as for a gather without in edges.
+        for (int i = 0; i < min(distance, num_in); i++) {
+            auto&& edge = cur.in_edge(i);
+            spmi.remove_edata(edge);
+            spmi.remove_vdata(edge.source());
+        }
     } else {
         const edge_dir_type gather_dir = vprog.gather_edges(context, cur);
 
@@ -460,33 +989,28 @@ void async_engine<VertexProgram>::execute_vprog(vertex_id_type vid) {
 
         // Loop over in edges
         if (gather_dir == graphlab::IN_EDGES || gather_dir == graphlab::ALL_EDGES) {
-            for (int i = 0; i < cur.in_edges.size(); i++) {
+            spm.metrics[GATHER_EDGES] += num_in;
+            for (int i = 0; i < num_in; i++) {
                 // -- load ahead into SPM --
-                if (i + load_ahead_distance < cur.in_edges.size()) {
+                if (i + distance < num_in) {
                     // load an in_edge
-                    edge_type *load_ahead_edgeptr = cur.in_edges[i + load_ahead_distance];
-                    if (!is_same<edge_data_type, graphlab::empty>::value) {
-                        spmi.load_edata(*load_ahead_edgeptr);
-                    }
-                    if (!is_same<vertex_data_type, graphlab::empty>::value) {
-                        spmi.load_vdata(load_ahead_edgeptr->source());
-                    }
-                } else if (i + load_ahead_distance - cur.in_edges.size() < cur.out_edges.size()) {
+                    auto&& load_ahead_edge = cur.in_edge(i + distance);
+                    spmi.load_edata(load_ahead_edge);
+                    spmi.load_vdata(load_ahead_edge.source());
+                } else if (i + distance - num_in < num_out) {
                     //  load an out_edge
                     /**
                      * Out edges are loaded even if gather_dir == graphlab::IN_EDGES. 
                      * Scatters begin with out edges so even if gather skips them, the loads
                      * will heuristically be used (since often scatter contains out edges)
                      */
-                    edge_type *load_ahead_edgeptr = cur.out_edges[i + load_ahead_distance - cur.in_edges.size()];
-                    if (!is_same<edge_data_type, graphlab::empty>::value) {
-                        spmi.load_edata(*load_ahead_edgeptr);
-                    }
-                    if (!is_same<vertex_data_type, graphlab::empty>::value) {
-                        spmi.load_vdata(load_ahead_edgeptr->target());
-                    }
+                    auto&& load_ahead_edge = cur.out_edge(i + distance - num_in);
+                    spmi.load_edata(load_ahead_edge);
+                    spmi.load_vdata(load_ahead_edge.target());
                 }
 
+                auto&& edge = cur.in_edge(i);
+
                 /**
                  * Need a compiler modification to replace gather's access to
                  * edge and vertex data with SPM instructions. For now, gather
@@ -495,69 +1019,68 @@ void async_engine<VertexProgram>::execute_vprog(vertex_id_type vid) {
                  * Whether the data is present in SPM is still checked in order
                  * to analyse the SPM hit rate.
                  */
-                //cerr << "gather in edges, v: " << cur.id() << " i: " << i << " s: " << (cur.in_edges[i])->source().id();
-                check_spm_hit(*(cur.in_edges[i]), (cur.in_edges[i])->source());
+                //cerr << "gather in edges, v: " << cur.id() << " i: " << i << " s: " << edge.source().id();
+                check_spm_hit(spm, edge, edge.source());
                 
                 // execute the actual gather
                 if (accum_is_set) {
-                    accum += vprog.gather(context, cur, *(cur.in_edges[i]));
+                    accum += vprog.gather(context, cur, edge);
                 } else {
-                    accum = vprog.gather(context, cur, *(cur.in_edges[i]));
+                    accum = vprog.gather(context, cur, edge);
                     accum_is_set = true;
                 }
 
                 // -- remove from SPM --
-                spmi.remove_edata(*(cur.in_edges[i]));
+                spmi.remove_edata(edge);
                 // if there is the opposite edge, the neighbour may be needed as an out_neigh.
-                if (!(cur.in_edges[i]->has_opposite)) {
-                    spmi.remove_vdata((cur.in_edges[i])->source());
+                if (!edge.has_opposite) {
+                    spmi.remove_vdata(edge.source());
                 } else {
                     //cerr << "has opp., not removed\n";
-                    loaded_doubcon_neighs.push_back(&(cur.in_edges[i])->source());
+                    loaded_doubcon_neighs.push_back(edge.source().id());
                 }
             }
         } else {
             // Gather does not include in_edges. Remove the data previously loaded for them.
-            for (int i = 0; i < min(load_ahead_distance, (int) cur.in_edges.size()); i++) {
-                spmi.remove_edata(*(cur.in_edges[i]));
-                spmi.remove_vdata((cur.in_edges[i])->source());
+            for (int i = 0; i < min(distance, num_in); i++) {
+                auto&& edge = cur.in_edge(i);
+                spmi.remove_edata(edge);
+                spmi.remove_vdata(edge.source());
             }
         }
 
         // << "gather_in done v: " << cur.id() << endl;
         // Loop over out edges
         if (gather_dir == graphlab::OUT_EDGES || gather_dir == graphlab::ALL_EDGES) {
-            for (int i = 0; i < cur.out_edges.size(); i++) {
+            spm.metrics[GATHER_EDGES] += num_out;
+            for (int i = 0; i < num_out; i++) {
                 // -- load ahead into SPM --
-                if (i + load_ahead_distance < cur.out_edges.size()) {
+                if (i + distance < num_out) {
                     // load an out_edge
-                    edge_type *load_ahead_edgeptr = cur.out_edges[i + load_ahead_distance];
-                    if (!is_same<edge_data_type, graphlab::empty>::value) {
-                        spmi.load_edata(*load_ahead_edgeptr);
-                    }
-                    if (!is_same<vertex_data_type, graphlab::empty>::value) {
-                        spmi.load_vdata(load_ahead_edgeptr->target());
-                    }
+                    auto&& load_ahead_edge = cur.out_edge(i + distance);
+                    spmi.load_edata(load_ahead_edge);
+                    spmi.load_vdata(load_ahead_edge.target());
                 }
 
-                check_spm_hit(*(cur.out_edges[i]), (cur.out_edges[i])->target());
+                auto&& edge = cur.out_edge(i);
+                check_spm_hit(spm, edge, edge.target());
 
                 // execute the actual gather
                 if (accum_is_set) {
-                    accum += vprog.gather(context, cur, *(cur.out_edges[i]));
+                    accum += vprog.gather(context, cur, edge);
                 } else {
-                    accum = vprog.gather(context, cur, *(cur.out_edges[i]));
+                    accum = vprog.gather(context, cur, edge);
                     accum_is_set = true;
                 }
 
                 // -- remove from SPM --
                 /**
-                 * Do not remove the first load_ahead_distance pairs of data.
+                 * Do not remove the first distance pairs of data.
                  * These are likely to be used again at the beginning of the scatters.
                  */
-                if (i >= load_ahead_distance) {
-                    spmi.remove_edata(*(cur.out_edges[i]));
-                    spmi.remove_vdata((cur.out_edges[i])->target());
+                if (i >= distance) {
+                    spmi.remove_edata(edge);
+                    spmi.remove_vdata(edge.target());
                 }
             }
         }
@@ -566,8 +1089,10 @@ void async_engine<VertexProgram>::execute_vprog(vertex_id_type vid) {
         // that the accumulator was never set in which case we are
         // effectively "zeroing out" the cache.
         if(caching_enabled && accum_is_set) {
-            gather_cache[vid] = accum; 
-            has_cache[vid] = true;
+            update_state(vid, [&]{ cache.set(vid, accum); }, [&](vertex_state& s){
+                s.has_cache = true;
+                s.cache = accum;
+            });
         }
     }
 
@@ -582,42 +1107,38 @@ void async_engine<VertexProgram>::execute_vprog(vertex_id_type vid) {
     const edge_dir_type scatter_dir = vprog.scatter_edges(context, cur);
     // Loop over out edges
     if (scatter_dir == graphlab::OUT_EDGES || scatter_dir == graphlab::ALL_EDGES) {
-        for (int i = 0; i < cur.out_edges.size(); i++) {
+        spm.metrics[SCATTER_EDGES] += num_out;
+        for (int i = 0; i < num_out; i++) {
             // -- load ahead into SPM --
-            if (i + load_ahead_distance < cur.out_edges.size()) {
+            if (i + distance < num_out) {
                 // load an out_edge
-                edge_type *load_ahead_edgeptr = cur.out_edges[i + load_ahead_distance];
-                if (!is_same<edge_data_type, graphlab::empty>::value) {
-                    spmi.load_edata(*load_ahead_edgeptr);
-                }
-                if (!is_same<vertex_data_type, graphlab::empty>::value) {
-                    spmi.load_vdata(load_ahead_edgeptr->target());
-                }
+                auto&& load_ahead_edge = cur.out_edge(i + distance);
+                spmi.load_edata(load_ahead_edge);
+                spmi.load_vdata(load_ahead_edge.target());
             } else if (scatter_dir == graphlab::ALL_EDGES &&    // stop loading if scatter will not include in_edges
-                i + load_ahead_distance - cur.out_edges.size() < cur.in_edges.size()) {
+                i + distance - num_out < num_in) {
                 // load an in_edge
-                edge_type *load_ahead_edgeptr = cur.in_edges[i + load_ahead_distance - cur.out_edges.size()];
-                if (!is_same<edge_data_type, graphlab::empty>::value) {
-                    spmi.load_edata(*load_ahead_edgeptr);
-                }
-                if (!is_same<vertex_data_type, graphlab::empty>::value) {
-                    spmi.load_vdata(load_ahead_edgeptr->source());
-                }
+                auto&& load_ahead_edge = cur.in_edge(i + distance - num_out);
+                spmi.load_edata(load_ahead_edge);
+                spmi.load_vdata(load_ahead_edge.source());
             }
+
+            auto&& edge = cur.out_edge(i);
             //cerr << "scatter out edges, v: " << cur.id() << " i: " << i;
-            check_spm_hit(*(cur.out_edges[i]), (cur.out_edges[i])->target());
+            check_spm_hit(spm, edge, edge.target());
 
-            vprog.scatter(context, cur, *(cur.out_edges[i]));
+            vprog.scatter(context, cur, edge);
             
             // -- remove from SPM --
-            spmi.remove_edata(*(cur.out_edges[i]));
-            spmi.remove_vdata((cur.out_edges[i])->target());
+            spmi.remove_edata(edge);
+            spmi.remove_vdata(edge.target());
         }
     } else {
         // Scatter does not include out_edges. Remove the data previously loaded for them.
-        for (int i = 0; i < min(load_ahead_distance, (int) cur.out_edges.size()); i++) {
-            spmi.remove_edata(*(cur.out_edges[i]));
-            spmi.remove_vdata((cur.out_edges[i])->target());
+        const int num_loaded = min(distance, num_out);
+        spmi.remove_edata_range(cur, 0, num_loaded);
+        for (int i = 0; i < num_loaded; i++) {
+            spmi.remove_vdata(cur.out_edge(i).target());
         }
     }
 
@@ -625,33 +1146,251 @@ void async_engine<VertexProgram>::execute_vprog(vertex_id_type vid) {
 
     // Loop over in edges
     if (scatter_dir == graphlab::IN_EDGES || scatter_dir == graphlab::ALL_EDGES) {
-        for (int i = 0; i < cur.in_edges.size(); i++) {
+        spm.metrics[SCATTER_EDGES] += num_in;
+        for (int i = 0; i < num_in; i++) {
             // -- load ahead into SPM --
-            if (i + load_ahead_distance < cur.in_edges.size()) {
+            if (i + distance < num_in) {
                 // load an in_edge
-                edge_type *load_ahead_edgeptr = cur.in_edges[i + load_ahead_distance];
-                if (!is_same<edge_data_type, graphlab::empty>::value) {
-                    spmi.load_edata(*load_ahead_edgeptr);
-                }
-                if (!is_same<vertex_data_type, graphlab::empty>::value) {
-                    spmi.load_vdata(load_ahead_edgeptr->source());
-                }
+                auto&& load_ahead_edge = cur.in_edge(i + distance);
+                spmi.load_edata(load_ahead_edge);
+                spmi.load_vdata(load_ahead_edge.source());
             }
-            
-            check_spm_hit(*(cur.in_edges[i]), (cur.in_edges[i])->source());
 
-            vprog.scatter(context, cur, *(cur.in_edges[i]));
+            auto&& edge = cur.in_edge(i);
+            check_spm_hit(spm, edge, edge.source());
+
+            vprog.scatter(context, cur, edge);
             
             // -- remove from SPM --
-            spmi.remove_edata(*(cur.in_edges[i]));
-            spmi.remove_vdata((cur.in_edges[i])->source());
+            spmi.remove_edata(edge);
+            spmi.remove_vdata(edge.source());
         }
     }
 
     // Doubly-connected vertex data should be removed here
-    for (int i = 0; i < loaded_doubcon_neighs.size(); i++) {
-        spmi.remove_vdata(*loaded_doubcon_neighs[i]); 
+    for (std::size_t i = 0; i < loaded_doubcon_neighs.size(); i++) {
+        spmi.remove_vdata(g.vertex(loaded_doubcon_neighs[i])); 
+    }
+}
+
+template<typename VertexProgram>
+void async_engine<VertexProgram>::execute_hub(int thread_id, vertex_id_type vid, int distance) {
+    spm_interface<graph_type>& spmi = spms[thread_id]->spmi;
+    thread_metrics& m = spms[thread_id]->metrics;
+
+    VertexProgram vprog;
+    auto&& cur = g.vertex(vid);
+    const int num_in = cur.num_in_edges();
+    const int num_out = cur.num_out_edges();
+
+    // the chunks load their own data. Drop what thread_start loaded ahead.
+    for (int i = 0; i < min(distance, num_in); i++) {
+        auto&& edge = cur.in_edge(i);
+        spmi.remove_edata(edge);
+        spmi.remove_vdata(edge.source());
+    }
+    const int num_out_preloaded = min(distance - num_in, num_out);
+    spmi.remove_edata_range(cur, 0, num_out_preloaded);
+    for (int i = 0; i < num_out_preloaded; i++) {
+        spmi.remove_vdata(cur.out_edge(i).target());
     }
+
+    /**
+     * -----  INIT PHASE  -----
+     */
+    message_type message = message_type();
+    update_state(vid, [&]{ messages.take(vid, message); }, [](vertex_state& s){ s.has_message = false; });
+    vprog.init(context, cur, message);
+
+    /**
+     * -----  GATHER PHASE  -----
+     * Every chunk has its own partial sum, which are added up in chunk order
+     * so that the result does not depend on which thread ran which chunk.
+     */
+    bool accum_is_set = false;
+    gather_type accum = gather_type();
+    if (caching_enabled && cache.get(vid, accum)) {
+        accum_is_set = true;
+    } else {
+        const edge_dir_type gather_dir = vprog.gather_edges(context, cur);
+        for (int in = 1; in >= 0; in--) {
+            if (gather_dir != graphlab::ALL_EDGES && gather_dir != (in ? graphlab::IN_EDGES : graphlab::OUT_EDGES)) {
+                continue;
+            }
+            m[GATHER_EDGES] += in ? num_in : num_out;
+            const int n = num_chunks(in ? num_in : num_out);
+            vector<gather_type> partials(n);
+            vector<char> partial_is_set(n, 0);
+            for_edges_chunked(thread_id, cur, in, distance, [&](edge_type& edge, int chunk) {
+                if (partial_is_set[chunk]) {
+                    partials[chunk] += vprog.gather(context, cur, edge);
+                } else {
+                    partials[chunk] = vprog.gather(context, cur, edge);
+                    partial_is_set[chunk] = 1;
+                }
+            });
+            for (int i = 0; i < n; i++) {
+                if (!partial_is_set[i]) {
+                    continue;
+                }
+                if (accum_is_set) {
+                    accum += partials[i];
+                } else {
+                    accum = partials[i];
+                    accum_is_set = true;
+                }
+            }
+        }
+        if (caching_enabled && accum_is_set) {
+            update_state(vid, [&]{ cache.set(vid, accum); }, [&](vertex_state& s){
+                s.has_cache = true;
+                s.cache = accum;
+            });
+        }
+    }
+
+    /**
+     * -----  APPLY PHASE  -----
+     */
+    vprog.apply(context, cur, accum);
+
+    /**
+     * -----  SCATTER PHASE  -----
+     */
+    const edge_dir_type scatter_dir = vprog.scatter_edges(context, cur);
+    for (int in = 0; in <= 1; in++) {
+        if (scatter_dir != graphlab::ALL_EDGES && scatter_dir != (in ? graphlab::IN_EDGES : graphlab::OUT_EDGES)) {
+            continue;
+        }
+        m[SCATTER_EDGES] += in ? num_in : num_out;
+        for_edges_chunked(thread_id, cur, in, distance, [&](edge_type& edge, int chunk) {
+            vprog.scatter(context, cur, edge);
+        });
+    }
+}
+
+template<typename VertexProgram>
+template<typename EdgeFunction>
+void async_engine<VertexProgram>::for_edges_chunked(int thread_id, const vertex_type& cur, bool in_edges,
+                                                    int distance, EdgeFunction f) {
+    const int num_edges = in_edges ? cur.num_in_edges() : cur.num_out_edges();
+    hub_task task;
+    task.num_chunks = num_chunks(num_edges);
+    task.next_chunk = 0;
+    task.chunks_done = 0;
+    const uint64_t owner_phase = job_phase;    // the helpers' signals belong to the hub's job
+    task.run_chunk = [&, owner_phase](int tid, int chunk) {
+        const uint64_t own_phase = job_phase;
+        job_phase = owner_phase;
+        auto chunk_f = [&](edge_type& edge) { f(edge, chunk); };
+        process_chunk(tid, cur, in_edges, chunk * hub_chunk_size, min(num_edges, (chunk + 1) * hub_chunk_size),
+                      distance, chunk_f);
+        job_phase = own_phase;
+    };
+
+    hub_lock.lock();
+    hub_tasks.push_back(&task);
+    num_hub_tasks.fetch_add(1, memory_order_relaxed);
+    hub_lock.unlock();
+    idle.notify_all();
+
+    while (true) {
+        int chunk;
+        hub_lock.lock();
+        const bool claimed = claim_chunk(task, chunk);
+        hub_lock.unlock();
+        if (!claimed) {
+            break;
+        }
+        task.run_chunk(thread_id, chunk);
+        task.chunks_done.fetch_add(1, memory_order_release);
+    }
+
+    hub_lock.lock();
+    hub_tasks.erase(find(hub_tasks.begin(), hub_tasks.end(), &task));
+    num_hub_tasks.fetch_sub(1, memory_order_relaxed);
+    hub_lock.unlock();
+
+    // the helpers may still be running the last chunks. Help other hubs in the meantime.
+    for (int spins = 0; task.chunks_done.load(memory_order_acquire) < task.num_chunks; spins++) {
+        if (help_hub(thread_id)) {
+            spins = 0;
+        } else if (spins < idle_waiter::SPIN_PAUSES) {
+            cpu_relax();
+        } else {
+            this_thread::yield();
+        }
+    }
+}
+
+template<typename VertexProgram>
+template<typename EdgeFunction>
+void async_engine<VertexProgram>::process_chunk(int thread_id, const vertex_type& cur, bool in_edges, int begin, int end,
+                                                int distance, EdgeFunction& f) {
+    thread_spm& spm = *spms[thread_id];
+    spm_interface<graph_type>& spmi = spm.spmi;
+
+    // the chunk is loaded ahead as a vertex of its own would be.
+    const int num_preloaded = min(distance, end - begin);
+    if (in_edges) {
+        for (int i = begin; i < begin + num_preloaded; i++) {
+            auto&& edge = cur.in_edge(i);
+            spmi.load_edata(edge);
+            spmi.load_vdata(edge.source());
+        }
+    } else {
+        spmi.load_edata_range(cur, begin, num_preloaded);
+        for (int i = begin; i < begin + num_preloaded; i++) {
+            spmi.load_vdata(cur.out_edge(i).target());
+        }
+    }
+    spmi.barrier();
+
+    for (int i = begin; i < end; i++) {
+        if (i + distance < end) {
+            auto&& load_ahead_edge = in_edges ? cur.in_edge(i + distance) : cur.out_edge(i + distance);
+            spmi.load_edata(load_ahead_edge);
+            spmi.load_vdata(in_edges ? load_ahead_edge.source() : load_ahead_edge.target());
+        }
+
+        auto&& edge = in_edges ? cur.in_edge(i) : cur.out_edge(i);
+        auto&& neighbour = in_edges ? edge.source() : edge.target();
+        check_spm_hit(spm, edge, neighbour);
+
+        f(edge);
+
+        spmi.remove_edata(edge);
+        spmi.remove_vdata(neighbour);
+    }
+}
+
+template<typename VertexProgram>
+bool async_engine<VertexProgram>::claim_chunk(hub_task& task, int& ret_chunk) {
+    if (task.next_chunk == task.num_chunks) {
+        return false;
+    }
+    ret_chunk = task.next_chunk++;
+    return true;
+}
+
+template<typename VertexProgram>
+bool async_engine<VertexProgram>::help_hub(int thread_id) {
+    hub_task *task = NULL;
+    int chunk;
+    hub_lock.lock();
+    for (hub_task *t : hub_tasks) {
+        if (claim_chunk(*t, chunk)) {
+            task = t;
+            break;
+        }
+    }
+    hub_lock.unlock();
+    if (task == NULL) {
+        return false;
+    }
+    task->run_chunk(thread_id, chunk);
+    task->chunks_done.fetch_add(1, memory_order_release);   // the owner may return right after this
+    return true;
 }
 
-#endif
\ No newline at end of file
+#endif
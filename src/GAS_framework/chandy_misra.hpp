@@ -0,0 +1,239 @@
+/**
+ * Edge consistency through the Chandy-Misra solution to the dining
+ * philosophers problem ("The Drinking Philosophers Problem", Chandy & Misra,
+ * 1984), similar to GraphLab's shared memory chandy_misra.hpp.
+ *
+ * Every edge has a fork owned by one of its endpoints. A vertex may execute
+ * (eat) once it owns the forks of all its in and out edges. Forks are dirty
+ * after they have been eaten with. The owner of a dirty fork gives it away
+ * when a neighbour requests it, unless it is eating. A clean fork is kept by
+ * a hungry owner, which is what prevents deadlock and starvation. Initially
+ * every fork is dirty and owned by the endpoint with the lower id, so the
+ * precedence graph is acyclic.
+ *
+ * There is no global lock. The state of a vertex and the forks of its edges
+ * are protected by per-vertex spinlocks. A fork is only changed with the locks
+ * of both of its endpoints held, which are always acquired lower id first.
+ *
+ * A vertex whose forks can not all be collected by make_hungry() does not
+ * block its thread. It becomes ready when a neighbour that was holding the
+ * last missing fork stops eating, and stop_eating() returns it to the caller
+ * (which should then execute it).
+ *
+ * A vertex can be signalled and taken by another thread while it eats. Its
+ * make_hungry() then only records that, and the stop_eating() of the current
+ * meal makes it hungry again once all forks are dirty, so that the forks of
+ * one meal are never taken for the next one's.
+ *
+ * Graphs with both (u, v) and (v, u) have two forks between u and v, and a
+ * vertex needs both of them.
+ */
+
+#ifndef __CHANDY_MISRA_H
+#define __CHANDY_MISRA_H
+
+#include "spinlock.hpp"
+
+#include <vector>
+
+template<typename GraphType>
+class chandy_misra {
+public:
+    typedef GraphType graph_type;
+    typedef typename graph_type::vertex_id_type vertex_id_type;
+    typedef typename graph_type::edge_id_type edge_id_type;
+
+    explicit chandy_misra(graph_type& g): g(g),
+                                          locks(g.num_vertices()),
+                                          states(g.num_vertices(), THINKING),
+                                          hungry_again(g.num_vertices(), 0),
+                                          forks_owned(g.num_vertices(), 0),
+                                          num_forks(g.num_vertices(), 0),
+                                          forks(g.num_edges(), 0) {
+        for (vertex_id_type vid = 0; vid < g.num_vertices(); vid++) {
+            auto&& v = g.vertex(vid);
+            num_forks[vid] = v.num_in_edges() + v.num_out_edges();
+            for (int i = 0; i < v.num_out_edges(); i++) {
+                auto&& e = v.out_edge(i);
+                const vertex_id_type target = e.target().id();
+                forks[e.id()] = DIRTY | (target < vid ? OWNER_IS_TARGET : 0);
+                forks_owned[target < vid ? target : vid]++;
+            }
+        }
+    }
+
+    /**
+     * Requests the missing forks of vid. Returns true if vid owns all of them
+     * and may execute now. Otherwise vid is returned later by the stop_eating()
+     * call of the neighbour that gives it the last missing fork, or of vid
+     * itself if it is still eating.
+     */
+    bool make_hungry(vertex_id_type vid) {
+        locks[vid].lock();
+        if (states[vid] == EATING || states[vid] == STOPPING) {
+            hungry_again[vid] = 1;
+            locks[vid].unlock();
+            return false;
+        }
+        states[vid] = HUNGRY;
+        locks[vid].unlock();
+
+        // a neighbour may hand over the last fork and start vid before the loops are done.
+        // The remaining forks must not be requested then: a clean fork is never given away
+        // by a vertex that has eaten and is thinking again.
+        auto&& v = g.vertex(vid);
+        for (int i = 0; i < v.num_in_edges(); i++) {
+            auto&& e = v.in_edge(i);
+            if (!request_fork(e.id(), e.source().id(), vid, true)) {
+                return false;
+            }
+        }
+        for (int i = 0; i < v.num_out_edges(); i++) {
+            auto&& e = v.out_edge(i);
+            if (!request_fork(e.id(), vid, e.target().id(), false)) {
+                return false;
+            }
+        }
+
+        locks[vid].lock();
+        const bool ready = try_start_eating(vid);
+        locks[vid].unlock();
+        return ready;
+    }
+
+    /**
+     * Marks the forks of vid dirty and passes the requested ones on.
+     * Neighbours that got their last missing fork this way are appended to
+     * ready, they have to be executed by the caller. So is vid if it became
+     * hungry again while eating and can eat right away.
+     */
+    void stop_eating(vertex_id_type vid, std::vector<vertex_id_type>& ready) {
+        locks[vid].lock();
+        states[vid] = STOPPING;
+        locks[vid].unlock();
+
+        auto&& v = g.vertex(vid);
+        for (int i = 0; i < v.num_in_edges(); i++) {
+            auto&& e = v.in_edge(i);
+            release_fork(e.id(), e.source().id(), vid, e.source().id(), ready);
+        }
+        for (int i = 0; i < v.num_out_edges(); i++) {
+            auto&& e = v.out_edge(i);
+            release_fork(e.id(), vid, e.target().id(), e.target().id(), ready);
+        }
+
+        locks[vid].lock();
+        states[vid] = THINKING;
+        const bool again = hungry_again[vid];
+        hungry_again[vid] = 0;
+        locks[vid].unlock();
+        if (again && make_hungry(vid)) {
+            ready.push_back(vid);
+        }
+    }
+
+private:
+    enum philosopher_state {
+        THINKING,
+        HUNGRY,
+        EATING,
+        STOPPING    // gives its forks away as if thinking, but can not become hungry yet
+    };
+
+    // bits of a fork
+    enum {
+        OWNER_IS_TARGET = 1,    // otherwise owned by the source of the edge
+        DIRTY = 2,
+        SOURCE_REQUESTS = 4,
+        TARGET_REQUESTS = 8
+    };
+
+    graph_type& g;
+    std::vector<spinlock> locks;
+    std::vector<unsigned char> states;
+    std::vector<unsigned char> hungry_again;    // make_hungry() was called while eating or stopping
+    std::vector<int> forks_owned;
+    std::vector<int> num_forks;     // in degree + out degree
+    std::vector<unsigned char> forks;
+
+    void lock_pair(vertex_id_type a, vertex_id_type b) {
+        if (a < b) {
+            locks[a].lock();
+            locks[b].lock();
+        } else {
+            locks[b].lock();
+            locks[a].lock();
+        }
+    }
+
+    void unlock_pair(vertex_id_type a, vertex_id_type b) {
+        locks[a].unlock();
+        locks[b].unlock();
+    }
+
+    // requires the locks of vid. Returns true if vid was hungry and now eats.
+    bool try_start_eating(vertex_id_type vid) {
+        if (states[vid] == HUNGRY && forks_owned[vid] == num_forks[vid]) {
+            states[vid] = EATING;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Requires the locks of both endpoints. Hands the fork from its owner to
+     * the other endpoint if the latter requests it, the fork is dirty and the
+     * owner is not eating. A hungry owner requests the fork back.
+     * Returns the endpoint that received the fork, or -1.
+     */
+    vertex_id_type advance_fork(edge_id_type eid, vertex_id_type source, vertex_id_type target) {
+        unsigned char& fork = forks[eid];
+        const bool target_owns = fork & OWNER_IS_TARGET;
+        const vertex_id_type owner = target_owns ? target : source;
+        const vertex_id_type other = target_owns ? source : target;
+        const unsigned char other_requests = target_owns ? SOURCE_REQUESTS : TARGET_REQUESTS;
+        const unsigned char owner_requests = target_owns ? TARGET_REQUESTS : SOURCE_REQUESTS;
+
+        if (!(fork & other_requests) || !(fork & DIRTY) || states[owner] == EATING) {
+            return -1;
+        }
+        fork = (fork ^ OWNER_IS_TARGET) & ~(DIRTY | other_requests);
+        forks_owned[owner]--;
+        forks_owned[other]++;
+        if (states[owner] == HUNGRY) {
+            fork |= owner_requests;
+        }
+        return other;
+    }
+
+    // returns false, without requesting, if the requester is not hungry anymore (it has been started).
+    bool request_fork(edge_id_type eid, vertex_id_type source, vertex_id_type target, bool target_is_requester) {
+        lock_pair(source, target);
+        if (states[target_is_requester ? target : source] != HUNGRY) {
+            unlock_pair(source, target);
+            return false;
+        }
+        const bool target_owns = forks[eid] & OWNER_IS_TARGET;
+        if (target_owns != target_is_requester) {
+            forks[eid] |= target_is_requester ? TARGET_REQUESTS : SOURCE_REQUESTS;
+            advance_fork(eid, source, target);
+        }
+        unlock_pair(source, target);
+        return true;
+    }
+
+    void release_fork(edge_id_type eid, vertex_id_type source, vertex_id_type target,
+                      vertex_id_type neighbour, std::vector<vertex_id_type>& ready) {
+        lock_pair(source, target);
+        // the fork may have been handed to a hungry neighbour after vid stopped eating. It is clean then.
+        if (((forks[eid] & OWNER_IS_TARGET) != 0) != (neighbour == target)) {
+            forks[eid] |= DIRTY;
+        }
+        if (advance_fork(eid, source, target) == neighbour && try_start_eating(neighbour)) {
+            ready.push_back(neighbour);
+        }
+        unlock_pair(source, target);
+    }
+};
+
+#endif
@@ -0,0 +1,574 @@
+/**
+ * Checkpoints of async_engine, taken while its worker threads keep running.
+ *
+ * A checkpoint is a graph file (see graph_file.hpp) with the vertex and edge
+ * data of a snapshot, and the engine state sections: the active vertices, the
+ * combined messages they have not taken yet and the cached gathers. A run
+ * that was preempted is continued by restoring the newest checkpoint with
+ * async_engine::restore_checkpoint(), after which start() resumes from the
+ * saved frontier instead of signal_all():
+ *
+ * \code
+ * engine_options opts;
+ * opts.checkpoint_prefix = "pagerank.ckpt";
+ * opts.checkpoint_interval = 600;  // seconds
+ * async_engine<pagerank> engine(g, opts);
+ * const std::string latest = engine_snapshot<graph_type, double, graphlab::empty>::latest(opts.checkpoint_prefix);
+ * if (latest.empty()) {
+ *     engine.signal_all();
+ * } else {
+ *     engine.restore_checkpoint(latest);
+ * }
+ * engine.start();
+ * \endcode
+ *
+ * Snapshots are epoch-based copy-on-write. Every execution of a vertex
+ * program (a job) belongs to the epoch in which it got exclusive access to its
+ * vertex. Snapshot E holds the state after all the jobs of the epochs before
+ * E and after none of the later ones. The checkpoint thread
+ *  1. makes the workers aware of the snapshot and waits for the jobs that
+ *     began before that to finish,
+ *  2. starts epoch E and waits for the jobs of earlier epochs to finish,
+ *  3. copies whatever has not been copied yet, and ends the snapshot.
+ * From 2 on, a job of epoch E first copies what it is about to change: the
+ * data of its vertex and of its edges when it begins, and the state of a
+ * vertex before it signals it, posts a delta to it or takes its message.
+ * Jobs of earlier epochs still running apply their changes to the copies as
+ * well. Aware jobs change the state of a vertex under a lock of the snapshot,
+ * so a worker only ever waits for the copy of one vertex. Outside of
+ * snapshots a job costs a fence and a few stores more.
+ *
+ * Writes are incremental. Checkpoints alternate between two files,
+ * prefix.0 and prefix.1, so that an interrupted write leaves the previous
+ * checkpoint intact. A file that holds checkpoint K only gets the data of the
+ * vertices that ran since K and of their edges, plus the engine state
+ * sections, while its header is marked incomplete. Files that this object did
+ * not write are written in full (to a temporary file that replaces them).
+ * latest() finds the newest complete checkpoint of a prefix.
+ *
+ * Checkpoints need a csr_graph and trivially copyable vertex data, edge data,
+ * gather and message types. The copies take about as much memory as the
+ * vertex and edge data, and the cached gathers. Edge data is only consistent
+ * if scatters that modify it run under edge consistency.
+ *
+ * A checkpoint can be loaded with graph_file::load like any graph file, but
+ * not while an engine writes checkpoints to it.
+ */
+
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include "csr_graph.hpp"
+#include "graph_file.hpp"
+#include "spinlock.hpp"
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <functional>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <thread>
+#include <cstdio>       // rename
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+template<typename GraphType, typename GatherType, typename MessageType>
+class engine_snapshot {
+public:
+    typedef GraphType graph_type;
+    typedef typename graph_type::vertex_id_type vertex_id_type;
+    typedef typename graph_type::vertex_data_type vertex_data_type;
+    typedef typename graph_type::edge_data_type edge_data_type;
+    typedef GatherType gather_type;
+    typedef MessageType message_type;
+
+    // what the engine keeps of a vertex besides its data.
+    struct vertex_state {
+        bool active;
+        bool has_message;
+        bool has_cache;
+        message_type message;
+        gather_type cache;
+
+        vertex_state(): active(false), has_message(false), has_cache(false), message(), cache() {}
+
+        void add_message(const message_type& msg) {
+            if (has_message) {
+                message += msg;
+            } else {
+                message = msg;
+                has_message = true;
+            }
+        }
+    };
+
+    // fills in the current state of a vertex, see the constructor.
+    typedef std::function<void(vertex_id_type, vertex_state&)> state_reader;
+
+    static constexpr bool supported = is_csr_graph<graph_type>::value
+                                      && std::is_trivially_copyable<vertex_data_type>::value
+                                      && std::is_trivially_copyable<edge_data_type>::value
+                                      && std::is_trivially_copyable<gather_type>::value
+                                      && std::is_trivially_copyable<message_type>::value;
+
+    /**
+     * Checkpoints of g to prefix.0 and prefix.1. read_state is called with
+     * the snapshot's lock of the vertex held, while state changes of aware
+     * jobs wait (see update()). caching tells whether the engine caches
+     * gathers. Throws std::runtime_error if the types are not supported.
+     */
+    engine_snapshot(graph_type& g, int num_threads, const std::string& prefix, bool caching, state_reader read_state)
+        : g(g), prefix(prefix), caching(caching), read_state(read_state), phase(uint64_t(1) << 1),
+          jobs(num_threads), locks(g.num_vertices()),
+          data_stamps(zeroed(g.num_vertices())), state_stamps(zeroed(g.num_vertices())),
+          edge_stamps(zeroed(has_edata ? g.num_edges() : 0)), last_run(zeroed(g.num_vertices())),
+          states(g.num_vertices()) {
+        if (!supported) {
+            throw std::runtime_error("checkpoints need a csr_graph and trivially copyable vertex data, "
+                                     "edge data, gather and message types");
+        }
+        vdata.resize(g.num_vertices());
+        edata.resize(has_edata ? g.num_edges() : 0);
+        file_epochs[0] = file_epochs[1] = 0;
+    }
+
+    // the name of the newest complete checkpoint of prefix, empty if there is none.
+    static std::string latest(const std::string& prefix) {
+        std::string ret;
+        uint64_t newest = 0;
+        for (int i = 0; i < 2; i++) {
+            const std::string filename = file_name(prefix, i);
+            graph_file_header header;
+            try {
+                header = graph_file::read_header(filename);
+            } catch (const std::runtime_error&) {
+                continue;
+            }
+            if (header.has_engine_state && header.complete && header.checkpoint_epoch > newest) {
+                newest = header.checkpoint_epoch;
+                ret = filename;
+            }
+        }
+        return ret;
+    }
+
+    // ---- called by the worker threads ---- //
+
+    /**
+     * Called by thread_id once it has exclusive access to vid, before the job
+     * changes anything. Returns the phase of the job, which goes with every
+     * state change the job makes (see update()).
+     */
+    uint64_t begin_job(int thread_id, vertex_id_type vid) {
+        std::atomic<uint64_t>& slot = jobs[thread_id].phase;
+        slot.store(BEGINNING, std::memory_order_seq_cst);
+        const uint64_t job = phase.load(std::memory_order_seq_cst);
+        slot.store(job, std::memory_order_seq_cst);
+        last_run[vid].store(job >> 1, std::memory_order_relaxed);
+        // a job of an earlier epoch than the snapshot's is part of it and does not copy.
+        if ((job & AWARE) && (data_stamps[vid].load(std::memory_order_relaxed) >> 1) < (job >> 1)) {
+            locks[vid].lock();
+            const uint32_t epoch = phase.load(std::memory_order_acquire) >> 1;
+            if ((job >> 1) >= epoch && (data_stamps[vid].load(std::memory_order_relaxed) >> 1) < epoch) {
+                copy_data(vid, epoch);
+            }
+            locks[vid].unlock();
+        }
+        return job;
+    }
+
+    void end_job(int thread_id) {
+        jobs[thread_id].phase.store(NO_JOB, std::memory_order_release);
+    }
+
+    /**
+     * Runs mutate, which changes the state of vid on behalf of the job with
+     * phase job (0 outside of jobs). mirror applies the same change to a
+     * vertex_state, which is needed if the job is part of a snapshot that
+     * has copied the state of vid already.
+     */
+    template<typename Mutate, typename Mirror>
+    void update(vertex_id_type vid, uint64_t job, Mutate mutate, Mirror mirror) {
+        if (!(job & AWARE)) {
+            mutate();
+            return;
+        }
+        locks[vid].lock();
+        const uint32_t epoch = phase.load(std::memory_order_acquire) >> 1;
+        const uint32_t stamp = state_stamps[vid].load(std::memory_order_relaxed);
+        if ((job >> 1) < epoch) {
+            if (stamp == epoch) {
+                mirror(states[vid]);
+            }
+        } else if (stamp < epoch) {
+            copy_state(vid, epoch);
+        }
+        mutate();
+        locks[vid].unlock();
+    }
+
+    // ---- called by the checkpoint thread, or between runs ---- //
+
+    /**
+     * Takes the next snapshot while the workers run and writes it. Throws
+     * std::runtime_error if it can not be written. Returns the epoch.
+     */
+    uint64_t checkpoint() {
+        const uint32_t epoch = (phase.load(std::memory_order_relaxed) >> 1) + 1;
+        uint64_t& file_epoch = file_epochs[epoch % 2];
+        if (file_epoch != 0 && !holds(file_name(prefix, epoch % 2), file_epoch)) {
+            file_epoch = 0;     // changed by someone else, write it in full
+        }
+        take(epoch, file_epoch);
+        write(epoch, file_epoch);
+        file_epoch = epoch;
+        return epoch;
+    }
+
+    /**
+     * Reads the checkpoint filename into the vertex and edge data of the
+     * graph and calls apply for the state of every vertex. Later checkpoints
+     * get higher epochs. Throws std::runtime_error if filename is not a
+     * complete checkpoint of this graph and these types.
+     */
+    void restore(const std::string& filename, std::function<void(vertex_id_type, const vertex_state&)> apply) {
+        const graph_file_header header = graph_file::read_header(filename);
+        if (!header.complete || !matches(header, false)) {
+            throw std::runtime_error(filename + " is not a complete checkpoint of this graph and engine");
+        }
+        std::ifstream in(filename, std::ios::binary);
+        const vertex_id_type num_v = g.num_vertices();
+        read_section(in, header, graph_file_header::VDATA, vdata.data(), filename);
+        for (vertex_id_type vid = 0; vid < num_v; vid++) {
+            g.vertex(vid).data() = vdata[vid];
+        }
+        if (has_edata) {
+            read_section(in, header, graph_file_header::EDATA, edata.data(), filename);
+            for (vertex_id_type vid = 0; vid < num_v; vid++) {
+                auto&& v = g.vertex(vid);
+                for (int i = 0; i < v.num_out_edges(); i++) {
+                    auto&& e = v.out_edge(i);
+                    e.data() = edata[e.id()];
+                }
+            }
+        }
+        std::vector<unsigned char> active(num_v), has_message(num_v), has_cache(header.gather_data_size > 0 ? num_v : 0);
+        csr_array<message_type> messages;
+        csr_array<gather_type> caches;
+        messages.resize(num_v);
+        caches.resize(has_cache.size());
+        read_section(in, header, graph_file_header::ACTIVE, active.data(), filename);
+        read_section(in, header, graph_file_header::HAS_MESSAGE, has_message.data(), filename);
+        read_section(in, header, graph_file_header::MESSAGES, messages.data(), filename);
+        read_section(in, header, graph_file_header::HAS_CACHE, has_cache.data(), filename);
+        read_section(in, header, graph_file_header::GATHER_CACHE, caches.data(), filename);
+        for (vertex_id_type vid = 0; vid < num_v; vid++) {
+            vertex_state s;
+            s.active = active[vid];
+            s.has_message = has_message[vid];
+            s.message = messages[vid];
+            s.has_cache = !has_cache.empty() && has_cache[vid];
+            if (s.has_cache) {
+                s.cache = caches[vid];
+            }
+            apply(vid, s);
+        }
+        const uint64_t epoch = std::max<uint64_t>(phase.load(std::memory_order_relaxed) >> 1, header.checkpoint_epoch);
+        phase.store(epoch << 1, std::memory_order_relaxed);
+        file_epochs[0] = file_epochs[1] = 0;
+    }
+
+    // after the edges of the graph changed, between runs. The next checkpoints are written in full.
+    void graph_changed() {
+        edge_stamps = zeroed(has_edata ? g.num_edges() : 0);
+        edata.resize(has_edata ? g.num_edges() : 0);
+        file_epochs[0] = file_epochs[1] = 0;
+    }
+
+private:
+    static constexpr bool has_vdata = !std::is_same<vertex_data_type, graphlab::empty>::value;
+    static constexpr bool has_edata = !std::is_same<edge_data_type, graphlab::empty>::value;
+
+    /**
+     * The phase is epoch << 1 | AWARE. Jobs remember the phase in which they
+     * began, in their thread's slot while they run.
+     */
+    enum { AWARE = 1 };
+    static constexpr uint64_t NO_JOB = 0;
+    static constexpr uint64_t BEGINNING = ~uint64_t(0);     // reading the phase
+
+    struct alignas(64) job_slot {
+        std::atomic<uint64_t> phase;
+
+        job_slot(): phase(NO_JOB) {}
+    };
+
+    graph_type& g;
+    const std::string prefix;
+    const bool caching;
+    state_reader read_state;
+
+    std::atomic<uint64_t> phase;
+    std::vector<job_slot> jobs;         // indexed by thread id
+    std::vector<spinlock> locks;        // of the copies of every vertex's data and state
+
+    /**
+     * 2 * epoch + 1 if the snapshot of that epoch copied the vertex's (or
+     * edge's) data, 2 * epoch if it did not need to, see take().
+     */
+    std::vector<std::atomic<uint32_t> > data_stamps;
+    std::vector<std::atomic<uint32_t> > state_stamps;   // epoch of the last snapshot that copied the state
+    std::vector<std::atomic<uint32_t> > edge_stamps;    // empty without edge data
+    std::vector<std::atomic<uint32_t> > last_run;       // epoch of the last job of every vertex
+
+    // the copies
+    csr_array<vertex_data_type> vdata;
+    csr_array<edge_data_type> edata;    // in out edge order
+    std::vector<vertex_state> states;
+
+    uint64_t file_epochs[2];    // of the checkpoints in prefix.0 and prefix.1 written by this object, 0 if unknown
+
+    static std::vector<std::atomic<uint32_t> > zeroed(std::size_t n) {
+        std::vector<std::atomic<uint32_t> > ret(n);
+        for (std::size_t i = 0; i < n; i++) {
+            ret[i].store(0, std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
+    static std::string file_name(const std::string& prefix, int i) {
+        return prefix + "." + std::to_string(i);
+    }
+
+    // with the lock of vid held.
+    void copy_data(vertex_id_type vid, uint32_t epoch) {
+        auto&& v = g.vertex(vid);
+        vdata[vid] = v.data();
+        if (has_edata) {
+            for (int i = 0; i < v.num_in_edges(); i++) {
+                copy_edge(v.in_edge(i), epoch);
+            }
+            for (int i = 0; i < v.num_out_edges(); i++) {
+                copy_edge(v.out_edge(i), epoch);
+            }
+        }
+        data_stamps[vid].store(2 * epoch + 1, std::memory_order_relaxed);
+    }
+
+    // the edge has two endpoints, whose locks may be held by different threads.
+    template<typename EdgeType>
+    void copy_edge(EdgeType&& e, uint32_t epoch) {
+        std::atomic<uint32_t>& stamp = edge_stamps[e.id()];
+        uint32_t s = stamp.load(std::memory_order_relaxed);
+        while ((s >> 1) < epoch) {
+            if (stamp.compare_exchange_weak(s, 2 * epoch + 1, std::memory_order_relaxed)) {
+                edata[e.id()] = e.data();
+                return;
+            }
+        }
+    }
+
+    // with the lock of vid held.
+    void copy_state(vertex_id_type vid, uint32_t epoch) {
+        states[vid] = vertex_state();
+        read_state(vid, states[vid]);
+        state_stamps[vid].store(epoch, std::memory_order_relaxed);
+    }
+
+    // waits until the job of every thread is done, or done(phase of the job) is true.
+    template<typename Done>
+    void wait_for_jobs(Done done) {
+        for (job_slot& slot : jobs) {
+            while (true) {
+                const uint64_t job = slot.phase.load(std::memory_order_seq_cst);
+                if (job == NO_JOB || (job != BEGINNING && done(job))) {
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    /**
+     * Snapshot epoch, see the top of the file. The data of vertices that did
+     * not run since dirty_since is not copied, the file has it already.
+     */
+    void take(uint32_t epoch, uint64_t dirty_since) {
+        phase.store((uint64_t(epoch - 1) << 1) | AWARE, std::memory_order_seq_cst);
+        wait_for_jobs([](uint64_t job) { return (job & AWARE) != 0; });
+        phase.store((uint64_t(epoch) << 1) | AWARE, std::memory_order_seq_cst);
+        wait_for_jobs([epoch](uint64_t job) { return (job >> 1) >= epoch; });
+
+        for (vertex_id_type vid = 0; vid < g.num_vertices(); vid++) {
+            locks[vid].lock();
+            if (state_stamps[vid].load(std::memory_order_relaxed) < epoch) {
+                copy_state(vid, epoch);
+            }
+            if ((data_stamps[vid].load(std::memory_order_relaxed) >> 1) < epoch) {
+                if (last_run[vid].load(std::memory_order_relaxed) >= dirty_since) {
+                    copy_data(vid, epoch);
+                } else {
+                    data_stamps[vid].store(2 * epoch, std::memory_order_relaxed);
+                }
+            }
+            locks[vid].unlock();
+        }
+        phase.store(uint64_t(epoch) << 1, std::memory_order_seq_cst);
+    }
+
+    // true if the header fits this graph and engine. With gathers, the cached ones must match too.
+    bool matches(const graph_file_header& header, bool with_gathers) const {
+        const uint32_t gather_size = graph_file::data_size<gather_type>();
+        return header.has_engine_state
+               && header.num_vertices == (uint64_t) g.num_vertices()
+               && header.num_edges == (uint64_t) g.num_edges()
+               && header.vertex_id_size == sizeof(vertex_id_type)
+               && header.edge_id_size == sizeof(typename graph_type::edge_id_type)
+               && header.vertex_data_size == graph_file::data_size<vertex_data_type>()
+               && header.edge_data_size == graph_file::data_size<edge_data_type>()
+               && header.message_data_size == graph_file::data_size<message_type>()
+               && (with_gathers ? header.gather_data_size == (caching ? gather_size : 0)
+                                : header.gather_data_size == 0 || header.gather_data_size == gather_size);
+    }
+
+    // true if filename is the complete checkpoint epoch of this graph and engine.
+    bool holds(const std::string& filename, uint64_t epoch) const {
+        try {
+            const graph_file_header header = graph_file::read_header(filename);
+            return header.complete && header.checkpoint_epoch == epoch && matches(header, true);
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+    }
+
+    // writes the copies of snapshot epoch over the checkpoint file_epoch, or to a new file if it is 0.
+    void write(uint32_t epoch, uint64_t file_epoch) {
+        if constexpr (supported) {
+            const std::string filename = file_name(prefix, epoch % 2);
+            const vertex_id_type num_v = g.num_vertices();
+            std::vector<unsigned char> active(num_v), has_message(num_v), has_cache(caching ? num_v : 0);
+            csr_array<message_type> messages;
+            csr_array<gather_type> caches;
+            messages.resize(num_v);
+            caches.resize(has_cache.size());
+            for (vertex_id_type vid = 0; vid < num_v; vid++) {
+                const vertex_state& s = states[vid];
+                active[vid] = s.active;
+                has_message[vid] = s.has_message;
+                messages[vid] = s.message;
+                if (caching) {
+                    has_cache[vid] = s.has_cache;
+                    caches[vid] = s.cache;
+                }
+            }
+            graph_file_engine_state state;
+            state.checkpoint_epoch = epoch;
+            state.message_data_size = graph_file::data_size<message_type>();
+            state.gather_data_size = caching ? graph_file::data_size<gather_type>() : 0;
+            const void *sections[] = {active.data(), has_message.data(), messages.data(), has_cache.data(), caches.data()};
+            std::copy(sections, sections + 5, state.sections);
+
+            if (file_epoch == 0) {
+                const std::string tmp = filename + ".tmp";
+                graph_file::save(g, tmp, vdata.data(), edata.data(), &state);
+                const int fd = open(tmp.c_str(), O_RDONLY);
+                if (fd < 0 || fsync(fd) != 0) {
+                    throw std::runtime_error("can not sync " + tmp);
+                }
+                close(fd);
+                if (std::rename(tmp.c_str(), filename.c_str()) != 0) {
+                    throw std::runtime_error("can not replace " + filename);
+                }
+                return;
+            }
+
+            graph_file_header header = graph_file::read_header(filename);
+            uint64_t sizes[graph_file_header::NUM_SECTIONS];
+            graph_file::section_sizes(header, sizes);
+            const int fd = open(filename.c_str(), O_RDWR);
+            if (fd < 0) {
+                throw std::runtime_error("can not open " + filename + " for writing");
+            }
+            header.complete = 0;
+            write_at(fd, &header, sizeof(header), 0, filename);
+            sync(fd, filename);
+            if (has_vdata) {
+                write_copied(fd, header.section_offset[graph_file_header::VDATA], data_stamps, vdata.data(), epoch, filename);
+            }
+            if (has_edata) {
+                write_copied(fd, header.section_offset[graph_file_header::EDATA], edge_stamps, edata.data(), epoch, filename);
+            }
+            for (int i = graph_file_header::NUM_GRAPH_SECTIONS; i < graph_file_header::NUM_SECTIONS; i++) {
+                write_at(fd, state.sections[i - graph_file_header::NUM_GRAPH_SECTIONS], sizes[i],
+                         header.section_offset[i], filename);
+            }
+            sync(fd, filename);
+            header.complete = 1;
+            header.checkpoint_epoch = epoch;
+            write_at(fd, &header, sizeof(header), 0, filename);
+            sync(fd, filename);
+            close(fd);
+        }
+    }
+
+    // writes the runs of consecutive entries of data that snapshot epoch copied.
+    template<typename T>
+    static void write_copied(int fd, uint64_t offset, const std::vector<std::atomic<uint32_t> >& stamps,
+                             const T *data, uint32_t epoch, const std::string& filename) {
+        const uint32_t copied = 2 * epoch + 1;
+        std::size_t i = 0;
+        while (i < stamps.size()) {
+            if (stamps[i].load(std::memory_order_relaxed) != copied) {
+                i++;
+                continue;
+            }
+            std::size_t end = i + 1;
+            while (end < stamps.size() && stamps[end].load(std::memory_order_relaxed) == copied) {
+                end++;
+            }
+            write_at(fd, data + i, (end - i) * sizeof(T), offset + i * sizeof(T), filename);
+            i = end;
+        }
+    }
+
+    static void write_at(int fd, const void *buf, uint64_t size, uint64_t offset, const std::string& filename) {
+        const char *p = (const char *) buf;
+        while (size > 0) {
+            const ssize_t n = pwrite(fd, p, size, offset);
+            if (n <= 0) {
+                close(fd);
+                throw std::runtime_error("failed writing " + filename);
+            }
+            p += n;
+            size -= n;
+            offset += n;
+        }
+    }
+
+    static void sync(int fd, const std::string& filename) {
+        if (fdatasync(fd) != 0) {
+            close(fd);
+            throw std::runtime_error("can not sync " + filename);
+        }
+    }
+
+    static void read_section(std::ifstream& in, const graph_file_header& header, int section, void *buf,
+                             const std::string& filename) {
+        uint64_t sizes[graph_file_header::NUM_SECTIONS];
+        graph_file::section_sizes(header, sizes);
+        if (sizes[section] == 0) {
+            return;
+        }
+        in.seekg(header.section_offset[section]);
+        in.read((char *) buf, sizes[section]);
+        if (!in.good()) {
+            throw std::runtime_error("failed reading " + filename);
+        }
+    }
+};
+
+#endif
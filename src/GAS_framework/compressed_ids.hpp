@@ -0,0 +1,140 @@
+/**
+ * A compressed array of vertex ids that is split into lists (the neighbour
+ * lists of a CSR or CSC graph, see csr_graph::compress_neighbours).
+ *
+ * Every id is stored as the difference to the id before it in the same list,
+ * zigzag encoded (so that unsorted lists work too) and written as a varint of
+ * 7 bits per byte. Lists sorted by id, as csr_graph_builder makes them, then
+ * take one or two bytes per id instead of sizeof(IdType).
+ *
+ * The first id of every list and of every block of BLOCK entries is stored
+ * as is (as the difference to 0), and the byte offset of every block is kept.
+ * get() of an arbitrary entry therefore decodes at most BLOCK varints, while
+ * a cursor walks a list at the cost of one varint per id. The block offsets
+ * add 8 / BLOCK bytes per id.
+ */
+
+#ifndef __COMPRESSED_IDS_H
+#define __COMPRESSED_IDS_H
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+template<typename IdType>
+class compressed_ids {
+public:
+    enum { BLOCK = 16 };
+
+    compressed_ids(): num_entries(0) {}
+
+    /**
+     * Encodes ids[0 .. offsets[num_lists]). List l is ids[offsets[l] .. offsets[l + 1]).
+     */
+    template<typename OffsetType>
+    void encode(const IdType *ids, const OffsetType *offsets, std::size_t num_lists) {
+        num_entries = offsets[num_lists];
+        bytes.clear();
+        block_offset.clear();
+        block_offset.reserve(num_entries / BLOCK + 1);
+        for (std::size_t l = 0; l < num_lists; l++) {
+            for (std::size_t j = offsets[l]; j < (std::size_t) offsets[l + 1]; j++) {
+                if (j % BLOCK == 0) {
+                    block_offset.push_back(bytes.size());
+                }
+                const bool first = j == (std::size_t) offsets[l] || j % BLOCK == 0;
+                put(zigzag((int64_t) ids[j] - (first ? 0 : (int64_t) ids[j - 1])));
+            }
+        }
+        bytes.shrink_to_fit();
+    }
+
+    /**
+     * The id at index j, which is in the list that begins at index list_begin.
+     */
+    IdType get(std::size_t j, std::size_t list_begin) const {
+        const std::size_t block_begin = j - j % BLOCK;
+        const uint8_t *p = bytes.data() + block_offset[j / BLOCK];
+        std::size_t k = block_begin;
+        for (; k < list_begin; k++) {   // entries of earlier lists in the same block
+            skip(p);
+        }
+        int64_t id = unzigzag(read(p));
+        for (k++; k <= j; k++) {
+            id += unzigzag(read(p));
+        }
+        return (IdType) id;
+    }
+
+    /**
+     * Decodes the list that begins at index list_begin, in order.
+     */
+    class cursor {
+    public:
+        IdType next() {
+            const int64_t delta = unzigzag(read(p));
+            id = j % BLOCK == 0 || j == list_begin ? delta : id + delta;
+            j++;
+            return (IdType) id;
+        }
+
+    private:
+        friend class compressed_ids;
+
+        const uint8_t *p;
+        std::size_t j;          // index of the next entry
+        std::size_t list_begin;
+        int64_t id;
+
+        cursor(const uint8_t *p, std::size_t j, std::size_t list_begin): p(p), j(j), list_begin(list_begin), id(0) {}
+    };
+
+    cursor list(std::size_t list_begin) const {
+        if (list_begin >= num_entries) {    // an empty list at the end, never read
+            return cursor(bytes.data() + bytes.size(), list_begin, list_begin);
+        }
+        const uint8_t *p = bytes.data() + block_offset[list_begin / BLOCK];
+        for (std::size_t k = list_begin - list_begin % BLOCK; k < list_begin; k++) {
+            skip(p);
+        }
+        return cursor(p, list_begin, list_begin);
+    }
+
+    std::size_t size() const { return num_entries; }
+
+    // of the encoding and the block offsets
+    std::size_t memory_bytes() const { return bytes.capacity() + block_offset.capacity() * sizeof(uint64_t); }
+
+private:
+    std::vector<uint8_t> bytes;
+    std::vector<uint64_t> block_offset;     // of every BLOCK'th entry in bytes
+    std::size_t num_entries;
+
+    void put(uint64_t v) {
+        while (v >= 0x80) {
+            bytes.push_back(uint8_t(v) | 0x80);
+            v >>= 7;
+        }
+        bytes.push_back(uint8_t(v));
+    }
+
+    static uint64_t read(const uint8_t *&p) {
+        uint64_t v = *p & 0x7f;
+        int shift = 7;
+        while (*p++ & 0x80) {
+            v |= uint64_t(*p & 0x7f) << shift;
+            shift += 7;
+        }
+        return v;
+    }
+
+    static void skip(const uint8_t *&p) {
+        while (*p++ & 0x80) {}
+    }
+
+    static uint64_t zigzag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+
+    static int64_t unzigzag(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+};
+
+#endif
@@ -0,0 +1,376 @@
+/**
+ * An immutable graph structure stored in compressed sparse row (out edges)
+ * and compressed sparse column (in edges) form.
+ *
+ * Unlike Graph (simple_graph.hpp), edges are not individually allocated.
+ * Out edges of vertex v are out_targets[out_offsets[v] .. out_offsets[v + 1])
+ * and their data lives at the same indices of edata. In edges are stored the
+ * same way in in_sources, and in_to_out maps every in edge to the index of
+ * the same edge on the out side, so that edge data is stored only once and
+ * both endpoints see the same main memory address for it (which is what
+ * spm_interface uses to locate data in SPM).
+ *
+ * vertex_type and edge_type are lightweight handles into the arrays above.
+ * They provide the same interface as Graph::vertex_type and Graph::edge_type
+ * so vertex programs and async_engine work with either graph type.
+ *
+ * The arrays either own their memory or point into a memory-mapped graph
+ * file (see graph_file.hpp), in which case the mapping is kept alive for
+ * as long as any csr_graph refers to it.
+ *
+ * Vertex ids are ints by default, as in Graph. VertexIdType may be any
+ * integer type that holds num_vertices(), e.g. uint32_t to double the id
+ * range at the same size or int64_t/uint64_t for more than 2^32 vertices.
+ * Edge ids stay 32-bit.
+ *
+ * compress_neighbours() replaces out_targets and in_sources by their delta and
+ * varint encoding (see compressed_ids.hpp), which is about a quarter to a half
+ * of their size for graphs with sorted neighbour lists. Edge handles then
+ * decode their neighbour's id, at the cost of the branch on compressed and up
+ * to compressed_ids::BLOCK varints per call of in_edge or out_edge. Loops
+ * that walk all in edges of a vertex in order can use for_in_neighbours()
+ * instead, which decodes one varint per edge.
+ */
+
+#ifndef __CSR_GRAPH_H
+#define __CSR_GRAPH_H
+
+#include "simple_graph.hpp"
+#include "compressed_ids.hpp"
+#include "../graphlab/util/empty.hpp"
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <stdint.h>
+
+/**
+ * An array that either owns its elements or is a view of memory owned by
+ * someone else. Only what csr_graph and its builders need is provided.
+ */
+template<typename T>
+class csr_array {
+    std::vector<T> storage;
+    T *ptr;
+    size_t len;
+
+public:
+    csr_array(): ptr(NULL), len(0) {}
+
+    csr_array(const csr_array& other): storage(other.storage), len(other.len) {
+        ptr = other.owns_memory() ? storage.data() : other.ptr;
+    }
+
+    csr_array(csr_array&& other): ptr(other.ptr), len(other.len) {
+        if (other.owns_memory()) {
+            storage.swap(other.storage);
+            ptr = storage.data();
+        }
+        other.ptr = other.storage.data();
+        other.len = other.storage.size();
+    }
+
+    csr_array& operator=(csr_array other) {
+        const bool other_owns_memory = other.owns_memory();
+        storage.swap(other.storage);
+        ptr = other_owns_memory ? storage.data() : other.ptr;
+        len = other.len;
+        return *this;
+    }
+
+    bool owns_memory() const { return ptr == storage.data(); }
+
+    void assign(size_t n, const T& value) { storage.assign(n, value); rebind(); }
+
+    void resize(size_t n) { storage.resize(n); rebind(); }
+
+    void reserve(size_t n) { storage.reserve(n); rebind(); }
+
+    void push_back(const T& value) { storage.push_back(value); rebind(); }
+
+    // drops owned elements and points to n elements at p instead.
+    void view(T *p, size_t n) {
+        std::vector<T>().swap(storage);
+        ptr = p;
+        len = n;
+    }
+
+    T& operator[](size_t i) const { return ptr[i]; }
+
+    T *data() const { return ptr; }
+
+    size_t size() const { return len; }
+
+private:
+    void rebind() {
+        ptr = storage.data();
+        len = storage.size();
+    }
+};
+
+/**
+ * graphlab::empty has no value, so the array only keeps its length and every
+ * element is the same object (as with std::vector<graphlab::empty>).
+ */
+template<>
+class csr_array<graphlab::empty> {
+    mutable graphlab::empty e;
+    size_t len;
+
+public:
+    csr_array(): len(0) {}
+
+    bool owns_memory() const { return true; }
+
+    void assign(size_t n, const graphlab::empty& value) { len = n; }
+
+    void resize(size_t n) { len = n; }
+
+    void reserve(size_t n) {}
+
+    void push_back(const graphlab::empty& value) { len++; }
+
+    void view(graphlab::empty *p, size_t n) { len = n; }
+
+    graphlab::empty& operator[](size_t i) const { return e; }
+
+    graphlab::empty *data() const { return NULL; }
+
+    size_t size() const { return len; }
+};
+
+template<typename VertexData, typename EdgeData, typename VertexIdType = int>
+class csr_graph {
+public:
+    // ---------------------------------------- //
+    // ---------------- TYPES ----------------- //
+    // ---------------------------------------- //
+    typedef VertexIdType vertex_id_type;
+    typedef uint32_t edge_id_type;     // limits the graph to 2^32 - 1 edges
+
+    typedef VertexData vertex_data_type;    // used by ivertex_program
+    typedef EdgeData edge_data_type;    // used by ivertex_program
+
+    class edge_type;
+
+    class vertex_type {
+        csr_graph *graph_ptr;
+        vertex_id_type vid;
+
+    public:
+        vertex_type(csr_graph& graph_ref, vertex_id_type vid): graph_ptr(&graph_ref), vid(vid) {}
+
+        VertexData& data() { return graph_ptr->vdata[vid]; }
+
+        const VertexData& data() const { return graph_ptr->vdata[vid]; }
+
+        int num_in_edges() const {
+            return graph_ptr->in_offsets[vid + 1] - graph_ptr->in_offsets[vid];
+        }
+
+        int num_out_edges() const {
+            return graph_ptr->out_offsets[vid + 1] - graph_ptr->out_offsets[vid];
+        }
+
+        vertex_id_type id() const {
+            return vid;
+        }
+
+        // i'th in edge of the vertex, 0 <= i < num_in_edges()
+        edge_type in_edge(int i) const {
+            edge_id_type in_idx = graph_ptr->in_offsets[vid] + i;
+            return edge_type(*graph_ptr, graph_ptr->in_source(in_idx, vid), vid,
+                             graph_ptr->in_to_out[in_idx]);
+        }
+
+        // i'th out edge of the vertex, 0 <= i < num_out_edges()
+        edge_type out_edge(int i) const {
+            edge_id_type eid = graph_ptr->out_offsets[vid] + i;
+            return edge_type(*graph_ptr, vid, graph_ptr->out_target(eid, vid), eid);
+        }
+    };
+
+    class edge_type {
+        csr_graph *graph_ptr;
+        vertex_id_type source_vid;
+        vertex_id_type target_vid;
+        edge_id_type eid;   // index of the edge in out_targets and edata
+
+    public:
+        bool has_opposite;  // true if the graph contains an edge from target to source.
+
+        edge_type(csr_graph& graph_ref, vertex_id_type source, vertex_id_type target, edge_id_type eid)
+            : graph_ptr(&graph_ref), source_vid(source), target_vid(target), eid(eid),
+              has_opposite(graph_ref.opposite[eid]) {}
+
+        vertex_type source() const {
+            return vertex_type(*graph_ptr, source_vid);
+        }
+
+        vertex_type target() const {
+            return vertex_type(*graph_ptr, target_vid);
+        }
+
+        const EdgeData& data() const { return graph_ptr->edata[eid]; }
+
+        EdgeData& data() { return graph_ptr->edata[eid]; }
+
+        edge_id_type id() const {
+            return eid;
+        }
+    };
+
+
+    // ---------------------------------------- //
+    // --------------- METHODS ---------------- //
+    // ---------------------------------------- //
+
+    csr_graph() {
+        out_offsets.push_back(0);
+        in_offsets.push_back(0);
+    }
+
+    /**
+     * Finalizes an adjacency list-based Graph into CSR/CSC form.
+     * Out edges keep the order in which they were added to g.
+     * Gaps in the vertex id range of g become vertices without edges.
+     */
+    explicit csr_graph(Graph<VertexData, EdgeData, VertexIdType>& g) {
+        typedef typename Graph<VertexData, EdgeData, VertexIdType>::edge_type graph_edge_type;
+
+        const vertex_id_type num_v = g.num_vertices();
+        vdata.reserve(num_v);
+        out_offsets.reserve(num_v + 1);
+        in_offsets.reserve(num_v + 1);
+
+        // out side. Remember where each edge ended up to build in_to_out below.
+        std::unordered_map<const graph_edge_type *, edge_id_type> out_index;
+        out_offsets.push_back(0);
+        for (vertex_id_type vid = 0; vid < num_v; vid++) {
+            vdata.push_back(g.vertices[vid].data());
+            for (graph_edge_type *e : g.vertices[vid].out_edges) {
+                out_index[e] = out_targets.size();
+                out_targets.push_back(e->target_vid);
+                edata.push_back(e->data());
+                opposite.push_back(e->has_opposite);
+            }
+            out_offsets.push_back(out_targets.size());
+        }
+
+        // in side
+        in_offsets.push_back(0);
+        for (vertex_id_type vid = 0; vid < num_v; vid++) {
+            for (graph_edge_type *e : g.vertices[vid].in_edges) {
+                in_sources.push_back(e->source_vid);
+                in_to_out.push_back(out_index[e]);
+            }
+            in_offsets.push_back(in_sources.size());
+        }
+    }
+
+    vertex_type vertex(vertex_id_type vid) {
+        return vertex_type(*this, vid);
+    }
+
+    vertex_id_type num_vertices() {
+        return vdata.size();
+    }
+
+    edge_id_type num_edges() {
+        return out_offsets[out_offsets.size() - 1];
+    }
+
+    /**
+     * Encodes the neighbour lists with compressed_ids and frees the plain
+     * arrays. There is no way back, copy the graph first to keep them.
+     */
+    void compress_neighbours() {
+        if (compressed) {
+            return;
+        }
+        packed_out_targets.encode(out_targets.data(), out_offsets.data(), num_vertices());
+        packed_in_sources.encode(in_sources.data(), in_offsets.data(), num_vertices());
+        out_targets = csr_array<vertex_id_type>();
+        in_sources = csr_array<vertex_id_type>();
+        compressed = true;
+    }
+
+    bool neighbours_compressed() const { return compressed; }
+
+    // bytes taken by the neighbour ids (out and in), compressed or not.
+    size_t neighbour_bytes() const {
+        if (compressed) {
+            return packed_out_targets.memory_bytes() + packed_in_sources.memory_bytes();
+        }
+        return (out_targets.size() + in_sources.size()) * sizeof(vertex_id_type);
+    }
+
+    /**
+     * Calls f(in_idx, source) for the in edges of vid in order, where in_idx is
+     * the index of the edge in the CSC arrays (i.e. in_offsets[vid] + i).
+     */
+    template<typename Fn>
+    void for_in_neighbours(vertex_id_type vid, Fn f) {
+        const edge_id_type begin = in_offsets[vid];
+        const edge_id_type end = in_offsets[vid + 1];
+        if (compressed) {
+            typename compressed_ids<vertex_id_type>::cursor c = packed_in_sources.list(begin);
+            for (edge_id_type i = begin; i < end; i++) {
+                f(i, c.next());
+            }
+        } else {
+            for (edge_id_type i = begin; i < end; i++) {
+                f(i, in_sources[i]);
+            }
+        }
+    }
+
+private:
+    template<typename, typename, typename> friend class csr_graph_builder;
+    template<typename, typename, typename> friend struct csr_gather_kernels;
+    friend class graph_file;
+
+    // ---------------------------------------- //
+    // -------------- PROPERTIES -------------- //
+    // ---------------------------------------- //
+
+    csr_array<VertexData> vdata;
+
+    csr_array<edge_id_type> out_offsets;        // num_vertices() + 1 entries
+    csr_array<vertex_id_type> out_targets;      // num_edges() entries
+    csr_array<EdgeData> edata;                  // num_edges() entries, in out edge order
+    csr_array<unsigned char> opposite;          // num_edges() entries, has_opposite per out edge
+
+    csr_array<edge_id_type> in_offsets;         // num_vertices() + 1 entries
+    csr_array<vertex_id_type> in_sources;       // num_edges() entries
+    csr_array<edge_id_type> in_to_out;          // num_edges() entries, in edge -> out edge index
+
+    // set when the arrays above are views into a memory-mapped file. Unmaps it when released.
+    std::shared_ptr<void> mapping;
+
+    // out_targets and in_sources after compress_neighbours(), which leaves those two empty.
+    bool compressed = false;
+    compressed_ids<vertex_id_type> packed_out_targets;
+    compressed_ids<vertex_id_type> packed_in_sources;
+
+    vertex_id_type in_source(edge_id_type in_idx, vertex_id_type vid) const {
+        return compressed ? packed_in_sources.get(in_idx, in_offsets[vid]) : in_sources[in_idx];
+    }
+
+    vertex_id_type out_target(edge_id_type eid, vertex_id_type vid) const {
+        return compressed ? packed_out_targets.get(eid, out_offsets[vid]) : out_targets[eid];
+    }
+};
+
+// is_csr_graph<GraphType>::value is true if GraphType is a csr_graph.
+template<typename GraphType>
+struct is_csr_graph {
+    static constexpr bool value = false;
+};
+
+template<typename VertexData, typename EdgeData, typename VertexIdType>
+struct is_csr_graph<csr_graph<VertexData, EdgeData, VertexIdType> > {
+    static constexpr bool value = true;
+};
+
+#endif
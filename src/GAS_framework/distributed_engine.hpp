@@ -0,0 +1,475 @@
+/**
+ * A bulk-synchronous engine over several processes, after PowerGraph's
+ * synchronous engine. Each process runs one distributed_engine on its part of
+ * a distributed_graph (see distributed_graph.hpp), and every process calls
+ * signal_all() and start() together.
+ *
+ * An iteration has the phases of synchronous_engine, with an exchange between
+ * the processes (see tcp_comm.hpp) after each of them:
+ *  1. init:    the masters of the active vertices run init with the combined
+ *              messages of their signals and send the vertex program
+ *              (VertexProgram::save) to the mirrors, which become active too.
+ *  2. gather:  every replica gathers over the edges stored on its process.
+ *              The mirrors send their partial sums to the master, which adds
+ *              them to its own with gather_type::operator+=, in process order.
+ *  3. apply:   the masters apply and send the new vertex data and the vertex
+ *              program to the mirrors.
+ *  4. scatter: every replica scatters over its local edges. Signals go to the
+ *              master of their vertex, which combines their messages for the
+ *              next iteration.
+ * All messages of a phase to one process travel as one batch. The iterations
+ * end when no vertex is active on any process (or after max_iterations).
+ *
+ * Within a process, num_threads workers of thread_pool::global() split each
+ * phase over the local replicas. The data of a vertex is read from its local replica, which is up
+ * to date as of the last apply, so programs see their neighbours' data as of
+ * the end of the previous apply phase, as with synchronous_engine.
+ *
+ * Vertex programs have to define save(oarchive&) const and load(iarchive&)
+ * for the state that init and apply leave for gather, apply and scatter (see
+ * archive.hpp). Vertex data, edge data, gather and message types have to be
+ * trivially copyable. Gather caching (post_delta) is not supported; post_delta
+ * and clear_gather_cache do nothing. Neither are aggregators (aggregator.hpp).
+ *
+ * context.stop() on any process and the budgets of engine_options end the run
+ * on all processes after the current iteration.
+ */
+
+#ifndef __DISTRIBUTED_ENGINE_H
+#define __DISTRIBUTED_ENGINE_H
+
+#include "../graphlab/graphlab.hpp"
+#include "engine_options.hpp"
+#include "distributed_graph.hpp"
+#include "message_combiner.hpp"
+#include "tcp_comm.hpp"
+#include "archive.hpp"
+#include "thread_pool.hpp"
+
+#include <vector>
+#include <type_traits>  //for is_base_of
+#include <utility>      // declval
+#include <algorithm>    //min()
+#include <stdexcept>
+
+#include <atomic>
+#include <chrono>
+
+/**
+ * has_save_load<VertexProgram>::value is true if VertexProgram defines
+ * save(oarchive&) const and load(iarchive&).
+ */
+template<typename VertexProgram, typename = void>
+struct has_save_load {
+    static constexpr bool value = false;
+};
+
+template<typename VertexProgram>
+struct has_save_load<VertexProgram, decltype(
+        (void) std::declval<const VertexProgram&>().save(std::declval<oarchive&>()),
+        (void) std::declval<VertexProgram&>().load(std::declval<iarchive&>()))> {
+    static constexpr bool value = true;
+};
+
+template<typename VertexProgram>
+class distributed_engine {
+    // ---------------------------------------- //
+    // --------------- TYPEDEFS --------------- //
+    // ---------------------------------------- //
+public:
+    typedef VertexProgram vertex_program_type;
+    typedef typename VertexProgram::gather_type gather_type;
+    typedef typename VertexProgram::message_type message_type;
+    typedef typename VertexProgram::vertex_data_type vertex_data_type;
+    typedef typename VertexProgram::edge_data_type edge_data_type;
+    typedef typename VertexProgram::graph_type  graph_type;
+    typedef typename graph_type::vertex_type vertex_type;
+    typedef typename graph_type::edge_type edge_type;
+    typedef typename graph_type::vertex_id_type vertex_id_type;
+    typedef graphlab::context<distributed_engine> context_type;
+    typedef graphlab::edge_dir_type edge_dir_type;
+
+    static_assert(has_save_load<VertexProgram>::value,
+                  "distributed_engine needs VertexProgram::save(oarchive&) const and load(iarchive&), see archive.hpp");
+
+    // ---------------------------------------- //
+    // -------------- FUNCTIONS --------------- //
+    // ---------------------------------------- //
+
+    // num_threads, pin_threads, max_iterations, max_seconds and max_updates of opts are used.
+    distributed_engine(graph_type& g, tcp_comm& comm, const engine_options& opts)
+        : bytes_sent(0), g(g), comm(comm), context(*this, g),
+          num_threads(std::max(1, opts.num_threads)),
+          pin_threads(opts.pin_threads),
+          max_iterations(opts.max_iterations),
+          max_seconds(opts.max_seconds),
+          max_updates(opts.max_updates),
+          stop_requested(false),
+          iteration_counter(0),
+          run_executed(0),
+          num_executed(0),
+          vertex_programs(g.num_local_vertices()),
+          gather_accum(g.num_local_vertices()),
+          accum_is_set(g.num_local_vertices(), 0),
+          active(g.num_local_vertices(), 0),
+          active_next(g.num_local_vertices(), 0),
+          messages(g.num_local_vertices()),
+          outbox(num_threads, std::vector<std::vector<char> >(comm.num_procs())) {
+        if (!std::is_base_of<graphlab::ivertex_program<graph_type, gather_type, message_type>, VertexProgram>::value) {
+            throw "type parameter for distributed engine is not derived from graphlab::ivertex_program";
+        }
+    }
+
+    // called by the application programmer, on every process
+    void signal_all();
+    void start();
+
+    // called by the context
+    int iteration() const { return iteration_counter; }
+    std::size_t procid() const { return comm.procid(); }
+    std::size_t num_procs() const { return comm.num_procs(); }
+    float elapsed_seconds() const {
+        return std::chrono::duration<float>(std::chrono::steady_clock::now() - start_time).count();
+    }
+    void internal_stop() { stop_requested.store(true, std::memory_order_relaxed); }
+    void internal_signal(const vertex_type& vertex, const message_type& message = message_type());
+    void internal_post_delta(const vertex_type& vertex, const gather_type& delta) {}
+    void internal_clear_gather_cache(const vertex_type& vertex) {}
+
+    // ---------------------------------------- //
+    // ------------- DATA MEMBERS ------------- //
+    // ---------------------------------------- //
+
+    long bytes_sent;    // to other processes, by the last start()
+
+private:
+    graph_type& g;
+    tcp_comm& comm;
+
+    // creating a separate context for each vertex program is not necessary. This one is used by all of them.
+    context_type context;
+
+    const int num_threads;
+    const bool pin_threads;
+    const int max_iterations;
+    const double max_seconds;   // of a start(), negative for no limit
+    const long max_updates;     // summed over the processes
+    std::chrono::steady_clock::time_point start_time;
+    std::atomic<bool> stop_requested;   // on this process, by the context or a budget. Reset by start().
+    int iteration_counter;
+    long run_executed;                  // applies of this process in the current start()
+
+public:
+    long num_executed;  // applies of the masters of this process
+
+private:
+    // by local id. Only masters use gather_accum, accum_is_set, active_next and messages.
+    std::vector<VertexProgram> vertex_programs;
+    std::vector<gather_type> gather_accum;
+    std::vector<char> accum_is_set;
+    std::vector<char> active;           // the current iteration
+    std::vector<char> active_next;      // signalled for the next iteration
+    message_combiner<message_type> messages;
+
+    // what each thread has to send to each process in the current phase
+    std::vector<std::vector<std::vector<char> > > outbox;
+
+    /**
+     * Id of the worker thread (0 .. num_threads - 1) that is running on the current thread.
+     * internal_signal writes to its outbox. It is 0 on any other thread.
+     */
+    static thread_local int worker_id;
+
+    // number of consecutive local vertices a thread takes at once in a phase.
+    enum { CHUNK_SIZE = 256 };
+
+    // calls fn(thread_id, lvid) for every local vertex with active[lvid] (or every one), on num_threads threads.
+    template<typename Fn>
+    void sweep(Fn fn, bool only_active = true);
+
+    // local id of a replica that another process sent something about
+    vertex_id_type local_id(vertex_id_type vid) const;
+
+    // sends the outboxes and returns what the other processes sent, by process.
+    void exchange(std::vector<std::vector<char> >& recv);
+
+    bool prepare_iteration();   // returns false if the engine is done
+    void init_phase();
+    void gather_phase();
+    void apply_phase();
+    void scatter_phase();
+};
+
+/**
+ * implementation below. As in async_engine.hpp, template functions need to be in the header.
+ */
+
+using namespace std;
+
+template<typename VertexProgram>
+thread_local int distributed_engine<VertexProgram>::worker_id = 0;
+
+template<typename VertexProgram>
+void distributed_engine<VertexProgram>::internal_signal(const vertex_type& vertex, const message_type& message) {
+    oarchive(outbox[worker_id][g.master_of(vertex.id())]) << vertex.id() << message;
+}
+
+/**
+ * Signals every vertex once, from its master. Must be called before start() (or between runs).
+ */
+template<typename VertexProgram>
+void distributed_engine<VertexProgram>::signal_all() {
+    for (vertex_id_type lvid = 0; lvid < g.num_local_vertices(); lvid++) {
+        if (g.is_master(lvid)) {
+            active_next[lvid] = 1;
+        }
+    }
+}
+
+template<typename VertexProgram>
+void distributed_engine<VertexProgram>::start() {
+    start_time = chrono::steady_clock::now();
+    stop_requested = false;
+    run_executed = 0;
+    bytes_sent = 0;
+    while (prepare_iteration()) {
+        init_phase();
+        gather_phase();
+        apply_phase();
+        scatter_phase();
+        iteration_counter++;
+    }
+}
+
+template<typename VertexProgram>
+template<typename Fn>
+void distributed_engine<VertexProgram>::sweep(Fn fn, bool only_active) {
+    const vertex_id_type num_local = g.num_local_vertices();
+    atomic<vertex_id_type> next(0);
+    thread_pool::global().run(num_threads, [&](int i) {
+        worker_id = i;
+        while (true) {
+            const vertex_id_type begin = next.fetch_add(CHUNK_SIZE, memory_order_relaxed);
+            if (begin >= num_local) {
+                return;
+            }
+            const vertex_id_type end = min<vertex_id_type>(begin + CHUNK_SIZE, num_local);
+            for (vertex_id_type lvid = begin; lvid < end; lvid++) {
+                if (!only_active || active[lvid]) {
+                    fn(i, lvid);
+                }
+            }
+        }
+    }, pin_threads);
+}
+
+template<typename VertexProgram>
+typename distributed_engine<VertexProgram>::vertex_id_type
+distributed_engine<VertexProgram>::local_id(vertex_id_type vid) const {
+    vertex_id_type lvid;
+    if (!g.local_id(vid, lvid)) {
+        throw std::runtime_error("distributed_engine: received a message for a vertex that is not stored here");
+    }
+    return lvid;
+}
+
+template<typename VertexProgram>
+void distributed_engine<VertexProgram>::exchange(vector<vector<char> >& recv) {
+    vector<vector<char> > send(comm.num_procs());
+    for (int p = 0; p < comm.num_procs(); p++) {
+        for (int t = 0; t < num_threads; t++) {
+            send[p].insert(send[p].end(), outbox[t][p].begin(), outbox[t][p].end());
+            outbox[t][p].clear();
+        }
+        if (p != comm.procid()) {
+            bytes_sent += send[p].size();
+        }
+    }
+    comm.exchange(send, recv);
+}
+
+/**
+ * The masters signalled in the last iteration become active, the mirrors
+ * follow in init_phase. If a process stops, all of them do, and the signalled
+ * vertices stay so for the next start().
+ */
+template<typename VertexProgram>
+bool distributed_engine<VertexProgram>::prepare_iteration() {
+    const long total_executed = comm.all_reduce_sum(run_executed);
+    const long stop = comm.all_reduce_max(stop_requested.load(memory_order_relaxed)
+                                          || (max_seconds >= 0 && elapsed_seconds() >= max_seconds));
+    if (stop || (max_updates >= 0 && total_executed >= max_updates)
+        || (max_iterations >= 0 && iteration_counter >= max_iterations)) {
+        return false;
+    }
+    long num_active = 0;
+    for (vertex_id_type lvid = 0; lvid < g.num_local_vertices(); lvid++) {
+        active[lvid] = active_next[lvid];
+        active_next[lvid] = 0;
+        num_active += active[lvid];
+    }
+    num_active = comm.all_reduce_sum(num_active);
+    return num_active > 0;
+}
+
+template<typename VertexProgram>
+void distributed_engine<VertexProgram>::init_phase() {
+    sweep([this](int thread_id, vertex_id_type lvid) {
+        VertexProgram& vprog = vertex_programs[lvid];
+        vprog = VertexProgram();
+        auto&& cur = g.vertex(lvid);
+        message_type message = message_type();
+        messages.take(lvid, message);
+        vprog.init(context, cur, message);
+        for (const int *p = g.mirrors_begin(lvid); p != g.mirrors_end(lvid); p++) {
+            oarchive oarc(outbox[thread_id][*p]);
+            oarc << cur.id();
+            vprog.save(oarc);
+        }
+    });
+    vector<vector<char> > recv;
+    exchange(recv);
+    for (int p = 0; p < comm.num_procs(); p++) {
+        iarchive iarc(recv[p]);
+        while (!iarc.empty()) {
+            vertex_id_type vid;
+            iarc >> vid;
+            const vertex_id_type lvid = local_id(vid);
+            vertex_programs[lvid] = VertexProgram();
+            vertex_programs[lvid].load(iarc);
+            active[lvid] = 1;
+        }
+    }
+}
+
+template<typename VertexProgram>
+void distributed_engine<VertexProgram>::gather_phase() {
+    sweep([this](int thread_id, vertex_id_type lvid) {
+        VertexProgram& vprog = vertex_programs[lvid];
+        auto&& cur = g.vertex(lvid);
+        bool is_set = false;
+        gather_type accum = gather_type();  // imporant to explicitly call the default constructor for basic data types
+
+        const edge_dir_type gather_dir = vprog.gather_edges(context, cur);
+        if (gather_dir == graphlab::IN_EDGES || gather_dir == graphlab::ALL_EDGES) {
+            const int num_in = cur.num_local_in_edges();
+            for (int i = 0; i < num_in; i++) {
+                auto&& edge = cur.local_in_edge(i);
+                if (is_set) {
+                    accum += vprog.gather(context, cur, edge);
+                } else {
+                    accum = vprog.gather(context, cur, edge);
+                    is_set = true;
+                }
+            }
+        }
+        if (gather_dir == graphlab::OUT_EDGES || gather_dir == graphlab::ALL_EDGES) {
+            const int num_out = cur.num_local_out_edges();
+            for (int i = 0; i < num_out; i++) {
+                auto&& edge = cur.local_out_edge(i);
+                if (is_set) {
+                    accum += vprog.gather(context, cur, edge);
+                } else {
+                    accum = vprog.gather(context, cur, edge);
+                    is_set = true;
+                }
+            }
+        }
+        if (g.is_master(lvid)) {
+            gather_accum[lvid] = accum;
+            accum_is_set[lvid] = is_set;
+        } else if (is_set) {
+            oarchive(outbox[thread_id][g.master_of(cur.id())]) << cur.id() << accum;
+        }
+    });
+    vector<vector<char> > recv;
+    exchange(recv);
+    for (int p = 0; p < comm.num_procs(); p++) {
+        iarchive iarc(recv[p]);
+        while (!iarc.empty()) {
+            vertex_id_type vid;
+            gather_type partial;
+            iarc >> vid >> partial;
+            const vertex_id_type lvid = local_id(vid);
+            if (accum_is_set[lvid]) {
+                gather_accum[lvid] += partial;
+            } else {
+                gather_accum[lvid] = partial;
+                accum_is_set[lvid] = 1;
+            }
+        }
+    }
+}
+
+template<typename VertexProgram>
+void distributed_engine<VertexProgram>::apply_phase() {
+    long executed = 0;
+    sweep([this](int thread_id, vertex_id_type lvid) {
+        if (!g.is_master(lvid)) {
+            return;
+        }
+        VertexProgram& vprog = vertex_programs[lvid];
+        auto&& cur = g.vertex(lvid);
+        vprog.apply(context, cur, gather_accum[lvid]);
+        for (const int *p = g.mirrors_begin(lvid); p != g.mirrors_end(lvid); p++) {
+            oarchive oarc(outbox[thread_id][*p]);
+            oarc << cur.id() << cur.data();
+            vprog.save(oarc);
+        }
+    });
+    for (vertex_id_type lvid = 0; lvid < g.num_local_vertices(); lvid++) {
+        executed += active[lvid] && g.is_master(lvid);
+    }
+    num_executed += executed;
+    run_executed += executed;
+    vector<vector<char> > recv;
+    exchange(recv);
+    for (int p = 0; p < comm.num_procs(); p++) {
+        iarchive iarc(recv[p]);
+        while (!iarc.empty()) {
+            vertex_id_type vid;
+            iarc >> vid;
+            const vertex_id_type lvid = local_id(vid);
+            iarc >> g.vertex(lvid).data();
+            vertex_programs[lvid].load(iarc);
+        }
+    }
+}
+
+template<typename VertexProgram>
+void distributed_engine<VertexProgram>::scatter_phase() {
+    sweep([this](int thread_id, vertex_id_type lvid) {
+        VertexProgram& vprog = vertex_programs[lvid];
+        auto&& cur = g.vertex(lvid);
+        const edge_dir_type scatter_dir = vprog.scatter_edges(context, cur);
+        if (scatter_dir == graphlab::OUT_EDGES || scatter_dir == graphlab::ALL_EDGES) {
+            const int num_out = cur.num_local_out_edges();
+            for (int i = 0; i < num_out; i++) {
+                auto&& edge = cur.local_out_edge(i);
+                vprog.scatter(context, cur, edge);
+            }
+        }
+        if (scatter_dir == graphlab::IN_EDGES || scatter_dir == graphlab::ALL_EDGES) {
+            const int num_in = cur.num_local_in_edges();
+            for (int i = 0; i < num_in; i++) {
+                auto&& edge = cur.local_in_edge(i);
+                vprog.scatter(context, cur, edge);
+            }
+        }
+    });
+    vector<vector<char> > recv;
+    exchange(recv);
+    for (int p = 0; p < comm.num_procs(); p++) {
+        iarchive iarc(recv[p]);
+        while (!iarc.empty()) {
+            vertex_id_type vid;
+            message_type message;
+            iarc >> vid >> message;
+            const vertex_id_type lvid = local_id(vid);
+            messages.add(lvid, message);
+            active_next[lvid] = 1;
+        }
+    }
+}
+
+#endif
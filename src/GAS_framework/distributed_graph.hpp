@@ -0,0 +1,477 @@
+/**
+ * The part of a graph that one process of distributed_engine holds, after
+ * PowerGraph's vertex-cut: every edge is stored by exactly one process, and a
+ * vertex is replicated on every process that stores one of its edges.
+ *
+ * One replica of every vertex is its master, the others are mirrors. The
+ * master is process vid % num_procs (which stores the vertex even if it has
+ * no edges there), so any process can tell where to send something about a
+ * vertex without a lookup table. Only the master knows the list of mirrors.
+ * All replicas keep a copy of the vertex data, which the engine updates after
+ * every apply.
+ *
+ * The edges of a process are a csr_graph over local ids 0 .. num_local_vertices(),
+ * which are the global ids of the local replicas in increasing order.
+ * vertex_type::id() is the global id. num_in_edges() and num_out_edges() are
+ * the degrees in the whole graph, which is what vertex programs like PageRank
+ * divide by, while local_in_edge(i) / local_out_edge(i) iterate over the
+ * num_local_in_edges() / num_local_out_edges() edges stored here.
+ *
+ * distributed_graph_builder places the edges. Every process adds a share of
+ * the edges (e.g. every num_procs'th line of the input, see ingest_lines) and
+ * finalize(), which all processes call together, sends every edge to the
+ * process the vertex-cut picks for it:
+ *  - RANDOM_CUT hashes the endpoints, which balances the edges but replicates
+ *    a vertex on up to min(degree, num_procs) processes.
+ *  - OBLIVIOUS_CUT is PowerGraph's oblivious greedy heuristic: every process
+ *    places its own edges one by one, preferring processes that already have
+ *    replicas of both endpoints, then of one of them, then the least loaded
+ *    one, as far as it knows from its own placements. That needs no
+ *    coordination and gives much fewer replicas of vertices with clustered
+ *    edges.
+ *
+ * Duplicate and self edges are dropped. An edge that two processes add is only
+ * merged if both send it to the same process, which RANDOM_CUT guarantees.
+ */
+
+#ifndef __DISTRIBUTED_GRAPH_H
+#define __DISTRIBUTED_GRAPH_H
+
+#include "csr_graph.hpp"
+#include "graph_builder.hpp"
+#include "tcp_comm.hpp"
+#include "archive.hpp"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+
+enum vertex_cut_type {
+    RANDOM_CUT,         // edges are hashed to processes
+    OBLIVIOUS_CUT       // greedy placement of each process's edges, see above
+};
+
+template<typename VertexData, typename EdgeData, typename VertexIdType = int>
+class distributed_graph {
+public:
+    // ---------------------------------------- //
+    // ---------------- TYPES ----------------- //
+    // ---------------------------------------- //
+    typedef VertexIdType vertex_id_type;
+    typedef csr_graph<VertexData, EdgeData, VertexIdType> local_graph_type;
+    typedef typename local_graph_type::edge_id_type edge_id_type;
+
+    typedef VertexData vertex_data_type;    // used by ivertex_program
+    typedef EdgeData edge_data_type;    // used by ivertex_program
+
+    class edge_type;
+
+    class vertex_type {
+        distributed_graph *graph_ptr;
+        vertex_id_type lvid;
+
+    public:
+        vertex_type(distributed_graph& graph_ref, vertex_id_type lvid): graph_ptr(&graph_ref), lvid(lvid) {}
+
+        VertexData& data() { return graph_ptr->local.vertex(lvid).data(); }
+
+        const VertexData& data() const { return graph_ptr->local.vertex(lvid).data(); }
+
+        // in the whole graph
+        int num_in_edges() const { return graph_ptr->num_in[lvid]; }
+
+        int num_out_edges() const { return graph_ptr->num_out[lvid]; }
+
+        // the global id
+        vertex_id_type id() const { return graph_ptr->global_ids[lvid]; }
+
+        vertex_id_type local_id() const { return lvid; }
+
+        // stored on this process
+        int num_local_in_edges() const { return graph_ptr->local.vertex(lvid).num_in_edges(); }
+
+        int num_local_out_edges() const { return graph_ptr->local.vertex(lvid).num_out_edges(); }
+
+        // i'th in edge stored on this process, 0 <= i < num_local_in_edges()
+        edge_type local_in_edge(int i) const {
+            return edge_type(*graph_ptr, graph_ptr->local.vertex(lvid).in_edge(i));
+        }
+
+        // i'th out edge stored on this process, 0 <= i < num_local_out_edges()
+        edge_type local_out_edge(int i) const {
+            return edge_type(*graph_ptr, graph_ptr->local.vertex(lvid).out_edge(i));
+        }
+    };
+
+    class edge_type {
+        distributed_graph *graph_ptr;
+        typename local_graph_type::edge_type e;
+
+    public:
+        edge_type(distributed_graph& graph_ref, const typename local_graph_type::edge_type& e)
+            : graph_ptr(&graph_ref), e(e) {}
+
+        vertex_type source() const { return vertex_type(*graph_ptr, e.source().id()); }
+
+        vertex_type target() const { return vertex_type(*graph_ptr, e.target().id()); }
+
+        const EdgeData& data() const { return e.data(); }
+
+        EdgeData& data() { return e.data(); }
+    };
+
+
+    // ---------------------------------------- //
+    // --------------- METHODS ---------------- //
+    // ---------------------------------------- //
+
+    distributed_graph(): procid(0), num_procs(1), total_vertices(0), total_edges(0) {}
+
+    // by local id
+    vertex_type vertex(vertex_id_type lvid) {
+        return vertex_type(*this, lvid);
+    }
+
+    // in the whole graph
+    vertex_id_type num_vertices() const { return total_vertices; }
+
+    long num_edges() const { return total_edges; }
+
+    vertex_id_type num_local_vertices() const { return global_ids.size(); }
+
+    edge_id_type num_local_edges() { return local.num_edges(); }
+
+    bool is_master(vertex_id_type lvid) const { return master_of(global_ids[lvid]) == procid; }
+
+    int master_of(vertex_id_type vid) const { return vid % num_procs; }
+
+    // finds the local id of vid. Returns false if vid has no replica here.
+    bool local_id(vertex_id_type vid, vertex_id_type& ret) const {
+        typename std::unordered_map<vertex_id_type, vertex_id_type>::const_iterator it = local_ids.find(vid);
+        if (it == local_ids.end()) {
+            return false;
+        }
+        ret = it->second;
+        return true;
+    }
+
+    // the processes with a mirror of the master lvid
+    const int *mirrors_begin(vertex_id_type lvid) const { return mirror_procs.data() + mirror_offsets[lvid]; }
+
+    const int *mirrors_end(vertex_id_type lvid) const { return mirror_procs.data() + mirror_offsets[lvid + 1]; }
+
+    // replicas per vertex, over all processes. Collective.
+    double replication_factor(tcp_comm& comm) const {
+        return (double) comm.all_reduce_sum(global_ids.size()) / std::max<long>(total_vertices, 1);
+    }
+
+private:
+    template<typename, typename, typename> friend class distributed_graph_builder;
+
+    int procid;
+    int num_procs;
+    vertex_id_type total_vertices;
+    long total_edges;
+
+    local_graph_type local;
+    std::vector<vertex_id_type> global_ids;                         // by local id, increasing
+    std::unordered_map<vertex_id_type, vertex_id_type> local_ids;   // the inverse
+    std::vector<int> num_in;                                        // global degrees, by local id
+    std::vector<int> num_out;
+    std::vector<std::size_t> mirror_offsets;                        // num_local_vertices() + 1 entries
+    std::vector<int> mirror_procs;                                  // of masters only
+};
+
+template<typename VertexData, typename EdgeData, typename VertexIdType = int>
+class distributed_graph_builder {
+public:
+    typedef distributed_graph<VertexData, EdgeData, VertexIdType> graph_type;
+    typedef VertexIdType vertex_id_type;
+
+    /**
+     * Vertices that are not added explicitly get default_vdata. num_threads
+     * threads build the local csr_graph.
+     */
+    distributed_graph_builder(tcp_comm& comm, vertex_cut_type cut = OBLIVIOUS_CUT,
+                              const VertexData& default_vdata = VertexData(), int num_threads = 1)
+        : comm(comm), cut(cut), default_vdata(default_vdata), num_threads(num_threads), max_vid(-1) {}
+
+    // may be called by any process, the data goes to the master. Returns false if vid is negative.
+    bool add_vertex(vertex_id_type vid, const VertexData& vdata = VertexData()) {
+        if (vid < 0) {
+            return false;
+        }
+        vertices.push_back(std::make_pair(vid, vdata));
+        max_vid = std::max<long>(max_vid, vid);
+        return true;
+    }
+
+    // returns false if a vid is negative.
+    bool add_edge(vertex_id_type source, vertex_id_type target, const EdgeData& edata = EdgeData()) {
+        if (source < 0 || target < 0) {
+            return false;
+        }
+        edge_record e;
+        e.source = source;
+        e.target = target;
+        e.data = edata;
+        edges.push_back(e);
+        max_vid = std::max<long>(max_vid, std::max(source, target));
+        return true;
+    }
+
+    /**
+     * Passes every num_procs'th line of the file, starting at line procid, to
+     * parse_line(line_begin, line_end), which is expected to call add_vertex
+     * and add_edge. The file is streamed, not read at once. Returns false if
+     * it can not be opened.
+     */
+    template<typename LineParser>
+    bool ingest_lines(const std::string& filename, LineParser parse_line) {
+        std::ifstream file(filename);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::string line;
+        for (long i = 0; std::getline(file, line); i++) {
+            if (i % comm.num_procs() == comm.procid()) {
+                parse_line(line.data(), line.data() + line.size());
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Places the edges, builds the local graph and sets up the masters and
+     * mirrors. Must be called by all processes. Clears the builder.
+     */
+    graph_type finalize() {
+        graph_type g;
+        g.procid = comm.procid();
+        g.num_procs = comm.num_procs();
+        const int num_procs = g.num_procs;
+        g.total_vertices = comm.all_reduce_max(max_vid) + 1;
+
+        // --- drop duplicate and self edges among ours, then place them
+        std::sort(edges.begin(), edges.end());
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < edges.size(); i++) {
+            if (edges[i].source == edges[i].target) {
+                continue;
+            }
+            if (kept > 0 && !(edges[kept - 1] < edges[i])) {
+                continue;
+            }
+            edges[kept++] = edges[i];
+        }
+        edges.resize(kept);
+
+        std::vector<std::vector<char> > send(num_procs), recv;
+        {
+            edge_placement placement(num_procs);
+            for (const edge_record& e : edges) {
+                const int p = cut == RANDOM_CUT ? placement.random(e.source, e.target)
+                                                : placement.greedy(e.source, e.target);
+                oarchive(send[p]) << e.source << e.target << e.data;
+            }
+        }
+        std::vector<edge_record>().swap(edges);
+        comm.exchange(send, recv);
+
+        std::vector<edge_record> local_edges;
+        for (int p = 0; p < num_procs; p++) {
+            iarchive iarc(recv[p]);
+            while (!iarc.empty()) {
+                edge_record e;
+                iarc >> e.source >> e.target >> e.data;
+                local_edges.push_back(e);
+            }
+            std::vector<char>().swap(recv[p]);
+        }
+
+        // --- the local replicas: endpoints of local edges and the masters of the vertices
+        for (const edge_record& e : local_edges) {
+            g.global_ids.push_back(e.source);
+            g.global_ids.push_back(e.target);
+        }
+        for (vertex_id_type vid = g.procid; vid < g.total_vertices; vid += num_procs) {
+            g.global_ids.push_back(vid);
+        }
+        std::sort(g.global_ids.begin(), g.global_ids.end());
+        g.global_ids.erase(std::unique(g.global_ids.begin(), g.global_ids.end()), g.global_ids.end());
+        const vertex_id_type num_local = g.global_ids.size();
+        g.local_ids.reserve(num_local);
+        for (vertex_id_type lvid = 0; lvid < num_local; lvid++) {
+            g.local_ids[g.global_ids[lvid]] = lvid;
+        }
+
+        csr_graph_builder<VertexData, EdgeData, VertexIdType> builder(num_threads, default_vdata);
+        if (num_local > 0) {
+            builder.add_vertex(num_local - 1, default_vdata);
+        }
+        for (const edge_record& e : local_edges) {
+            builder.add_edge(g.local_ids[e.source], g.local_ids[e.target], e.data);
+        }
+        std::vector<edge_record>().swap(local_edges);
+        g.local = builder.finalize();
+        g.total_edges = comm.all_reduce_sum(g.local.num_edges());
+
+        // --- vertex data to the masters
+        for (const std::pair<vertex_id_type, VertexData>& v : vertices) {
+            oarchive(send[g.master_of(v.first)]) << v.first << v.second;
+        }
+        std::vector<std::pair<vertex_id_type, VertexData> >().swap(vertices);
+        comm.exchange(send, recv);
+        for (int p = 0; p < num_procs; p++) {
+            iarchive iarc(recv[p]);
+            while (!iarc.empty()) {
+                vertex_id_type vid;
+                VertexData vdata;
+                iarc >> vid >> vdata;
+                g.local.vertex(g.local_ids[vid]).data() = vdata;
+            }
+        }
+
+        // --- every replica tells its master about itself and its local degrees
+        for (vertex_id_type lvid = 0; lvid < num_local; lvid++) {
+            auto&& v = g.local.vertex(lvid);
+            const int num_in = v.num_in_edges();
+            const int num_out = v.num_out_edges();
+            oarchive(send[g.master_of(g.global_ids[lvid])]) << g.global_ids[lvid] << num_in << num_out;
+        }
+        comm.exchange(send, recv);
+        g.num_in.assign(num_local, 0);
+        g.num_out.assign(num_local, 0);
+        std::vector<std::vector<int> > mirrors(num_local);
+        for (int p = 0; p < num_procs; p++) {
+            iarchive iarc(recv[p]);
+            while (!iarc.empty()) {
+                vertex_id_type vid;
+                int num_in, num_out;
+                iarc >> vid >> num_in >> num_out;
+                const vertex_id_type lvid = g.local_ids[vid];
+                g.num_in[lvid] += num_in;
+                g.num_out[lvid] += num_out;
+                if (p != g.procid) {
+                    mirrors[lvid].push_back(p);
+                }
+            }
+        }
+        g.mirror_offsets.assign(num_local + 1, 0);
+        for (vertex_id_type lvid = 0; lvid < num_local; lvid++) {
+            g.mirror_offsets[lvid + 1] = g.mirror_offsets[lvid] + mirrors[lvid].size();
+            g.mirror_procs.insert(g.mirror_procs.end(), mirrors[lvid].begin(), mirrors[lvid].end());
+        }
+
+        // --- and gets the data and the degrees of the whole graph back
+        for (vertex_id_type lvid = 0; lvid < num_local; lvid++) {
+            for (const int *p = g.mirrors_begin(lvid); p != g.mirrors_end(lvid); p++) {
+                oarchive(send[*p]) << g.global_ids[lvid] << g.local.vertex(lvid).data()
+                                   << g.num_in[lvid] << g.num_out[lvid];
+            }
+        }
+        comm.exchange(send, recv);
+        for (int p = 0; p < num_procs; p++) {
+            iarchive iarc(recv[p]);
+            while (!iarc.empty()) {
+                vertex_id_type vid;
+                VertexData vdata;
+                int num_in, num_out;
+                iarc >> vid >> vdata >> num_in >> num_out;
+                const vertex_id_type lvid = g.local_ids[vid];
+                g.local.vertex(lvid).data() = vdata;
+                g.num_in[lvid] = num_in;
+                g.num_out[lvid] = num_out;
+            }
+        }
+        max_vid = -1;
+        return g;
+    }
+
+private:
+    struct edge_record {
+        vertex_id_type source;
+        vertex_id_type target;
+        EdgeData data;
+
+        bool operator<(const edge_record& other) const {
+            return source < other.source || (source == other.source && target < other.target);
+        }
+    };
+
+    /**
+     * Where this process has placed edges so far. The greedy score of a process
+     * is the number of endpoints it already has a replica of plus how far its
+     * load is below the maximum load, scaled to [0, BALANCE_WEIGHT]. A weight
+     * above 1 lets balance win against one shared endpoint once the loads
+     * differ enough, otherwise the first process would get every edge of a
+     * connected component.
+     */
+    class edge_placement {
+    public:
+        explicit edge_placement(int num_procs): num_procs(num_procs), load(num_procs, 0) {}
+
+        int random(vertex_id_type source, vertex_id_type target) const {
+            uint64_t h = (uint64_t) source * 0x9E3779B97F4A7C15ull ^ (uint64_t) target;
+            h ^= h >> 29;
+            h *= 0xBF58476D1CE4E5B9ull;
+            h ^= h >> 32;
+            return h % num_procs;
+        }
+
+        int greedy(vertex_id_type source, vertex_id_type target) {
+            const std::size_t s = index_of(source);
+            const std::size_t t = index_of(target);
+            const long max_load = *std::max_element(load.begin(), load.end());
+            const long min_load = *std::min_element(load.begin(), load.end());
+            int best = 0;
+            double best_score = -1;
+            for (int p = 0; p < num_procs; p++) {
+                const double score = placed[s * num_procs + p] + placed[t * num_procs + p]
+                                     + BALANCE_WEIGHT * (max_load - load[p]) / (1.0 + max_load - min_load);
+                if (score > best_score) {
+                    best = p;
+                    best_score = score;
+                }
+            }
+            placed[s * num_procs + best] = 1;
+            placed[t * num_procs + best] = 1;
+            load[best]++;
+            return best;
+        }
+
+    private:
+        static constexpr double BALANCE_WEIGHT = 1.5;
+
+        const int num_procs;
+        std::vector<long> load;                 // edges placed on each process
+        std::unordered_map<vertex_id_type, std::size_t> index;
+        std::vector<unsigned char> placed;      // index * num_procs + p: a replica on p
+
+        std::size_t index_of(vertex_id_type vid) {
+            typename std::unordered_map<vertex_id_type, std::size_t>::iterator it = index.find(vid);
+            if (it != index.end()) {
+                return it->second;
+            }
+            const std::size_t i = index.size();
+            index[vid] = i;
+            placed.resize(placed.size() + num_procs, 0);
+            return i;
+        }
+    };
+
+    tcp_comm& comm;
+    const vertex_cut_type cut;
+    const VertexData default_vdata;
+    const int num_threads;
+    long max_vid;
+
+    std::vector<edge_record> edges;
+    std::vector<std::pair<vertex_id_type, VertexData> > vertices;
+};
+
+#endif
@@ -0,0 +1,146 @@
+/**
+ * Counters of the worker threads of async_engine and synchronous_engine.
+ *
+ * Every worker thread counts into its own thread_metrics, which is aligned to
+ * a cache line so that the threads do not write to the same lines. The engines
+ * add them to their engine_metrics at the end of every start(), so it holds
+ * the sums over all runs, per thread and in total. write_json and write_csv
+ * export them:
+ *
+ * \code
+ * engine.start();
+ * std::ofstream out("metrics.json");
+ * engine.metrics.write_json(out);
+ * \endcode
+ *
+ * LOCK_WAIT_NS and IDLE_NS are only measured with engine_options::time_metrics,
+ * since they read the clock twice per vertex. Counters that do not apply to an
+ * engine stay 0 (the SPM and lock counters of synchronous_engine).
+ */
+
+#ifndef __ENGINE_METRICS_H
+#define __ENGINE_METRICS_H
+
+#include <vector>
+#include <ostream>
+#include <chrono>
+#include <cstddef>
+
+enum metric_type {
+    VERTEX_UPDATES,     // vertex programs executed
+    GATHER_EDGES,       // edges gathered over
+    SCATTER_EDGES,      // edges scattered over
+    LOCK_FAILURES,      // async_engine: get_exclusive_access had to leave the vertex to another thread
+    LOCK_WAIT_NS,       // async_engine: in get_exclusive_access
+    IDLE_NS,            // waiting for a job (async_engine) or at the barriers (synchronous_engine)
+    SPM_HITS,           // async_engine: data of a gathered or scattered edge found in SPM
+    SPM_MISSES,
+    SPM_FAILED_LOADS,   // loads dropped because the SPM was full
+    SPM_EVICTIONS,      // slots freed in SPM
+    SPM_COMPACTIONS,    // the opposite slab was compacted to make room for a load
+    NUM_METRICS
+};
+
+// the names in the exports, in the order of metric_type
+static const char *const metric_names[NUM_METRICS] = {
+    "vertex_updates", "gather_edges", "scatter_edges", "lock_failures", "lock_wait_ns", "idle_ns",
+    "spm_hits", "spm_misses", "spm_failed_loads", "spm_evictions", "spm_compactions"
+};
+
+struct alignas(64) thread_metrics {
+    long counts[NUM_METRICS];
+
+    thread_metrics() { clear(); }
+
+    long& operator[](metric_type m) { return counts[m]; }
+    long operator[](metric_type m) const { return counts[m]; }
+
+    void clear() {
+        for (int i = 0; i < NUM_METRICS; i++) {
+            counts[i] = 0;
+        }
+    }
+
+    thread_metrics& operator+=(const thread_metrics& other) {
+        for (int i = 0; i < NUM_METRICS; i++) {
+            counts[i] += other.counts[i];
+        }
+        return *this;
+    }
+};
+
+// nanoseconds on a monotonic clock, for LOCK_WAIT_NS and IDLE_NS.
+inline long metrics_clock_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class engine_metrics {
+public:
+    std::vector<thread_metrics> threads;    // by thread id
+
+    // adds the counters of a thread of the last run.
+    void merge(int thread_id, const thread_metrics& m) {
+        if ((int) threads.size() <= thread_id) {
+            threads.resize(thread_id + 1);
+        }
+        threads[thread_id] += m;
+    }
+
+    thread_metrics total() const {
+        thread_metrics ret;
+        for (const thread_metrics& m : threads) {
+            ret += m;
+        }
+        return ret;
+    }
+
+    long operator[](metric_type m) const { return total()[m]; }
+
+    void clear() { threads.clear(); }
+
+    // {"total": {"vertex_updates": ..., ...}, "threads": [{...}, ...]}
+    void write_json(std::ostream& out) const {
+        out << "{\n  \"total\": ";
+        write_json_object(out, total());
+        out << ",\n  \"threads\": [";
+        for (std::size_t t = 0; t < threads.size(); t++) {
+            out << (t > 0 ? ",\n    " : "\n    ");
+            write_json_object(out, threads[t]);
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    // a header line, then a line per thread and one for the total, whose thread column is "total".
+    void write_csv(std::ostream& out) const {
+        out << "thread";
+        for (int i = 0; i < NUM_METRICS; i++) {
+            out << "," << metric_names[i];
+        }
+        out << "\n";
+        for (std::size_t t = 0; t < threads.size(); t++) {
+            out << t;
+            write_csv_values(out, threads[t]);
+        }
+        out << "total";
+        write_csv_values(out, total());
+    }
+
+private:
+    static void write_json_object(std::ostream& out, const thread_metrics& m) {
+        out << "{";
+        for (int i = 0; i < NUM_METRICS; i++) {
+            out << (i > 0 ? ", \"" : "\"") << metric_names[i] << "\": " << m.counts[i];
+        }
+        out << "}";
+    }
+
+    static void write_csv_values(std::ostream& out, const thread_metrics& m) {
+        for (int i = 0; i < NUM_METRICS; i++) {
+            out << "," << m.counts[i];
+        }
+        out << "\n";
+    }
+};
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * Options of async_engine and synchronous_engine. Defaults match the
+ * positional constructors. Options that only apply to one of the engines
+ * are ignored by the other.
+ */
+
+#ifndef __ENGINE_OPTIONS_H
+#define __ENGINE_OPTIONS_H
+
+#include "new_arch.hpp"
+
+#include <string>
+
+enum scheduler_type {
+    WORK_STEALING,  // per-thread work-stealing deques, see work_stealing_scheduler.hpp
+    PRIORITY        // relaxed priority order of the messages' priority(), see multiqueue_scheduler.hpp
+};
+
+enum prefetch_policy_type {
+    FIXED_PREFETCH,     // load_ahead_distance for every vertex
+    DEGREE_PREFETCH,    // load_ahead_distance capped by the degree and the free SPM, see prefetch_policy.hpp
+    ADAPTIVE_PREFETCH   // tuned online from the stall cycles, starting at load_ahead_distance
+};
+
+enum consistency_model {
+    EDGE_CONSISTENCY,           // Chandy-Misra forks on the edges, see chandy_misra.hpp
+    MONITOR_EDGE_CONSISTENCY,   // edge consistency by locking whole neighbourhoods at once, see neighbourhood_locks.hpp
+    VERTEX_CONSISTENCY          // only the vertex itself is locked. Neighbours may execute concurrently.
+};
+
+struct engine_options {
+    int load_ahead_distance;
+    int num_threads;
+    bool enable_caching;
+    scheduler_type scheduler;           // async_engine only
+    prefetch_policy_type prefetch;      // async_engine only
+    consistency_model consistency;     // async_engine only
+    new_arch::size_t spm_size;          // async_engine only. Bytes of the SPM of each thread.
+    new_arch::timing_model timing;      // async_engine only. Cycle costs of the simulated cores, see new_arch.hpp.
+    /**
+     * async_engine only. Vertices with at least hub_degree edges gather and scatter
+     * in chunks of hub_chunk_size edges, which all threads work on. 0 disables it.
+     */
+    int hub_degree;
+    int hub_chunk_size;
+    /**
+     * async_engine with WORK_STEALING only. Gives every thread a contiguous range of
+     * vertex ids with about the same number of edges, whose vertices it runs before it
+     * steals (see work_stealing_scheduler.hpp). Best with a graph relabeled for
+     * locality (see vertex_order.hpp).
+     */
+    bool partition_vertices;
+    int max_iterations;                 // synchronous_engine and distributed_engine only. Negative for no limit.
+    /**
+     * synchronous_engine only. Set if the scatter over out edges of the program does
+     * nothing but signal edge.target(). Lets the engine pull those signals in
+     * iterations with many active vertices, see synchronous_engine.hpp. Pulled
+     * signals carry message_type(), not the message of the scatter, so the
+     * program must give the same result without it. SSSP does, because a vertex
+     * without a candidate distance gathers over all its in edges.
+     */
+    bool pull_signals;
+    /**
+     * Budgets of every start(), negative for none. The engines stop once
+     * max_seconds have passed or max_updates vertex programs have run, as
+     * with icontext::stop: vertex programs that have begun still finish, and
+     * synchronous_engine and distributed_engine finish the current iteration.
+     * The vertices that are still active run on the next start().
+     */
+    double max_seconds;
+    long max_updates;
+    /**
+     * async_engine and synchronous_engine. Also measure the LOCK_WAIT_NS and
+     * IDLE_NS metrics (see engine_metrics.hpp), which reads the clock around
+     * every lock and every wait for work.
+     */
+    bool time_metrics;
+    /**
+     * async_engine, synchronous_engine and distributed_engine. Pin the i-th
+     * worker thread to the i-th core of the process's CPU set, NUMA node by
+     * node, see thread_pool.hpp.
+     */
+    bool pin_threads;
+    /**
+     * async_engine only. Checkpoints go to checkpoint_prefix.0 and .1, taken
+     * every checkpoint_interval seconds while the workers run (0 for none) and
+     * by save_checkpoint(), see checkpoint.hpp. Empty disables checkpoints.
+     */
+    std::string checkpoint_prefix;
+    double checkpoint_interval;
+
+    engine_options(): load_ahead_distance(10),
+                      num_threads(1),
+                      enable_caching(false),
+                      scheduler(WORK_STEALING),
+                      prefetch(FIXED_PREFETCH),
+                      consistency(EDGE_CONSISTENCY),
+                      spm_size(new_arch::DEFAULT_SPM_SIZE),
+                      hub_degree(0),
+                      hub_chunk_size(1024),
+                      partition_vertices(false),
+                      max_iterations(-1),
+                      pull_signals(false),
+                      max_seconds(-1),
+                      max_updates(-1),
+                      time_metrics(false),
+                      pin_threads(false),
+                      checkpoint_interval(0) {}
+};
+
+#endif
@@ -0,0 +1,112 @@
+/**
+ * The set of active vertices of an iteration of synchronous_engine.
+ *
+ * A frontier is built by insert() calls from any number of threads, then
+ * finalize() picks its representation:
+ *  - sparse: a sorted list of the active vertex ids, when few vertices are
+ *    active. Sweeping it costs O(active) instead of O(num_vertices).
+ *  - dense: only the bitmap, when many vertices are active. Sweeping it is a
+ *    sequential scan over the vertex id range.
+ *
+ * The bitmap is always kept since it drops duplicate inserts. Each thread
+ * records the ids it inserts in a list of its own, up to its share of the
+ * sparse limit. A thread that exceeds it stops recording, which makes the
+ * frontier dense. Inserts into a finalized dense frontier only set the bit,
+ * size() does not count them.
+ */
+
+#ifndef __FRONTIER_H
+#define __FRONTIER_H
+
+#include "ischeduler.hpp"   // for atomic_bitset
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+template<typename VertexIdType>
+class frontier {
+public:
+    typedef VertexIdType vertex_id_type;
+
+    /**
+     * The frontier is sparse if at most sparse_limit vertices are active.
+     */
+    frontier(vertex_id_type num_vertices, int num_threads, std::size_t sparse_limit)
+        : bits(num_vertices), thread_lists(num_threads), overflowed(num_threads, 0),
+          thread_limit(sparse_limit / num_threads + 1), dense(false), num_active(0) {}
+
+    // returns true if vid was not in the frontier yet.
+    bool insert(int thread_id, vertex_id_type vid) {
+        if (!bits.set(vid)) {
+            return false;
+        }
+        if (!dense && !overflowed[thread_id]) {
+            if (thread_lists[thread_id].size() < thread_limit) {
+                thread_lists[thread_id].push_back(vid);
+            } else {
+                overflowed[thread_id] = 1;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Called once all inserts are done, by one thread.
+     * force_dense skips building the list (e.g. when it was filled by a dense sweep).
+     */
+    void finalize(bool force_dense = false) {
+        dense = force_dense;
+        for (std::size_t i = 0; i < overflowed.size(); i++) {
+            dense = dense || overflowed[i];
+        }
+        list.clear();
+        if (dense) {
+            num_active = bits.count();
+        } else {
+            for (std::size_t i = 0; i < thread_lists.size(); i++) {
+                list.insert(list.end(), thread_lists[i].begin(), thread_lists[i].end());
+            }
+            std::sort(list.begin(), list.end());    // sweep in vertex id order
+            num_active = list.size();
+        }
+        for (std::size_t i = 0; i < thread_lists.size(); i++) {
+            thread_lists[i].clear();
+            overflowed[i] = 0;
+        }
+    }
+
+    // called by one thread while no inserts happen.
+    void clear() {
+        bits.clear_all();
+        list.clear();
+        for (std::size_t i = 0; i < thread_lists.size(); i++) {
+            thread_lists[i].clear();
+            overflowed[i] = 0;
+        }
+        dense = false;
+        num_active = 0;
+    }
+
+    bool contains(vertex_id_type vid) const { return bits.test(vid); }
+
+    bool is_dense() const { return dense; }
+
+    // after finalize()
+    std::size_t size() const { return num_active; }
+
+    // i'th active vertex of a sparse frontier, in increasing id order.
+    vertex_id_type operator[](std::size_t i) const { return list[i]; }
+
+private:
+    atomic_bitset bits;
+    std::vector<std::vector<vertex_id_type> > thread_lists;
+    std::vector<char> overflowed;
+    std::size_t thread_limit;   // not const so that frontiers can be swapped
+
+    std::vector<vertex_id_type> list;   // the sparse representation
+    bool dense;
+    std::size_t num_active;
+};
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * The gather cache of the engines (GraphLab's delta caching).
+ *
+ * A vertex program that keeps its neighbours' cached gathers up to date with
+ * context.post_delta() turns the next gather of those neighbours into a
+ * lookup. context.clear_gather_cache() forces a full gather instead.
+ *
+ * post_delta() is called by the scatters of all the in neighbours of a
+ * vertex, which may run concurrently. Every entry has its own spinlock and
+ * takes up a whole cache line, so that deltas posted to consecutive vertices
+ * by different threads do not contend for the same line. That is 64 bytes
+ * per vertex (more for big gather types), which is why it is only allocated
+ * when caching is enabled.
+ *
+ * A delta posted to a vertex without a cached value is dropped, the next
+ * gather computes the sum from scratch.
+ */
+
+#ifndef __GATHER_CACHE_H
+#define __GATHER_CACHE_H
+
+#include "spinlock.hpp"
+
+#include <vector>
+#include <cstddef>
+
+template<typename GatherType>
+class gather_cache {
+public:
+    typedef GatherType gather_type;
+
+    gather_cache() {}
+
+    explicit gather_cache(std::size_t num_vertices): entries(num_vertices) {}
+
+    // copies the cached value of vid to ret. Returns false if there is none.
+    bool get(std::size_t vid, gather_type& ret) {
+        entry& e = entries[vid];
+        e.lock.lock();
+        const bool valid = e.valid;
+        if (valid) {
+            ret = e.value;
+        }
+        e.lock.unlock();
+        return valid;
+    }
+
+    void set(std::size_t vid, const gather_type& value) {
+        entry& e = entries[vid];
+        e.lock.lock();
+        e.value = value;
+        e.valid = true;
+        e.lock.unlock();
+    }
+
+    void post_delta(std::size_t vid, const gather_type& delta) {
+        entry& e = entries[vid];
+        e.lock.lock();
+        if (e.valid) {
+            e.value += delta;
+        }
+        e.lock.unlock();
+    }
+
+    void invalidate(std::size_t vid) {
+        entry& e = entries[vid];
+        e.lock.lock();
+        e.valid = false;
+        e.lock.unlock();
+    }
+
+private:
+    struct alignas(64) entry {
+        spinlock lock;
+        bool valid;
+        gather_type value;
+
+        entry(): valid(false), value() {}
+    };
+
+    std::vector<entry> entries;
+};
+
+#endif
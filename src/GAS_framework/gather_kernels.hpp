@@ -0,0 +1,126 @@
+/**
+ * A gather over the in edges of a csr_graph vertex that runs on the arrays of
+ * the graph instead of the edge_type handles.
+ *
+ * Vertex programs opt in by defining, next to gather,
+ *
+ * \code
+ * gather_type gather_source(const vertex_data_type& source_data, int source_num_out_edges,
+ *                           const edge_data_type& edge_data) const;
+ * \endcode
+ *
+ * which must return what gather returns for an in edge with that source and
+ * edge data, and must not depend on anything else of the edge or on the
+ * context. PageRank's and SSSP's gathers are of that form.
+ *
+ * The kernel then only touches the arrays it needs: in_sources, vdata and
+ * out_offsets of the sources (for the out degree), and edata through
+ * in_to_out only if the edge data is not graphlab::empty. The values are
+ * reduced into LANES independent accumulators that are combined at the end,
+ * so the loop has no dependency from one edge to the next and the compiler
+ * can keep LANES edges in flight (and vectorize it for arithmetic gather
+ * types, e.g. with -O3 -march=native). The order of the += calls differs from
+ * the edge order, which changes the rounding of floating point sums.
+ */
+
+#ifndef __GATHER_KERNELS_H
+#define __GATHER_KERNELS_H
+
+#include "csr_graph.hpp"
+
+#include <utility>    // declval
+
+/**
+ * has_source_gather<VertexProgram>::value is true if VertexProgram defines
+ * gather_source as above.
+ */
+template<typename VertexProgram, typename = void>
+struct has_source_gather {
+    static constexpr bool value = false;
+};
+
+template<typename VertexProgram>
+struct has_source_gather<VertexProgram, decltype((void) std::declval<const VertexProgram&>().gather_source(
+        std::declval<const typename VertexProgram::vertex_data_type&>(), 0,
+        std::declval<const typename VertexProgram::edge_data_type&>()))> {
+    static constexpr bool value = true;
+};
+
+template<typename VertexData, typename EdgeData, typename VertexIdType>
+struct csr_gather_kernels {
+    typedef csr_graph<VertexData, EdgeData, VertexIdType> graph_type;
+    typedef typename graph_type::vertex_id_type vertex_id_type;
+    typedef typename graph_type::edge_id_type edge_id_type;
+
+    enum { LANES = 4 };
+
+    /**
+     * Adds the gathers over the in edges of vid to accum, as the engines'
+     * gather loops do: the first value is assigned if accum_is_set is false.
+     */
+    template<typename VertexProgram, typename GatherType>
+    static void gather_in_edges(const VertexProgram& vprog, graph_type& g, vertex_id_type vid,
+                                GatherType& accum, bool& accum_is_set) {
+        if (g.compressed) {
+            // the ids can only be decoded in order. No lanes, the decoding is the bottleneck anyway.
+            g.for_in_neighbours(vid, [&](edge_id_type in_idx, vertex_id_type source) {
+                if (accum_is_set) {
+                    accum += value(vprog, g, in_idx, source);
+                } else {
+                    accum = value(vprog, g, in_idx, source);
+                    accum_is_set = true;
+                }
+            });
+            return;
+        }
+        const edge_id_type begin = g.in_offsets[vid];
+        const edge_id_type end = g.in_offsets[vid + 1];
+        edge_id_type i = begin;
+
+        if (end - begin >= (edge_id_type) LANES) {
+            GatherType lane[LANES];
+            for (int l = 0; l < LANES; l++) {
+                lane[l] = value(vprog, g, i + l);
+            }
+            for (i += LANES; i + LANES <= end; i += LANES) {
+                for (int l = 0; l < LANES; l++) {
+                    lane[l] += value(vprog, g, i + l);
+                }
+            }
+            for (int l = 1; l < LANES; l++) {
+                lane[0] += lane[l];
+            }
+            if (accum_is_set) {
+                accum += lane[0];
+            } else {
+                accum = lane[0];
+                accum_is_set = true;
+            }
+        }
+        for (; i < end; i++) {
+            if (accum_is_set) {
+                accum += value(vprog, g, i);
+            } else {
+                accum = value(vprog, g, i);
+                accum_is_set = true;
+            }
+        }
+    }
+
+private:
+    // the gather over the in edge at index in_idx of the CSC arrays.
+    template<typename VertexProgram>
+    static typename VertexProgram::gather_type value(const VertexProgram& vprog, graph_type& g, edge_id_type in_idx) {
+        return value(vprog, g, in_idx, g.in_sources[in_idx]);
+    }
+
+    template<typename VertexProgram>
+    static typename VertexProgram::gather_type value(const VertexProgram& vprog, graph_type& g, edge_id_type in_idx,
+                                                     vertex_id_type source) {
+        const int source_num_out_edges = g.out_offsets[source + 1] - g.out_offsets[source];
+        // for graphlab::empty, edata ignores the index and the load of in_to_out is dropped.
+        return vprog.gather_source(g.vdata[source], source_num_out_edges, g.edata[g.in_to_out[in_idx]]);
+    }
+};
+
+#endif
@@ -0,0 +1,483 @@
+/**
+ * Builds a csr_graph from an edge list in one shot.
+ *
+ * Graph::add_edge scans the target's out edges to set has_opposite, which
+ * makes loading quadratic in the degree. The builder instead buffers edges
+ * (one buffer per ingesting thread, so threads never share a buffer) and
+ * does all of the work in finalize():
+ *
+ *  1. partition: edges are bucketed by source vertex range, one bucket per thread.
+ *  2. sort:      each bucket is sorted by (source, target) in parallel.
+ *  3. dedup:     duplicate and self edges are dropped and the out side (CSR) is filled.
+ *  4. transpose: the in side (CSC) is built by bucketing and sorting (target, source).
+ *  5. opposite:  has_opposite is set with a merge pass over the sorted out and
+ *                in neighbour lists of each vertex.
+ *
+ * Out and in neighbour lists of the resulting graph are sorted by vertex id.
+ * When duplicate edges are added, the data of one of them is kept.
+ */
+
+#ifndef __GRAPH_BUILDER_H
+#define __GRAPH_BUILDER_H
+
+#include "csr_graph.hpp"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <stdint.h>
+
+template<typename VertexData, typename EdgeData, typename VertexIdType = int>
+class csr_graph_builder {
+public:
+    // ---------------------------------------- //
+    // ---------------- TYPES ----------------- //
+    // ---------------------------------------- //
+    typedef csr_graph<VertexData, EdgeData, VertexIdType> graph_type;
+    typedef typename graph_type::vertex_id_type vertex_id_type;
+    typedef typename graph_type::edge_id_type edge_id_type;
+
+    struct edge_record {
+        vertex_id_type source;
+        vertex_id_type target;
+        EdgeData data;
+
+        bool operator<(const edge_record& other) const {
+            return source < other.source || (source == other.source && target < other.target);
+        }
+    };
+
+    /**
+     * Wall-clock time spent in each phase, in seconds.
+     * ingest is only measured for ingest_lines().
+     */
+    struct build_timings {
+        double ingest;
+        double partition;
+        double sort;
+        double dedup;
+        double transpose;
+        double opposite;
+        double finalize;    // total of the phases in finalize()
+
+        build_timings(): ingest(0), partition(0), sort(0), dedup(0), transpose(0), opposite(0), finalize(0) {}
+    };
+
+    // ---------------------------------------- //
+    // --------------- METHODS ---------------- //
+    // ---------------------------------------- //
+
+    /**
+     * Vertices that are not added explicitly (but appear in an edge, or fall
+     * in a gap of the id range) get default_vdata.
+     */
+    csr_graph_builder(int num_threads = 1, const VertexData& default_vdata = VertexData())
+        : num_threads(std::max(num_threads, 1)), default_vdata(default_vdata),
+          edge_buffers(this->num_threads), vertex_buffers(this->num_threads) {}
+
+    /**
+     * add_vertex and add_edge may be called concurrently as long as each
+     * calling thread uses its own thread_id in [0, num_threads).
+     * Returns false if vid is negative.
+     */
+    bool add_vertex(vertex_id_type vid, const VertexData& vdata = VertexData(), int thread_id = 0) {
+        if (vid < 0) {
+            return false;
+        }
+        vertex_buffers[thread_id].push_back(std::make_pair(vid, vdata));
+        return true;
+    }
+
+    // returns false if a vid is negative. Self edges are accepted here and dropped in finalize().
+    bool add_edge(vertex_id_type source, vertex_id_type target,
+                  const EdgeData& edata = EdgeData(), int thread_id = 0) {
+        if (source < 0 || target < 0) {
+            return false;
+        }
+        edge_record e;
+        e.source = source;
+        e.target = target;
+        e.data = edata;
+        edge_buffers[thread_id].push_back(e);
+        return true;
+    }
+
+    /**
+     * Reads the whole file into memory and splits it into num_threads
+     * contiguous ranges of lines. Each line is passed to
+     * parse_line(thread_id, line_begin, line_end) from the thread that
+     * owns its range, which is expected to call add_vertex/add_edge with
+     * that thread_id. Returns false if the file can not be opened.
+     */
+    template<typename LineParser>
+    bool ingest_lines(const std::string& filename, LineParser parse_line) {
+        timer t;
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::string contents(file.tellg(), '\0');
+        file.seekg(0);
+        file.read(&contents[0], contents.size());
+        file.close();
+
+        const char *begin = contents.data();
+        const char *end = begin + contents.size();
+        // split points are moved forward to the next line start.
+        std::vector<const char *> splits(num_threads + 1, end);
+        splits[0] = begin;
+        for (int i = 1; i < num_threads; i++) {
+            const char *p = begin + contents.size() * i / num_threads;
+            p = std::max(p, splits[i - 1]);
+            while (p < end && p > begin && *(p - 1) != '\n') {
+                p++;
+            }
+            splits[i] = p;
+        }
+
+        parallel_for([&](int thread_id) {
+            const char *line = splits[thread_id];
+            while (line < splits[thread_id + 1]) {
+                const char *line_end = std::find(line, splits[thread_id + 1], '\n');
+                parse_line(thread_id, line, line_end);
+                line = line_end + 1;
+            }
+        });
+        timings.ingest = t.seconds();
+        return true;
+    }
+
+    /**
+     * Parses a line of the adjacency list text format used by the sample
+     * programs, "vid neigh_vid neigh_vid ...", and adds the vertex with
+     * default_vdata and its edges, so vertices without edges are kept.
+     * Returns the vid of the line or vertex_id_type(-1) if the line is empty.
+     */
+    vertex_id_type add_adjacency_line(const char *line, const char *line_end, int thread_id = 0) {
+        char *pos;
+        const vertex_id_type vid = strtol(line, &pos, 10);
+        if (pos == line || pos > line_end) {
+            return -1;
+        }
+        add_vertex(vid, default_vdata, thread_id);
+        while (pos < line_end) {
+            const char *prev = pos;
+            const vertex_id_type neigh_vid = strtol(pos, &pos, 10);
+            if (pos == prev || pos > line_end) {  // strtol skips to the next line if this one is done
+                break;
+            }
+            add_edge(vid, neigh_vid, EdgeData(), thread_id);
+        }
+        return vid;
+    }
+
+    /**
+     * Same as add_adjacency_line for lines of the form
+     * "vid neigh_vid weight neigh_vid weight ...". EdgeData is constructed from the weight.
+     * A neighbour without a weight ends the line.
+     */
+    vertex_id_type add_weighted_adjacency_line(const char *line, const char *line_end, int thread_id = 0) {
+        char *pos;
+        const vertex_id_type vid = strtol(line, &pos, 10);
+        if (pos == line || pos > line_end) {
+            return -1;
+        }
+        add_vertex(vid, default_vdata, thread_id);
+        while (pos < line_end) {
+            const char *prev = pos;
+            const vertex_id_type neigh_vid = strtol(pos, &pos, 10);
+            if (pos == prev || pos > line_end) {
+                break;
+            }
+            const char *weight_begin = pos;
+            const long weight = strtol(pos, &pos, 10);
+            if (pos == weight_begin || pos > line_end) {
+                break;
+            }
+            add_edge(vid, neigh_vid, EdgeData(weight), thread_id);
+        }
+        return vid;
+    }
+
+    /**
+     * Builds the graph from everything added so far and clears the builder.
+     */
+    graph_type finalize() {
+        timer total_timer;
+        timer t;
+        graph_type g;
+
+        // --- number of vertices: one past the largest vid seen
+        vertex_id_type num_v = 0;
+        for (int i = 0; i < num_threads; i++) {
+            for (size_t j = 0; j < vertex_buffers[i].size(); j++) {
+                num_v = std::max(num_v, vertex_buffers[i][j].first + 1);
+            }
+            for (size_t j = 0; j < edge_buffers[i].size(); j++) {
+                num_v = std::max(num_v, std::max(edge_buffers[i][j].source, edge_buffers[i][j].target) + 1);
+            }
+        }
+
+        g.vdata.assign(num_v, default_vdata);
+        for (int i = 0; i < num_threads; i++) {
+            for (size_t j = 0; j < vertex_buffers[i].size(); j++) {
+                g.vdata[vertex_buffers[i][j].first] = vertex_buffers[i][j].second;
+            }
+            std::vector<std::pair<vertex_id_type, VertexData> >().swap(vertex_buffers[i]);
+        }
+
+        // --- 1. partition edges into per-thread source ranges
+        std::vector<edge_record> edges;
+        std::vector<size_t> bucket_begin;
+        bucket_by_vertex(edge_buffers, num_v, edges, bucket_begin,
+                         [](const edge_record& e) { return e.source; });
+        for (int i = 0; i < num_threads; i++) {
+            std::vector<edge_record>().swap(edge_buffers[i]);
+        }
+        timings.partition = t.seconds();
+
+        // --- 2. sort each bucket by (source, target)
+        t.reset();
+        parallel_for([&](int b) {
+            std::sort(edges.begin() + bucket_begin[b], edges.begin() + bucket_begin[b + 1]);
+        });
+        timings.sort = t.seconds();
+
+        // --- 3. drop duplicates and self edges, fill the out side
+        t.reset();
+        std::vector<size_t> bucket_kept(num_threads + 1, 0);
+        parallel_for([&](int b) {
+            size_t kept = bucket_begin[b];
+            for (size_t i = bucket_begin[b]; i < bucket_begin[b + 1]; i++) {
+                const edge_record& e = edges[i];
+                if (e.source == e.target) {
+                    continue;
+                }
+                if (kept > bucket_begin[b] && edges[kept - 1].source == e.source
+                                           && edges[kept - 1].target == e.target) {
+                    continue;
+                }
+                edges[kept++] = e;
+            }
+            bucket_kept[b + 1] = kept - bucket_begin[b];
+        });
+        for (int b = 0; b < num_threads; b++) {
+            bucket_kept[b + 1] += bucket_kept[b];   // now the first out edge id of each bucket
+        }
+        const size_t num_e = bucket_kept[num_threads];
+
+        g.out_offsets.assign(num_v + 1, 0);
+        g.out_targets.resize(num_e);
+        g.edata.resize(num_e);
+        g.opposite.assign(num_e, 0);
+        parallel_for([&](int b) {
+            edge_id_type eid = bucket_kept[b];
+            const size_t src_begin = bucket_begin[b];
+            const size_t src_end = src_begin + (bucket_kept[b + 1] - bucket_kept[b]);
+            size_t i = src_begin;
+            for (vertex_id_type v = range_begin(b, num_v); v < range_begin(b + 1, num_v); v++) {
+                g.out_offsets[v] = eid;
+                while (i < src_end && edges[i].source == v) {
+                    g.out_targets[eid] = edges[i].target;
+                    g.edata[eid] = edges[i].data;
+                    eid++;
+                    i++;
+                }
+            }
+        });
+        g.out_offsets[num_v] = num_e;
+        std::vector<edge_record>().swap(edges);
+        timings.dedup = t.seconds();
+
+        // --- 4. transpose into the in side
+        t.reset();
+        transpose(g, num_v);
+        timings.transpose = t.seconds();
+
+        // --- 5. has_opposite merge pass
+        t.reset();
+        parallel_for([&](int b) {
+            for (vertex_id_type v = range_begin(b, num_v); v < range_begin(b + 1, num_v); v++) {
+                // u -> v has an opposite iff u is also an in neighbour of v. Both lists are sorted.
+                edge_id_type in_idx = g.in_offsets[v];
+                const edge_id_type in_end = g.in_offsets[v + 1];
+                for (edge_id_type eid = g.out_offsets[v]; eid < g.out_offsets[v + 1]; eid++) {
+                    while (in_idx < in_end && g.in_sources[in_idx] < g.out_targets[eid]) {
+                        in_idx++;
+                    }
+                    g.opposite[eid] = (in_idx < in_end && g.in_sources[in_idx] == g.out_targets[eid]);
+                }
+            }
+        });
+        timings.opposite = t.seconds();
+
+        timings.finalize = total_timer.seconds();
+        return g;
+    }
+
+    const build_timings& get_timings() const {
+        return timings;
+    }
+
+    void print_timings(std::ostream& out) const {
+        out << "Graph load time: " << timings.ingest + timings.finalize << " s" << std::endl;
+        out << "  ingest:    " << timings.ingest << " s" << std::endl;
+        out << "  partition: " << timings.partition << " s" << std::endl;
+        out << "  sort:      " << timings.sort << " s" << std::endl;
+        out << "  dedup:     " << timings.dedup << " s" << std::endl;
+        out << "  transpose: " << timings.transpose << " s" << std::endl;
+        out << "  opposite:  " << timings.opposite << " s" << std::endl;
+    }
+
+private:
+    // ---------------------------------------- //
+    // ------------ INTERNAL TYPES ------------ //
+    // ---------------------------------------- //
+    struct in_edge_record {
+        vertex_id_type target;
+        vertex_id_type source;
+        edge_id_type eid;
+
+        bool operator<(const in_edge_record& other) const {
+            return target < other.target || (target == other.target && source < other.source);
+        }
+    };
+
+    struct timer {
+        std::chrono::steady_clock::time_point start;
+        timer(): start(std::chrono::steady_clock::now()) {}
+        void reset() { start = std::chrono::steady_clock::now(); }
+        double seconds() const {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    };
+
+    // ---------------------------------------- //
+    // ------------- DATA MEMBERS ------------- //
+    // ---------------------------------------- //
+    const int num_threads;
+    VertexData default_vdata;
+
+    std::vector<std::vector<edge_record> > edge_buffers;   // one per ingesting thread
+    std::vector<std::vector<std::pair<vertex_id_type, VertexData> > > vertex_buffers;
+
+    build_timings timings;
+
+    // ---------------------------------------- //
+    // ---------- INTERNAL FUNCTIONS ---------- //
+    // ---------------------------------------- //
+
+    // runs fn(thread_id) on num_threads threads and waits for all of them.
+    template<typename Fn>
+    void parallel_for(Fn fn) {
+        std::vector<std::thread> threads;
+        for (int i = 1; i < num_threads; i++) {
+            threads.push_back(std::thread(fn, i));
+        }
+        fn(0);
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i].join();
+        }
+    }
+
+    // the vertex range of bucket b is [range_begin(b), range_begin(b + 1))
+    vertex_id_type range_begin(int b, vertex_id_type num_v) const {
+        return (vertex_id_type) (((uint64_t) b * num_v + num_threads - 1) / num_threads);
+    }
+
+    int bucket_of(vertex_id_type vid, vertex_id_type num_v) const {
+        return (int) ((uint64_t) vid * num_threads / num_v);
+    }
+
+    /**
+     * Concatenates inputs into out so that records whose key falls into the
+     * vertex range of bucket b are in out[bucket_begin[b] .. bucket_begin[b + 1]).
+     * Each input is counted and scattered by its own thread.
+     */
+    template<typename Record, typename KeyFn>
+    void bucket_by_vertex(const std::vector<std::vector<Record> >& inputs, vertex_id_type num_v,
+                          std::vector<Record>& out, std::vector<size_t>& bucket_begin, KeyFn key) {
+        const int num_inputs = inputs.size();
+        // counts[i][b]: number of records of input i in bucket b. Turned into write positions below.
+        std::vector<std::vector<size_t> > counts(num_inputs, std::vector<size_t>(num_threads, 0));
+        parallel_for([&](int t) {
+            for (int i = t; i < num_inputs; i += num_threads) {
+                for (size_t j = 0; j < inputs[i].size(); j++) {
+                    counts[i][bucket_of(key(inputs[i][j]), num_v)]++;
+                }
+            }
+        });
+
+        bucket_begin.assign(num_threads + 1, 0);
+        size_t pos = 0;
+        for (int b = 0; b < num_threads; b++) {
+            bucket_begin[b] = pos;
+            for (int i = 0; i < num_inputs; i++) {
+                size_t c = counts[i][b];
+                counts[i][b] = pos;
+                pos += c;
+            }
+        }
+        bucket_begin[num_threads] = pos;
+
+        out.resize(pos);
+        parallel_for([&](int t) {
+            for (int i = t; i < num_inputs; i += num_threads) {
+                for (size_t j = 0; j < inputs[i].size(); j++) {
+                    out[counts[i][bucket_of(key(inputs[i][j]), num_v)]++] = inputs[i][j];
+                }
+            }
+        });
+    }
+
+    // builds in_offsets, in_sources and in_to_out from the out side of g.
+    void transpose(graph_type& g, vertex_id_type num_v) {
+        // one input per source range, so that each thread reads its own part of the out side.
+        std::vector<std::vector<in_edge_record> > inputs(num_threads);
+        parallel_for([&](int b) {
+            const edge_id_type first = g.out_offsets[range_begin(b, num_v)];
+            const edge_id_type last = g.out_offsets[range_begin(b + 1, num_v)];
+            inputs[b].reserve(last - first);
+            for (vertex_id_type v = range_begin(b, num_v); v < range_begin(b + 1, num_v); v++) {
+                for (edge_id_type eid = g.out_offsets[v]; eid < g.out_offsets[v + 1]; eid++) {
+                    in_edge_record r;
+                    r.target = g.out_targets[eid];
+                    r.source = v;
+                    r.eid = eid;
+                    inputs[b].push_back(r);
+                }
+            }
+        });
+
+        std::vector<in_edge_record> in_edges;
+        std::vector<size_t> bucket_begin;
+        bucket_by_vertex(inputs, num_v, in_edges, bucket_begin,
+                         [](const in_edge_record& r) { return r.target; });
+        std::vector<std::vector<in_edge_record> >().swap(inputs);
+
+        const size_t num_e = in_edges.size();
+        g.in_offsets.assign(num_v + 1, 0);
+        g.in_sources.resize(num_e);
+        g.in_to_out.resize(num_e);
+        parallel_for([&](int b) {
+            std::sort(in_edges.begin() + bucket_begin[b], in_edges.begin() + bucket_begin[b + 1]);
+            size_t i = bucket_begin[b];
+            for (vertex_id_type v = range_begin(b, num_v); v < range_begin(b + 1, num_v); v++) {
+                g.in_offsets[v] = i;
+                while (i < bucket_begin[b + 1] && in_edges[i].target == v) {
+                    g.in_sources[i] = in_edges[i].source;
+                    g.in_to_out[i] = in_edges[i].eid;
+                    i++;
+                }
+            }
+        });
+        g.in_offsets[num_v] = num_e;
+    }
+};
+
+#endif
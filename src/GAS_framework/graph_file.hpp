@@ -0,0 +1,347 @@
+/**
+ * A binary on-disk format for csr_graph that can be memory-mapped and used
+ * in place, without parsing or copying.
+ *
+ * Layout (native byte order, every section starts at an 8-byte boundary):
+ *
+ *   graph_file_header
+ *   out_offsets   (num_vertices + 1) * edge_id_size
+ *   out_targets   num_edges * vertex_id_size
+ *   opposite      num_edges bytes
+ *   in_offsets    (num_vertices + 1) * edge_id_size
+ *   in_sources    num_edges * vertex_id_size
+ *   in_to_out     num_edges * edge_id_size
+ *   edata         num_edges * edge_data_size (absent if edge_data_size == 0)
+ *   vdata         num_vertices * vertex_data_size (initial vertex data, absent if 0)
+ *
+ * Checkpoints of async_engine (see checkpoint.hpp) are graph files with the
+ * vertex and edge data of the snapshot and the state of the engine in five
+ * more sections, which are absent (empty) unless has_engine_state is set:
+ *
+ *   active        num_vertices bytes, 1 if the vertex is active
+ *   has_message   num_vertices bytes
+ *   messages      num_vertices * message_data_size
+ *   has_cache     num_vertices bytes (absent if gather_data_size == 0)
+ *   gather_cache  num_vertices * gather_data_size, the cached gathers
+ *
+ * The header records the byte offset of each section, so later versions
+ * may add sections without breaking the loader for this one. Version 1 files
+ * (without the fields after the first eight section offsets) still load.
+ *
+ * Vertex and edge data are written with their in-memory representation, so
+ * only trivially copyable types can be stored.
+ *
+ * Graphs with compressed neighbour lists are written with plain ones.
+ *
+ * The file is mapped MAP_PRIVATE, i.e. changes made by vertex programs to
+ * vertex and edge data are copy-on-write and never reach the file.
+ */
+
+#ifndef __GRAPH_FILE_H
+#define __GRAPH_FILE_H
+
+#include "csr_graph.hpp"
+#include "../graphlab/util/empty.hpp"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <memory>
+#include <cstring>
+#include <cstddef>     // offsetof
+#include <algorithm>   // min
+#include <stdint.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+struct graph_file_header {
+    enum { NUM_GRAPH_SECTIONS = 8, NUM_SECTIONS = 13 };
+    enum section_type {
+        OUT_OFFSETS = 0, OUT_TARGETS, OPPOSITE, IN_OFFSETS, IN_SOURCES, IN_TO_OUT, EDATA, VDATA,
+        ACTIVE, HAS_MESSAGE, MESSAGES, HAS_CACHE, GATHER_CACHE  // engine state
+    };
+
+    char magic[8];              // GRAPH_FILE_MAGIC
+    uint32_t version;           // GRAPH_FILE_VERSION
+    uint32_t header_size;       // sizeof(graph_file_header) of the writer
+    uint64_t num_vertices;
+    uint64_t num_edges;
+    uint32_t vertex_id_size;
+    uint32_t edge_id_size;
+    uint32_t vertex_data_size;  // 0 for graphlab::empty
+    uint32_t edge_data_size;    // 0 for graphlab::empty
+    uint64_t section_offset[NUM_SECTIONS];   // from the beginning of the file
+    // version 2
+    uint32_t has_engine_state;  // the last five sections are present
+    uint32_t complete;          // 0 while a checkpoint is written into the file
+    uint64_t checkpoint_epoch;  // of the snapshot, see checkpoint.hpp
+    uint32_t message_data_size;
+    uint32_t gather_data_size;  // 0 if no gathers are cached
+};
+
+// the size of a version 1 header, which ends after the graph sections' offsets.
+#define GRAPH_FILE_V1_HEADER_SIZE   (offsetof(graph_file_header, section_offset) + 8 * graph_file_header::NUM_GRAPH_SECTIONS)
+
+#define GRAPH_FILE_MAGIC    "GASCSR\0"
+#define GRAPH_FILE_VERSION  2
+
+/**
+ * The engine state sections of a checkpoint, one entry per vertex in each
+ * array, see checkpoint.hpp.
+ */
+struct graph_file_engine_state {
+    uint64_t checkpoint_epoch;
+    uint32_t message_data_size;
+    uint32_t gather_data_size;
+    const void *sections[graph_file_header::NUM_SECTIONS - graph_file_header::NUM_GRAPH_SECTIONS];
+};
+
+class graph_file {
+public:
+    /**
+     * Writes g to filename. Throws std::runtime_error on failure.
+     */
+    template<typename VertexData, typename EdgeData, typename VertexIdType>
+    static void save(csr_graph<VertexData, EdgeData, VertexIdType>& g, const std::string& filename) {
+        save(g, filename, g.vdata.data(), g.edata.data(), NULL);
+    }
+
+    /**
+     * Writes the structure of g with the vertex data vdata and the edge data
+     * edata (in out edge order) instead of g's, and the engine state sections
+     * of state if it is not null. The file is complete, see
+     * graph_file_header::complete. Throws std::runtime_error on failure.
+     */
+    template<typename VertexData, typename EdgeData, typename VertexIdType>
+    static void save(csr_graph<VertexData, EdgeData, VertexIdType>& g, const std::string& filename,
+                     const VertexData *vdata, const EdgeData *edata, const graph_file_engine_state *state) {
+        typedef csr_graph<VertexData, EdgeData, VertexIdType> graph_type;
+        check_storable<VertexData>();
+        check_storable<EdgeData>();
+
+        graph_file_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, GRAPH_FILE_MAGIC, sizeof(header.magic));
+        header.version = GRAPH_FILE_VERSION;
+        header.header_size = sizeof(graph_file_header);
+        header.num_vertices = g.num_vertices();
+        header.num_edges = g.num_edges();
+        header.vertex_id_size = sizeof(typename graph_type::vertex_id_type);
+        header.edge_id_size = sizeof(typename graph_type::edge_id_type);
+        header.vertex_data_size = data_size<VertexData>();
+        header.edge_data_size = data_size<EdgeData>();
+        header.complete = 1;
+        if (state != NULL) {
+            header.has_engine_state = 1;
+            header.checkpoint_epoch = state->checkpoint_epoch;
+            header.message_data_size = state->message_data_size;
+            header.gather_data_size = state->gather_data_size;
+        }
+
+        // the file always has plain neighbour arrays.
+        std::vector<typename graph_type::vertex_id_type> out_targets, in_sources;
+        if (g.compressed) {
+            decompress(g, out_targets, in_sources);
+        }
+
+        const void *sections[graph_file_header::NUM_SECTIONS];
+        uint64_t sizes[graph_file_header::NUM_SECTIONS];
+        sections[graph_file_header::OUT_OFFSETS] = g.out_offsets.data();
+        sections[graph_file_header::OUT_TARGETS] = g.compressed ? out_targets.data() : g.out_targets.data();
+        sections[graph_file_header::OPPOSITE] = g.opposite.data();
+        sections[graph_file_header::IN_OFFSETS] = g.in_offsets.data();
+        sections[graph_file_header::IN_SOURCES] = g.compressed ? in_sources.data() : g.in_sources.data();
+        sections[graph_file_header::IN_TO_OUT] = g.in_to_out.data();
+        sections[graph_file_header::EDATA] = edata;
+        sections[graph_file_header::VDATA] = vdata;
+        for (int i = graph_file_header::NUM_GRAPH_SECTIONS; i < graph_file_header::NUM_SECTIONS; i++) {
+            sections[i] = state != NULL ? state->sections[i - graph_file_header::NUM_GRAPH_SECTIONS] : NULL;
+        }
+        section_sizes(header, sizes);
+
+        uint64_t offset = align(sizeof(graph_file_header));
+        for (int i = 0; i < graph_file_header::NUM_SECTIONS; i++) {
+            header.section_offset[i] = offset;
+            offset = align(offset + sizes[i]);
+        }
+
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            throw std::runtime_error("can not open " + filename + " for writing");
+        }
+        out.write((const char *) &header, sizeof(header));
+        uint64_t written = sizeof(header);
+        const char padding[8] = {0};
+        for (int i = 0; i < graph_file_header::NUM_SECTIONS; i++) {
+            out.write(padding, header.section_offset[i] - written);
+            out.write((const char *) sections[i], sizes[i]);
+            written = header.section_offset[i] + sizes[i];
+        }
+        if (!out.good()) {
+            throw std::runtime_error("failed writing " + filename);
+        }
+    }
+
+    /**
+     * Maps filename into memory and returns a csr_graph whose arrays point
+     * into the mapping. Throws std::runtime_error if the file can not be
+     * mapped or was not written for this graph type (which includes the
+     * width of the vertex ids).
+     */
+    template<typename VertexData, typename EdgeData, typename VertexIdType = int>
+    static csr_graph<VertexData, EdgeData, VertexIdType> load(const std::string& filename) {
+        typedef csr_graph<VertexData, EdgeData, VertexIdType> graph_type;
+        typedef typename graph_type::vertex_id_type vertex_id_type;
+        typedef typename graph_type::edge_id_type edge_id_type;
+
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("can not open " + filename);
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t) sizeof(graph_file_header)) {
+            close(fd);
+            throw std::runtime_error(filename + " is not a graph file");
+        }
+        const size_t file_size = file_stat.st_size;
+        void *addr = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);  // the mapping stays valid
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error("can not map " + filename);
+        }
+        std::shared_ptr<void> mapping(addr, [file_size](void *p) { munmap(p, file_size); });
+
+        char *base = (char *) addr;
+        const graph_file_header header = parse_header(base, file_size, filename);
+        if (header.vertex_id_size != sizeof(vertex_id_type)
+            || header.edge_id_size != sizeof(edge_id_type)
+            || header.vertex_data_size != data_size<VertexData>()
+            || header.edge_data_size != data_size<EdgeData>()) {
+            throw std::runtime_error(filename + " was written for a different graph type");
+        }
+        const size_t num_v = header.num_vertices;
+        const size_t num_e = header.num_edges;
+        graph_type g;
+        g.out_offsets.view((edge_id_type *) (base + header.section_offset[graph_file_header::OUT_OFFSETS]), num_v + 1);
+        g.out_targets.view((vertex_id_type *) (base + header.section_offset[graph_file_header::OUT_TARGETS]), num_e);
+        g.opposite.view((unsigned char *) (base + header.section_offset[graph_file_header::OPPOSITE]), num_e);
+        g.in_offsets.view((edge_id_type *) (base + header.section_offset[graph_file_header::IN_OFFSETS]), num_v + 1);
+        g.in_sources.view((vertex_id_type *) (base + header.section_offset[graph_file_header::IN_SOURCES]), num_e);
+        g.in_to_out.view((edge_id_type *) (base + header.section_offset[graph_file_header::IN_TO_OUT]), num_e);
+        g.edata.view((EdgeData *) (base + header.section_offset[graph_file_header::EDATA]), num_e);
+        g.vdata.view((VertexData *) (base + header.section_offset[graph_file_header::VDATA]), num_v);
+        g.mapping = mapping;
+        return g;
+    }
+
+    /**
+     * Reads and checks the header of the graph file filename, of any graph
+     * type. Throws std::runtime_error if it is not a graph file or truncated.
+     */
+    static graph_file_header read_header(const std::string& filename) {
+        std::ifstream in(filename, std::ios::binary);
+        if (!in.is_open()) {
+            throw std::runtime_error("can not open " + filename);
+        }
+        in.seekg(0, std::ios::end);
+        const uint64_t file_size = in.tellg();
+        std::vector<char> buf(std::min<uint64_t>(file_size, sizeof(graph_file_header)));
+        in.seekg(0);
+        in.read(buf.data(), buf.size());
+        if (!in.good()) {
+            throw std::runtime_error(filename + " is not a graph file");
+        }
+        return parse_header(buf.data(), file_size, filename, buf.size());
+    }
+
+    // sizes[i] is the size in bytes of section i of a file with header.
+    static void section_sizes(const graph_file_header& header, uint64_t sizes[]) {
+        const uint64_t num_v = header.num_vertices;
+        const uint64_t num_e = header.num_edges;
+        const uint64_t num_state_v = header.has_engine_state ? num_v : 0;
+        sizes[graph_file_header::OUT_OFFSETS] = (num_v + 1) * header.edge_id_size;
+        sizes[graph_file_header::OUT_TARGETS] = num_e * header.vertex_id_size;
+        sizes[graph_file_header::OPPOSITE] = num_e;
+        sizes[graph_file_header::IN_OFFSETS] = (num_v + 1) * header.edge_id_size;
+        sizes[graph_file_header::IN_SOURCES] = num_e * header.vertex_id_size;
+        sizes[graph_file_header::IN_TO_OUT] = num_e * header.edge_id_size;
+        sizes[graph_file_header::EDATA] = num_e * header.edge_data_size;
+        sizes[graph_file_header::VDATA] = num_v * header.vertex_data_size;
+        sizes[graph_file_header::ACTIVE] = num_state_v;
+        sizes[graph_file_header::HAS_MESSAGE] = num_state_v;
+        sizes[graph_file_header::MESSAGES] = num_state_v * header.message_data_size;
+        sizes[graph_file_header::HAS_CACHE] = header.gather_data_size > 0 ? num_state_v : 0;
+        sizes[graph_file_header::GATHER_CACHE] = num_state_v * header.gather_data_size;
+    }
+
+    template<typename DataType>
+    static uint32_t data_size() {
+        return std::is_same<DataType, graphlab::empty>::value ? 0 : sizeof(DataType);
+    }
+
+private:
+    /**
+     * The header at the beginning of a file of file_size bytes, of which
+     * available were read to base. Version 1 headers are extended with zeros.
+     */
+    static graph_file_header parse_header(const char *base, uint64_t file_size, const std::string& filename,
+                                          uint64_t available = sizeof(graph_file_header)) {
+        graph_file_header header;
+        std::memset(&header, 0, sizeof(header));
+        if (file_size < GRAPH_FILE_V1_HEADER_SIZE || available < GRAPH_FILE_V1_HEADER_SIZE
+            || std::memcmp(base, GRAPH_FILE_MAGIC, sizeof(header.magic)) != 0) {
+            throw std::runtime_error(filename + " is not a graph file");
+        }
+        std::memcpy(&header, base, GRAPH_FILE_V1_HEADER_SIZE);
+        if (header.version == GRAPH_FILE_VERSION && header.header_size >= sizeof(graph_file_header)
+            && available >= sizeof(graph_file_header)) {
+            std::memcpy(&header, base, sizeof(graph_file_header));
+        } else if (header.version == 1) {
+            header.complete = 1;
+        } else {
+            throw std::runtime_error(filename + " has an unsupported graph file version");
+        }
+        uint64_t sizes[graph_file_header::NUM_SECTIONS];
+        section_sizes(header, sizes);
+        for (int i = 0; i < graph_file_header::NUM_SECTIONS; i++) {
+            if (header.section_offset[i] + sizes[i] > file_size) {
+                throw std::runtime_error(filename + " is truncated");
+            }
+        }
+        return header;
+    }
+
+    template<typename DataType>
+    static void check_storable() {
+        static_assert(std::is_trivially_copyable<DataType>::value,
+                      "graph_file can only store trivially copyable vertex and edge data");
+    }
+
+    template<typename GraphType>
+    static void decompress(GraphType& g, std::vector<typename GraphType::vertex_id_type>& out_targets,
+                           std::vector<typename GraphType::vertex_id_type>& in_sources) {
+        typedef typename GraphType::vertex_id_type vertex_id_type;
+        out_targets.reserve(g.num_edges());
+        in_sources.resize(g.num_edges());
+        for (vertex_id_type v = 0; v < g.num_vertices(); v++) {
+            auto&& vertex = g.vertex(v);
+            for (int i = 0; i < vertex.num_out_edges(); i++) {
+                out_targets.push_back(vertex.out_edge(i).target().id());
+            }
+            g.for_in_neighbours(v, [&](typename GraphType::edge_id_type in_idx, vertex_id_type source) {
+                in_sources[in_idx] = source;
+            });
+        }
+    }
+
+    static uint64_t align(uint64_t offset) {
+        return (offset + 7) & ~uint64_t(7);
+    }
+};
+
+#endif
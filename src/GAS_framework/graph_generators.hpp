@@ -0,0 +1,206 @@
+/**
+ * Seeded generators of synthetic graphs, for benchmarks:
+ *  - rmat_graph:            R-MAT (Chakrabarti et al., "R-MAT: A Recursive Model
+ *                           for Graph Mining"), a skewed, power-law like degree
+ *                           distribution as in Graph500.
+ *  - barabasi_albert_graph: preferential attachment, a power-law degree
+ *                           distribution with every vertex in one component.
+ *  - grid_graph:            a 2D grid, every vertex has at most 4 neighbours.
+ *
+ * The same parameters and seed give the same graph on every platform: the
+ * random numbers come from splitmix64, not from rand() or the distributions of
+ * <random>, whose results differ between standard libraries.
+ *
+ * The edge lists are sorted by (source, target), without self or duplicate
+ * edges. Barabasi-Albert and grid graphs are undirected, so every edge is in
+ * the list in both directions. write_adjacency writes a graph in the text
+ * format that pagerank.cpp (unweighted) and SSSP.cpp (weighted) read.
+ */
+
+#ifndef __GRAPH_GENERATORS_H
+#define __GRAPH_GENERATORS_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <ostream>
+#include <stdint.h>
+
+struct generated_graph {
+    long num_vertices;
+    std::vector<std::pair<long, long> > edges;     // (source, target)
+
+    generated_graph(): num_vertices(0) {}
+
+    // sorts the edges and drops self and duplicate edges.
+    void normalize() {
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+        edges.erase(std::remove_if(edges.begin(), edges.end(),
+                                   [](const std::pair<long, long>& e) { return e.first == e.second; }),
+                    edges.end());
+    }
+};
+
+// splitmix64, after Steele et al., "Fast Splittable Pseudorandom Number Generators".
+class generator_rng {
+public:
+    explicit generator_rng(uint64_t seed): state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // in [0, n). The bias of the modulo is negligible for the n used here.
+    long uniform(long n) { return (long) (next() % (uint64_t) n); }
+
+    // in [0, 1)
+    double real() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+private:
+    uint64_t state;
+};
+
+/**
+ * 2^scale vertices and edge_factor * 2^scale edges before duplicates are
+ * dropped. Every edge descends scale times into one of the quadrants of the
+ * adjacency matrix, with probabilities a, b, c and 1 - a - b - c. The defaults
+ * are Graph500's. The vertex ids are shuffled afterwards unless scramble is
+ * false, so that the high degree vertices are not all at the low ids.
+ */
+inline generated_graph rmat_graph(int scale, int edge_factor, uint64_t seed,
+                                  double a = 0.57, double b = 0.19, double c = 0.19, bool scramble = true) {
+    generator_rng rng(seed);
+    generated_graph g;
+    g.num_vertices = 1L << scale;
+    const long num_edges = (long) edge_factor << scale;
+    g.edges.reserve(num_edges);
+    for (long i = 0; i < num_edges; i++) {
+        long source = 0, target = 0;
+        for (int level = 0; level < scale; level++) {
+            const double r = rng.real();
+            const long bit = 1L << level;
+            if (r < a) {
+                // top left
+            } else if (r < a + b) {
+                target |= bit;
+            } else if (r < a + b + c) {
+                source |= bit;
+            } else {
+                source |= bit;
+                target |= bit;
+            }
+        }
+        g.edges.push_back(std::make_pair(source, target));
+    }
+    if (scramble) {
+        std::vector<long> new_id(g.num_vertices);
+        for (long v = 0; v < g.num_vertices; v++) {
+            new_id[v] = v;
+        }
+        for (long v = g.num_vertices - 1; v > 0; v--) {  // Fisher-Yates
+            std::swap(new_id[v], new_id[rng.uniform(v + 1)]);
+        }
+        for (std::pair<long, long>& e : g.edges) {
+            e.first = new_id[e.first];
+            e.second = new_id[e.second];
+        }
+    }
+    g.normalize();
+    return g;
+}
+
+/**
+ * Starts with a clique of edges_per_vertex + 1 vertices. Every further vertex
+ * is connected to edges_per_vertex distinct earlier vertices, each picked with
+ * a probability proportional to its degree.
+ */
+inline generated_graph barabasi_albert_graph(long num_vertices, int edges_per_vertex, uint64_t seed) {
+    generator_rng rng(seed);
+    generated_graph g;
+    const long m = std::max(1, edges_per_vertex);
+    g.num_vertices = std::max(num_vertices, m + 1);
+    std::vector<long> endpoints;    // every vertex once per edge, to pick by degree
+    for (long u = 0; u <= m; u++) {
+        for (long v = u + 1; v <= m; v++) {
+            g.edges.push_back(std::make_pair(u, v));
+            endpoints.push_back(u);
+            endpoints.push_back(v);
+        }
+    }
+    std::vector<long> targets;
+    for (long v = m + 1; v < g.num_vertices; v++) {
+        targets.clear();
+        while ((long) targets.size() < m) {
+            const long t = endpoints[rng.uniform(endpoints.size())];
+            if (std::find(targets.begin(), targets.end(), t) == targets.end()) {
+                targets.push_back(t);
+            }
+        }
+        for (long t : targets) {
+            g.edges.push_back(std::make_pair(v, t));
+            endpoints.push_back(v);
+            endpoints.push_back(t);
+        }
+    }
+    const std::size_t num_undirected = g.edges.size();
+    for (std::size_t i = 0; i < num_undirected; i++) {
+        g.edges.push_back(std::make_pair(g.edges[i].second, g.edges[i].first));
+    }
+    g.normalize();
+    return g;
+}
+
+// rows * cols vertices, vertex r * cols + c is connected to its left, right, upper and lower neighbour.
+inline generated_graph grid_graph(long rows, long cols) {
+    generated_graph g;
+    g.num_vertices = rows * cols;
+    for (long r = 0; r < rows; r++) {
+        for (long c = 0; c < cols; c++) {
+            const long v = r * cols + c;
+            if (c + 1 < cols) {
+                g.edges.push_back(std::make_pair(v, v + 1));
+                g.edges.push_back(std::make_pair(v + 1, v));
+            }
+            if (r + 1 < rows) {
+                g.edges.push_back(std::make_pair(v, v + cols));
+                g.edges.push_back(std::make_pair(v + cols, v));
+            }
+        }
+    }
+    g.normalize();
+    return g;
+}
+
+/**
+ * The weight of edge i of a graph, in [2, max_weight + 1] as in
+ * input_generator_SSSP.cpp. Only depends on seed and i.
+ */
+inline long generated_weight(uint64_t seed, std::size_t i, long max_weight = 100) {
+    generator_rng rng(seed ^ (0x632be59bd9b4e019ULL * (i + 1)));
+    return 2 + rng.uniform(max_weight);
+}
+
+/**
+ * Writes a line "vid neigh_vid neigh_vid ..." for every vertex, or
+ * "vid neigh_vid weight neigh_vid weight ..." if weighted. Vertices without
+ * out edges get a line with only their id.
+ */
+inline void write_adjacency(std::ostream& out, const generated_graph& g, bool weighted, uint64_t seed = 1) {
+    std::size_t i = 0;
+    for (long v = 0; v < g.num_vertices; v++) {
+        out << v;
+        for (; i < g.edges.size() && g.edges[i].first == v; i++) {
+            out << " " << g.edges[i].second;
+            if (weighted) {
+                out << " " << generated_weight(seed, i);
+            }
+        }
+        out << "\n";
+    }
+}
+
+#endif
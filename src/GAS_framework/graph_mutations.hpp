@@ -0,0 +1,194 @@
+/**
+ * A log of edge insertions and deletions for a csr_graph, applied in batches.
+ *
+ * csr_graph is immutable, so updates are collected here and compacted into
+ * the graph by apply(), which rebuilds it with csr_graph_builder (O(V + E)
+ * per batch, independent of the size of the batch). Until then the graph and
+ * any engine running on it see the old edges. add_edge and remove_edge may be
+ * called by any number of threads at once, while an engine runs or not.
+ *
+ * apply() returns the vertices whose neighbourhood changed, so that a finished
+ * engine can be resumed on them only (see graph_changed() of the engines)
+ * instead of being rerun with signal_all():
+ *
+ * \code
+ * graph_mutations<vertex_data, edge_data> log(graph);
+ * log.add_edge(3, 7, 1);
+ * log.remove_edge(7, 2);
+ * engine.graph_changed(log.apply(num_threads));
+ * engine.start();
+ * \endcode
+ *
+ * Those are the endpoints of the changed edges and all their in and out
+ * neighbours in the new graph, which covers programs whose gathers look at
+ * the degrees of their neighbours, like PageRank's division by the out degree
+ * of the source. Programs that only ever decrease their values (SSSP) reconverge
+ * from there after insertions; after deletions, values that depended on a
+ * deleted edge have to be reset by the application first.
+ *
+ * Edges can only be added between existing vertices, since the engines size
+ * their per-vertex state by the number of vertices when they are constructed.
+ * Vertex ids, vertex data and the data of untouched edges stay as they are.
+ * Edge ids change, and as with every graph of the builder, duplicate and self
+ * edges are dropped and neighbour lists end up sorted.
+ */
+
+#ifndef __GRAPH_MUTATIONS_H
+#define __GRAPH_MUTATIONS_H
+
+#include "csr_graph.hpp"
+#include "graph_builder.hpp"
+#include "spinlock.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+template<typename VertexData, typename EdgeData, typename VertexIdType = int>
+class graph_mutations {
+public:
+    typedef csr_graph<VertexData, EdgeData, VertexIdType> graph_type;
+    typedef typename graph_type::vertex_id_type vertex_id_type;
+
+    explicit graph_mutations(graph_type& g): g(g) {}
+
+    /**
+     * Adds source -> target, or replaces its data if the edge exists.
+     * Returns false if an id is not a vertex of the graph or source == target.
+     */
+    bool add_edge(vertex_id_type source, vertex_id_type target, const EdgeData& edata = EdgeData()) {
+        return log_mutation(source, target, edata, false);
+    }
+
+    /**
+     * Removes source -> target, if it exists when the log is applied.
+     * Returns false if an id is not a vertex of the graph or source == target.
+     */
+    bool remove_edge(vertex_id_type source, vertex_id_type target) {
+        return log_mutation(source, target, EdgeData(), true);
+    }
+
+    // mutations logged since the last apply()
+    std::size_t size() {
+        lock.lock();
+        const std::size_t ret = mutations.size();
+        lock.unlock();
+        return ret;
+    }
+
+    /**
+     * Rebuilds the graph with the logged mutations, in the order in which they
+     * were logged (the last one of an edge wins), and clears the log. Returns the
+     * affected vertices (see above) in increasing id order.
+     * Must not be called while an engine is running on the graph.
+     */
+    std::vector<vertex_id_type> apply(int num_threads = 1) {
+        std::vector<mutation> batch;
+        lock.lock();
+        batch.swap(mutations);
+        lock.unlock();
+        if (batch.empty()) {
+            return std::vector<vertex_id_type>();
+        }
+
+        // the last mutation of every edge, sorted by (source, target).
+        std::stable_sort(batch.begin(), batch.end());
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < batch.size(); i++) {
+            if (kept > 0 && !(batch[kept - 1] < batch[i])) {
+                batch[kept - 1] = batch[i];     // same edge, later in the log
+            } else {
+                batch[kept++] = batch[i];
+            }
+        }
+        batch.resize(kept);
+
+        const vertex_id_type num_v = g.num_vertices();
+        std::vector<unsigned char> changed(num_v, 0);
+        csr_graph_builder<VertexData, EdgeData, VertexIdType> builder(num_threads);
+        for (vertex_id_type vid = 0; vid < num_v; vid++) {
+            auto&& v = g.vertex(vid);
+            builder.add_vertex(vid, v.data());
+            for (int i = 0; i < v.num_out_edges(); i++) {
+                auto&& e = v.out_edge(i);
+                mutation key;
+                key.source = vid;
+                key.target = e.target().id();
+                // logged edges are added (or not) below, with their new data.
+                typename std::vector<mutation>::iterator m = std::lower_bound(batch.begin(), batch.end(), key);
+                if (m != batch.end() && !(key < *m)) {
+                    changed[key.source] = changed[key.target] = 1;
+                } else {
+                    builder.add_edge(key.source, key.target, e.data());
+                }
+            }
+        }
+        for (const mutation& m : batch) {
+            if (!m.remove) {
+                builder.add_edge(m.source, m.target, m.data);
+                changed[m.source] = changed[m.target] = 1;
+            }
+        }
+        const bool was_compressed = g.neighbours_compressed();
+        g = builder.finalize();
+        if (was_compressed) {
+            g.compress_neighbours();
+        }
+
+        std::vector<unsigned char> affected(changed);
+        for (vertex_id_type vid = 0; vid < num_v; vid++) {
+            if (!changed[vid]) {
+                continue;
+            }
+            auto&& v = g.vertex(vid);
+            for (int i = 0; i < v.num_in_edges(); i++) {
+                affected[v.in_edge(i).source().id()] = 1;
+            }
+            for (int i = 0; i < v.num_out_edges(); i++) {
+                affected[v.out_edge(i).target().id()] = 1;
+            }
+        }
+        std::vector<vertex_id_type> ret;
+        for (vertex_id_type vid = 0; vid < num_v; vid++) {
+            if (affected[vid]) {
+                ret.push_back(vid);
+            }
+        }
+        return ret;
+    }
+
+private:
+    struct mutation {
+        vertex_id_type source;
+        vertex_id_type target;
+        EdgeData data;      // of an insertion
+        bool remove;
+
+        bool operator<(const mutation& other) const {
+            return source < other.source || (source == other.source && target < other.target);
+        }
+    };
+
+    graph_type& g;
+    spinlock lock;
+    std::vector<mutation> mutations;    // protected by lock, in the order of the calls
+
+    bool log_mutation(vertex_id_type source, vertex_id_type target, const EdgeData& edata, bool remove) {
+        // num_vertices() does not change before apply(), which may not run concurrently.
+        if (source < 0 || target < 0 || source >= g.num_vertices() || target >= g.num_vertices()
+            || source == target) {
+            return false;
+        }
+        mutation m;
+        m.source = source;
+        m.target = target;
+        m.data = edata;
+        m.remove = remove;
+        lock.lock();
+        mutations.push_back(m);
+        lock.unlock();
+        return true;
+    }
+};
+
+#endif
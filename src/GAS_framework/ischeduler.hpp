@@ -0,0 +1,119 @@
+/**
+ * The interface between async_engine and the data structure that holds the
+ * active vertices (the ones that have been signalled and not executed yet).
+ *
+ * A vertex is active from the moment it is scheduled until the thread that
+ * took it obtains exclusive access to it and calls deactivate(). Signals that
+ * arrive in between are dropped, since the execution that is about to begin
+ * sees the latest data anyway. Signals that arrive after deactivate() schedule
+ * the vertex again.
+ *
+ * Implementations must allow schedule() to be called from any number of
+ * worker threads at the same time as get_next(), without a global lock.
+ * thread_id is the id (0 .. num_threads - 1) of the calling worker thread.
+ * Before the engine starts, any thread may call schedule() with any id.
+ *
+ * Every signal has a priority, lower is more urgent. Schedulers that do not
+ * order their vertices ignore it.
+ */
+
+#ifndef __ISCHEDULER_H
+#define __ISCHEDULER_H
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+
+template<typename VertexIdType>
+class ischeduler {
+public:
+    typedef VertexIdType vertex_id_type;
+
+    virtual ~ischeduler() {}
+
+    // makes vid active. Returns false if vid is already active (the signal is dropped).
+    virtual bool schedule(int thread_id, vertex_id_type vid, double priority) = 0;
+
+    // takes an active vertex to execute. Returns false if none could be found right now.
+    virtual bool get_next(int thread_id, vertex_id_type& ret_vid) = 0;
+
+    // called once the thread that took vid has exclusive access to it, right before executing it.
+    virtual void deactivate(vertex_id_type vid) = 0;
+
+    // called after vid has been executed and its locks released.
+    virtual void completed(int thread_id, vertex_id_type vid) = 0;
+
+    // true if no vertex is active or executing. No further activation is possible then.
+    virtual bool finished() = 0;
+
+    // true from the schedule() of vid until its deactivate(). Used for checkpoints, see checkpoint.hpp.
+    virtual bool is_active(vertex_id_type vid) = 0;
+};
+
+/**
+ * The priority of a signal with message msg: msg.priority() if the message
+ * type has such a member (as in GraphLab), 0 otherwise.
+ */
+template<typename MessageType>
+auto message_priority(const MessageType& msg, int) -> decltype(double(msg.priority())) {
+    return msg.priority();
+}
+
+template<typename MessageType>
+double message_priority(const MessageType& msg, long) {
+    return 0;
+}
+
+template<typename MessageType>
+double message_priority(const MessageType& msg) {
+    return message_priority(msg, 0);
+}
+
+/**
+ * One bit per vertex, set while the vertex is active. Used by the schedulers
+ * to drop duplicate signals without locking.
+ */
+class atomic_bitset {
+    std::vector<std::atomic<uint64_t> > words;
+
+public:
+    explicit atomic_bitset(std::size_t num_bits): words((num_bits + 63) / 64) {
+        for (std::size_t i = 0; i < words.size(); i++) {
+            words[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // sets bit i. Returns true if this call changed it from 0 to 1.
+    bool set(std::size_t i) {
+        const uint64_t mask = uint64_t(1) << (i % 64);
+        return (words[i / 64].fetch_or(mask, std::memory_order_acq_rel) & mask) == 0;
+    }
+
+    void clear(std::size_t i) {
+        const uint64_t mask = uint64_t(1) << (i % 64);
+        words[i / 64].fetch_and(~mask, std::memory_order_acq_rel);
+    }
+
+    bool test(std::size_t i) const {
+        return (words[i / 64].load(std::memory_order_acquire) >> (i % 64)) & 1;
+    }
+
+    // not atomic as a whole. Only call while no other thread modifies the set.
+    void clear_all() {
+        for (std::size_t i = 0; i < words.size(); i++) {
+            words[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // not atomic as a whole. Only call while no other thread modifies the set.
+    std::size_t count() const {
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < words.size(); i++) {
+            n += __builtin_popcountll(words[i].load(std::memory_order_relaxed));
+        }
+        return n;
+    }
+};
+
+#endif
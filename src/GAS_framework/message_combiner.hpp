@@ -0,0 +1,96 @@
+/**
+ * Combines the messages sent to a vertex until it runs, as in GraphLab: the
+ * vertex program's init() gets the sum (message_type::operator+=) of all the
+ * messages of the signals since its last execution.
+ *
+ * There is one message slot per vertex. The slots are protected by a fixed
+ * number of striped spinlocks (vertex id modulo NUM_STRIPES), each on its own
+ * cache line, so that concurrent signals to different vertices rarely wait
+ * for each other and the memory overhead does not grow with the graph.
+ *
+ * graphlab::empty messages are not stored at all.
+ */
+
+#ifndef __MESSAGE_COMBINER_H
+#define __MESSAGE_COMBINER_H
+
+#include "spinlock.hpp"
+#include "../graphlab/util/empty.hpp"
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+template<typename MessageType>
+class message_combiner {
+public:
+    typedef MessageType message_type;
+
+    explicit message_combiner(std::size_t num_vertices): messages(num_vertices), has_message(num_vertices, 0),
+                                                         stripes(NUM_STRIPES) {}
+
+    // adds msg to the message of vid.
+    void add(std::size_t vid, const message_type& msg) {
+        spinlock& lock = stripes[vid % NUM_STRIPES].lock;
+        lock.lock();
+        if (has_message[vid]) {
+            messages[vid] += msg;
+        } else {
+            messages[vid] = msg;
+            has_message[vid] = 1;
+        }
+        lock.unlock();
+    }
+
+    // moves the message of vid to ret. Returns false (and leaves ret alone) if vid has none.
+    bool take(std::size_t vid, message_type& ret) {
+        spinlock& lock = stripes[vid % NUM_STRIPES].lock;
+        lock.lock();
+        const bool found = has_message[vid];
+        if (found) {
+            ret = std::move(messages[vid]);
+            has_message[vid] = 0;
+        }
+        lock.unlock();
+        return found;
+    }
+
+    // copies the message of vid to ret. Returns false (and leaves ret alone) if vid has none.
+    bool peek(std::size_t vid, message_type& ret) {
+        spinlock& lock = stripes[vid % NUM_STRIPES].lock;
+        lock.lock();
+        const bool found = has_message[vid];
+        if (found) {
+            ret = messages[vid];
+        }
+        lock.unlock();
+        return found;
+    }
+
+private:
+    enum { NUM_STRIPES = 1024 };
+
+    struct alignas(64) stripe {
+        spinlock lock;
+    };
+
+    std::vector<message_type> messages;
+    std::vector<char> has_message;
+    std::vector<stripe> stripes;
+};
+
+template<>
+class message_combiner<graphlab::empty> {
+public:
+    typedef graphlab::empty message_type;
+
+    explicit message_combiner(std::size_t num_vertices) {}
+
+    void add(std::size_t vid, const message_type& msg) {}
+
+    bool take(std::size_t vid, message_type& ret) { return false; }
+
+    bool peek(std::size_t vid, message_type& ret) { return false; }
+};
+
+#endif
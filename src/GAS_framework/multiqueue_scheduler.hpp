@@ -0,0 +1,200 @@
+/**
+ * A relaxed priority scheduler: the MultiQueue of Rihani, Sanders & Dementiev
+ * ("MultiQueues: Simple Relaxed Concurrent Priority Queues").
+ *
+ * There are QUEUES_PER_THREAD binary heaps per worker thread, each with its
+ * own spinlock. schedule() pushes onto a random heap. get_next() looks at the
+ * tops of two random heaps and pops the one with the lower priority, so the
+ * vertices come out roughly (not exactly) in priority order.
+ *
+ * The priority of a signal is priority() of its message (see
+ * message_priority() in ischeduler.hpp), lower runs first. With SSSP and the
+ * tentative distance as priority this is close to Dijkstra's order, and a
+ * vertex rarely relaxes before its final distance has arrived.
+ *
+ * Signalling an active vertex with a lower priority pushes another entry for
+ * it instead of changing the old one (decrease-key). Whichever entry comes out
+ * first takes the vertex, the others are dropped when they are popped.
+ *
+ * Entries of equal priority leave a heap in the order they were pushed.
+ * Otherwise the lowest vertex ids would win every tie, and programs whose
+ * messages have no priority() (all 0) would keep rerunning them.
+ */
+
+#ifndef __MULTIQUEUE_SCHEDULER_H
+#define __MULTIQUEUE_SCHEDULER_H
+
+#include "ischeduler.hpp"
+#include "spinlock.hpp"
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <functional>   // greater
+#include <limits>
+#include <utility>
+#include <stdint.h>
+
+template<typename VertexIdType>
+class multiqueue_scheduler: public ischeduler<VertexIdType> {
+public:
+    typedef VertexIdType vertex_id_type;
+
+    multiqueue_scheduler(vertex_id_type num_vertices, int num_threads)
+        : num_queues(num_threads * QUEUES_PER_THREAD),
+          queues(num_threads * QUEUES_PER_THREAD),
+          rngs(num_threads),
+          states(num_vertices),
+          priorities(num_vertices),
+          num_pending(0) {
+        for (vertex_id_type i = 0; i < num_vertices; i++) {
+            states[i].store(IDLE, std::memory_order_relaxed);
+            priorities[i].store(std::numeric_limits<double>::infinity(), std::memory_order_relaxed);
+        }
+        for (int i = 0; i < num_threads; i++) {
+            rngs[i].state = 0x9E3779B97F4A7C15ull * (i + 1);
+        }
+    }
+
+    bool schedule(int thread_id, vertex_id_type vid, double priority) override {
+        unsigned char expected = IDLE;
+        if (states[vid].compare_exchange_strong(expected, QUEUED, std::memory_order_acq_rel)) {
+            priorities[vid].store(priority, std::memory_order_relaxed);
+            num_pending.fetch_add(1, std::memory_order_relaxed);
+            push(thread_id, vid, priority);
+            return true;
+        }
+        if (expected == TAKEN) {
+            return false;   // about to execute, see ischeduler.hpp
+        }
+        // queued already. Requeue if the priority got lower.
+        double old = priorities[vid].load(std::memory_order_relaxed);
+        while (priority < old) {
+            if (priorities[vid].compare_exchange_weak(old, priority, std::memory_order_relaxed)) {
+                push(thread_id, vid, priority);
+                break;
+            }
+        }
+        return false;
+    }
+
+    bool get_next(int thread_id, vertex_id_type& ret_vid) override {
+        for (int attempt = 0; attempt < 2 * num_queues; attempt++) {
+            rng& r = rngs[thread_id];
+            const int i = r.next() % num_queues;
+            const int j = r.next() % num_queues;
+            const double top_i = queues[i].top.load(std::memory_order_relaxed);
+            const double top_j = queues[j].top.load(std::memory_order_relaxed);
+            if (top_i == EMPTY && top_j == EMPTY) {
+                continue;
+            }
+            if (pop(top_i <= top_j ? i : j, ret_vid)) {
+                return true;
+            }
+        }
+        // the random choices may have missed the last few entries.
+        for (int i = 0; i < num_queues; i++) {
+            while (queues[i].top.load(std::memory_order_relaxed) != EMPTY) {
+                if (pop(i, ret_vid)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void deactivate(vertex_id_type vid) override {
+        priorities[vid].store(std::numeric_limits<double>::infinity(), std::memory_order_relaxed);
+        states[vid].store(IDLE, std::memory_order_release);
+    }
+
+    void completed(int thread_id, vertex_id_type vid) override {
+        num_pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    bool finished() override {
+        return num_pending.load(std::memory_order_acquire) == 0;
+    }
+
+    bool is_active(vertex_id_type vid) override {
+        return states[vid].load(std::memory_order_acquire) != IDLE;
+    }
+
+private:
+    enum { QUEUES_PER_THREAD = 2 };
+
+    // states of a vertex
+    enum {
+        IDLE,       // not active
+        QUEUED,     // active, at least one entry in a heap
+        TAKEN       // returned by get_next, not deactivated yet
+    };
+
+    static constexpr double EMPTY = std::numeric_limits<double>::infinity();
+
+    // (priority, (push sequence number of the heap, vid))
+    typedef std::pair<double, std::pair<uint64_t, vertex_id_type> > entry;
+
+    struct alignas(64) queue {
+        spinlock lock;
+        std::vector<entry> heap;            // a min-heap on the priority
+        std::atomic<double> top;            // priority of heap.front(), EMPTY if empty. Read without the lock.
+        uint64_t next_seq;                  // protected by lock
+
+        queue(): top(EMPTY), next_seq(0) {}
+    };
+
+    // xorshift64, one per thread
+    struct alignas(64) rng {
+        uint64_t state;
+
+        uint64_t next() {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        }
+    };
+
+    const int num_queues;
+    std::vector<queue> queues;
+    std::vector<rng> rngs;
+    std::vector<std::atomic<unsigned char> > states;
+    std::vector<std::atomic<double> > priorities;   // lowest priority queued for a vertex
+
+    // number of vertices that are active or executing.
+    alignas(64) std::atomic<long> num_pending;
+
+    void push(int thread_id, vertex_id_type vid, double priority) {
+        queue& q = queues[rngs[thread_id].next() % num_queues];
+        q.lock.lock();
+        q.heap.push_back(entry(priority, std::make_pair(q.next_seq++, vid)));
+        std::push_heap(q.heap.begin(), q.heap.end(), std::greater<entry>());
+        q.top.store(q.heap.front().first, std::memory_order_relaxed);
+        q.lock.unlock();
+    }
+
+    // pops the top of queue i. Returns true if that entry took its vertex.
+    bool pop(int i, vertex_id_type& ret_vid) {
+        queue& q = queues[i];
+        q.lock.lock();
+        if (q.heap.empty()) {
+            q.lock.unlock();
+            return false;
+        }
+        std::pop_heap(q.heap.begin(), q.heap.end(), std::greater<entry>());
+        const vertex_id_type vid = q.heap.back().second.second;
+        q.heap.pop_back();
+        q.top.store(q.heap.empty() ? EMPTY : q.heap.front().first, std::memory_order_relaxed);
+        q.lock.unlock();
+
+        unsigned char expected = QUEUED;
+        if (!states[vid].compare_exchange_strong(expected, TAKEN, std::memory_order_acq_rel)) {
+            return false;   // another entry of vid took it first
+        }
+        ret_vid = vid;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,165 @@
+/**
+ * The lock table of MONITOR_EDGE_CONSISTENCY: a vertex may execute once it
+ * holds the lock words of itself and all of its in and out neighbours.
+ *
+ * Every vertex has one atomic word with the owner of its lock (0 if it is
+ * free), which is 2 bytes per vertex. Threads that have to wait do not wait
+ * on a condition variable of the vertex but park in a small wait table:
+ * NUM_BUCKETS buckets of a mutex, a condition variable and a waiter count,
+ * picked by hashing the id of the vertex that is in the way. An unlock only
+ * touches the mutex of a bucket if somebody is parked in it, so releasing a
+ * neighbourhood without waiters is a store and a load per neighbour.
+ *
+ * lock() takes all words or none, as the monitor of Silberschatz et al. did,
+ * so there is no hold-and-wait and no deadlock. If a word is taken, the words
+ * acquired so far are released again and the thread parks until the taken
+ * word is free. Unlike the monitor, threads with disjoint neighbourhoods do
+ * not serialize on a global mutex.
+ *
+ * Neighbour lists may contain a vertex more than once (multi-edges, both
+ * (u, v) and (v, u), self loops), which is why the owner is stored and not
+ * only a flag: a word that is already the caller's counts as acquired.
+ */
+
+#ifndef __NEIGHBOURHOOD_LOCKS_H
+#define __NEIGHBOURHOOD_LOCKS_H
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <stdint.h>
+
+template<typename GraphType>
+class neighbourhood_locks {
+public:
+    typedef GraphType graph_type;
+    typedef typename graph_type::vertex_id_type vertex_id_type;
+    typedef uint16_t owner_type;
+
+    // owners are thread ids + 1, 0 means free.
+    static const int MAX_THREADS = 0xffff - 1;
+
+    neighbourhood_locks(graph_type& g, int num_threads): g(g), owner(g.num_vertices()) {
+        if (num_threads > MAX_THREADS) {
+            throw std::invalid_argument("neighbourhood_locks: too many threads");
+        }
+        for (auto& o : owner) {
+            o.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Blocks until thread_id holds vid and all of its neighbours.
+     */
+    void lock(int thread_id, vertex_id_type vid) {
+        const owner_type me = thread_id + 1;
+        vertex_id_type block;
+        while (!try_lock(me, vid, block)) {
+            park(block);
+        }
+    }
+
+    void unlock(int thread_id, vertex_id_type vid) {
+        const owner_type me = thread_id + 1;
+        auto&& v = g.vertex(vid);
+        release(me, vid);
+        for (int i = 0; i < v.num_in_edges(); i++) {
+            release(me, v.in_edge(i).source().id());
+        }
+        for (int i = 0; i < v.num_out_edges(); i++) {
+            release(me, v.out_edge(i).target().id());
+        }
+    }
+
+private:
+    enum { NUM_BUCKETS = 256 };
+
+    struct alignas(64) bucket {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::atomic<int> waiters;
+
+        bucket(): waiters(0) {}
+    };
+
+    graph_type& g;
+    std::vector<std::atomic<owner_type> > owner;
+    bucket buckets[NUM_BUCKETS];
+
+    bucket& bucket_of(vertex_id_type vid) {
+        return buckets[((uint32_t) vid * 2654435761u) >> 24];     // Fibonacci hashing to 8 bits
+    }
+
+    bool acquire(owner_type me, vertex_id_type vid) {
+        owner_type expected = 0;
+        return owner[vid].compare_exchange_strong(expected, me, std::memory_order_acquire)
+               || expected == me;
+    }
+
+    // a word may be listed twice, only the first release of the caller frees it.
+    void release(owner_type me, vertex_id_type vid) {
+        owner_type expected = me;
+        if (!owner[vid].compare_exchange_strong(expected, 0, std::memory_order_seq_cst)) {
+            return;
+        }
+        bucket& b = bucket_of(vid);
+        if (b.waiters.load(std::memory_order_seq_cst) > 0) {
+            // taking the mutex makes sure a waiter that has not seen the free word yet is waiting.
+            { std::lock_guard<std::mutex> lock(b.mutex); }
+            b.cv.notify_all();
+        }
+    }
+
+    bool try_lock(owner_type me, vertex_id_type vid, vertex_id_type& block) {
+        auto&& v = g.vertex(vid);
+        const int num_in = v.num_in_edges();
+        const int num_out = v.num_out_edges();
+        // the order of acquire: vid, in neighbours, out neighbours. On failure, undo the prefix.
+        if (!acquire(me, vid)) {
+            block = vid;
+            return false;
+        }
+        int i = 0;
+        for (; i < num_in; i++) {
+            if (!acquire(me, v.in_edge(i).source().id())) {
+                block = v.in_edge(i).source().id();
+                break;
+            }
+        }
+        int j = 0;
+        if (i == num_in) {
+            for (; j < num_out; j++) {
+                if (!acquire(me, v.out_edge(j).target().id())) {
+                    block = v.out_edge(j).target().id();
+                    break;
+                }
+            }
+            if (j == num_out) {
+                return true;
+            }
+        }
+        for (int k = 0; k < j; k++) {
+            release(me, v.out_edge(k).target().id());
+        }
+        for (int k = 0; k < i; k++) {
+            release(me, v.in_edge(k).source().id());
+        }
+        release(me, vid);
+        return false;
+    }
+
+    void park(vertex_id_type block) {
+        bucket& b = bucket_of(block);
+        std::unique_lock<std::mutex> lock(b.mutex);
+        b.waiters.fetch_add(1, std::memory_order_seq_cst);
+        // other vertices of the bucket wake us up too, the loop of lock() retries then.
+        while (owner[block].load(std::memory_order_seq_cst) != 0) {
+            b.cv.wait(lock);
+        }
+        b.waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+};
+
+#endif
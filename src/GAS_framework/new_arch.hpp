@@ -2,69 +2,199 @@
 #define __NEW_ARCH_H
 
 #include <stdexcept>
+#include <vector>
+#include <algorithm>    // max
+#include <cstring>      // memcpy
+#include <stdint.h>
 
 namespace new_arch {
     typedef intptr_t size_t;
     typedef intptr_t spm_addr_type;
     typedef intptr_t word;
 
-    const size_t SPM_SIZE = 4 * 1024;    // in bytes
+    // Default size of a core's SPM in bytes. spm_interface adds the space of its residency index.
+    const size_t DEFAULT_SPM_SIZE = 4 * 1024;
+
+    /**
+     * Costs of the simulated instructions in cycles of a core. The defaults are
+     * placeholders in the right ballpark, not measurements of any hardware.
+     */
+    struct timing_model {
+        long spm_cycles;            // SPM2REG and REG2SPM
+        long issue_cycles;          // issuing NBL2SPM or SPM2MEM
+        long mm_latency;            // until the first word of a main memory transfer arrives
+        long bytes_per_cycle;       // bandwidth of the DMA channel of a core
+        long op_cycles;             // a gather or scatter call, besides its memory accesses
+
+        timing_model(): spm_cycles(1), issue_cycles(1), mm_latency(100), bytes_per_cycle(8), op_cycles(10) {}
+    };
+
+    /**
+     * The SPM and the DMA channel of one core, with a cycle counter that the
+     * instructions below advance.
+     *
+     * The transfers of NBL2SPM and SPM2MEM go into the core's DMA queue, which
+     * serves them in order at bytes_per_cycle, and complete mm_latency cycles
+     * after they leave the queue. The data is copied right away for simplicity,
+     * but an instruction that accesses SPM words of a transfer that has not
+     * completed yet stalls the core until it has. BARRIER stalls until the
+     * whole queue is done.
+     *
+     * Since transfers complete in order, the queue is just the cycle at which
+     * the channel is free plus the completion cycle of every SPM word (a
+     * scoreboard), which avoids searching the outstanding transfers on every
+     * SPM access.
+     */
+    class core {
+    public:
+        core(size_t spm_size, const timing_model& timing = timing_model())
+            : spm(spm_size / sizeof(word), 0), ready(spm_size / sizeof(word), 0),
+              timing(timing), cycles(0), stall_cycles(0), dma_free(0), dma_done(0) {}
+
+        word *spm_data() { return spm.data(); }
+        const timing_model& timings() const { return timing; }
+
+        long get_cycles() const { return cycles; }
+        long get_stall_cycles() const { return stall_cycles; }
+
+        // computation of the core
+        void tick(long n) { cycles += n; }
+
+        // stalls until the SPM words in [spm_addr, spm_addr + size) are not being transferred anymore.
+        void wait_for(spm_addr_type spm_addr, size_t size) {
+            const size_t end = (spm_addr + size + sizeof(word) - 1) / sizeof(word);
+            for (size_t i = spm_addr / sizeof(word); i < end; i++) {
+                stall_until(ready[i]);
+            }
+        }
+
+        void wait_all() { stall_until(dma_done); }
+
+        // queues a transfer to or from the SPM words in [spm_addr, spm_addr + size).
+        void issue(spm_addr_type spm_addr, size_t size) {
+            issue_strided(spm_addr, size, size, 1);
+        }
+
+        // queues one transfer of count elements of size bytes, spm_stride bytes apart in SPM.
+        void issue_strided(spm_addr_type spm_addr, size_t size, size_t spm_stride, size_t count) {
+            cycles += timing.issue_cycles;
+            const long start = std::max(cycles, dma_free);
+            dma_free = start + (count * size + timing.bytes_per_cycle - 1) / timing.bytes_per_cycle;
+            dma_done = dma_free + timing.mm_latency;
+            for (size_t k = 0; k < count; k++) {
+                const spm_addr_type elem = spm_addr + k * spm_stride;
+                const size_t end = (elem + size + sizeof(word) - 1) / sizeof(word);
+                for (size_t i = elem / sizeof(word); i < end; i++) {
+                    ready[i] = dma_done;
+                }
+            }
+        }
+
+        // a main memory access that bypasses SPM and the DMA queue (e.g. after an SPM miss).
+        void mm_access(size_t size) {
+            stall_until(cycles + timing.mm_latency + (size + timing.bytes_per_cycle - 1) / timing.bytes_per_cycle);
+        }
+
+    private:
+        std::vector<word> spm;
+        std::vector<long> ready;    // cycle at which the last transfer of each word completes
+        timing_model timing;
+
+        long cycles;
+        long stall_cycles;          // spent waiting for memory
+        long dma_free;              // cycle at which the DMA channel can start the next transfer
+        long dma_done;              // completion of the last transfer issued
+
+        void stall_until(long t) {
+            if (t > cycles) {
+                stall_cycles += t - cycles;
+                cycles = t;
+            }
+        }
+    };
 
     // --- placeholder functions for special instructions ---
     // ! currently, these functions are not placeholders but implement access to an
     // ! in-memory simulation of SPM.
-    // For simplicity, the memory is word-addressable right now. 
+    // For simplicity, the memory is word-addressable right now.
     // NBL2SPM and SPM2MEM work for sizes divisible by or less than 8 (word size)
 
     // a word is 8 bytes (intptr_t)
-    word *SPM = new word[SPM_SIZE / sizeof(word)];
-    
+    // Every core has its own SPM. c is the core that executes the instruction.
+
     // Non-blocking load to SPM
-    void NBL2SPM(const void *mm_addr, spm_addr_type spm_addr, size_t size) {
+    inline void NBL2SPM(core &c, const void *mm_addr, spm_addr_type spm_addr, size_t size) {
         if (spm_addr % 8 > 0 || (size % 8 > 0 && size > 8)) {
             // not iplemented yet for simplicity
             throw std::runtime_error("NBL2SPM not word-aligned");
         }
+        word *spm = c.spm_data();
         for (int i = 0; i < size / 8; i++) {
-            SPM[spm_addr / 8 + i] = *(( word *)mm_addr + i);
+            spm[spm_addr / 8 + i] = *(( word *)mm_addr + i);
+        }
+        c.issue(spm_addr, size);
+    }
+
+    /**
+     * Non-blocking strided load to SPM: count elements of size bytes (at most a
+     * word) that are contiguous in main memory go to the words spm_stride bytes
+     * apart from spm_addr. One transfer, one instruction.
+     */
+    inline void NBL2SPM_STRIDED(core &c, const void *mm_addr, spm_addr_type spm_addr, size_t spm_stride,
+                                size_t size, size_t count) {
+        if (spm_addr % 8 > 0 || spm_stride % 8 > 0 || size > 8) {
+            // not iplemented yet for simplicity
+            throw std::runtime_error("NBL2SPM_STRIDED not word-aligned");
+        }
+        word *spm = c.spm_data();
+        for (size_t k = 0; k < count; k++) {
+            std::memcpy(&spm[(spm_addr + k * spm_stride) / 8], (const char *)mm_addr + k * size, size);
         }
+        c.issue_strided(spm_addr, size, spm_stride, count);
     }
 
     // Non-blocking store from SPM
-    void SPM2MEM(const void *mm_addr, spm_addr_type spm_addr, size_t size) {
+    inline void SPM2MEM(core &c, const void *mm_addr, spm_addr_type spm_addr, size_t size) {
         if (spm_addr % 8 > 0 || (size % 8 > 0 && size > 8)) {
             // not iplemented yet for simplicity
             throw std::runtime_error("SPM2MEM not word-aligned");
         }
-
+        c.wait_for(spm_addr, size);     // the data may still be on its way in
+        const word *spm = c.spm_data();
         for (int i = 0; i < size / 8; i++) {
-            *((unsigned int *)mm_addr + i) = SPM[spm_addr / 8 + i] ;
+            *((word *)mm_addr + i) = spm[spm_addr / 8 + i];
         }
+        c.issue(spm_addr, size);
     }
 
     // Synchronous load to a register from SPM
-    word SPM2REG(spm_addr_type spm_addr) {
-        // THIS ONE cAUSES SEGFALUT
+    inline word SPM2REG(core &c, spm_addr_type spm_addr) {
         if (spm_addr % 8 > 0) {
             // not iplemented yet for simplicity
             throw std::runtime_error("SPM2REG not word-aligned");
         }
-        return SPM[spm_addr / 8];
+        c.wait_for(spm_addr, sizeof(word));
+        c.tick(c.timings().spm_cycles);
+        return c.spm_data()[spm_addr / 8];
     }
 
     // Synchronous store to a SPM from a register
-    void REG2SPM(spm_addr_type spm_addr, word value) {
+    inline void REG2SPM(core &c, spm_addr_type spm_addr, word value) {
         if (spm_addr % 8 > 0) {
             // not iplemented yet for simplicity
             throw std::runtime_error("REG2SPM not word-aligned");
         }
-        SPM[spm_addr / 8] = value;
+        c.wait_for(spm_addr, sizeof(word));
+        c.tick(c.timings().spm_cycles);
+        c.spm_data()[spm_addr / 8] = value;
     }
 
     // Returns when all non-blocking memory requests are completed
-    void BARRIER() { /* NOP */ }
+    inline void BARRIER(core &c) {
+        c.wait_all();
+    }
+
 
-    
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,91 @@
+/**
+ * An arena of objects of one type. Objects are constructed in place in blocks
+ * of block_size objects, so creating one costs no malloc (except for one per
+ * block), their addresses are stable, and all of them are destroyed and freed
+ * at once with the arena. Single objects can not be freed.
+ *
+ * Not thread-safe.
+ */
+
+#ifndef __OBJECT_ARENA_H
+#define __OBJECT_ARENA_H
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <utility>      // forward
+#include <algorithm>    // max
+#include <cstddef>
+
+template<typename T>
+class object_arena {
+public:
+    explicit object_arena(std::size_t block_size = 4096)
+        : block_size(std::max<std::size_t>(block_size, 1)), block_used(0), block_capacity(0), count(0) {}
+
+    object_arena(const object_arena&) = delete;
+    object_arena& operator=(const object_arena&) = delete;
+
+    ~object_arena() { clear(); }
+
+    template<typename... Args>
+    T *create(Args&&... args) {
+        if (block_used == block_capacity) {
+            add_block(block_size);
+        }
+        T *ret = new (blocks.back().get() + block_used) T(std::forward<Args>(args)...);
+        block_used++;
+        count++;
+        return ret;
+    }
+
+    /**
+     * Makes room for n more objects in one block, so that the next n calls of
+     * create() do not allocate.
+     */
+    void reserve(std::size_t n) {
+        if (block_capacity - block_used < n) {
+            add_block(n);
+        }
+    }
+
+    // destroys all objects and frees the blocks.
+    void clear() {
+        for (std::size_t b = 0; b < blocks.size(); b++) {
+            const std::size_t used = b + 1 == blocks.size() ? block_used : used_of[b];
+            for (std::size_t i = 0; i < used; i++) {
+                (blocks[b].get() + i)->~T();
+            }
+        }
+        blocks.clear();
+        used_of.clear();
+        block_used = 0;
+        block_capacity = 0;
+        count = 0;
+    }
+
+    std::size_t size() const { return count; }
+
+private:
+    struct block_deleter {
+        void operator()(T *p) const { ::operator delete(p); }
+    };
+
+    const std::size_t block_size;
+    std::vector<std::unique_ptr<T, block_deleter> > blocks;
+    std::vector<std::size_t> used_of;   // objects in each block but the last
+    std::size_t block_used;             // objects in the last block
+    std::size_t block_capacity;         // of the last block
+    std::size_t count;
+
+    void add_block(std::size_t capacity) {
+        if (!blocks.empty()) {
+            used_of.push_back(block_used);  // the rest of the last block stays unused
+        }
+        blocks.emplace_back(static_cast<T *>(::operator new(capacity * sizeof(T))));
+        block_used = 0;
+        block_capacity = capacity;
+    }
+};
+
+#endif
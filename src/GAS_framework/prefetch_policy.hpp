@@ -0,0 +1,148 @@
+/**
+ * The interface between async_engine and the policy that picks the load ahead
+ * distance of every vertex program: how many edges (with their neighbours)
+ * are loaded into SPM before the program starts and how far the loads run
+ * ahead of its gathers and scatters.
+ *
+ * distance() is called by the worker thread that is about to execute a
+ * vertex, with the degrees of the vertex and the state of the thread's SPM.
+ * record() is called after the execution with the number of edges it
+ * processed and the cycles its core stalled on memory (see new_arch.hpp),
+ * which includes the SPM misses. Both are only called by worker thread_id,
+ * so policies can keep per-thread state without locks.
+ *
+ * Three policies are implemented:
+ *  - fixed_prefetch_policy uses engine_options::load_ahead_distance for
+ *    every vertex, as the engine always did.
+ *  - degree_prefetch_policy caps that distance by the degree of the vertex
+ *    and by the number of edges that fit into the free part of the SPM, so
+ *    that high-degree vertices do not overflow the SPM.
+ *  - adaptive_prefetch_policy tunes the distance of every thread online by
+ *    hill climbing on the stall cycles per edge, under the degree cap.
+ */
+
+#ifndef __PREFETCH_POLICY_H
+#define __PREFETCH_POLICY_H
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+/**
+ * What a policy gets to know about the SPM of the thread. An edge and its
+ * neighbour take pair_bytes of it.
+ */
+struct spm_occupancy {
+    long free_bytes;
+    long capacity_bytes;
+    long pair_bytes;
+};
+
+class iprefetch_policy {
+public:
+    virtual ~iprefetch_policy() {}
+
+    virtual int distance(int thread_id, int num_in_edges, int num_out_edges, const spm_occupancy& spm) = 0;
+
+    virtual void record(int thread_id, long num_edges, long stall_cycles) {}
+};
+
+class fixed_prefetch_policy: public iprefetch_policy {
+public:
+    explicit fixed_prefetch_policy(int load_ahead_distance): load_ahead_distance(load_ahead_distance) {}
+
+    int distance(int thread_id, int num_in_edges, int num_out_edges, const spm_occupancy& spm) override {
+        return load_ahead_distance;
+    }
+
+private:
+    const int load_ahead_distance;
+};
+
+class degree_prefetch_policy: public iprefetch_policy {
+public:
+    explicit degree_prefetch_policy(int max_distance): max_distance(max_distance) {}
+
+    int distance(int thread_id, int num_in_edges, int num_out_edges, const spm_occupancy& spm) override {
+        return cap(max_distance, num_in_edges, num_out_edges, spm);
+    }
+
+    /**
+     * Nothing beyond the edges of the vertex is loaded, so a distance above
+     * the degree only keeps the preloaded data longer. Half of the free SPM is
+     * left for the loads that run ahead of the gathers and scatters.
+     */
+    static int cap(int distance, int num_in_edges, int num_out_edges, const spm_occupancy& spm) {
+        if (spm.pair_bytes == 0) {
+            return std::min(distance, num_in_edges + num_out_edges);   // nothing to load anyway
+        }
+        const long fit = spm.free_bytes / spm.pair_bytes / 2;
+        return (int) std::min<long>(std::min(distance, num_in_edges + num_out_edges), fit);
+    }
+
+private:
+    const int max_distance;
+};
+
+/**
+ * Every thread measures the stall cycles per edge over windows of
+ * WINDOW_EDGES edges and moves its distance by a step in one direction. If a
+ * window was worse than the one before, the direction is reversed. The misses
+ * alone would be misleading: with a distance of 0 every edge is loaded right
+ * before it is used, which never misses but always waits for the whole
+ * memory latency.
+ */
+class adaptive_prefetch_policy: public iprefetch_policy {
+public:
+    adaptive_prefetch_policy(int num_threads, int initial_distance): threads(num_threads) {
+        for (thread_state& t : threads) {
+            t.distance = initial_distance;
+        }
+    }
+
+    int distance(int thread_id, int num_in_edges, int num_out_edges, const spm_occupancy& spm) override {
+        thread_state& t = threads[thread_id];
+        // no use in growing beyond what the SPM holds
+        const int max_distance = (int) std::min<long>(std::numeric_limits<int>::max(),
+            spm.pair_bytes == 0 ? 0 : spm.capacity_bytes / spm.pair_bytes / 2);
+        t.distance = std::max(0, std::min(t.distance, max_distance));
+        return degree_prefetch_policy::cap(t.distance, num_in_edges, num_out_edges, spm);
+    }
+
+    void record(int thread_id, long num_edges, long stall_cycles) override {
+        thread_state& t = threads[thread_id];
+        t.edges += num_edges;
+        t.stalls += stall_cycles;
+        if (t.edges < WINDOW_EDGES) {
+            return;
+        }
+        const double cost = double(t.stalls) / t.edges;
+        if (cost > t.last_cost) {
+            t.direction = -t.direction;
+        }
+        t.last_cost = cost;
+        t.distance = std::max(0, t.distance + t.direction * std::max(1, t.distance / 4));
+        t.edges = 0;
+        t.stalls = 0;
+    }
+
+    int current_distance(int thread_id) const { return threads[thread_id].distance; }
+
+private:
+    enum { WINDOW_EDGES = 4096 };
+
+    struct alignas(64) thread_state {
+        int distance;
+        int direction;      // +1 or -1
+        long edges;         // in the current window
+        long stalls;
+        double last_cost;   // stall cycles per edge in the last window
+
+        thread_state(): distance(0), direction(1), edges(0), stalls(0),
+                        last_cost(std::numeric_limits<double>::infinity()) {}
+    };
+
+    std::vector<thread_state> threads;
+};
+
+#endif
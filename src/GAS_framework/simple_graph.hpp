@@ -1,14 +1,17 @@
 /**
+ * Vertices are stored by value in one contiguous array indexed by id, so
+ * sweeps over the vertex data are sequential. Edges are allocated from an
+ * object_arena (see object_arena.hpp) and freed with the graph. reserve()
+ * takes the expected sizes, so that loading a graph of known size allocates
+ * the vertex array and the edges once.
+ *
+ * References to vertices are invalidated by add_vertex (the array may grow),
+ * references to edges stay valid for the lifetime of the graph. Since edges
+ * refer to their graph, graphs can not be copied or moved.
+ *
  * TODO:
- *  - Reconsider the efficieny of the graph representation.
- *    using direct references instead of vertex id's might eliminate
- *    retrieval time from the map.
- * 
  *  - Force things to be default constructible as in GraphLab. 
  * 
- *  - Vertices and edges store data directly, not a pointer.
- *    might make sense to fix this to avert possible copying overhead.
- * 
  *  - Consider moving to GraphLab's representation, where the
  *    vertex_type objects do not store the edges and are used to store
  *    other vertex information.
@@ -17,19 +20,25 @@
 #ifndef __SIMPLE_GRAPH_H
 #define __SIMPLE_GRAPH_H
 
+#include "object_arena.hpp"
+
 #include <vector>
 #include <algorithm> // for std::find
 
 /** 
  * An adjacency list-based graph structure
  */
-template<typename VertexData, typename EdgeData>
+template<typename VertexData, typename EdgeData, typename VertexIdType = int>
 class Graph {
 public:
     // ---------------------------------------- //
     // ---------------- TYPES ----------------- //
     // ---------------------------------------- //
-    typedef int vertex_id_type;
+    typedef VertexIdType vertex_id_type;
+
+    // the id of the default constructed vertices in gaps of the id range (-1, or the largest unsigned id).
+    static constexpr vertex_id_type NO_VID = vertex_id_type(-1);
+    typedef int edge_id_type;
 
     typedef VertexData vertex_data_type;    // used by ivertex_program
     typedef EdgeData edge_data_type;    // used by ivertex_program
@@ -46,7 +55,7 @@ public:
          * Default constructor required to use vertex_type as the value type in
          * std::vector. A default-constructed vertex should never be processed.
          */
-        vertex_type(): vid(-1) {}
+        vertex_type(): vid(NO_VID) {}
 
         /**
          * TODO: the constructor copies the data. What is the better alternative?
@@ -69,6 +78,16 @@ public:
         vertex_id_type id() const {
             return vid;
         }
+
+        // i'th in edge of the vertex. Same interface as csr_graph::vertex_type.
+        edge_type& in_edge(int i) const {
+            return *in_edges[i];
+        }
+
+        // i'th out edge of the vertex. Same interface as csr_graph::vertex_type.
+        edge_type& out_edge(int i) const {
+            return *out_edges[i];
+        }
     };
 
     struct edge_type {
@@ -76,6 +95,7 @@ public:
 
         vertex_id_type source_vid;
         vertex_id_type target_vid; 
+        edge_id_type eid;   // edges are numbered 0 .. num_edges() - 1 in the order they are added.
         EdgeData edata;
 
         bool has_opposite;  // true if the graph contains an edge from target to source.
@@ -84,20 +104,26 @@ public:
          * TODO: the constructor copies the data. What is the better alternative?
          * hold a pointer to vertexdata instead? Is that unnecessary complication?
          */
-        edge_type(Graph& graph_ref, vertex_id_type source, vertex_id_type target, const EdgeData& data)
-            : graph_ref(graph_ref), source_vid(source), target_vid(target), edata(data), has_opposite(false) {}
+        edge_type(Graph& graph_ref, vertex_id_type source, vertex_id_type target, edge_id_type eid,
+                  const EdgeData& data)
+            : graph_ref(graph_ref), source_vid(source), target_vid(target), eid(eid), edata(data),
+              has_opposite(false) {}
 
         vertex_type &source() const {
-            return *(graph_ref.vertices.at(source_vid));
+            return graph_ref.vertices[source_vid];
         }
 
         vertex_type &target() const {
-            return *(graph_ref.vertices.at(target_vid));
+            return graph_ref.vertices[target_vid];
         }
 
         const EdgeData& data() const { return edata; }
 
         EdgeData& data() { return edata; }
+
+        edge_id_type id() const {
+            return eid;
+        }
     };
 
 
@@ -105,30 +131,44 @@ public:
     // -------------- PROPERTIES -------------- //
     // ---------------------------------------- //
 
-    std::vector<vertex_type*> vertices;
+    std::vector<vertex_type> vertices;  // gaps in the id range are default constructed, with id NO_VID
+
+    edge_id_type edge_count = 0;
 
 
     // ---------------------------------------- //
     // --------------- METHODS ---------------- //
     // ---------------------------------------- // 
 
-    /** 
-     * TODO: provide a destructor that de-allocates dynamic memory. 
-     */
+    Graph() {}
 
-    // returns true if vid is negative or occupied 
+    Graph(const Graph&) = delete;
+    Graph& operator=(const Graph&) = delete;
+
+    // the arena frees the edges, everything else is held by value.
+    ~Graph() {}
+
+    // makes room for the given total numbers of vertices and edges.
+    void reserve(vertex_id_type num_vertices, edge_id_type num_edges) {
+        vertices.reserve(num_vertices);
+        if (num_edges > edge_count) {
+            edges.reserve(num_edges - edge_count);
+        }
+    }
+
+    // returns false if vid is negative or occupied
     bool add_vertex(vertex_id_type vid, const VertexData& vdata = VertexData()) {
-        if (vid < 0) {
+        if (vid < 0 || vid == NO_VID) {
             return false;
         }
-        if (vid >= vertices.size()) {
-            vertices.resize(vid + 1, new vertex_type());    // fill gaps with default constructed 
-                                                            // vertices. They have negative id's.
+        if (vid >= (vertex_id_type) vertices.size()) {
+            vertices.resize(vid + 1);   // with default constructed vertices in the gap
         }
-        if (vertices[vid]->id() > 0) {    // the vid is occupied
+        if (vertices[vid].id() != NO_VID) {    // the vid is occupied
             return false;
         }
-        vertices[vid] = new vertex_type(vid, vdata);
+        vertices[vid].vid = vid;
+        vertices[vid].vdata = vdata;
         return true;
     }
 
@@ -136,33 +176,44 @@ public:
     bool add_edge(vertex_id_type source, vertex_id_type target,
                   const EdgeData& edata = EdgeData()) {
         if (source == target    // self edge
-            || source < 0 || source >= vertices.size() || vertices[source]->id() < 0     // source invalid
-            || source < 0 || source >= vertices.size() || vertices[source]->id() < 0) {  // target invalid
+            || !valid(source)
+            || !valid(target)) {
             return false;
         }
 
-        edge_type *e = new edge_type(*this, source ,target, edata);
+        edge_type *e = edges.create(*this, source, target, edge_count++, edata);
 
         // set has_opposite if needed
-        for (int i = 0; i < vertices[target]->out_edges.size(); i++) {
-            if (vertices[target]->out_edges[i]->target().id() == source) {
+        for (edge_type *out : vertices[target].out_edges) {
+            if (out->target_vid == source) {
                 e->has_opposite = true;
-                vertices[target]->out_edges[i]->has_opposite = true;
+                out->has_opposite = true;
             }
         }
 
-        vertices[source]->out_edges.push_back(e);
-        vertices[target]->in_edges.push_back(e);
+        vertices[source].out_edges.push_back(e);
+        vertices[target].in_edges.push_back(e);
         return true;
     }
 
     vertex_type& vertex(vertex_id_type vid) {
-        return *(vertices.at(vid));
+        return vertices.at(vid);
     }
 
-    int num_vertices() {
+    vertex_id_type num_vertices() {
         return vertices.size();
     }
+
+    edge_id_type num_edges() {
+        return edge_count;
+    }
+
+private:
+    object_arena<edge_type> edges;
+
+    bool valid(vertex_id_type vid) const {
+        return vid >= 0 && vid < (vertex_id_type) vertices.size() && vertices[vid].id() != NO_VID;
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef __SPINLOCK_H
+#define __SPINLOCK_H
+
+#include <atomic>
+#include <thread>
+
+/**
+ * A test-and-test-and-set lock. Small enough to keep one per vertex.
+ */
+class spinlock {
+    std::atomic<bool> locked;
+
+public:
+    spinlock(): locked(false) {}
+
+    void lock() {
+        while (locked.exchange(true, std::memory_order_acquire)) {
+            while (locked.load(std::memory_order_relaxed)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    bool try_lock() {
+        return !locked.load(std::memory_order_relaxed)
+               && !locked.exchange(true, std::memory_order_acquire);
+    }
+
+    void unlock() {
+        locked.store(false, std::memory_order_release);
+    }
+};
+
+#endif
@@ -8,8 +8,24 @@
  * vertex data sizes are very different (if one's slot size is 2 times 
  * the other or more). Fix this when removing the above assumption.
  * 
- * * Implement dirty-checks when removing data instead of writing
- * back to the main memory all the time.
+ * Every core has its own SPM, so an spm_interface is owned by one thread
+ * and nothing in it is locked. The same data may be in the SPMs of several
+ * cores. Write-backs are therefore limited to dirty slots (written with
+ * write_x), it is the engine's responsibility that only one core writes
+ * the same data.
+ *
+ * Layout of SPM (spm_size bytes plus the indexes):
+ *   [slab metadata][vertex index][edge index][vertex slab ->      <- edge slab]
+ *
+ * The residency indexes map the main memory address of the data in a slot
+ * to the slot, so that finding data in SPM does not scan the slabs. Each
+ * is an open-addressing hash table with linear probing of index_entries
+ * 16-bit entries (the next power of two from the number of slots that fit), 4 to a word. An entry is the SPM address of a slot
+ * divided by the word size, or 0 if it is empty. The key of an
+ * entry is not stored, it is read from the slot (the first word of every
+ * slot is its main memory address, the lowest bit of which is the dirty
+ * bit). Deletions shift the following entries back instead of leaving
+ * tombstones.
  */
 
 #ifndef __SPM_INTERFACE_H
@@ -17,11 +33,13 @@
 
 #include "new_arch.hpp"
 #include "simple_graph.hpp"
+#include "../graphlab/util/empty.hpp"
 
 #include <stdexcept>
-#include <mutex>
-
-using namespace new_arch;
+#include <vector>
+#include <algorithm>     // min
+#include <type_traits>  // is_same
+#include <stdint.h>
 
 #define SPM_POINTER_SZ      sizeof(spm_addr_type)
 #define ADDR_VSLAB_END      0
@@ -29,14 +47,27 @@ using namespace new_arch;
 #define ADDR_ESLAB_END      (2 * SPM_POINTER_SZ)
 #define ADDR_EEMPTY_HEAD    (3 * SPM_POINTER_SZ)
 
-#define VSLAB_START         (4 * SPM_POINTER_SZ)
+#define INDEX_ENTRY_SZ      2
+#define ADDR_VINDEX         (4 * SPM_POINTER_SZ)
+
 #define SPM_NULL            spm_addr_type(0)    // 0 is reserved, can be considered as null
+#define SLOT_DIRTY          word(1)             // in the main memory address of a slot, which is word-aligned
+
+/**
+ * read_x and write_x move data that fits into a word between SPM and registers.
+ * graphlab::empty has no value, so there is nothing to convert.
+ */
+template<typename DataType>
+inline DataType word_to_data(new_arch::word w) { return DataType(w); }
 
-int num_esq = 0; // test 
-int num_v = 0; // test 
-int num_e = 0; // test
+template<>
+inline graphlab::empty word_to_data<graphlab::empty>(new_arch::word w) { return graphlab::empty(); }
 
-std::string in;
+template<typename DataType>
+inline new_arch::word data_to_word(const DataType& data) { return new_arch::word(data); }
+
+template<>
+inline new_arch::word data_to_word<graphlab::empty>(const graphlab::empty& data) { return 0; }
 
 template<typename GraphType>
 class spm_interface {
@@ -46,45 +77,86 @@ class spm_interface {
     typedef typename GraphType::edge_type edge_type;
     typedef typename GraphType::vertex_data_type vertex_data_type;
     typedef typename GraphType::edge_data_type edge_data_type;
-
-
-    // ! turn these into macros so that additional memory access is not necessary.
-    const new_arch::size_t v_slot_size = sizeof(vertex_data_type) + sizeof(vertex_data_type *);  
-    const new_arch::size_t e_slot_size = sizeof(edge_data_type) + sizeof(edge_data_type *);
+    typedef new_arch::spm_addr_type spm_addr_type;
+    typedef new_arch::word word;
 
     /**
-     * The mutexes below regulate insertion to and deletio from their respective slabs.
-     * Access to individual slots is not regulated since it is the engine's responsiblity
-     * to ensure that two threads never access the same edge or vertex data simultaneously
+     * graphlab::empty data is never brought to SPM. Its slab and index take no
+     * space, the whole SPM goes to the other kind of data, and the functions
+     * for it return right away (the branches on these are resolved at compile
+     * time, so the engine's calls for empty data compile to nothing).
      */
-    std::mutex vslab_mutex;
-    std::mutex eslab_mutex;
+    static constexpr bool has_vdata = !std::is_same<vertex_data_type, graphlab::empty>::value;
+    static constexpr bool has_edata = !std::is_same<edge_data_type, graphlab::empty>::value;
 
+    static constexpr new_arch::size_t v_slot_size = has_vdata ? sizeof(vertex_data_type) + sizeof(vertex_data_type *) : 0;
+    static constexpr new_arch::size_t e_slot_size = has_edata ? sizeof(edge_data_type) + sizeof(edge_data_type *) : 0;
 
-    /**
-     * read_x and write_x normally do not have to be executed in mutual exclusion with
-     * load_x and remove_x since the latter two do not modify existing data in SPM.
-     * However, load_x may result in the opposite being shrunk, in which case it may
-     * cause errors in read_x and write_x. The two mutexes below are used to lock in that
-     * specific case. 
-     */
-    std::mutex vslot_reloc_mutex;
-    std::mutex eslot_reloc_mutex;
+    const new_arch::size_t spm_size;    // without the indexes
+    const int index_bits;               // log2(index_entries)
+    const int index_entries;            // per index, a power of two
+    const spm_addr_type addr_eindex;
+    const spm_addr_type vslab_start;
+    const spm_addr_type spm_end;
+
+    new_arch::core c;                   // the simulated SPM of this core and its DMA queue
+
+    // occupied slots. Kept by the simulator, they are not in SPM.
+    long num_vslots = 0;
+    long num_eslots = 0;
 
 public:
 
-    long int num_failed_loads = 0;  // test-purpose counter
+    // test-purpose counters, read and reset by the engine (see engine_metrics.hpp)
+    long int num_failed_loads = 0;  // loads dropped because the SPM was full
+    long int num_evictions = 0;     // slots freed by remove_vdata, remove_edata and remove_edata_range
+    long int num_compactions = 0;   // the opposite slab was compacted to make room for a load
 
     /**
-     * constructor initializes the fixed-size metadata at the beginning of SPM.
+     * constructor allocates an SPM of spm_size bytes (metadata and slabs) and
+     * initializes the fixed-size metadata at the beginning of it. The indexes
+     * are empty since the SPM starts out zeroed.
      */
-    spm_interface() {
-        REG2SPM(ADDR_VSLAB_END, VSLAB_START);  // store v_slab_end
+    explicit spm_interface(new_arch::size_t spm_size = new_arch::DEFAULT_SPM_SIZE,
+                           const new_arch::timing_model& timing = new_arch::timing_model())
+        : spm_size(spm_size),
+          index_bits(index_bits_for(spm_size)),
+          index_entries(1 << index_bits),
+          addr_eindex(ADDR_VINDEX + (has_vdata ? index_entries * INDEX_ENTRY_SZ : 0)),
+          vslab_start(addr_eindex + (has_edata ? index_entries * INDEX_ENTRY_SZ : 0)),
+          spm_end(spm_size + vslab_start - ADDR_VINDEX),
+          c(spm_end, timing) {
+        if (spm_size % sizeof(word) > 0 || spm_size < new_arch::size_t(ADDR_VINDEX + v_slot_size + e_slot_size)) {
+            throw std::runtime_error("invalid SPM size");
+        }
+        if (spm_end / sizeof(word) > 0xFFFF) {
+            throw std::runtime_error("SPM too big for 16-bit index entries");
+        }
+        REG2SPM(ADDR_VSLAB_END, vslab_start);  // store v_slab_end
         REG2SPM(ADDR_VEMPTY_HEAD, SPM_NULL);  // store v_empty_head
-        REG2SPM(ADDR_ESLAB_END, SPM_SIZE - e_slot_size); // store e_slab_end
+        REG2SPM(ADDR_ESLAB_END, spm_end - e_slot_size); // store e_slab_end
         REG2SPM(ADDR_EEMPTY_HEAD, SPM_NULL); // store e_empty_head
     }
 
+    // the SPM is not shared, copies would be separate SPMs that refer to each other's memory.
+    spm_interface(const spm_interface&) = delete;
+    spm_interface& operator=(const spm_interface&) = delete;
+
+    new_arch::size_t size() const { return spm_size; }
+
+    // bytes of the slabs, in use and overall.
+    long used_bytes() const { return num_vslots * v_slot_size + num_eslots * e_slot_size; }
+    long capacity_bytes() const { return spm_end - vslab_start; }
+
+    long vertex_slot_size() const { return v_slot_size; }
+    long edge_slot_size() const { return e_slot_size; }
+
+    // the core this SPM belongs to, for its cycle counters.
+    new_arch::core& get_core() { return c; }
+
+    // waits until all the loads and write-backs issued so far are done.
+    void barrier() { new_arch::BARRIER(c); }
+
     // ------------------------------------------ //
     // ---- FUNCTIONS RELATED TO VERTEX DATA ---- //
     // ------------------------------------------ //
@@ -122,85 +194,84 @@ public:
      * both as an in_neigh and out_neigh).
      */
     bool load_vdata(const vertex_type &v) {
-        if (find_vdata(v) != SPM_NULL) {
+        if constexpr (!has_vdata) {
             return false;
-        }
-        // ensure exclusive access to VEMPTY_HEAD and VSLAB_END
-        std::unique_lock<std::mutex> lock(vslab_mutex);
-        // if there is an empty slot in the vertex slab, store there
-        spm_addr_type head = (spm_addr_type) SPM2REG(ADDR_VEMPTY_HEAD);
-        if (head != SPM_NULL) {
-            // advance VEMPTY_HEAD
-            spm_addr_type tail = SPM2REG(head + sizeof(vertex_data_type *));
-            REG2SPM(ADDR_VEMPTY_HEAD, tail);
-
-            internal_load_vdata(v, head);
-            return true;
-        }
-
-        // if extending the vertex slab will not cause collision with the edge slab
-        spm_addr_type end = (spm_addr_type) SPM2REG(ADDR_VSLAB_END);
-            // uppermost edge slab entry begins at ESLAB_END + e_slot_size
-        if (end + v_slot_size <= SPM2REG(ADDR_ESLAB_END) + e_slot_size) {
-            // extend vertex slab
-            REG2SPM(ADDR_VSLAB_END, end + v_slot_size);
-
-            internal_load_vdata(v, end);
-            return true;
-        }
+        } else {
+            if (find_vdata(v) != SPM_NULL) {
+                return false;
+            }
+            // if there is an empty slot in the vertex slab, store there
+            spm_addr_type head = (spm_addr_type) SPM2REG(ADDR_VEMPTY_HEAD);
+            if (head != SPM_NULL) {
+                // advance VEMPTY_HEAD
+                spm_addr_type tail = SPM2REG(head + sizeof(vertex_data_type *));
+                REG2SPM(ADDR_VEMPTY_HEAD, tail);
 
-        // if there are empty slots in the edge slab, compress it.
-        {   // local scope for the locks
+                internal_load_vdata(v, head);
+                return true;
+            }
 
-            std::unique_lock<std::mutex> lock2(eslab_mutex);
-            std::unique_lock<std::mutex> lock3(eslot_reloc_mutex);
+            // if extending the vertex slab will not cause collision with the edge slab
+            spm_addr_type end = (spm_addr_type) SPM2REG(ADDR_VSLAB_END);
+                // uppermost edge slab entry begins at ESLAB_END + e_slot_size
+            if (end + v_slot_size <= SPM2REG(ADDR_ESLAB_END) + e_slot_size) {
+                // extend vertex slab
+                REG2SPM(ADDR_VSLAB_END, end + v_slot_size);
 
-            spm_addr_type edge_head = (spm_addr_type) SPM2REG(ADDR_EEMPTY_HEAD);
-            if (edge_head != SPM_NULL) {
-                num_esq++;
-                spm_addr_type edge_end = SPM2REG(ADDR_ESLAB_END);
-                word end_mm_addr = SPM2REG(edge_end + e_slot_size);
+                internal_load_vdata(v, end);
+                return true;
+            }
 
-                if (end_mm_addr == SPM_NULL) {  // if the last slot is an empty slot
-                    // scan linked list until the parent of the last slot is found
-                    // TODO: if two SPM pointers fit into a slot, use a doubly linked list to avoid linear scan
-                    spm_addr_type cur = SPM2REG(ADDR_EEMPTY_HEAD);
-                    if (cur == edge_end + e_slot_size) {  // last slot is head
-                        REG2SPM(ADDR_EEMPTY_HEAD, SPM_NULL);
-                    } else {
-                        //cur = SPM2REG(cur + sizeof(edge_data_type *));  // advance cur
-                        while (cur != SPM_NULL &&  SPM2REG(cur + sizeof(edge_data_type *)) != edge_end + e_slot_size) {
-                            cur = SPM2REG(cur + sizeof(edge_data_type *));
-                        }
-                        if (cur != SPM_NULL) {  // cur is the parent of the last node
-                            spm_addr_type grandchild = SPM2REG(edge_end + e_slot_size + sizeof(edge_data_type *));
-                            REG2SPM(cur + sizeof(edge_data_type *), grandchild); // make cur point to grandchild
+            // if there are empty slots in the edge slab, compress it.
+            {
+                spm_addr_type edge_head = (spm_addr_type) SPM2REG(ADDR_EEMPTY_HEAD);
+                if (edge_head != SPM_NULL) {
+                    num_compactions++;
+                    spm_addr_type edge_end = SPM2REG(ADDR_ESLAB_END);
+                    word end_mm_addr = SPM2REG(edge_end + e_slot_size);
+
+                    if (end_mm_addr == SPM_NULL) {  // if the last slot is an empty slot
+                        // scan linked list until the parent of the last slot is found
+                        // TODO: if two SPM pointers fit into a slot, use a doubly linked list to avoid linear scan
+                        spm_addr_type cur = SPM2REG(ADDR_EEMPTY_HEAD);
+                        if (cur == edge_end + e_slot_size) {  // last slot is head
+                            REG2SPM(ADDR_EEMPTY_HEAD, SPM_NULL);
+                        } else {
+                            //cur = SPM2REG(cur + sizeof(edge_data_type *));  // advance cur
+                            while (cur != SPM_NULL &&  SPM2REG(cur + sizeof(edge_data_type *)) != edge_end + e_slot_size) {
+                                cur = SPM2REG(cur + sizeof(edge_data_type *));
+                            }
+                            if (cur != SPM_NULL) {  // cur is the parent of the last node
+                                spm_addr_type grandchild = SPM2REG(edge_end + e_slot_size + sizeof(edge_data_type *));
+                                REG2SPM(cur + sizeof(edge_data_type *), grandchild); // make cur point to grandchild
+                            }
                         }
+                    } else {
+                        // advance edge head
+                        spm_addr_type edge_tail = SPM2REG(edge_head + sizeof(edge_data_type *));
+                        REG2SPM(ADDR_EEMPTY_HEAD, edge_tail);
+
+                        // move last edge slot to edge empty head
+                        word end_data = SPM2REG(edge_end + e_slot_size + sizeof(edge_data_type *));
+                        REG2SPM(edge_head, end_mm_addr);
+                        REG2SPM(edge_head + sizeof(edge_data_type *), end_data);
+                        index_move(addr_eindex, end_mm_addr, edge_end + e_slot_size, edge_head);
                     }
-                } else {
-                    // advance edge head
-                    spm_addr_type edge_tail = SPM2REG(edge_head + sizeof(edge_data_type *));
-                    REG2SPM(ADDR_EEMPTY_HEAD, edge_tail);
-
-                    // move last edge slot to edge empty head
-                    word end_data = SPM2REG(edge_end + e_slot_size + sizeof(edge_data_type *));
-                    REG2SPM(edge_head, end_mm_addr);
-                    REG2SPM(edge_head + sizeof(edge_data_type *), end_data);
-                }
-                // shrink edge slab
-                REG2SPM(ADDR_ESLAB_END, edge_end + e_slot_size);
+                    // shrink edge slab
+                    REG2SPM(ADDR_ESLAB_END, edge_end + e_slot_size);
 
-                // load to the end of v_slab
-                REG2SPM(ADDR_VSLAB_END, end + v_slot_size);
+                    // load to the end of v_slab
+                    REG2SPM(ADDR_VSLAB_END, end + v_slot_size);
  
-                internal_load_vdata(v, end);    
+                    internal_load_vdata(v, end);    
 
-                return true;
+                    return true;
+                }
             }
-        }
-        num_failed_loads++;
+            num_failed_loads++;
 
-        return false;
+            return false;
+        }
     }
 
     /**
@@ -210,30 +281,34 @@ public:
      * Returns false if vertex data is not in SPM.
      */
     bool remove_vdata(const vertex_type &v) {
-        // ensure exclusive access to VEMPTY_HEAD and VSLAB_END
-        std::unique_lock<std::mutex> lock(vslab_mutex);
-
-        spm_addr_type rm_addr = find_vdata(v);
-        if (rm_addr == SPM_NULL) {
+        if constexpr (!has_vdata) {
             return false;
-        }
-        // store back to main memory before removal
-        // ! a dirty check may be implemented in the future. Always write back for now.
-        // !!!! write backs are eliminated for the hit/miss tests in order to run the tests faster
-        // !!!! GAS functions operate purely on the main memory copy.
-        SPM2MEM(&(v.data()), rm_addr + sizeof(vertex_data_type *), sizeof(vertex_data_type));
-
-        if (rm_addr + v_slot_size == SPM2REG(ADDR_VSLAB_END)) {
-            // removal from the end, shrink vertex slab.
-            REG2SPM(ADDR_VSLAB_END, rm_addr);
         } else {
-            // add the freed slot to the empty list
-            spm_addr_type head = SPM2REG(ADDR_VEMPTY_HEAD);
-            REG2SPM(rm_addr, SPM_NULL); // put empty marker into freed slot
-            REG2SPM(rm_addr + sizeof(vertex_data_type *), head); // link head to freed slot
-            REG2SPM(ADDR_VEMPTY_HEAD, rm_addr); // change head pointer to freed slot
+            spm_addr_type rm_addr = find_vdata(v);
+            if (rm_addr == SPM_NULL) {
+                return false;
+            }
+            // store back to main memory before removal if the SPM copy was written.
+            // !!!! GAS functions operate purely on the main memory copy, so the copies are never dirty for now.
+            if (SPM2REG(rm_addr) & SLOT_DIRTY) {
+                SPM2MEM(&(v.data()), rm_addr + sizeof(vertex_data_type *), sizeof(vertex_data_type));
+            }
+            index_erase(ADDR_VINDEX, (word) &(v.data()), rm_addr);  // before the slot is overwritten, the index reads keys from slots
+            num_vslots--;
+            num_evictions++;
+
+            if (rm_addr + v_slot_size == SPM2REG(ADDR_VSLAB_END)) {
+                // removal from the end, shrink vertex slab.
+                REG2SPM(ADDR_VSLAB_END, rm_addr);
+            } else {
+                // add the freed slot to the empty list
+                spm_addr_type head = SPM2REG(ADDR_VEMPTY_HEAD);
+                REG2SPM(rm_addr, SPM_NULL); // put empty marker into freed slot
+                REG2SPM(rm_addr + sizeof(vertex_data_type *), head); // link head to freed slot
+                REG2SPM(ADDR_VEMPTY_HEAD, rm_addr); // change head pointer to freed slot
+            }
+            return true;
         }
-        return true;
     }
 
     /**
@@ -242,13 +317,16 @@ public:
      * The data read is returned in argument ret_data.
      */
     bool read_vdata(const vertex_type &v, vertex_data_type &ret_data) {
-        std::unique_lock<std::mutex> lock(vslot_reloc_mutex);
-        spm_addr_type addr = find_vdata(v);
-        if (addr == SPM_NULL) {
+        if constexpr (!has_vdata) {
             return false;
         } else {
-            ret_data = vertex_data_type(SPM2REG(addr + sizeof(vertex_data_type *)));
-            return true;
+            spm_addr_type addr = find_vdata(v);
+            if (addr == SPM_NULL) {
+                return false;
+            } else {
+                ret_data = word_to_data<vertex_data_type>(SPM2REG(addr + sizeof(vertex_data_type *)));
+                return true;
+            }
         }
     }
 
@@ -258,13 +336,17 @@ public:
      * The data read is returned in argument ret_data..
      */
     bool write_vdata(const vertex_type &v, const vertex_data_type &w_data) {
-        std::unique_lock<std::mutex> lock(vslot_reloc_mutex);
-        spm_addr_type addr = find_vdata(v);
-        if (addr == SPM_NULL) {
+        if constexpr (!has_vdata) {
             return false;
         } else {
-            REG2SPM(addr + sizeof(vertex_data_type *), word(w_data));
-            return true;
+            spm_addr_type addr = find_vdata(v);
+            if (addr == SPM_NULL) {
+                return false;
+            } else {
+                REG2SPM(addr, SPM2REG(addr) | SLOT_DIRTY);
+                REG2SPM(addr + sizeof(vertex_data_type *), data_to_word(w_data));
+                return true;
+            }
         }
     }
 
@@ -280,79 +362,78 @@ public:
      * TODO: implement a check for the line above
      */
     bool load_edata(const edge_type &e) {
-        {
-            // ensure exclusive access to EEMPTY_HEAD and ESLAB_END
-            std::unique_lock<std::mutex> lock(eslab_mutex);
-
-            // if there is an empty slot in the edge slab, store there
-            spm_addr_type head = (spm_addr_type) SPM2REG(ADDR_EEMPTY_HEAD);
-            if (head != SPM_NULL) {
-                // advance EEMPTY_HEAD
-                spm_addr_type tail = SPM2REG(head + sizeof(edge_data_type *));
-                REG2SPM(ADDR_EEMPTY_HEAD, tail);
-
-                internal_load_edata(e, head);
-                return true;
-            }
-            // if extending the edge slab will not cause collision with the vertex slab
-            spm_addr_type end = (spm_addr_type) SPM2REG(ADDR_ESLAB_END);
-            if (end - e_slot_size >= SPM2REG(ADDR_VSLAB_END)) {
-                // extend edge slab
-                REG2SPM(ADDR_ESLAB_END, end - e_slot_size);
-                internal_load_edata(e, end);
-                return true;
+        if constexpr (!has_edata) {
+            return false;
+        } else {
+            {
+                // if there is an empty slot in the edge slab, store there
+                spm_addr_type head = (spm_addr_type) SPM2REG(ADDR_EEMPTY_HEAD);
+                if (head != SPM_NULL) {
+                    // advance EEMPTY_HEAD
+                    spm_addr_type tail = SPM2REG(head + sizeof(edge_data_type *));
+                    REG2SPM(ADDR_EEMPTY_HEAD, tail);
+
+                    internal_load_edata(e, head);
+                    return true;
+                }
+                // if extending the edge slab will not cause collision with the vertex slab
+                spm_addr_type end = (spm_addr_type) SPM2REG(ADDR_ESLAB_END);
+                if (end - e_slot_size >= SPM2REG(ADDR_VSLAB_END)) {
+                    // extend edge slab
+                    REG2SPM(ADDR_ESLAB_END, end - e_slot_size);
+                    internal_load_edata(e, end);
+                    return true;
+                }
             }
-        }   // end of local scope with e_slab_mutex. Need to release it and re-acqquire after
-            // vslab_mutex in the next local scope to avoid deadlocks.
-
-        // if there are empty slots in the vertex slab, compress it.
-        {   // local scope for the lock on vslab_mutex
-            std::unique_lock<std::mutex> lock1(vslab_mutex);
-            std::unique_lock<std::mutex> lock2(eslab_mutex);
-            std::unique_lock<std::mutex> lock3(vslot_reloc_mutex);
-            spm_addr_type vertex_head = (spm_addr_type) SPM2REG(ADDR_VEMPTY_HEAD);
-            if (vertex_head != SPM_NULL) {
-                spm_addr_type vertex_end = SPM2REG(ADDR_VSLAB_END);
-                word end_mm_addr = SPM2REG(vertex_end - v_slot_size);
-                if (end_mm_addr == SPM_NULL) {  // if the last slot is an empty slot
-                    // scan linked list until the parent of the last slot is found
-                    // TODO: if two SPM pointers fit into a slot, use a doubly linked list to avoid linear scan
-                    spm_addr_type cur = SPM2REG(ADDR_VEMPTY_HEAD);
-                    if (cur == vertex_end - v_slot_size) {  // last slot is head
-                        REG2SPM(ADDR_VEMPTY_HEAD, SPM_NULL);
-                    } else {
-                        //cur = SPM2REG(cur + sizeof(vertex_data_type *));  // advance cur
-                        while (cur != SPM_NULL &&  SPM2REG(cur + sizeof(vertex_data_type *)) != vertex_end - v_slot_size) {
-                            cur = SPM2REG(cur + sizeof(vertex_data_type *));
-                        }
-                        if (cur != SPM_NULL) {  // cur is the parent of the last node
-                            spm_addr_type grandchild = SPM2REG(vertex_end - v_slot_size + sizeof(vertex_data_type *));
-                            REG2SPM(cur + sizeof(vertex_data_type *), grandchild); // make cur point to grandchild
+
+            // if there are empty slots in the vertex slab, compress it.
+            {
+                spm_addr_type vertex_head = (spm_addr_type) SPM2REG(ADDR_VEMPTY_HEAD);
+                if (vertex_head != SPM_NULL) {
+                    num_compactions++;
+                    spm_addr_type vertex_end = SPM2REG(ADDR_VSLAB_END);
+                    word end_mm_addr = SPM2REG(vertex_end - v_slot_size);
+                    if (end_mm_addr == SPM_NULL) {  // if the last slot is an empty slot
+                        // scan linked list until the parent of the last slot is found
+                        // TODO: if two SPM pointers fit into a slot, use a doubly linked list to avoid linear scan
+                        spm_addr_type cur = SPM2REG(ADDR_VEMPTY_HEAD);
+                        if (cur == vertex_end - v_slot_size) {  // last slot is head
+                            REG2SPM(ADDR_VEMPTY_HEAD, SPM_NULL);
+                        } else {
+                            //cur = SPM2REG(cur + sizeof(vertex_data_type *));  // advance cur
+                            while (cur != SPM_NULL &&  SPM2REG(cur + sizeof(vertex_data_type *)) != vertex_end - v_slot_size) {
+                                cur = SPM2REG(cur + sizeof(vertex_data_type *));
+                            }
+                            if (cur != SPM_NULL) {  // cur is the parent of the last node
+                                spm_addr_type grandchild = SPM2REG(vertex_end - v_slot_size + sizeof(vertex_data_type *));
+                                REG2SPM(cur + sizeof(vertex_data_type *), grandchild); // make cur point to grandchild
+                            }
                         }
+                    } else {
+                        // advance vertex head
+                        spm_addr_type vertex_tail = SPM2REG(vertex_head + sizeof(vertex_data_type *));
+                        REG2SPM(ADDR_VEMPTY_HEAD, vertex_tail);
+
+                        // move last vertex slot to vertex empty head
+                        word end_data = SPM2REG(vertex_end - v_slot_size + sizeof(edge_data_type *));
+                        REG2SPM(vertex_head, end_mm_addr);
+                        REG2SPM(vertex_head + sizeof(edge_data_type *), end_data);
+                        index_move(ADDR_VINDEX, end_mm_addr, vertex_end - v_slot_size, vertex_head);
                     }
-                } else {
-                    // advance vertex head
-                    spm_addr_type vertex_tail = SPM2REG(vertex_head + sizeof(vertex_data_type *));
-                    REG2SPM(ADDR_VEMPTY_HEAD, vertex_tail);
-
-                    // move last vertex slot to vertex empty head
-                    word end_data = SPM2REG(vertex_end - v_slot_size + sizeof(edge_data_type *));
-                    REG2SPM(vertex_head, end_mm_addr);
-                    REG2SPM(vertex_head + sizeof(edge_data_type *), end_data);
-                }
-                // shrink vertex slab
-                REG2SPM(ADDR_VSLAB_END, vertex_end - v_slot_size);
+                    // shrink vertex slab
+                    REG2SPM(ADDR_VSLAB_END, vertex_end - v_slot_size);
 
-                // load to the end of e_slab
-                spm_addr_type end = (spm_addr_type) SPM2REG(ADDR_ESLAB_END);
-                REG2SPM(ADDR_ESLAB_END, end - e_slot_size);
-                internal_load_edata(e, end);    
+                    // load to the end of e_slab
+                    spm_addr_type end = (spm_addr_type) SPM2REG(ADDR_ESLAB_END);
+                    REG2SPM(ADDR_ESLAB_END, end - e_slot_size);
+                    internal_load_edata(e, end);    
 
-                return true;
+                    return true;
+                }
             }
+            num_failed_loads++;
+            return false;
         }
-        num_failed_loads++;
-        return false;
     }
 
     /**
@@ -362,30 +443,125 @@ public:
      * Returns false if edge data is not in SPM.
      */
     bool remove_edata(const edge_type &e) {
-        // ensure exclusive access to EEMPTY_HEAD and ESLAB_END
-        std::unique_lock<std::mutex> lock(eslab_mutex);
-
-        spm_addr_type rm_addr = find_edata(e);
-        if (rm_addr == SPM_NULL) {
+        if constexpr (!has_edata) {
             return false;
+        } else {
+            spm_addr_type rm_addr = find_edata(e);
+            if (rm_addr == SPM_NULL) {
+                return false;
+            }
+            // store back to main memory before removal if the SPM copy was written.
+            if (SPM2REG(rm_addr) & SLOT_DIRTY) {
+                SPM2MEM(&(e.data()), rm_addr + sizeof(edge_data_type *), sizeof(edge_data_type));
+            }
+            index_erase(addr_eindex, (word) &(e.data()), rm_addr);
+            num_eslots--;
+            num_evictions++;
+
+            if (rm_addr - e_slot_size == SPM2REG(ADDR_ESLAB_END)) {
+                // removal from the end, shrink edge slab.
+                REG2SPM(ADDR_ESLAB_END, rm_addr);
+            } else {
+                // add the freed slot to the empty list
+                spm_addr_type head = SPM2REG(ADDR_EEMPTY_HEAD);
+                REG2SPM(rm_addr, SPM_NULL); // put empty marker into freed slot
+                REG2SPM(rm_addr + sizeof(edge_data_type *), head); // link head to freed slot
+                REG2SPM(ADDR_EEMPTY_HEAD, rm_addr); // change head pointer to freed slot
+            }
+            return true;
+        }
+    }
+
+    /**
+     * Brings the data of the out edges first .. first + count - 1 of v to SPM.
+     * In a CSR graph the data of these edges is contiguous in main memory, so
+     * it goes into consecutive slots at the end of the edge slab with one
+     * strided transfer and one update of ESLAB_END. The edges that do not fit
+     * there, or whose data is not contiguous, are loaded one by one.
+     *
+     * Returns the number of edges loaded.
+     * ! as for load_edata, should not be called for edata already in SPM.
+     */
+    int load_edata_range(const vertex_type &v, int first, int count) {
+        if constexpr (!has_edata) {
+            return 0;
+        } else {
+            if (count <= 0) {
+                return 0;
+            }
+            const edge_data_type *first_data = &(v.out_edge(first).data());
+            int run = 1;
+            while (run < count && &(v.out_edge(first + run).data()) == first_data + run) {
+                run++;
+            }
+            // the slab grows downwards from ESLAB_END. Edge first goes to the lowest slot of the run.
+            const spm_addr_type end = (spm_addr_type) SPM2REG(ADDR_ESLAB_END);
+            run = std::min<spm_addr_type>(run, (end - SPM2REG(ADDR_VSLAB_END)) / e_slot_size);
+            int loaded = 0;
+            if (run > 1) {
+                const spm_addr_type low = end - (run - 1) * e_slot_size;
+                for (int i = 0; i < run; i++) {
+                    REG2SPM(low + i * e_slot_size, (word) (first_data + i)); // store mm_addresses to SPM
+                }
+                new_arch::NBL2SPM_STRIDED(c, first_data, low + sizeof(edge_data_type *), e_slot_size, sizeof(edge_data_type), run);
+                for (int i = 0; i < run; i++) {
+                    index_insert(addr_eindex, (word) (first_data + i), low + i * e_slot_size);
+                }
+                REG2SPM(ADDR_ESLAB_END, end - run * e_slot_size);
+                num_eslots += run;
+                loaded = run;
+            }
+            for (int i = loaded; i < count; i++) {
+                loaded += load_edata(v.out_edge(first + i));
+            }
+            return loaded;
         }
-        // store back to main memory before removal
-        // ! a dirty check may be implemented in the future. Always write back for now.
-        // !!!! write backs are eliminated for the hit/miss tests in order to run the tests faster
-        // !!!! GAS functions operate purely on the main memory copy.
-        //SPM2MEM(&(e.data()), rm_addr + sizeof(edge_data_type *), sizeof(edge_data_type));
-
-        if (rm_addr - e_slot_size == SPM2REG(ADDR_ESLAB_END)) {
-            // removal from the end, shrink edge slab.
-            REG2SPM(ADDR_ESLAB_END, rm_addr);
+    }
+
+    /**
+     * remove_edata for the out edges first .. first + count - 1 of v, which
+     * updates the slab metadata once. Slots of a run loaded by load_edata_range
+     * are freed from the end of the slab, so the slab shrinks instead of
+     * growing its empty list.
+     *
+     * Returns the number of edges removed.
+     */
+    int remove_edata_range(const vertex_type &v, int first, int count) {
+        if constexpr (!has_edata) {
+            return 0;
         } else {
-            // add the freed slot to the empty list
+            if (count <= 0) {
+                return 0;
+            }
+            spm_addr_type eslab_end = SPM2REG(ADDR_ESLAB_END);
             spm_addr_type head = SPM2REG(ADDR_EEMPTY_HEAD);
-            REG2SPM(rm_addr, SPM_NULL); // put empty marker into freed slot
-            REG2SPM(rm_addr + sizeof(edge_data_type *), head); // link head to freed slot
-            REG2SPM(ADDR_EEMPTY_HEAD, rm_addr); // change head pointer to freed slot
+            int removed = 0;
+            for (int i = 0; i < count; i++) {
+                auto&& e = v.out_edge(first + i);
+                spm_addr_type rm_addr = find_edata(e);
+                if (rm_addr == SPM_NULL) {
+                    continue;
+                }
+                if (SPM2REG(rm_addr) & SLOT_DIRTY) {
+                    SPM2MEM(&(e.data()), rm_addr + sizeof(edge_data_type *), sizeof(edge_data_type));
+                }
+                index_erase(addr_eindex, (word) &(e.data()), rm_addr);
+                num_eslots--;
+
+                if (rm_addr - e_slot_size == eslab_end) {
+                    eslab_end = rm_addr;
+                } else {
+                    REG2SPM(rm_addr, SPM_NULL);
+                    REG2SPM(rm_addr + sizeof(edge_data_type *), head);
+                    head = rm_addr;
+                }
+                removed++;
+            }
+            REG2SPM(ADDR_ESLAB_END, eslab_end);
+            REG2SPM(ADDR_EEMPTY_HEAD, head);
+            num_evictions += removed;
+            return removed;
         }
-        return true;
     }
 
     /**
@@ -394,13 +570,16 @@ public:
      * The data read is returned in argument ret_data.
      */
     bool read_edata(const edge_type &e, edge_data_type &ret_data) {
-        std::unique_lock<std::mutex> lock(eslot_reloc_mutex);
-        spm_addr_type addr = find_edata(e);
-        if (addr == SPM_NULL) {
+        if constexpr (!has_edata) {
             return false;
         } else {
-            ret_data = edge_data_type(SPM2REG(addr + sizeof(edge_data_type *)));
-            return true;
+            spm_addr_type addr = find_edata(e);
+            if (addr == SPM_NULL) {
+                return false;
+            } else {
+                ret_data = word_to_data<edge_data_type>(SPM2REG(addr + sizeof(edge_data_type *)));
+                return true;
+            }
         }
     }
 
@@ -410,32 +589,28 @@ public:
      * The data read is returned in argument ret_data..
      */
     bool write_edata(const edge_type &e, const edge_data_type &w_data) {
-        std::unique_lock<std::mutex> lock(eslot_reloc_mutex);
-        spm_addr_type addr = find_edata(e);
-        if (addr == SPM_NULL) {
+        if constexpr (!has_edata) {
             return false;
         } else {
-            REG2SPM(addr + sizeof(edge_data_type *), word(w_data));
-            return true;
+            spm_addr_type addr = find_edata(e);
+            if (addr == SPM_NULL) {
+                return false;
+            } else {
+                REG2SPM(addr, SPM2REG(addr) | SLOT_DIRTY);
+                REG2SPM(addr + sizeof(edge_data_type *), data_to_word(w_data));
+                return true;
+            }
         }
     }
 
 private:
     /**
-     * Helper function that does a linear search overthe vertex slab 
-     * and locates the slot which contains the data of argument vertex.
+     * Helper function that locates the slot which contains the data of
+     * argument vertex through the vertex index.
      * Returns SPM_NULL if vdata is not in SPM.
      */
     spm_addr_type find_vdata(const vertex_type &v) {
-        spm_addr_type cur = VSLAB_START;
-        spm_addr_type end = SPM2REG(ADDR_VSLAB_END);
-        while (cur < end) {
-            if (SPM2REG(cur) != SPM_NULL && SPM2REG(cur) == (word) &(v.data())) {
-                return cur;
-            }
-            cur += v_slot_size;
-        }
-        return SPM_NULL;
+        return index_find(ADDR_VINDEX, (word) &(v.data()));
     }
 
     /**
@@ -445,23 +620,17 @@ private:
     void internal_load_vdata(const vertex_type &v, spm_addr_type addr) {
         REG2SPM(addr, (word) &(v.data())); // store mm_address to SPM
         NBL2SPM(&(v.data()), addr + sizeof(vertex_data_type *), sizeof(vertex_data_type)); // load vdata to SPM
+        index_insert(ADDR_VINDEX, (word) &(v.data()), addr);
+        num_vslots++;
     }
 
     /**
-     * Helper function that does a linear search over the edge slab 
-     * and locates the slot which contains the data of argument edge.
+     * Helper function that locates the slot which contains the data of
+     * argument edge through the edge index.
      * Returns SPM_NULL if edata is not in SPM.
      */
     spm_addr_type find_edata(const edge_type &e) {
-        spm_addr_type cur = SPM_SIZE - e_slot_size;
-        spm_addr_type end = SPM2REG(ADDR_ESLAB_END);
-        while (cur > end) {
-            if (SPM2REG(cur) != SPM_NULL && SPM2REG(cur) == (word) &(e.data())) {
-                return cur;
-            }
-            cur -= e_slot_size;
-        }
-        return SPM_NULL;
+        return index_find(addr_eindex, (word) &(e.data()));
     }
     /**
      * Helper function used by load_edata once the spm_addr for the load
@@ -470,6 +639,125 @@ private:
     void internal_load_edata(const edge_type &e, spm_addr_type addr) {
         REG2SPM(addr, (word) &(e.data())); // store mm_address to SPM
         NBL2SPM(&(e.data()), addr + sizeof(edge_data_type *), sizeof(edge_data_type)); // load edata to SPM
+        index_insert(addr_eindex, (word) &(e.data()), addr);
+        num_eslots++;
+    }
+
+    // ---- INSTRUCTIONS ON THIS CORE'S SPM ---- //
+
+    word SPM2REG(spm_addr_type spm_addr) {
+        return new_arch::SPM2REG(c, spm_addr);
+    }
+
+    void REG2SPM(spm_addr_type spm_addr, word value) {
+        new_arch::REG2SPM(c, spm_addr, value);
+    }
+
+    void NBL2SPM(const void *mm_addr, spm_addr_type spm_addr, new_arch::size_t size) {
+        new_arch::NBL2SPM(c, mm_addr, spm_addr, size);
+    }
+
+    void SPM2MEM(const void *mm_addr, spm_addr_type spm_addr, new_arch::size_t size) {
+        new_arch::SPM2MEM(c, mm_addr, spm_addr, size);
+    }
+
+    // enough index entries for a slab that takes up the whole SPM, at least a word of them.
+    static int index_bits_for(new_arch::size_t spm_size) {
+        const new_arch::size_t min_slot_size = !has_edata ? v_slot_size :
+                                               !has_vdata ? e_slot_size : std::min(v_slot_size, e_slot_size);
+        const new_arch::size_t max_slots = min_slot_size == 0 ? 0 : (spm_size - ADDR_VINDEX) / min_slot_size;
+        int bits = 2;
+        while ((new_arch::size_t(1) << bits) < max_slots) {
+            bits++;
+        }
+        return bits;
+    }
+
+    // ---- RESIDENCY INDEX ---- //
+
+    // slot of entry i of the index at base, SPM_NULL if the entry is empty.
+    spm_addr_type index_get(spm_addr_type base, int i) {
+        const int shift = (i % 4) * 16;
+        return ((SPM2REG(base + (i / 4) * sizeof(word)) >> shift) & 0xFFFF) * sizeof(word);
+    }
+
+    void index_set(spm_addr_type base, int i, spm_addr_type slot) {
+        const spm_addr_type addr = base + (i / 4) * sizeof(word);
+        const int shift = (i % 4) * 16;
+        const word w = SPM2REG(addr) & ~(word(0xFFFF) << shift);
+        REG2SPM(addr, w | (word(slot / sizeof(word)) << shift));
+    }
+
+    int index_hash(word mm_addr) const {
+        // Fibonacci hashing on the high bits. The low bits of the addresses are always 0 (but for the dirty bit).
+        return (int) (((uint64_t) (mm_addr & ~SLOT_DIRTY) * 0x9E3779B97F4A7C15ull) >> (64 - index_bits));
+    }
+
+    /**
+     * Position of the entry for mm_addr, -1 if there is none. If slot is
+     * given, only the entry of that slot matches.
+     */
+    int index_position(spm_addr_type base, word mm_addr, spm_addr_type slot = SPM_NULL) {
+        int i = index_hash(mm_addr);
+        for (int probes = 0; probes < index_entries; probes++) {
+            const spm_addr_type cur = index_get(base, i);
+            if (cur == SPM_NULL) {
+                return -1;
+            }
+            if (slot == SPM_NULL ? (SPM2REG(cur) & ~SLOT_DIRTY) == mm_addr : cur == slot) {
+                return i;
+            }
+            i = (i + 1) & (index_entries - 1);
+        }
+        return -1;
+    }
+
+    spm_addr_type index_find(spm_addr_type base, word mm_addr) {
+        const int i = index_position(base, mm_addr);
+        return i < 0 ? SPM_NULL : index_get(base, i);
+    }
+
+    // the slot must already contain mm_addr.
+    void index_insert(spm_addr_type base, word mm_addr, spm_addr_type slot) {
+        int i = index_hash(mm_addr);
+        for (int probes = 0; index_get(base, i) != SPM_NULL; probes++) {
+            if (probes == index_entries) {
+                // can only happen if index_entries is less than the number of slots
+                throw std::runtime_error("SPM residency index full");
+            }
+            i = (i + 1) & (index_entries - 1);
+        }
+        index_set(base, i, slot);
+    }
+
+    // called when the data of mm_addr has been moved from old_slot to new_slot.
+    void index_move(spm_addr_type base, word mm_addr, spm_addr_type old_slot, spm_addr_type new_slot) {
+        const int i = index_position(base, mm_addr, old_slot);
+        if (i >= 0) {
+            index_set(base, i, new_slot);
+        }
+    }
+
+    // slot must still contain mm_addr.
+    void index_erase(spm_addr_type base, word mm_addr, spm_addr_type slot) {
+        int hole = index_position(base, mm_addr, slot);
+        if (hole < 0) {
+            return;
+        }
+        // move back the entries that would not be found across the hole.
+        for (int j = (hole + 1) & (index_entries - 1); ; j = (j + 1) & (index_entries - 1)) {
+            const spm_addr_type slot = index_get(base, j);
+            if (slot == SPM_NULL) {
+                break;
+            }
+            const int home = index_hash(SPM2REG(slot));
+            // distance from home to j is at least the distance from hole to j.
+            if (((j - home) & (index_entries - 1)) >= ((j - hole) & (index_entries - 1))) {
+                index_set(base, hole, slot);
+                hole = j;
+            }
+        }
+        index_set(base, hole, SPM_NULL);
     }
 };
 
@@ -0,0 +1,598 @@
+/**
+ * A bulk-synchronous engine, after GraphLab's synchronous_engine.hpp.
+ *
+ * Execution proceeds in iterations (super-steps). In each iteration every
+ * active vertex runs init and gather, then apply, then scatter, with a
+ * barrier between the phases. Within a phase the threads sweep over the
+ * vertex id range in chunks, so consecutive vertices (and their CSR edge
+ * ranges) are processed in order. Vertices signalled during an iteration
+ * are active in the next one. The messages of those signals are combined
+ * (see message_combiner.hpp) and passed to init in the next iteration.
+ *
+ * Since a phase only reads what the previous phase wrote, no neighbourhood
+ * locking is needed. Vertex programs see their neighbours' data as of the end
+ * of the previous apply phase. Scatters may still modify edge data, which
+ * is safe as long as every edge is modified by only one of its endpoints.
+ *
+ * The vertex program objects live for the whole iteration, so members set
+ * in apply (e.g. PageRank's delta) can be used in scatter, as with async_engine.
+ *
+ * The active vertices are kept in a frontier (see frontier.hpp), which is a
+ * sorted id list while few vertices are active and a bitmap otherwise.
+ *
+ * Direction optimization (engine_options::pull_signals, after Beamer et al.,
+ * "Direction-Optimizing Breadth-First Search"): for programs whose scatter over
+ * out edges does nothing but signal the targets, an iteration whose active
+ * vertices have many out edges does not run those scatters. It only records
+ * which vertices would have scattered. The next iteration then sweeps over all
+ * vertices and activates the ones that have such an in neighbour, right before
+ * gathering over their in edges. This replaces one atomic signal per out edge
+ * with a sequential pass over the in edges, which stops at the first hit.
+ * Pulled signals carry no message, so init gets message_type() for them:
+ * programs whose messages carry data must not depend on it.
+ *
+ * Programs on a csr_graph that define gather_source gather over their in
+ * edges with the kernel of gather_kernels.hpp, which runs on the CSC arrays.
+ *
+ * After the edges of the graph were changed with graph_mutations.hpp,
+ * graph_changed() makes the affected vertices active for the next start().
+ *
+ * context.stop() and the budgets of engine_options end the run after the
+ * current iteration. The vertices signalled in it are active in the first
+ * iteration of the next start(). Periodic aggregators (see aggregator.hpp)
+ * run between iterations.
+ *
+ * The worker threads count their vertex updates and edges (and with
+ * engine_options::time_metrics the time at the barriers) in metrics, see
+ * engine_metrics.hpp.
+ *
+ * The worker threads are those of thread_pool::global(), see thread_pool.hpp.
+ *
+ * The SPM is not simulated by this engine.
+ */
+
+#ifndef __SYNCHRONOUS_ENGINE_H
+#define __SYNCHRONOUS_ENGINE_H
+
+#include "../graphlab/graphlab.hpp"
+#include "engine_options.hpp"
+#include "ischeduler.hpp"   // for atomic_bitset
+#include "frontier.hpp"
+#include "message_combiner.hpp"
+#include "gather_cache.hpp"
+#include "gather_kernels.hpp"
+#include "aggregator.hpp"
+#include "engine_metrics.hpp"
+#include "thread_pool.hpp"
+
+#include <vector>
+#include <type_traits>  //for is_base_of
+#include <algorithm>    //min()
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+template<typename VertexProgram>
+class synchronous_engine {
+    // ---------------------------------------- //
+    // --------------- TYPEDEFS --------------- //
+    // ---------------------------------------- //
+public:
+    typedef VertexProgram vertex_program_type;
+    typedef typename VertexProgram::gather_type gather_type;
+    typedef typename VertexProgram::message_type message_type;
+    typedef typename VertexProgram::vertex_data_type vertex_data_type;
+    typedef typename VertexProgram::edge_data_type edge_data_type;
+    typedef typename VertexProgram::graph_type  graph_type;
+    typedef typename graph_type::vertex_type vertex_type;
+    typedef typename graph_type::edge_type edge_type;
+    typedef typename graph_type::vertex_id_type vertex_id_type;
+    typedef graphlab::context<synchronous_engine> context_type;
+    typedef typename context_type::icontext_type icontext_type;
+    typedef graphlab::edge_dir_type edge_dir_type;
+
+    // ---------------------------------------- //
+    // -------------- FUNCTIONS --------------- //
+    // ---------------------------------------- //
+
+    // constructors
+    synchronous_engine(graph_type& g, int num_threads, bool enable_caching = false)
+        : synchronous_engine(g, make_options(num_threads, enable_caching)) {}
+
+    synchronous_engine(graph_type& g, const engine_options& opts): g(g),
+                                                                   context(*this, g),
+                                                                   aggregators(g, context, opts.num_threads),
+                                                                   num_threads(opts.num_threads),
+                                                                   pin_threads(opts.pin_threads),
+                                                                   caching_enabled(opts.enable_caching),
+                                                                   max_iterations(opts.max_iterations),
+                                                                   max_seconds(opts.max_seconds),
+                                                                   max_updates(opts.max_updates),
+                                                                   stop_requested(false),
+                                                                   num_updates(0),
+                                                                   time_metrics(opts.time_metrics),
+                                                                   thread_counters(opts.num_threads),
+                                                                   pull_enabled(opts.pull_signals),
+                                                                   iteration_counter(0),
+                                                                   messages(g.num_vertices()),
+                                                                   cache(opts.enable_caching ? g.num_vertices() : 0),
+                                                                   active_superstep(g.num_vertices(), opts.num_threads,
+                                                                                    g.num_vertices() / BETA),
+                                                                   active_next(g.num_vertices(), opts.num_threads,
+                                                                               g.num_vertices() / BETA),
+                                                                   scattered(g.num_vertices()),
+                                                                   scattered_next(g.num_vertices()),
+                                                                   pulling(false),
+                                                                   pull_next(false),
+                                                                   done(false),
+                                                                   barrier(opts.num_threads) {
+        if (!std::is_base_of<graphlab::ivertex_program<graph_type, gather_type, message_type>, VertexProgram>::value) {
+            throw "type parameter for synchronous egnine is not derived from graphlab::ivertex_program";
+        }
+        vertex_programs.resize(g.num_vertices());
+        gather_accum.resize(g.num_vertices());
+    }
+
+    // called by the application programmer
+    void signal_all();
+    void start();
+    void graph_changed(const std::vector<vertex_id_type>& affected);
+
+    // map-reduce over the vertices, see aggregator.hpp. Periodic ones run between iterations.
+    template<typename ReductionType>
+    bool add_vertex_aggregator(const std::string& key,
+                               std::function<ReductionType(icontext_type&, const vertex_type&)> map_fn,
+                               std::function<void(icontext_type&, const ReductionType&)> finalize_fn) {
+        return aggregators.template add_vertex_aggregator<ReductionType>(key, map_fn, finalize_fn);
+    }
+    bool aggregate_periodic(const std::string& key, double seconds) { return aggregators.aggregate_periodic(key, seconds); }
+    bool aggregate_now(const std::string& key) { return aggregators.aggregate_now(key); }     // between runs
+
+    engine_metrics metrics;     // of the worker threads, merged at the end of every start(), see engine_metrics.hpp
+
+    // called by the context
+    int iteration() const { return iteration_counter; }
+    std::size_t procid() const { return 0; }
+    std::size_t num_procs() const { return 1; }
+    float elapsed_seconds() const {
+        return std::chrono::duration<float>(std::chrono::steady_clock::now() - start_time).count();
+    }
+    void internal_stop() { stop_requested.store(true, std::memory_order_relaxed); }
+    void internal_signal(const vertex_type& vertex, const message_type& message = message_type());
+    void internal_post_delta(const vertex_type& vertex, const gather_type& delta);
+    void internal_clear_gather_cache(const vertex_type& vertex);
+
+private:
+    // ---------------------------------------- //
+    // ------------- DATA MEMBERS ------------- //
+    // ---------------------------------------- //
+    graph_type& g;  // A reference to the input graph.
+
+    // the gather over in edges runs on the CSC arrays, see gather_kernels.hpp.
+    static constexpr bool use_gather_kernel = is_csr_graph<graph_type>::value
+                                              && has_source_gather<VertexProgram>::value;
+
+    // creating a separate context for each vertex program is not necessary. This one is used by all of them.
+    context_type context;
+
+    aggregator<synchronous_engine> aggregators;
+
+    const int num_threads;
+    const bool pin_threads;
+    const bool caching_enabled;
+    const int max_iterations;
+    const double max_seconds;   // of a start(), negative for no limit
+    const long max_updates;
+    std::chrono::steady_clock::time_point start_time;
+    std::atomic<bool> stop_requested;   // by the context or a budget, reset by start()
+    long num_updates;                   // of the current start(), counted by thread 0 between iterations
+    const bool time_metrics;            // measure IDLE_NS at the barriers
+    std::vector<thread_metrics> thread_counters;    // of the current start(), by thread id
+    const bool pull_enabled;
+    int iteration_counter;
+
+    std::vector<VertexProgram> vertex_programs;     // the programs of the current iteration
+    std::vector<gather_type> gather_accum;          // gather results of the current iteration
+    message_combiner<message_type> messages;        // for the next iteration, taken by init
+
+    gather_cache<gather_type> cache;    // empty unless caching is enabled
+
+    /**
+     * active_superstep is read-only during an iteration (except for vertices
+     * activated by pulling). Signals go to active_next, which becomes
+     * active_superstep at the end of the iteration.
+     */
+    frontier<vertex_id_type> active_superstep;
+    frontier<vertex_id_type> active_next;
+
+    // ---- direction optimization ---- //
+    // thresholds of Beamer et al.
+    enum {
+        ALPHA = 14,     // pull once the active vertices have more than num_edges / ALPHA out edges
+        BETA = 24       // push again once less than num_vertices / BETA vertices are active
+    };
+    atomic_bitset scattered;        // vertices that skipped their out edge scatters last iteration
+    atomic_bitset scattered_next;   // the same for the current iteration
+    bool pulling;       // the current iteration activates vertices by pulling
+    bool pull_next;     // the next one does
+    std::atomic<long> active_count;         // active vertices of the current iteration
+    std::atomic<long> active_out_degree;    // and their out edges. Both known after the gather phase.
+
+    // decides whether the scatters of the current iteration are replaced by pulling.
+    bool use_pull() const {
+        if (!pull_enabled) {
+            return false;
+        }
+        if (pulling) {
+            return active_count.load() >= (long) g.num_vertices() / BETA;
+        }
+        return active_out_degree.load() > (long) g.num_edges() / ALPHA;
+    }
+
+    // true if an in neighbour of vid skipped its scatters last iteration.
+    bool pull_signal(vertex_id_type vid);
+
+    // ---------------------------------------- //
+    // --- MULTITHREADING & SYNCHRONIZATION ---- //
+    // ---------------------------------------- //
+
+    /**
+     * A reusable barrier for num_threads threads.
+     */
+    class thread_barrier {
+        std::mutex m;
+        std::condition_variable cv;
+        const int num_threads;
+        int num_waiting;
+        long generation;
+
+    public:
+        explicit thread_barrier(int num_threads): num_threads(num_threads), num_waiting(0), generation(0) {}
+
+        void wait() {
+            std::unique_lock<std::mutex> lock(m);
+            const long my_generation = generation;
+            if (++num_waiting == num_threads) {
+                num_waiting = 0;
+                generation++;
+                cv.notify_all();
+            } else {
+                cv.wait(lock, [&]{ return generation != my_generation; });
+            }
+        }
+    };
+
+    // number of consecutive vertices a thread takes at once in a phase.
+    enum { CHUNK_SIZE = 256 };
+
+    /**
+     * Id of the worker thread (0 .. num_threads - 1) that is running on the current thread.
+     * internal_signal passes it to the frontier. It is 0 on any other thread.
+     */
+    static thread_local int worker_id;
+
+    std::atomic<vertex_id_type> next_chunk[3];  // one per phase, reset between iterations
+    bool done;      // set by thread 0 between iterations
+    thread_barrier barrier;
+
+    static engine_options make_options(int num_threads, bool enable_caching) {
+        engine_options opts;
+        opts.num_threads = num_threads;
+        opts.enable_caching = enable_caching;
+        return opts;
+    }
+
+    void thread_start(int thread_id);
+
+    /**
+     * calls fn(vid) for each active vertex (every vertex if all_vertices), dividing
+     * them among the threads that call it in chunks.
+     */
+    template<typename Fn>
+    void sweep(std::atomic<vertex_id_type>& next, Fn fn, bool all_vertices = false);
+
+    // makes the vertices signalled in the last iteration active. Called by thread 0 only.
+    void prepare_iteration();
+
+    void gather_phase(int thread_id, vertex_id_type vid, long& num_active, long& out_degree);
+    void apply_phase(vertex_id_type vid);
+    void scatter_phase(vertex_id_type vid, bool pull);
+};
+
+/**
+ * implementation below. As in async_engine.hpp, template functions need to be in the header.
+ */
+
+using namespace std;
+
+template<typename VertexProgram>
+thread_local int synchronous_engine<VertexProgram>::worker_id = 0;
+
+template<typename VertexProgram>
+void synchronous_engine<VertexProgram>::internal_signal(const vertex_type& vertex, const message_type& message) {
+    messages.add(vertex.id(), message);
+    active_next.insert(worker_id, vertex.id());
+}
+
+template<typename VertexProgram>
+void synchronous_engine<VertexProgram>::
+internal_post_delta(const vertex_type& vertex, const gather_type& delta) {
+    if (caching_enabled) {
+        cache.post_delta(vertex.id(), delta);   // post_delta from several scatters may hit the same vertex
+    }
+}
+
+template<typename VertexProgram>
+void synchronous_engine<VertexProgram>::
+internal_clear_gather_cache(const vertex_type& vertex) {
+    if (caching_enabled) {
+        cache.invalidate(vertex.id());
+    }
+}
+
+/**
+ * Must be called before start() (or between runs).
+ */
+template<typename VertexProgram>
+void synchronous_engine<VertexProgram>::signal_all() {
+    for (vertex_id_type i = 0; i < g.num_vertices(); i++) {
+        active_next.insert(0, i);
+    }
+}
+
+/**
+ * Resumes after the structure of the graph changed (see graph_mutations.hpp):
+ * the affected vertices are active in the first iteration of the next start(),
+ * with their cached gathers invalidated, as if signalled with message_type().
+ * Must be called between runs, and the number of vertices must be the same.
+ */
+template<typename VertexProgram>
+void synchronous_engine<VertexProgram>::graph_changed(const vector<vertex_id_type>& affected) {
+    for (vertex_id_type vid : affected) {
+        internal_clear_gather_cache(g.vertex(vid));
+        internal_signal(g.vertex(vid));
+    }
+}
+
+template<typename VertexProgram>
+void synchronous_engine<VertexProgram>::start() {
+    start_time = chrono::steady_clock::now();
+    stop_requested = false;
+    num_updates = 0;
+    aggregators.start(0);
+    done = false;
+    prepare_iteration();
+
+    thread_pool::global().run(num_threads, [this](int i){ this->thread_start(i); }, pin_threads);
+    aggregators.run_due(elapsed_seconds(), true);   // the final values
+    for (int i = 0; i < num_threads; i++) {
+        metrics.merge(i, thread_counters[i]);
+        thread_counters[i].clear();
+    }
+}
+
+template<typename VertexProgram>
+void synchronous_engine<VertexProgram>::prepare_iteration() {
+    // the signalled vertices stay in active_next for the next start().
+    if (stop_requested.load(std::memory_order_relaxed)
+        || (max_iterations >= 0 && iteration_counter >= max_iterations)
+        || (max_seconds >= 0 && elapsed_seconds() >= max_seconds)
+        || (max_updates >= 0 && num_updates >= max_updates)) {
+        done = true;
+        return;
+    }
+    active_superstep.clear();
+    std::swap(active_superstep, active_next);
+    scattered.clear_all();
+    std::swap(scattered, scattered_next);
+    pulling = pull_next;
+    pull_next = false;
+
+    bool any_active;
+    if (pulling) {
+        // filled by the gather phase, on top of the vertices that were signalled explicitly.
+        active_superstep.finalize(true);
+        any_active = active_superstep.size() > 0 || scattered.count() > 0;
+    } else {
+        active_superstep.finalize();
+        any_active = active_superstep.size() > 0;
+    }
+    for (int i = 0; i < 3; i++) {
+        next_chunk[i].store(0, std::memory_order_relaxed);
+    }
+    active_count.store(0, std::memory_order_relaxed);
+    active_out_degree.store(0, std::memory_order_relaxed);
+    if (!any_active) {
+        done = true;
+    }
+}
+
+template<typename VertexProgram>
+void synchronous_engine<VertexProgram>::thread_start(int thread_id) {
+    worker_id = thread_id;
+    thread_metrics& m = thread_counters[thread_id];
+    auto wait = [&] {
+        const long wait_start = time_metrics ? metrics_clock_ns() : 0;
+        barrier.wait();
+        if (time_metrics) {
+            m[IDLE_NS] += metrics_clock_ns() - wait_start;
+        }
+    };
+    while (!done) {
+        long num_active = 0, out_degree = 0;
+        sweep(next_chunk[0], [&](vertex_id_type vid) {
+            gather_phase(thread_id, vid, num_active, out_degree);
+        }, pulling);
+        active_count.fetch_add(num_active, std::memory_order_relaxed);
+        active_out_degree.fetch_add(out_degree, std::memory_order_relaxed);
+        wait();
+        sweep(next_chunk[1], [this](vertex_id_type vid) { apply_phase(vid); });
+        wait();
+        const bool pull = use_pull();   // the same on every thread
+        sweep(next_chunk[2], [&](vertex_id_type vid) { scatter_phase(vid, pull); });
+        wait();
+        if (thread_id == 0) {
+            iteration_counter++;
+            num_updates += active_count.load(std::memory_order_relaxed);
+            pull_next = pull;
+            aggregators.run_due(elapsed_seconds());    // the other threads wait at the barrier
+            prepare_iteration();
+        }
+        wait();     // everyone sees done and the new active_superstep
+    }
+}
+
+template<typename VertexProgram>
+template<typename Fn>
+void synchronous_engine<VertexProgram>::sweep(std::atomic<vertex_id_type>& next, Fn fn, bool all_vertices) {
+    const vertex_id_type num_v = g.num_vertices();
+    if (all_vertices || active_superstep.is_dense()) {
+        while (true) {
+            const vertex_id_type begin = next.fetch_add(CHUNK_SIZE, std::memory_order_relaxed);
+            if (begin >= num_v) {
+                return;
+            }
+            const vertex_id_type end = min(begin + CHUNK_SIZE, num_v);
+            for (vertex_id_type vid = begin; vid < end; vid++) {
+                if (all_vertices || active_superstep.contains(vid)) {
+                    fn(vid);
+                }
+            }
+        }
+    } else {
+        const vertex_id_type num_active = active_superstep.size();
+        while (true) {
+            const vertex_id_type begin = next.fetch_add(CHUNK_SIZE, std::memory_order_relaxed);
+            if (begin >= num_active) {
+                return;
+            }
+            const vertex_id_type end = min(begin + CHUNK_SIZE, num_active);
+            for (vertex_id_type i = begin; i < end; i++) {
+                fn(active_superstep[i]);
+            }
+        }
+    }
+}
+
+template<typename VertexProgram>
+bool synchronous_engine<VertexProgram>::pull_signal(vertex_id_type vid) {
+    auto&& cur = g.vertex(vid);
+    const int num_in = cur.num_in_edges();
+    for (int i = 0; i < num_in; i++) {
+        if (scattered.test(cur.in_edge(i).source().id())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * In a pulling iteration, called for every vertex. Otherwise only for active ones.
+ */
+template<typename VertexProgram>
+void synchronous_engine<VertexProgram>::gather_phase(int thread_id, vertex_id_type vid,
+                                                     long& num_active, long& out_degree) {
+    if (pulling && !active_superstep.contains(vid)) {
+        if (!pull_signal(vid)) {
+            return;
+        }
+        active_superstep.insert(thread_id, vid);
+    }
+    num_active++;
+    out_degree += g.vertex(vid).num_out_edges();
+    thread_metrics& m = thread_counters[thread_id];
+    m[VERTEX_UPDATES]++;
+
+    VertexProgram& vprog = vertex_programs[vid];
+    vprog = VertexProgram();
+    auto&& cur = g.vertex(vid);
+    message_type message = message_type();
+    messages.take(vid, message);
+    vprog.init(context, cur, message);
+
+    if (caching_enabled && cache.get(vid, gather_accum[vid])) {
+        return;
+    }
+
+    bool accum_is_set = false;
+    gather_type accum = gather_type();  // imporant to explicitly call the default constructor for basic data types
+
+    const edge_dir_type gather_dir = vprog.gather_edges(context, cur);
+    if (gather_dir == graphlab::IN_EDGES || gather_dir == graphlab::ALL_EDGES) {
+        m[GATHER_EDGES] += cur.num_in_edges();
+        if constexpr (use_gather_kernel) {
+            csr_gather_kernels<vertex_data_type, edge_data_type, vertex_id_type>::gather_in_edges(vprog, g, vid, accum, accum_is_set);
+        } else {
+            const int num_in = cur.num_in_edges();
+            for (int i = 0; i < num_in; i++) {
+                auto&& edge = cur.in_edge(i);
+                if (accum_is_set) {
+                    accum += vprog.gather(context, cur, edge);
+                } else {
+                    accum = vprog.gather(context, cur, edge);
+                    accum_is_set = true;
+                }
+            }
+        }
+    }
+    if (gather_dir == graphlab::OUT_EDGES || gather_dir == graphlab::ALL_EDGES) {
+        const int num_out = cur.num_out_edges();
+        m[GATHER_EDGES] += num_out;
+        for (int i = 0; i < num_out; i++) {
+            auto&& edge = cur.out_edge(i);
+            if (accum_is_set) {
+                accum += vprog.gather(context, cur, edge);
+            } else {
+                accum = vprog.gather(context, cur, edge);
+                accum_is_set = true;
+            }
+        }
+    }
+    gather_accum[vid] = accum;
+
+    // see async_engine::execute_vprog. An unset accumulator "zeroes out" the cache.
+    if (caching_enabled && accum_is_set) {
+        cache.set(vid, accum);
+    }
+}
+
+template<typename VertexProgram>
+void synchronous_engine<VertexProgram>::apply_phase(vertex_id_type vid) {
+    auto&& cur = g.vertex(vid);
+    vertex_programs[vid].apply(context, cur, gather_accum[vid]);
+}
+
+/**
+ * With pull, the out edge scatters are skipped and the next iteration pulls their signals.
+ */
+template<typename VertexProgram>
+void synchronous_engine<VertexProgram>::scatter_phase(vertex_id_type vid, bool pull) {
+    VertexProgram& vprog = vertex_programs[vid];
+    auto&& cur = g.vertex(vid);
+    const edge_dir_type scatter_dir = vprog.scatter_edges(context, cur);
+    if (pull && (scatter_dir == graphlab::OUT_EDGES || scatter_dir == graphlab::ALL_EDGES)) {
+        if (cur.num_out_edges() > 0) {
+            scattered_next.set(vid);
+        }
+    } else if (scatter_dir == graphlab::OUT_EDGES || scatter_dir == graphlab::ALL_EDGES) {
+        const int num_out = cur.num_out_edges();
+        thread_counters[worker_id][SCATTER_EDGES] += num_out;
+        for (int i = 0; i < num_out; i++) {
+            auto&& edge = cur.out_edge(i);
+            vprog.scatter(context, cur, edge);
+        }
+    }
+    if (scatter_dir == graphlab::IN_EDGES || scatter_dir == graphlab::ALL_EDGES) {
+        const int num_in = cur.num_in_edges();
+        thread_counters[worker_id][SCATTER_EDGES] += num_in;
+        for (int i = 0; i < num_in; i++) {
+            auto&& edge = cur.in_edge(i);
+            vprog.scatter(context, cur, edge);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,444 @@
+/**
+ * The communication layer of distributed_engine: num_procs processes that
+ * are connected to each other by TCP (a full mesh), without MPI.
+ *
+ * Process i is given its id and the "host:port" of every process. It listens
+ * on its own port and connects to the processes with lower ids, which are
+ * retried until connect_timeout seconds have passed, so the processes may be
+ * started in any order. The connections from the processes with higher ids
+ * have to arrive before the same deadline. The connections carry the id of
+ * the connecting process first.
+ *
+ * All communication is collective: exchange() sends one buffer to every other
+ * process and receives one from each of them, every process has to call it
+ * the same number of times. The buffers are batches of whatever the caller
+ * wrote into them (see archive.hpp), so an exchange costs one frame per pair
+ * of processes no matter how many messages it carries. Sends and receives of
+ * all the peers are overlapped with nonblocking sockets and poll(), which
+ * avoids the deadlock of two processes that both block sending to each other.
+ *
+ * Errors (a peer that can not be reached or that closes its connection)
+ * throw std::runtime_error.
+ */
+
+#ifndef __TCP_COMM_H
+#define __TCP_COMM_H
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <thread>
+#include <algorithm>     // max
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+class tcp_comm {
+public:
+    tcp_comm(int procid, const std::vector<std::string>& hosts, double connect_timeout = 30)
+        : id(procid), fds(hosts.size(), -1) {
+        if (procid < 0 || procid >= (int) hosts.size()) {
+            throw std::invalid_argument("tcp_comm: procid out of range");
+        }
+        try {
+            connect_all(hosts, connect_timeout);
+        } catch (...) {
+            close_all();
+            throw;
+        }
+    }
+
+    tcp_comm(const tcp_comm&) = delete;
+    tcp_comm& operator=(const tcp_comm&) = delete;
+
+    ~tcp_comm() { close_all(); }
+
+    int procid() const { return id; }
+
+    int num_procs() const { return fds.size(); }
+
+    // splits "host:port,host:port,..." into its entries.
+    static std::vector<std::string> parse_hosts(const std::string& list) {
+        std::vector<std::string> ret;
+        std::string::size_type begin = 0;
+        while (begin <= list.size()) {
+            std::string::size_type end = list.find(',', begin);
+            if (end == std::string::npos) {
+                end = list.size();
+            }
+            if (end > begin) {
+                ret.push_back(list.substr(begin, end - begin));
+            }
+            begin = end + 1;
+        }
+        return ret;
+    }
+
+    /**
+     * Sends send[p] to every process p and fills recv[p] with what p sent to
+     * this one. send[procid()] is moved to recv[procid()]. send is left empty.
+     */
+    void exchange(std::vector<std::vector<char> >& send, std::vector<std::vector<char> >& recv) {
+        const int n = num_procs();
+        send.resize(n);
+        recv.assign(n, std::vector<char>());
+        recv[id].swap(send[id]);
+
+        std::vector<peer_state> peers(n);
+        std::vector<pollfd> pfds;
+        int pending = 0;
+        for (int p = 0; p < n; p++) {
+            if (p == id) {
+                continue;
+            }
+            const uint64_t len = send[p].size();
+            std::memcpy(peers[p].send_header, &len, sizeof(len));
+            pending += 2;   // the send and the receive
+        }
+        while (pending > 0) {
+            pfds.clear();
+            for (int p = 0; p < n; p++) {
+                if (p == id || (peers[p].sent_all && peers[p].received_all)) {
+                    continue;
+                }
+                pollfd pfd;
+                pfd.fd = fds[p];
+                pfd.events = (peers[p].sent_all ? 0 : POLLOUT) | (peers[p].received_all ? 0 : POLLIN);
+                pfd.revents = 0;
+                pfds.push_back(pfd);
+            }
+            if (poll(pfds.data(), pfds.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("tcp_comm: poll failed: ") + strerror(errno));
+            }
+            for (const pollfd& pfd : pfds) {
+                const int p = peer_of(pfd.fd);
+                if (pfd.revents & (POLLOUT | POLLERR | POLLHUP)) {
+                    if (!peers[p].sent_all && send_some(p, peers[p], send[p])) {
+                        pending--;
+                    }
+                }
+                if (pfd.revents & (POLLIN | POLLERR | POLLHUP)) {
+                    if (!peers[p].received_all && receive_some(p, peers[p], recv[p])) {
+                        pending--;
+                    }
+                }
+            }
+        }
+        for (int p = 0; p < n; p++) {
+            std::vector<char>().swap(send[p]);
+        }
+    }
+
+    long all_reduce_sum(long value) {
+        std::vector<std::vector<char> > recv;
+        all_gather(value, recv);
+        long ret = 0;
+        for (const std::vector<char>& buf : recv) {
+            long v;
+            std::memcpy(&v, buf.data(), sizeof(v));
+            ret += v;
+        }
+        return ret;
+    }
+
+    long all_reduce_max(long value) {
+        std::vector<std::vector<char> > recv;
+        all_gather(value, recv);
+        long ret = value;
+        for (const std::vector<char>& buf : recv) {
+            long v;
+            std::memcpy(&v, buf.data(), sizeof(v));
+            ret = std::max(ret, v);
+        }
+        return ret;
+    }
+
+    void barrier() {
+        std::vector<std::vector<char> > send(num_procs()), recv;
+        exchange(send, recv);
+    }
+
+private:
+    const int id;
+    std::vector<int> fds;   // socket to every other process, -1 for this one
+
+    // progress of one exchange with one peer.
+    struct peer_state {
+        char send_header[8];
+        char recv_header[8];
+        std::size_t sent;       // bytes of header + payload sent
+        std::size_t received;   // bytes of header + payload received
+        bool sent_all;
+        bool received_all;
+
+        peer_state(): sent(0), received(0), sent_all(false), received_all(false) {}
+    };
+
+    void all_gather(long value, std::vector<std::vector<char> >& recv) {
+        std::vector<std::vector<char> > send(num_procs(), std::vector<char>(sizeof(value)));
+        for (std::vector<char>& buf : send) {
+            std::memcpy(buf.data(), &value, sizeof(value));
+        }
+        exchange(send, recv);
+    }
+
+    int peer_of(int fd) const {
+        for (int p = 0; p < num_procs(); p++) {
+            if (fds[p] == fd) {
+                return p;
+            }
+        }
+        return -1;
+    }
+
+    // returns true once the header and the payload have been sent.
+    bool send_some(int p, peer_state& s, const std::vector<char>& payload) {
+        while (true) {
+            const char *data;
+            std::size_t len;
+            if (s.sent < sizeof(s.send_header)) {
+                data = s.send_header + s.sent;
+                len = sizeof(s.send_header) - s.sent;
+            } else {
+                data = payload.data() + (s.sent - sizeof(s.send_header));
+                len = payload.size() - (s.sent - sizeof(s.send_header));
+            }
+            if (len == 0) {
+                s.sent_all = true;
+                return true;
+            }
+            const ssize_t r = ::send(fds[p], data, len, MSG_NOSIGNAL);
+            if (r < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    return false;
+                }
+                throw std::runtime_error("tcp_comm: sending to process " + std::to_string(p) + " failed: "
+                                         + strerror(errno));
+            }
+            s.sent += r;
+        }
+    }
+
+    // returns true once the header and the payload it announces have been received.
+    bool receive_some(int p, peer_state& s, std::vector<char>& payload) {
+        while (true) {
+            char *data;
+            std::size_t len;
+            if (s.received < sizeof(s.recv_header)) {
+                data = s.recv_header + s.received;
+                len = sizeof(s.recv_header) - s.received;
+            } else {
+                if (s.received == sizeof(s.recv_header) && payload.empty()) {
+                    uint64_t size;
+                    std::memcpy(&size, s.recv_header, sizeof(size));
+                    payload.resize(size);
+                }
+                data = payload.data() + (s.received - sizeof(s.recv_header));
+                len = payload.size() - (s.received - sizeof(s.recv_header));
+            }
+            if (len == 0) {
+                s.received_all = true;
+                return true;
+            }
+            const ssize_t r = ::recv(fds[p], data, len, 0);
+            if (r == 0) {
+                throw std::runtime_error("tcp_comm: process " + std::to_string(p) + " closed the connection");
+            }
+            if (r < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    return false;
+                }
+                throw std::runtime_error("tcp_comm: receiving from process " + std::to_string(p) + " failed: "
+                                         + strerror(errno));
+            }
+            s.received += r;
+        }
+    }
+
+    static void split_host(const std::string& host_port, std::string& host, std::string& port) {
+        const std::string::size_type colon = host_port.rfind(':');
+        if (colon == std::string::npos) {
+            throw std::invalid_argument("tcp_comm: expected host:port, got " + host_port);
+        }
+        host = host_port.substr(0, colon);
+        port = host_port.substr(colon + 1);
+    }
+
+    static void write_fully(int fd, const void *data, std::size_t len) {
+        const char *p = static_cast<const char *>(data);
+        while (len > 0) {
+            const ssize_t r = ::send(fd, p, len, MSG_NOSIGNAL);
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+            if (r <= 0) {
+                throw std::runtime_error(std::string("tcp_comm: handshake failed: ") + strerror(errno));
+            }
+            p += r;
+            len -= r;
+        }
+    }
+
+    static void read_fully(int fd, void *data, std::size_t len) {
+        char *p = static_cast<char *>(data);
+        while (len > 0) {
+            const ssize_t r = ::recv(fd, p, len, 0);
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+            if (r <= 0) {
+                throw std::runtime_error(std::string("tcp_comm: handshake failed: ") + strerror(errno));
+            }
+            p += r;
+            len -= r;
+        }
+    }
+
+    static void set_socket_options(int fd) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    void connect_all(const std::vector<std::string>& hosts, double connect_timeout) {
+        const int n = hosts.size();
+        std::string host, port;
+
+        // listen first, so that the processes with higher ids can connect while this one connects
+        split_host(hosts[id], host, port);
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo *res;
+        if (getaddrinfo(NULL, port.c_str(), &hints, &res) != 0) {
+            throw std::runtime_error("tcp_comm: invalid port " + port);
+        }
+        const int listen_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        int one = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        const bool listening = listen_fd >= 0 && bind(listen_fd, res->ai_addr, res->ai_addrlen) == 0
+                               && listen(listen_fd, n) == 0;
+        freeaddrinfo(res);
+        if (!listening) {
+            const std::string error = strerror(errno);
+            if (listen_fd >= 0) {
+                close(listen_fd);
+            }
+            throw std::runtime_error("tcp_comm: can not listen on port " + port + ": " + error);
+        }
+
+        try {
+            const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+                + std::chrono::milliseconds((long) (connect_timeout * 1000));
+            for (int p = 0; p < id; p++) {
+                fds[p] = connect_to(hosts[p], deadline);
+                const int32_t my_id = id;
+                write_fully(fds[p], &my_id, sizeof(my_id));
+            }
+            for (int i = id + 1; i < n; i++) {
+                wait_for_connection(listen_fd, n - i, deadline);
+                const int fd = accept(listen_fd, NULL, NULL);
+                if (fd < 0) {
+                    throw std::runtime_error(std::string("tcp_comm: accept failed: ") + strerror(errno));
+                }
+                int32_t peer_id;
+                read_fully(fd, &peer_id, sizeof(peer_id));
+                if (peer_id <= id || peer_id >= n || fds[peer_id] >= 0) {
+                    close(fd);
+                    throw std::runtime_error("tcp_comm: unexpected connection from process "
+                                             + std::to_string(peer_id));
+                }
+                fds[peer_id] = fd;
+            }
+        } catch (...) {
+            close(listen_fd);
+            throw;
+        }
+        close(listen_fd);
+
+        for (int p = 0; p < n; p++) {
+            if (p != id) {
+                set_socket_options(fds[p]);
+                fcntl(fds[p], F_SETFL, fcntl(fds[p], F_GETFL) | O_NONBLOCK);
+            }
+        }
+    }
+
+    // waits until listen_fd has a connection to accept, or throws at the deadline.
+    static void wait_for_connection(int listen_fd, int num_missing, std::chrono::steady_clock::time_point deadline) {
+        while (true) {
+            const long remaining_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (remaining_ms <= 0) {
+                throw std::runtime_error("tcp_comm: timed out waiting for " + std::to_string(num_missing)
+                                         + " processes with higher ids to connect");
+            }
+            pollfd pfd;
+            pfd.fd = listen_fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            const int ready = poll(&pfd, 1, (int) std::min(remaining_ms, (long) 1000000000));
+            if (ready > 0) {
+                return;
+            }
+            if (ready < 0 && errno != EINTR) {
+                throw std::runtime_error(std::string("tcp_comm: poll failed: ") + strerror(errno));
+            }
+        }
+    }
+
+    static int connect_to(const std::string& host_port, std::chrono::steady_clock::time_point deadline) {
+        std::string host, port;
+        split_host(host_port, host, port);
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        while (true) {
+            addrinfo *res;
+            if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) {
+                throw std::runtime_error("tcp_comm: unknown host " + host_port);
+            }
+            const int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+            const bool connected = fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) == 0;
+            freeaddrinfo(res);
+            if (connected) {
+                return fd;
+            }
+            const std::string error = strerror(errno);
+            if (fd >= 0) {
+                close(fd);
+            }
+            // the peer may not have started yet
+            if (std::chrono::steady_clock::now() > deadline) {
+                throw std::runtime_error("tcp_comm: can not connect to " + host_port + ": " + error);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+
+    void close_all() {
+        for (int& fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+    }
+};
+
+#endif
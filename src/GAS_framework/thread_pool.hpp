@@ -0,0 +1,313 @@
+/**
+ * Persistent worker threads for the engines, so that a start() does not
+ * create and join its threads, and the idle waiting they share.
+ *
+ * idle_waiter is an event count: a thread that found nothing to do spins for
+ * a while, then announces itself with prepare_wait(), checks its condition
+ * once more and sleeps in wait() until some thread calls notify_all(). A
+ * notify_all() without sleeping threads is a fence and a load, so it can be
+ * called on hot paths (e.g. whenever a vertex becomes active).
+ *
+ * thread_pool::global() is shared by all engines of the process. run(n, fn)
+ * runs fn(0) .. fn(n - 1) at the same time on n idle workers (started the
+ * first time they are needed) and waits for them. The workers spin, then
+ * sleep between runs. Runs from different threads get different workers, so
+ * engines may run concurrently and use run() from within a run.
+ *
+ * With pin set (engine_options::pin_threads), the i-th worker is bound to the
+ * i-th core of the process's CPU set, ordered NUMA node by node (Linux only),
+ * so consecutive task ids of a run share a node and every task id stays on
+ * the same core from one run to the next.
+ */
+
+#ifndef __THREAD_POOL_H
+#define __THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include <stdint.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// a pause in spin loops
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+class idle_waiter {
+public:
+    // iterations of spin_until before a thread goes to sleep. The last ones yield.
+    enum { SPIN_PAUSES = 256, SPIN_YIELDS = 16 };
+
+    idle_waiter(): epoch(0), num_waiting(0) {}
+
+    // the key for wait(). Check the condition after this, then wait or call cancel_wait().
+    uint64_t prepare_wait() {
+        num_waiting.fetch_add(1, std::memory_order_seq_cst);
+        return epoch.load(std::memory_order_seq_cst);
+    }
+
+    void cancel_wait() { num_waiting.fetch_sub(1, std::memory_order_relaxed); }
+
+    // sleeps until notify_all() was called after the prepare_wait() that returned key.
+    void wait(uint64_t key) {
+        std::unique_lock<std::mutex> lock(m);
+        while (epoch.load(std::memory_order_relaxed) == key) {
+            cv.wait(lock);
+        }
+        num_waiting.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // wakes the threads that are waiting or about to, after whatever the caller changed.
+    void notify_all() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (num_waiting.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        epoch.fetch_add(1, std::memory_order_seq_cst);
+        std::lock_guard<std::mutex> lock(m);
+        cv.notify_all();
+    }
+
+    // spins, then sleeps until done() is true. done must become true before a notify_all().
+    template<typename Done>
+    void spin_until(Done done) {
+        for (int i = 0; i < SPIN_PAUSES + SPIN_YIELDS; i++) {
+            if (done()) {
+                return;
+            }
+            if (i < SPIN_PAUSES) {
+                cpu_relax();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        while (true) {
+            const uint64_t key = prepare_wait();
+            if (done()) {
+                cancel_wait();
+                return;
+            }
+            wait(key);
+        }
+    }
+
+private:
+    std::atomic<uint64_t> epoch;
+    std::atomic<int> num_waiting;
+    std::mutex m;
+    std::condition_variable cv;
+};
+
+class thread_pool {
+public:
+    thread_pool() {}
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    ~thread_pool() {
+        for (std::unique_ptr<worker>& w : workers) {
+            w->post(nullptr);   // exit
+            w->thread.join();
+        }
+    }
+
+    static thread_pool& global() {
+        static thread_pool pool;
+        return pool;
+    }
+
+    // runs fn(i) for every i in [0, num_tasks), each on its own worker, and returns once all are done.
+    void run(int num_tasks, const std::function<void(int)>& fn, bool pin = false) {
+        if (num_tasks <= 0) {
+            return;
+        }
+        job j(fn, num_tasks, pin);
+        std::vector<worker*> reserved = reserve(num_tasks);
+        for (int i = 0; i < num_tasks; i++) {
+            reserved[i]->task_id = i;
+            reserved[i]->post(&j);
+        }
+        j.done.spin_until([&j]{ return j.remaining.load(std::memory_order_acquire) == 0; });
+        while (!j.notified.load(std::memory_order_acquire)) {
+            std::this_thread::yield();  // the last worker is still in j.done.notify_all()
+        }
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        for (worker* w : reserved) {
+            w->reserved = false;
+        }
+    }
+
+    int num_workers() {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        return workers.size();
+    }
+
+private:
+    struct job {
+        const std::function<void(int)>& fn;
+        std::atomic<int> remaining;
+        std::atomic<bool> notified;     // by the last worker, which does not touch the job afterwards
+        const bool pin;
+        idle_waiter done;
+
+        job(const std::function<void(int)>& fn, int num_tasks, bool pin)
+            : fn(fn), remaining(num_tasks), notified(false), pin(pin) {}
+    };
+
+    struct alignas(64) worker {
+        std::atomic<job*> next;     // posted by run(), taken by the worker
+        std::atomic<bool> exiting;
+        idle_waiter posted;
+        int task_id;                // of next, written before it is posted
+        bool reserved;              // by a run(), protected by pool_mutex
+        int core;                   // -1 if there is none to pin to
+        bool pinned;
+        std::thread thread;
+
+        worker(int core): next(nullptr), exiting(false), task_id(0), reserved(false), core(core), pinned(false) {}
+
+        // hands j to the worker, or tells it to exit if j is null.
+        void post(job *j) {
+            if (j == nullptr) {
+                exiting.store(true, std::memory_order_release);
+            } else {
+                next.store(j, std::memory_order_release);
+            }
+            posted.notify_all();
+        }
+
+        void loop() {
+            while (true) {
+                posted.spin_until([this]{
+                    return next.load(std::memory_order_acquire) != nullptr || exiting.load(std::memory_order_acquire);
+                });
+                job *j = next.exchange(nullptr, std::memory_order_acq_rel);
+                if (j == nullptr) {
+                    return;     // exiting
+                }
+                set_pinned(j->pin);
+                j->fn(task_id);
+                if (j->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    j->done.notify_all();
+                    j->notified.store(true, std::memory_order_release);     // run() may return from here on
+                }
+            }
+        }
+
+        void set_pinned(bool pin) {
+#ifdef __linux__
+            if (pin == pinned || core < 0) {
+                return;
+            }
+            cpu_set_t set;
+            if (pin) {
+                CPU_ZERO(&set);
+                CPU_SET(core, &set);
+            } else {
+                set = process_cpus();
+            }
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            pinned = pin;
+#endif
+        }
+    };
+
+    std::mutex pool_mutex;
+    std::vector<std::unique_ptr<worker> > workers;
+
+    // num_tasks unreserved workers, the ones with the lowest ids first. Starts new ones if needed.
+    std::vector<worker*> reserve(int num_tasks) {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        std::vector<worker*> ret;
+        for (std::unique_ptr<worker>& w : workers) {
+            if ((int) ret.size() < num_tasks && !w->reserved) {
+                w->reserved = true;
+                ret.push_back(w.get());
+            }
+        }
+        while ((int) ret.size() < num_tasks) {
+            const std::vector<int>& cores = core_order();
+            const int core = cores.empty() ? -1 : cores[workers.size() % cores.size()];
+            workers.push_back(std::unique_ptr<worker>(new worker(core)));
+            worker *w = workers.back().get();
+            w->reserved = true;
+            w->thread = std::thread([w]{ w->loop(); });
+            ret.push_back(w);
+        }
+        return ret;
+    }
+
+#ifdef __linux__
+    // the CPUs the process may run on, as when it started.
+    static const cpu_set_t& process_cpus() {
+        static const cpu_set_t set = []{
+            cpu_set_t s;
+            CPU_ZERO(&s);
+            sched_getaffinity(0, sizeof(s), &s);
+            return s;
+        }();
+        return set;
+    }
+
+    // the ids of a list such as "0-3,8,10-11" in a file of /sys, empty if there is no such file.
+    static std::vector<int> read_id_list(const std::string& filename) {
+        std::vector<int> ret;
+        std::ifstream in(filename);
+        std::string range;
+        while (std::getline(in, range, ',')) {
+            char *end;
+            const int first = strtol(range.c_str(), &end, 10);
+            const int last = *end == '-' ? strtol(end + 1, NULL, 10) : first;
+            for (int id = first; id <= last; id++) {
+                ret.push_back(id);
+            }
+        }
+        return ret;
+    }
+#endif
+
+    // the cores of the process's CPU set, node by node. Empty where pinning is not supported.
+    static const std::vector<int>& core_order() {
+        static const std::vector<int> order = []{
+            std::vector<int> ret;
+#ifdef __linux__
+            const cpu_set_t& allowed = process_cpus();
+            std::vector<char> listed(CPU_SETSIZE, 0);
+            for (int node : read_id_list("/sys/devices/system/node/online")) {
+                const std::string dir = "/sys/devices/system/node/node" + std::to_string(node);
+                for (int cpu : read_id_list(dir + "/cpulist")) {
+                    if (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed) && !listed[cpu]) {
+                        ret.push_back(cpu);
+                        listed[cpu] = 1;
+                    }
+                }
+            }
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {   // without NUMA information
+                if (CPU_ISSET(cpu, &allowed) && !listed[cpu]) {
+                    ret.push_back(cpu);
+                }
+            }
+#endif
+            return ret;
+        }();
+        return order;
+    }
+};
+
+#endif
@@ -0,0 +1,278 @@
+/**
+ * A scheduler with one work-stealing deque per worker thread.
+ *
+ * A thread pushes the vertices it signals onto its own deque. When its deque
+ * is empty it steals from the other end of the other threads' deques. The
+ * deques are the ones described in "Dynamic Circular Work-Stealing Deque" by
+ * Chase & Lev, with the memory orderings of "Correct and Efficient
+ * Work-Stealing for Weak Memory Models" by Lê, Pop, Cohen & Zappa Nardelli.
+ *
+ * A thread also takes its own jobs from the stealing end (FIFO), with a CAS
+ * instead of the usual uncontended LIFO take. Signals then propagate in waves,
+ * much like a BFS. With LIFO order, SSSP ran more than 100 times as many
+ * vertex programs on the generated graphs. take() is only used if that CAS
+ * loses a race.
+ *
+ * Duplicate signals are dropped by an atomic_bitset, so a vertex is in at most
+ * one deque at a time and scheduling a vertex is a fetch_or plus a push.
+ * Priorities are ignored.
+ *
+ * With a partition (contiguous vertex id ranges, one per thread, see
+ * partition_vertices in vertex_order.hpp), every vertex has an owner thread.
+ * A signal for a vertex of another partition can not be pushed to its owner's
+ * deque, which only the owner may push to, so it goes to the owner's inbox
+ * (a vector under a spinlock) instead. A thread drains its inbox into its deque
+ * once the deque is empty, and only then steals, from the deques of the other
+ * threads first and from their inboxes last. Threads thereby run the vertices
+ * of their own partition until they run out of work.
+ */
+
+#ifndef __WORK_STEALING_SCHEDULER_H
+#define __WORK_STEALING_SCHEDULER_H
+
+#include "ischeduler.hpp"
+#include "spinlock.hpp"
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <algorithm>    // upper_bound
+#include <mutex>        // lock_guard
+#include <stdint.h>
+
+template<typename T>
+class alignas(64) work_stealing_deque {
+    struct circular_array {
+        const int64_t capacity;     // a power of two
+        std::unique_ptr<std::atomic<T>[]> items;
+
+        explicit circular_array(int64_t capacity): capacity(capacity), items(new std::atomic<T>[capacity]) {}
+
+        T get(int64_t i) const { return items[i & (capacity - 1)].load(std::memory_order_relaxed); }
+
+        void put(int64_t i, T x) { items[i & (capacity - 1)].store(x, std::memory_order_relaxed); }
+    };
+
+    std::atomic<int64_t> top;       // stolen from here
+    std::atomic<int64_t> bottom;    // pushed to and taken from here by the owner
+    std::atomic<circular_array *> array;
+
+    /**
+     * Arrays replaced by grow() may still be read by a concurrent steal, so
+     * they are freed with the deque. The total size is less than twice the
+     * size of the current array.
+     */
+    std::vector<std::unique_ptr<circular_array> > arrays;
+
+public:
+    explicit work_stealing_deque(int64_t initial_capacity = 1024): top(0), bottom(0) {
+        int64_t capacity = 1;
+        while (capacity < initial_capacity) {
+            capacity *= 2;
+        }
+        arrays.emplace_back(new circular_array(capacity));
+        array.store(arrays.back().get(), std::memory_order_relaxed);
+    }
+
+    work_stealing_deque(work_stealing_deque&& other)
+        : top(other.top.load()), bottom(other.bottom.load()), array(other.array.load()),
+          arrays(std::move(other.arrays)) {}
+
+    // only called by the owner
+    void push(T x) {
+        const int64_t b = bottom.load(std::memory_order_relaxed);
+        const int64_t t = top.load(std::memory_order_acquire);
+        circular_array *a = array.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) {
+            a = grow(a, t, b);
+        }
+        a->put(b, x);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // only called by the owner. Returns false if the deque is empty.
+    bool take(T& ret) {
+        const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        circular_array *a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b) {    // empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        ret = a->get(b);
+        if (t == b) {   // last item, race with the thieves
+            const bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                         std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // called by any thread. Returns false if the deque is empty or another thread won the item.
+    bool steal(T& ret) {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return false;
+        }
+        circular_array *a = array.load(std::memory_order_acquire);
+        ret = a->get(t);
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                           std::memory_order_relaxed);
+    }
+
+private:
+    circular_array *grow(circular_array *a, int64_t t, int64_t b) {
+        circular_array *bigger = new circular_array(a->capacity * 2);
+        for (int64_t i = t; i < b; i++) {
+            bigger->put(i, a->get(i));
+        }
+        arrays.emplace_back(bigger);
+        array.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+};
+
+template<typename VertexIdType>
+class work_stealing_scheduler: public ischeduler<VertexIdType> {
+public:
+    typedef VertexIdType vertex_id_type;
+
+    work_stealing_scheduler(vertex_id_type num_vertices, int num_threads)
+        : num_threads(num_threads), active(num_vertices), num_pending(0) {
+        deques.reserve(num_threads);
+        for (int i = 0; i < num_threads; i++) {
+            deques.emplace_back(num_vertices / num_threads + 1);
+        }
+    }
+
+    /**
+     * Thread p owns the vertices [partition_begin[p], partition_begin[p + 1]).
+     * partition_begin has num_threads + 1 entries.
+     */
+    work_stealing_scheduler(vertex_id_type num_vertices, int num_threads, const std::vector<vertex_id_type>& partition_begin)
+        : work_stealing_scheduler(num_vertices, num_threads) {
+        this->partition_begin = partition_begin;
+        inboxes = std::vector<inbox>(num_threads);
+    }
+
+    bool schedule(int thread_id, vertex_id_type vid, double priority) override {
+        if (!active.set(vid)) {
+            return false;
+        }
+        // counted before it becomes visible, so that finished() can not see 0 while it is queued.
+        num_pending.fetch_add(1, std::memory_order_relaxed);
+        const int owner = partition_begin.empty() ? thread_id : owner_of(vid);
+        if (owner == thread_id) {
+            deques[thread_id].push(vid);
+        } else {
+            std::lock_guard<spinlock> lock(inboxes[owner].lock);
+            inboxes[owner].vids.push_back(vid);
+            inboxes[owner].num_vids.store(inboxes[owner].vids.size(), std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    bool get_next(int thread_id, vertex_id_type& ret_vid) override {
+        // FIFO from the own deque, see the top of the file.
+        if (deques[thread_id].steal(ret_vid) || deques[thread_id].take(ret_vid)) {
+            return true;
+        }
+        if (!inboxes.empty() && drain_inbox(thread_id)) {
+            return deques[thread_id].steal(ret_vid) || deques[thread_id].take(ret_vid);
+        }
+        for (int i = 1; i < num_threads; i++) {
+            if (deques[(thread_id + i) % num_threads].steal(ret_vid)) {
+                return true;
+            }
+        }
+        for (int i = 1; i < (int) inboxes.size(); i++) {
+            if (steal_from_inbox((thread_id + i) % num_threads, ret_vid)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the thread that owns vid, if there is a partition.
+    int owner_of(vertex_id_type vid) const {
+        return std::upper_bound(partition_begin.begin() + 1, partition_begin.end() - 1, vid)
+               - partition_begin.begin() - 1;
+    }
+
+    void deactivate(vertex_id_type vid) override {
+        active.clear(vid);
+    }
+
+    void completed(int thread_id, vertex_id_type vid) override {
+        num_pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    bool finished() override {
+        return num_pending.load(std::memory_order_acquire) == 0;
+    }
+
+    bool is_active(vertex_id_type vid) override {
+        return active.test(vid);
+    }
+
+private:
+    // signals for the vertices of a thread from the other threads.
+    struct alignas(64) inbox {
+        spinlock lock;
+        std::vector<vertex_id_type> vids;   // protected by lock
+        std::atomic<long> num_vids;         // vids.size(), read without the lock
+
+        inbox(): num_vids(0) {}
+    };
+
+    const int num_threads;
+    std::vector<work_stealing_deque<vertex_id_type> > deques;
+    atomic_bitset active;
+
+    std::vector<vertex_id_type> partition_begin;    // empty without a partition
+    std::vector<inbox> inboxes;                     // indexed by owner thread, empty without a partition
+
+    // moves the inbox of thread_id to its deque. Returns false if it was empty.
+    bool drain_inbox(int thread_id) {
+        inbox& in = inboxes[thread_id];
+        if (in.num_vids.load(std::memory_order_relaxed) == 0) {
+            return false;
+        }
+        std::vector<vertex_id_type> vids;
+        {
+            std::lock_guard<spinlock> lock(in.lock);
+            vids.swap(in.vids);
+            in.num_vids.store(0, std::memory_order_relaxed);
+        }
+        for (vertex_id_type vid : vids) {
+            deques[thread_id].push(vid);
+        }
+        return !vids.empty();
+    }
+
+    bool steal_from_inbox(int owner, vertex_id_type& ret_vid) {
+        inbox& in = inboxes[owner];
+        if (in.num_vids.load(std::memory_order_relaxed) == 0) {
+            return false;
+        }
+        std::lock_guard<spinlock> lock(in.lock);
+        if (in.vids.empty()) {
+            return false;
+        }
+        ret_vid = in.vids.back();
+        in.vids.pop_back();
+        in.num_vids.store(in.vids.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    // number of vertices that are active or executing.
+    alignas(64) std::atomic<long> num_pending;
+};
+
+#endif
@@ -26,5 +26,6 @@
 
 #include "util/empty.hpp"
 #include "vertex_program/ivertex_program.hpp"   // currently ivertex_program includes everything else
+#include "vertex_program/static_vertex_program.hpp"
 
 #endif
@@ -39,9 +39,12 @@ namespace graphlab {
    * implements the \ref icontext interface.
    *
    * \tparam Engine the engine that is using this context.
+   *
+   * It is final, so that the calls of vertex programs that take it by its
+   * own type (see static_vertex_program.hpp) are not virtual.
    */
   template<typename Engine>
-  class context : 
+  class context final : 
     public icontext<typename Engine::graph_type,
                     typename Engine::gather_type,
                     typename Engine::message_type> {
@@ -76,11 +79,36 @@ namespace graphlab {
       engine(engine), graph(graph) { }
 
     /**
-     * Send a message to a vertex.
+     * The current iteration (super-step) of the engine, or -1 if it
+     * does not run in iterations.
+     */
+    int iteration() const { return engine.iteration(); }
+
+    /**
+     * The id of this process and the number of processes. 0 and 1
+     * unless the engine is a distributed_engine.
+     */
+    std::size_t procid() const { return engine.procid(); }
+    std::size_t num_procs() const { return engine.num_procs(); }
+
+    /**
+     * Seconds since the engine's start() was called.
+     */
+    float elapsed_seconds() const { return engine.elapsed_seconds(); }
+
+    /**
+     * Stops the engine, see icontext::stop. The active vertices run on
+     * the next start().
+     */
+    void stop() { engine.internal_stop(); }
+
+    /**
+     * Send a message to a vertex. The message's priority() (if it has one)
+     * orders the vertex in priority schedulers.
      */
     void signal(const vertex_type& vertex, 
                 const message_type& message = message_type()) {
-      engine.internal_signal(vertex/**, message*/);
+      engine.internal_signal(vertex, message);
     }         
 
     /**
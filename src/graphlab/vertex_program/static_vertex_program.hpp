@@ -0,0 +1,113 @@
+/**
+ * A base for vertex programs whose functions the engines call without
+ * virtual dispatch (not part of GraphLab).
+ *
+ * The engines call the functions of a vertex program on an object of the
+ * program's own type, with their own context type (graphlab::context<Engine>,
+ * which is final). A program derived from ivertex_program gets those calls
+ * statically already, but its functions take an icontext_type&, so every
+ * signal or post_delta in them is a virtual call and nothing of the context
+ * can be inlined into the gather and scatter loops.
+ *
+ * A program derived from static_vertex_program instead defines its functions
+ * as templates on the context type:
+ *
+ * \code
+ * class pagerank_program :
+ *   public graphlab::static_vertex_program<pagerank_program, graph_type, double> {
+ *   template<typename Context>
+ *   double gather(Context& context, const vertex_type& vertex, edge_type& edge) const { ... }
+ *   ...
+ * };
+ * \endcode
+ *
+ * and the engines instantiate them with their concrete context. Functions the
+ * program does not define get the defaults of ivertex_program. The virtual
+ * interface stays: the overrides below forward to the same templates,
+ * instantiated with icontext_type, so code that only knows ivertex_program
+ * keeps working. apply must be defined, as in ivertex_program.
+ */
+
+#ifndef GRAPHLAB_STATIC_VERTEX_PROGRAM_HPP
+#define GRAPHLAB_STATIC_VERTEX_PROGRAM_HPP
+
+#include "ivertex_program.hpp"
+
+namespace graphlab {
+
+  template<typename Derived,
+           typename GraphType,
+           typename GatherType,
+           typename MessageType = int>
+  class static_vertex_program :
+    public ivertex_program<GraphType, GatherType, MessageType> {
+  public:
+    typedef ivertex_program<GraphType, GatherType, MessageType> base_type;
+    typedef typename base_type::icontext_type icontext_type;
+    typedef typename base_type::vertex_type vertex_type;
+    typedef typename base_type::edge_type edge_type;
+    typedef typename base_type::gather_type gather_type;
+    typedef typename base_type::message_type message_type;
+    typedef typename base_type::edge_dir_type edge_dir_type;
+
+    // Defaults, hidden by the templates of the same name in Derived ==========
+
+    template<typename Context>
+    void init(Context& context, const vertex_type& vertex, const message_type& msg) { /** NOP */ }
+
+    template<typename Context>
+    edge_dir_type gather_edges(Context& context, const vertex_type& vertex) const {
+      return IN_EDGES;
+    }
+
+    template<typename Context>
+    gather_type gather(Context& context, const vertex_type& vertex, edge_type& edge) const {
+      std::cerr << "Gather not implemented!" << std::endl;
+      return gather_type();
+    }
+
+    template<typename Context>
+    edge_dir_type scatter_edges(Context& context, const vertex_type& vertex) const {
+      return OUT_EDGES;
+    }
+
+    template<typename Context>
+    void scatter(Context& context, const vertex_type& vertex, edge_type& edge) const {
+      std::cerr << "Scatter not implemented!" << std::endl;
+    }
+
+    // The virtual interface ==================================================
+    // .template only finds the templates, so these do not call themselves.
+
+    void init(icontext_type& context, const vertex_type& vertex, const message_type& msg) override {
+      derived().template init<icontext_type>(context, vertex, msg);
+    }
+
+    edge_dir_type gather_edges(icontext_type& context, const vertex_type& vertex) const override {
+      return derived().template gather_edges<icontext_type>(context, vertex);
+    }
+
+    gather_type gather(icontext_type& context, const vertex_type& vertex, edge_type& edge) const override {
+      return derived().template gather<icontext_type>(context, vertex, edge);
+    }
+
+    void apply(icontext_type& context, vertex_type& vertex, const gather_type& total) override {
+      derived().template apply<icontext_type>(context, vertex, total);
+    }
+
+    edge_dir_type scatter_edges(icontext_type& context, const vertex_type& vertex) const override {
+      return derived().template scatter_edges<icontext_type>(context, vertex);
+    }
+
+    void scatter(icontext_type& context, const vertex_type& vertex, edge_type& edge) const override {
+      derived().template scatter<icontext_type>(context, vertex, edge);
+    }
+
+  private:
+    Derived& derived() { return static_cast<Derived&>(*this); }
+    const Derived& derived() const { return static_cast<const Derived&>(*this); }
+  }; // end of static_vertex_program
+
+} // end of namespace graphlab
+
+#endif
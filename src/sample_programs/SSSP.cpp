@@ -1,8 +1,12 @@
 #include <iostream>
 #include <fstream>
-#include <sstream>
-#include "../GAS_framework/simple_graph.hpp"
+#include <cstdlib>
+#include <chrono>
+#include "../GAS_framework/csr_graph.hpp"
+#include "../GAS_framework/graph_builder.hpp"
+#include "../GAS_framework/graph_file.hpp"
 #include "../GAS_framework/async_engine.hpp"
+#include "../GAS_framework/synchronous_engine.hpp"
 #include "../graphlab/graphlab.hpp"
 
 using namespace std;
@@ -13,7 +17,8 @@ const string out_filename = "SSSP_output.txt";
 
 typedef long int vertex_data;
 typedef long int edge_data;
-typedef Graph<vertex_data, edge_data> graph_type;
+typedef csr_graph<vertex_data, edge_data> graph_type;
+typedef graph_type::vertex_id_type vertex_id_type;
 
 struct min_container {
     int min;
@@ -29,14 +34,44 @@ struct min_container {
 
 typedef min_container gather_type;
 
+/**
+ * Sent to the targets of a vertex whose distance changed, with the distance
+ * through that vertex. The engine combines the messages to a vertex into the
+ * shortest one. With the PRIORITY scheduler, vertices with shorter tentative
+ * distances run first.
+ * A signal without a candidate (signal_all, graph_changed) makes the vertex
+ * gather all of its in edges, which covers every candidate, so it wins over
+ * the candidates it is combined with. Otherwise a vertex whose in neighbours
+ * improved before it ran would only see the candidate that was sent last.
+ */
+struct distance_message {
+    long int distance;  // -1 if there is no candidate
+    distance_message(): distance(-1) { }
+    distance_message(long int distance): distance(distance) { }
+    distance_message &operator+=(const distance_message &right) {
+        if (distance >= 0 && (right.distance < 0 || right.distance < distance)) {
+            distance = right.distance;
+        }
+        return *this;
+    }
+    double priority() const { return distance; }
+};
+
 class SSSP_program :
-             public graphlab::ivertex_program<graph_type, gather_type> {
+             public graphlab::ivertex_program<graph_type, gather_type, distance_message> {
 private:
     bool do_scatter;
+    long int candidate;     // from the messages, -1 if there was none
 public:
+    void init(icontext_type& context, const vertex_type& vertex,
+              const distance_message& msg) {
+        candidate = msg.distance;
+    }
+
+    // the whole in-neighbourhood is only gathered if no candidate distance was sent (e.g. after signal_all).
     edge_dir_type gather_edges(icontext_type& context,
                              const vertex_type& vertex) const {
-        return graphlab::IN_EDGES;
+        return candidate >= 0 ? graphlab::NO_EDGES : graphlab::IN_EDGES;
     }
 
     gather_type gather(icontext_type& context, const vertex_type& vertex,
@@ -47,13 +82,21 @@ public:
 	    return min_container(-1);
     }
 
+    // the same as gather, for the gather kernel of synchronous_engine (see gather_kernels.hpp).
+    gather_type gather_source(const vertex_data& source_data, int source_num_out_edges,
+                              const edge_data& edata) const {
+        return min_container(source_data >= 0 ? source_data + edata : -1);
+    }
+
     void apply(icontext_type& context, vertex_type& vertex,
-             const gather_type& total) {
+             const gather_type& gathered) {
+        const gather_type total = candidate >= 0 ? min_container(candidate) : gathered;
         if (total.min > 0 && (vertex.data() < 0 || vertex.data() > total.min)) {
             do_scatter = true;
             vertex.data() = total.min;
         } else {
-            do_scatter = false;
+            // the source starts with its distance, so it has to send it out once (after signal_all).
+            do_scatter = vertex.data() == 0 && candidate < 0;
         }
         
     }
@@ -69,57 +112,99 @@ public:
 
     void scatter(icontext_type& context, const vertex_type& vertex,
                edge_type& edge) const {
-         context.signal(edge.target());
+         context.signal(edge.target(), distance_message(vertex.data() + edge.data()));
     }
 };
 
 int main(int argc, char** argv) {
-    if (argc != 3) {
+    if (argc < 3 || argc > 6) {
         cerr << "Wrong number of arguments" << endl;
+        cerr << "usage: SSSP <load_ahead_distance> <num_threads> [input graph (.txt or .bin)] [async|priority|sync] [fixed|degree|adaptive]" << endl;
         return -1;
     }
 
     int load_ahead_distance = atoi(argv[1]);
     int num_threads = atoi(argv[2]);
-
+    const string graph_filename = argc >= 4 ? argv[3] : in_graph_filename;
+    const string engine_name = argc >= 5 ? argv[4] : "async";
+    const string prefetch_name = argc == 6 ? argv[5] : "fixed";    // async and priority only
+    // priority is async_engine with the PRIORITY scheduler
+    if (engine_name != "async" && engine_name != "priority" && engine_name != "sync") {
+        cerr << "unknown engine " << engine_name << ", expected async, priority or sync" << endl;
+        return -1;
+    }
+    if (prefetch_name != "fixed" && prefetch_name != "degree" && prefetch_name != "adaptive") {
+        cerr << "unknown prefetch policy " << prefetch_name << ", expected fixed, degree or adaptive" << endl;
+        return -1;
+    }
 
     graph_type graph;
-
-    /**
-     *  ---- Parse the input file ----
-     * The parsing method used here is very specific. It only works with input
-     * files that have the format used in the test I've run.
-     */
-    string line;
-    ifstream input_graph(in_graph_filename);
-    if (!input_graph.is_open()) {
-      cout << "Can not open input file" << endl;
-      return -1;
-    }
-    int line_no = 0;
-    while (getline(input_graph, line)) {
-      stringstream ss(line);
-      int cur_vid;
-      int neigh_vid;
-      int edge_weight;
-      ss >> cur_vid;
-      graph.add_vertex(cur_vid, cur_vid == 0 ? 0 : -1);
-      while (ss >> neigh_vid) {
-        if (line_no < neigh_vid) {
-          // need to add neighbour here so that add_edge does not fail.
-          graph.add_vertex(neigh_vid, -1);
+    if (graph_filename.size() > 4 && graph_filename.substr(graph_filename.size() - 4) == ".bin") {
+        // binary graph files are written by testing_tools/text_to_binary.cpp
+        try {
+            graph = graph_file::load<vertex_data, edge_data>(graph_filename);
+        } catch (const std::runtime_error& e) {
+            cout << e.what() << endl;
+            return -1;
         }
-        ss >> edge_weight;
-        graph.add_edge(cur_vid, neigh_vid, edge_weight);
-      }
-      line_no++;
+    } else {
+        /**
+         *  ---- Parse the input file ----
+         * The parsing method used here is very specific. It only works with input
+         * files that have the format used in the test I've run.
+         * Each line is "vid neigh_vid weight neigh_vid weight ...". Lines are parsed
+         * by num_threads threads and the graph is built in one shot by the builder.
+         */
+        csr_graph_builder<vertex_data, edge_data> builder(num_threads, -1);  // all distances start at -1 (infinity)
+        bool opened = builder.ingest_lines(graph_filename,
+            [&](int thread_id, const char *line, const char *line_end) {
+                vertex_id_type vid = builder.add_weighted_adjacency_line(line, line_end, thread_id);
+                if (vid == 0) {
+                    builder.add_vertex(0, 0, thread_id);     // the source, the others get -1
+                }
+            });
+        if (!opened) {
+          cout << "Can not open input file" << endl;
+          return -1;
+        }
+        graph = builder.finalize();
+        builder.print_timings(cout);
     }
-    input_graph.close();
 
     // --- execute program
-    async_engine<SSSP_program> engine(graph, load_ahead_distance, num_threads, false);
-    engine.signal_all();
-    engine.start();
+    chrono::steady_clock::time_point engine_start = chrono::steady_clock::now();
+    long int spm_hits = 0, spm_misses = 0, num_executed = 0, simulated_cycles = 0, stall_cycles = 0;
+    if (engine_name == "sync") {
+        engine_options opts;    // load_ahead_distance is not used
+        opts.num_threads = num_threads;
+        // scatter only signals the targets. Pulled signals lose the distance, the vertex then gathers instead.
+        opts.pull_signals = true;
+        synchronous_engine<SSSP_program> engine(graph, opts);
+        engine.signal_all();
+        engine.start();
+    } else {
+        engine_options opts;
+        opts.load_ahead_distance = load_ahead_distance;
+        opts.num_threads = num_threads;
+        if (engine_name == "priority") {
+            opts.scheduler = PRIORITY;
+        }
+        if (prefetch_name == "degree") {
+            opts.prefetch = DEGREE_PREFETCH;
+        } else if (prefetch_name == "adaptive") {
+            opts.prefetch = ADAPTIVE_PREFETCH;
+        }
+        async_engine<SSSP_program> engine(graph, opts);
+        engine.signal_all();
+        engine.start();
+        spm_hits = engine.spm_hits;
+        spm_misses = engine.spm_misses;
+        simulated_cycles = engine.simulated_cycles;
+        stall_cycles = engine.stall_cycles;
+        num_executed = engine.num_executed;
+    }
+    cout << "Engine run time: "
+         << chrono::duration<double>(chrono::steady_clock::now() - engine_start).count() << " s" << endl;
 
     // --- write the output file
     ofstream out_file(out_filename);
@@ -133,6 +218,10 @@ int main(int argc, char** argv) {
     }
     out_file.close();
 
-    cout << "SPM hits: " << engine.spm_hits << endl;
-    cout << "SPM misses: " << engine.spm_misses << endl;
+    if (engine_name != "sync") {
+        cout << "SPM hits: " << spm_hits << endl;
+        cout << "SPM misses: " << spm_misses << endl;
+        cout << "Simulated cycles: " << simulated_cycles << " (" << stall_cycles << " stalled)" << endl;
+        cout << "Vertex programs executed: " << num_executed << endl;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,790 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <cstdio>      // remove
+#include <cmath>
+#include <chrono>
+#include <sys/resource.h>
+#include "../GAS_framework/simple_graph.hpp"
+#include "../GAS_framework/csr_graph.hpp"
+#include "../GAS_framework/graph_builder.hpp"
+#include "../GAS_framework/graph_generators.hpp"
+#include "../GAS_framework/graph_mutations.hpp"
+#include "../GAS_framework/async_engine.hpp"
+#include "../GAS_framework/synchronous_engine.hpp"
+#include "../graphlab/graphlab.hpp"
+
+using namespace std;
+
+/**
+ * Runs PageRank, SSSP and connected components on one graph for every
+ * combination of the given programs, graph backends, engines, thread counts
+ * and load ahead distances, and writes a row of results per run:
+ *
+ * \code
+ * ./benchmark rmat:16:16 threads=1,2,4 distances=0,10 out=results.csv
+ * ./benchmark ba:100000:8:3 engines=sync,async backends=csr,compressed out=results.json
+ * \endcode
+ *
+ * The graph is rmat:<scale>:<edge factor>[:seed], ba:<vertices>:<edges per
+ * vertex>[:seed] or grid:<rows>:<cols> (see graph_generators.hpp), or a text
+ * file in the format of pagerank.cpp. SSSP's weights are generated from the
+ * seed= option and its source is the vertex with the most out edges.
+ *
+ * Options (defaults in brackets):
+ *   programs=pagerank,sssp,cc   backends=csr,compressed,simple (csr is a csr_graph,
+ *   compressed one after compress_neighbours, simple a Graph of simple_graph.hpp)
+ *   engines=async,priority,sync   threads=1   distances=10 (load_ahead_distance,
+ *   async and priority only)   repeat=1   seed=1   pin=0 (1 pins the worker
+ *   threads to cores, see thread_pool.hpp)   inserts=0   checkpoint= (a file
+ *   prefix)   checkpoint_interval=0.001 (seconds)   out=benchmark_results.csv
+ *
+ * With inserts=N, every run on a csr_graph is followed by one that adds N
+ * random edges with graph_mutations.hpp to a copy of the graph and resumes the
+ * converged engine with graph_changed(). Its row has the engine name with
+ * "+inserts". Its result is checked against a run from scratch on the new graph
+ * (exactly, or within 1% for PageRank), and the benchmark exits with 1 if any
+ * result differs.
+ *
+ * With checkpoint=prefix, every async and priority run on a csr_graph is
+ * followed by one that stops after as many updates as there are vertices,
+ * writing checkpoints to prefix.0 and prefix.1 every checkpoint_interval
+ * seconds and once more with save_checkpoint() at the end. A new engine on a
+ * fresh copy of the graph then restores engine_snapshot::latest() of the
+ * prefix and runs to the end. Its row has the engine name with "+restore",
+ * and its result is checked against the uninterrupted run in the same way.
+ *
+ * out is written as JSON if its name ends in .json, as CSV otherwise. Every
+ * row has the configuration, the engine's run time (of start(), without
+ * building the graph), vertex updates and edges (gathered and scattered, from
+ * engine_metrics.hpp) per second, the SPM hit rate (async engines only), the
+ * peak resident set size of the run and a result to compare runs with: the
+ * sum of the ranks, the sum of the distances of the reached vertices, and the
+ * number of components.
+ *
+ * The peak RSS is reset before every run through /proc/self/clear_refs. Where
+ * that is not possible, it is the peak of the process so far.
+ */
+
+const string out_default = "benchmark_results.csv";
+
+/**
+ * The programs are templates on the graph type, so that every backend runs
+ * the same code. Each one also defines the initial vertex data and the result
+ * of a run.
+ */
+template<typename Graph>
+class pagerank_program :
+             public graphlab::static_vertex_program<pagerank_program<Graph>, Graph, double> {
+    typedef typename Graph::vertex_type vertex_type;
+    typedef typename Graph::edge_type edge_type;
+    double delta;
+public:
+    template<typename Context>
+    graphlab::edge_dir_type gather_edges(Context& context, const vertex_type& vertex) const {
+        return graphlab::IN_EDGES;
+    }
+    template<typename Context>
+    double gather(Context& context, const vertex_type& vertex, edge_type& edge) const {
+        return edge.source().data() / edge.source().num_out_edges();
+    }
+    double gather_source(const double& source_data, int source_num_out_edges, const graphlab::empty& edata) const {
+        return source_data / source_num_out_edges;
+    }
+    template<typename Context>
+    void apply(Context& context, vertex_type& vertex, const double& total) {
+        const double newval = total * 0.85 + 0.15;
+        delta = newval - vertex.data();
+        vertex.data() = newval;
+    }
+    template<typename Context>
+    graphlab::edge_dir_type scatter_edges(Context& context, const vertex_type& vertex) const {
+        return graphlab::OUT_EDGES;
+    }
+    template<typename Context>
+    void scatter(Context& context, const vertex_type& vertex, edge_type& edge) const {
+        if (std::fabs(delta) > 1E-3) {
+            context.signal(edge.target());
+        }
+    }
+
+    static double initial_data(long vid, long source) { return 1.0; }
+    static double result(Graph& g) {
+        double sum = 0;
+        for (long vid = 0; vid < g.num_vertices(); vid++) {
+            sum += g.vertex(vid).data();
+        }
+        return sum;
+    }
+};
+
+// the minimum of the gathered values, which are -1 if there is none.
+struct min_value {
+    long value;
+    min_value(): value(-1) {}
+    explicit min_value(long value): value(value) {}
+    min_value& operator+=(const min_value& other) {
+        if (other.value >= 0 && (value < 0 || other.value < value)) {
+            value = other.value;
+        }
+        return *this;
+    }
+};
+
+/**
+ * The smallest candidate value sent to a vertex, as distance_message in
+ * SSSP.cpp: a signal without a candidate (-1, e.g. from signal_all) makes the
+ * vertex gather all of its neighbours, so it wins over the candidates. With
+ * the PRIORITY scheduler, smaller candidates run first.
+ */
+struct min_message {
+    long value;
+    min_message(): value(-1) {}
+    explicit min_message(long value): value(value) {}
+    min_message& operator+=(const min_message& other) {
+        if (value >= 0 && (other.value < 0 || other.value < value)) {
+            value = other.value;
+        }
+        return *this;
+    }
+    double priority() const { return value; }
+};
+
+// as in SSSP.cpp: a vertex that got a candidate distance does not gather.
+template<typename Graph>
+class sssp_program :
+             public graphlab::static_vertex_program<sssp_program<Graph>, Graph, min_value, min_message> {
+    typedef typename Graph::vertex_type vertex_type;
+    typedef typename Graph::edge_type edge_type;
+    long candidate;
+    bool do_scatter;
+public:
+    template<typename Context>
+    void init(Context& context, const vertex_type& vertex, const min_message& msg) {
+        candidate = msg.value;
+    }
+    template<typename Context>
+    graphlab::edge_dir_type gather_edges(Context& context, const vertex_type& vertex) const {
+        return candidate >= 0 ? graphlab::NO_EDGES : graphlab::IN_EDGES;
+    }
+    template<typename Context>
+    min_value gather(Context& context, const vertex_type& vertex, edge_type& edge) const {
+        return gather_source(edge.source().data(), 0, edge.data());
+    }
+    min_value gather_source(const long& source_data, int source_num_out_edges, const long& edata) const {
+        return source_data >= 0 ? min_value(source_data + edata) : min_value();
+    }
+    template<typename Context>
+    void apply(Context& context, vertex_type& vertex, const min_value& gathered) {
+        const long total = candidate >= 0 ? candidate : gathered.value;
+        if (total > 0 && (vertex.data() < 0 || vertex.data() > total)) {
+            vertex.data() = total;
+            do_scatter = true;
+        } else {
+            do_scatter = vertex.data() == 0 && candidate < 0;  // the source, after signal_all
+        }
+    }
+    template<typename Context>
+    graphlab::edge_dir_type scatter_edges(Context& context, const vertex_type& vertex) const {
+        return do_scatter ? graphlab::OUT_EDGES : graphlab::NO_EDGES;
+    }
+    template<typename Context>
+    void scatter(Context& context, const vertex_type& vertex, edge_type& edge) const {
+        context.signal(edge.target(), min_message(vertex.data() + edge.data()));
+    }
+
+    static long initial_data(long vid, long source) { return vid == source ? 0 : -1; }
+    static double result(Graph& g) {
+        double sum = 0;
+        for (long vid = 0; vid < g.num_vertices(); vid++) {
+            sum += max(g.vertex(vid).data(), 0L);
+        }
+        return sum;
+    }
+};
+
+/**
+ * Weakly connected components by label propagation: every vertex ends up
+ * with the smallest id of its component. A vertex whose label dropped sends
+ * it to the neighbours with larger labels.
+ */
+template<typename Graph>
+class cc_program :
+             public graphlab::static_vertex_program<cc_program<Graph>, Graph, min_value, min_message> {
+    typedef typename Graph::vertex_type vertex_type;
+    typedef typename Graph::edge_type edge_type;
+    long candidate;
+    bool changed;
+public:
+    template<typename Context>
+    void init(Context& context, const vertex_type& vertex, const min_message& msg) {
+        candidate = msg.value;
+    }
+    template<typename Context>
+    graphlab::edge_dir_type gather_edges(Context& context, const vertex_type& vertex) const {
+        return candidate >= 0 ? graphlab::NO_EDGES : graphlab::ALL_EDGES;
+    }
+    template<typename Context>
+    min_value gather(Context& context, const vertex_type& vertex, edge_type& edge) const {
+        return min_value(edge.source().id() == vertex.id() ? edge.target().data() : edge.source().data());
+    }
+    template<typename Context>
+    void apply(Context& context, vertex_type& vertex, const min_value& gathered) {
+        const long label = candidate >= 0 ? candidate : gathered.value;
+        changed = label >= 0 && label < vertex.data();
+        if (changed) {
+            vertex.data() = label;
+        }
+    }
+    template<typename Context>
+    graphlab::edge_dir_type scatter_edges(Context& context, const vertex_type& vertex) const {
+        return changed ? graphlab::ALL_EDGES : graphlab::NO_EDGES;
+    }
+    template<typename Context>
+    void scatter(Context& context, const vertex_type& vertex, edge_type& edge) const {
+        const bool out = edge.source().id() == vertex.id();
+        if ((out ? edge.target().data() : edge.source().data()) > vertex.data()) {
+            context.signal(out ? edge.target() : edge.source(), min_message(vertex.data()));
+        }
+    }
+
+    static long initial_data(long vid, long source) { return vid; }
+    static double result(Graph& g) {
+        long num_components = 0;
+        for (long vid = 0; vid < g.num_vertices(); vid++) {
+            num_components += g.vertex(vid).data() == vid;
+        }
+        return num_components;
+    }
+};
+
+struct benchmark_options {
+    string graph_name;
+    vector<string> programs, backends, engines;
+    vector<int> threads, distances;
+    int repeat;
+    uint64_t seed;
+    bool pin;
+    long inserts;
+    string checkpoint_prefix;
+    double checkpoint_interval;
+    string out_filename;
+};
+
+struct result_row {
+    string program, backend, engine;
+    int threads;
+    int distance;       // -1 for sync
+    int run;
+    long num_vertices, num_edges;
+    double seconds;
+    long updates, edges;
+    long spm_hits, spm_misses;
+    long peak_rss_kb;
+    double result;
+};
+
+// ---- peak RSS ---- //
+
+// returns false if the peak RSS of the process can not be reset (before Linux 4.0, or no /proc).
+bool reset_peak_rss() {
+    ofstream clear_refs("/proc/self/clear_refs");
+    if (!clear_refs.is_open()) {
+        return false;
+    }
+    clear_refs << "5";
+    clear_refs.close();
+    return !clear_refs.fail();
+}
+
+long peak_rss_kb() {
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return atol(line.c_str() + 6);
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// ---- runs ---- //
+
+int num_mismatches = 0;     // of the checks of inserts= and checkpoint=
+
+// PageRank stops at a tolerance, so its results only agree approximately.
+bool same_result(const string& program, double a, double b) {
+    return program == "pagerank" ? fabs(a - b) <= 0.01 * max(fabs(a), fabs(b)) : a == b;
+}
+
+template<typename Program, typename Graph>
+void set_initial_data(Graph& g, long source) {
+    for (long vid = 0; vid < g.num_vertices(); vid++) {
+        g.vertex(vid).data() = Program::initial_data(vid, source);
+    }
+}
+
+/**
+ * Runs Engine to convergence on h, adds o.inserts random edges (with
+ * edge_data of their index) and resumes the engine on the affected vertices.
+ * Fills in the time, updates, edges and result of the resumed run.
+ */
+template<typename Engine, typename Graph, typename EdgeDataFn>
+void insert_and_resume(Graph& h, const engine_options& opts, EdgeDataFn edge_data, const benchmark_options& o,
+                       result_row& r) {
+    typedef typename Graph::vertex_id_type vertex_id_type;
+    Engine engine(h, opts);
+    engine.signal_all();
+    engine.start();
+    const long updates_before = engine.metrics[VERTEX_UPDATES];
+    const long edges_before = engine.metrics[GATHER_EDGES] + engine.metrics[SCATTER_EDGES];
+
+    graph_mutations<typename Graph::vertex_data_type, typename Graph::edge_data_type, vertex_id_type> log(h);
+    generator_rng rng(o.seed + 1);
+    const long num_v = h.num_vertices();
+    const long num_e = h.num_edges();
+    for (long i = 0; i < o.inserts; i++) {
+        log.add_edge((vertex_id_type) rng.uniform(num_v), (vertex_id_type) rng.uniform(num_v), edge_data(num_e + i));
+    }
+    engine.graph_changed(log.apply(opts.num_threads));
+
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    engine.start();
+    r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    r.num_edges = h.num_edges();
+    r.updates = engine.metrics[VERTEX_UPDATES] - updates_before;
+    r.edges = engine.metrics[GATHER_EDGES] + engine.metrics[SCATTER_EDGES] - edges_before;
+}
+
+// inserts= for the configuration of r, see the top of the file.
+template<typename Program, typename Graph, typename EdgeDataFn>
+void run_with_inserts(const Graph& g, long source, const engine_options& opts, EdgeDataFn edge_data,
+                      const benchmark_options& o, result_row r, vector<result_row>& rows) {
+    Graph h = g;
+    set_initial_data<Program>(h, source);
+    r.spm_hits = r.spm_misses = -1;
+    if (r.engine == "sync") {
+        insert_and_resume<synchronous_engine<Program> >(h, opts, edge_data, o, r);
+    } else {
+        insert_and_resume<async_engine<Program> >(h, opts, edge_data, o, r);
+    }
+    r.result = Program::result(h);
+    r.engine += "+inserts";
+    r.peak_rss_kb = peak_rss_kb();
+    rows.push_back(r);
+
+    Graph from_scratch = h;
+    set_initial_data<Program>(from_scratch, source);
+    if (r.engine == "sync+inserts") {    // the same engine and options from scratch
+        synchronous_engine<Program> engine(from_scratch, opts);
+        engine.signal_all();
+        engine.start();
+    } else {
+        async_engine<Program> engine(from_scratch, opts);
+        engine.signal_all();
+        engine.start();
+    }
+    const double expected = Program::result(from_scratch);
+    const bool same = same_result(r.program, r.result, expected);
+    num_mismatches += !same;
+    cout << r.program << " " << r.backend << " " << r.engine << " threads=" << r.threads << ": " << r.seconds
+         << " s, " << r.updates << " updates, result " << r.result;
+    if (same) {
+        cout << " (as from scratch)" << endl;
+    } else {
+        cout << " (from scratch: " << expected << ")" << endl;
+    }
+}
+
+// checkpoint= for the configuration of r (an async engine), see the top of the file.
+template<typename Program, typename Graph>
+void run_with_checkpoint(const Graph& g, long source, engine_options opts, const benchmark_options& o,
+                         result_row r, vector<result_row>& rows) {
+    typedef engine_snapshot<Graph, typename Program::gather_type, typename Program::message_type> snapshot_type;
+    remove((o.checkpoint_prefix + ".0").c_str());    // of earlier configurations
+    remove((o.checkpoint_prefix + ".1").c_str());
+    opts.checkpoint_prefix = o.checkpoint_prefix;
+    const double expected = r.result;
+    string latest;
+    long num_checkpoints = 0;
+    try {
+        Graph interrupted = g;
+        set_initial_data<Program>(interrupted, source);
+        opts.checkpoint_interval = o.checkpoint_interval;
+        opts.max_updates = interrupted.num_vertices();
+        async_engine<Program> engine(interrupted, opts);
+        engine.signal_all();
+        engine.start();
+        engine.save_checkpoint();
+        num_checkpoints = engine.num_checkpoints;
+        latest = snapshot_type::latest(o.checkpoint_prefix);
+        if (latest.empty()) {
+            throw runtime_error("no complete checkpoint of " + o.checkpoint_prefix);
+        }
+
+        Graph h = g;
+        set_initial_data<Program>(h, source);
+        opts.checkpoint_interval = 0;
+        opts.max_updates = -1;
+        async_engine<Program> resumed(h, opts);
+        resumed.restore_checkpoint(latest);
+        const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        resumed.start();
+        r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        r.updates = resumed.metrics[VERTEX_UPDATES];
+        r.edges = resumed.metrics[GATHER_EDGES] + resumed.metrics[SCATTER_EDGES];
+        r.spm_hits = resumed.spm_hits;
+        r.spm_misses = resumed.spm_misses;
+        r.result = Program::result(h);
+    } catch (const runtime_error& e) {
+        cout << r.program << " " << r.backend << " " << r.engine << "+restore threads=" << r.threads << ": "
+             << e.what() << endl;
+        num_mismatches++;
+        return;
+    }
+    r.engine += "+restore";
+    r.peak_rss_kb = peak_rss_kb();
+    rows.push_back(r);
+
+    const bool same = same_result(r.program, r.result, expected);
+    num_mismatches += !same;
+    cout << r.program << " " << r.backend << " " << r.engine << " threads=" << r.threads << ": " << r.seconds
+         << " s, " << r.updates << " updates after " << num_checkpoints << " checkpoints, restored " << latest
+         << ", result " << r.result;
+    if (same) {
+        cout << " (as without checkpoints)" << endl;
+    } else {
+        cout << " (without checkpoints: " << expected << ")" << endl;
+    }
+}
+
+template<typename Program, typename Graph, typename EdgeDataFn>
+void run_configurations(Graph& g, const string& program, const string& backend, long source, EdgeDataFn edge_data,
+                        const benchmark_options& o, vector<result_row>& rows) {
+    for (const string& engine_name : o.engines) {
+        for (int num_threads : o.threads) {
+            const vector<int> distances = engine_name == "sync" ? vector<int>(1, -1) : o.distances;
+            for (int distance : distances) {
+                for (int run = 0; run < o.repeat; run++) {
+                    set_initial_data<Program>(g, source);
+                    result_row r;
+                    r.program = program;
+                    r.backend = backend;
+                    r.engine = engine_name;
+                    r.threads = num_threads;
+                    r.distance = distance;
+                    r.run = run;
+                    r.num_vertices = g.num_vertices();
+                    r.num_edges = g.num_edges();
+                    r.spm_hits = r.spm_misses = -1;
+                    reset_peak_rss();
+                    engine_metrics metrics;
+                    chrono::steady_clock::time_point start;
+                    engine_options opts;
+                    opts.num_threads = num_threads;
+                    opts.pin_threads = o.pin;
+                    if (engine_name == "sync") {
+                        opts.pull_signals = program == "sssp";  // its out edge scatters only signal
+                        synchronous_engine<Program> engine(g, opts);
+                        engine.signal_all();
+                        start = chrono::steady_clock::now();
+                        engine.start();
+                        r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                        metrics = engine.metrics;
+                    } else {
+                        opts.load_ahead_distance = distance;
+                        opts.scheduler = engine_name == "priority" ? PRIORITY : WORK_STEALING;
+                        async_engine<Program> engine(g, opts);
+                        engine.signal_all();
+                        start = chrono::steady_clock::now();
+                        engine.start();
+                        r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                        metrics = engine.metrics;
+                        r.spm_hits = engine.spm_hits;
+                        r.spm_misses = engine.spm_misses;
+                    }
+                    r.peak_rss_kb = peak_rss_kb();
+                    r.updates = metrics[VERTEX_UPDATES];
+                    r.edges = metrics[GATHER_EDGES] + metrics[SCATTER_EDGES];
+                    r.result = Program::result(g);
+                    rows.push_back(r);
+                    cout << program << " " << backend << " " << engine_name << " threads=" << num_threads;
+                    if (distance >= 0) {
+                        cout << " distance=" << distance;
+                    }
+                    cout << ": " << r.seconds << " s, " << r.updates << " updates, result " << r.result << endl;
+                    if constexpr (is_csr_graph<Graph>::value) {    // graph_mutations only rebuilds csr_graphs
+                        if (o.inserts > 0) {
+                            run_with_inserts<Program>(g, source, opts, edge_data, o, r, rows);
+                        }
+                        if (!o.checkpoint_prefix.empty() && engine_name != "sync") {
+                            run_with_checkpoint<Program>(g, source, opts, o, r, rows);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Builds the graph of every backend with VertexData from Program::initial_data
+ * and EdgeData from edge_data(i) for edge i of input, and runs the configurations on it.
+ */
+template<template<typename> class Program, typename VertexData, typename EdgeData, typename EdgeDataFn>
+void run_backends(const generated_graph& input, const string& program, long source, EdgeDataFn edge_data,
+                  const benchmark_options& o, vector<result_row>& rows) {
+    for (const string& backend : o.backends) {
+        if (backend == "simple") {
+            typedef Graph<VertexData, EdgeData> graph_type;
+            graph_type g;
+            g.reserve(input.num_vertices, input.edges.size());
+            for (long vid = 0; vid < input.num_vertices; vid++) {
+                g.add_vertex(vid, Program<graph_type>::initial_data(vid, source));
+            }
+            for (std::size_t i = 0; i < input.edges.size(); i++) {
+                g.add_edge(input.edges[i].first, input.edges[i].second, edge_data(i));
+            }
+            run_configurations<Program<graph_type> >(g, program, backend, source, edge_data, o, rows);
+        } else {
+            typedef csr_graph<VertexData, EdgeData> graph_type;
+            csr_graph_builder<VertexData, EdgeData> builder;
+            for (long vid = 0; vid < input.num_vertices; vid++) {
+                builder.add_vertex(vid, Program<graph_type>::initial_data(vid, source));
+            }
+            for (std::size_t i = 0; i < input.edges.size(); i++) {
+                builder.add_edge(input.edges[i].first, input.edges[i].second, edge_data(i));
+            }
+            graph_type g = builder.finalize();
+            if (backend == "compressed") {
+                g.compress_neighbours();
+            }
+            run_configurations<Program<graph_type> >(g, program, backend, source, edge_data, o, rows);
+        }
+    }
+}
+
+// ---- input and output ---- //
+
+vector<string> split(const string& s, char sep) {
+    vector<string> ret;
+    stringstream in(s);
+    string item;
+    while (getline(in, item, sep)) {
+        ret.push_back(item);
+    }
+    return ret;
+}
+
+vector<int> split_ints(const string& s) {
+    vector<int> ret;
+    for (const string& item : split(s, ',')) {
+        ret.push_back(atoi(item.c_str()));
+    }
+    return ret;
+}
+
+// a generator spec (see the usage) or an unweighted adjacency list file. Returns false if the file can not be opened.
+bool load_graph(const string& name, generated_graph& g) {
+    const vector<string> spec = split(name, ':');
+    const uint64_t seed = spec.size() > 3 ? strtoull(spec[3].c_str(), NULL, 10) : 1;
+    if (spec.size() >= 3 && spec[0] == "rmat") {
+        g = rmat_graph(atoi(spec[1].c_str()), atoi(spec[2].c_str()), seed);
+        return true;
+    }
+    if (spec.size() >= 3 && spec[0] == "ba") {
+        g = barabasi_albert_graph(atol(spec[1].c_str()), atoi(spec[2].c_str()), seed);
+        return true;
+    }
+    if (spec.size() >= 3 && spec[0] == "grid") {
+        g = grid_graph(atol(spec[1].c_str()), atol(spec[2].c_str()));
+        return true;
+    }
+    ifstream in(name);
+    if (!in.is_open()) {
+        return false;
+    }
+    string line;
+    while (getline(in, line)) {
+        stringstream fields(line);
+        long vid, neigh;
+        if (!(fields >> vid)) {
+            continue;   // empty line
+        }
+        g.num_vertices = max(g.num_vertices, vid + 1);
+        while (fields >> neigh) {
+            g.edges.push_back(make_pair(vid, neigh));
+            g.num_vertices = max(g.num_vertices, neigh + 1);
+        }
+    }
+    g.normalize();
+    return true;
+}
+
+void write_csv(ostream& out, const benchmark_options& o, const vector<result_row>& rows) {
+    out << "program,graph,backend,engine,threads,load_ahead_distance,run,vertices,edges,seconds,"
+        << "updates,updates_per_sec,edges_per_sec,spm_hit_rate,peak_rss_kb,result\n";
+    for (const result_row& r : rows) {
+        out << r.program << "," << o.graph_name << "," << r.backend << "," << r.engine << "," << r.threads << ",";
+        if (r.distance >= 0) {
+            out << r.distance;
+        }
+        out << "," << r.run << "," << r.num_vertices << "," << r.num_edges << "," << r.seconds << ","
+            << r.updates << "," << r.updates / r.seconds << "," << r.edges / r.seconds << ",";
+        if (r.spm_hits + r.spm_misses > 0) {
+            out << (double) r.spm_hits / (r.spm_hits + r.spm_misses);
+        }
+        out << "," << r.peak_rss_kb << "," << r.result << "\n";
+    }
+}
+
+// an array of objects with the columns of write_csv, null where they do not apply.
+void write_json(ostream& out, const benchmark_options& o, const vector<result_row>& rows) {
+    out << "[";
+    for (std::size_t i = 0; i < rows.size(); i++) {
+        const result_row& r = rows[i];
+        out << (i > 0 ? ",\n  " : "\n  ")
+            << "{\"program\": \"" << r.program << "\", \"graph\": \"" << o.graph_name
+            << "\", \"backend\": \"" << r.backend << "\", \"engine\": \"" << r.engine
+            << "\", \"threads\": " << r.threads << ", \"load_ahead_distance\": ";
+        if (r.distance >= 0) {
+            out << r.distance;
+        } else {
+            out << "null";
+        }
+        out << ", \"run\": " << r.run << ", \"vertices\": " << r.num_vertices << ", \"edges\": " << r.num_edges
+            << ", \"seconds\": " << r.seconds << ", \"updates\": " << r.updates
+            << ", \"updates_per_sec\": " << r.updates / r.seconds << ", \"edges_per_sec\": " << r.edges / r.seconds
+            << ", \"spm_hit_rate\": ";
+        if (r.spm_hits + r.spm_misses > 0) {
+            out << (double) r.spm_hits / (r.spm_hits + r.spm_misses);
+        } else {
+            out << "null";
+        }
+        out << ", \"peak_rss_kb\": " << r.peak_rss_kb << ", \"result\": " << r.result << "}";
+    }
+    out << "\n]\n";
+}
+
+bool all_known(const vector<string>& values, const vector<string>& known, const string& what) {
+    for (const string& v : values) {
+        if (find(known.begin(), known.end(), v) == known.end()) {
+            cerr << "unknown " << what << " " << v << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        cerr << "usage: benchmark <rmat:scale:edge_factor[:seed]|ba:vertices:edges_per_vertex[:seed]|grid:rows:cols|graph.txt>"
+             << " [programs=pagerank,sssp,cc] [backends=csr,compressed,simple] [engines=async,priority,sync]"
+             << " [threads=1,...] [distances=10,...] [repeat=1] [seed=1] [pin=0] [inserts=0]"
+             << " [checkpoint=prefix] [checkpoint_interval=0.001] [out=" << out_default << "]"
+             << endl;
+        return -1;
+    }
+    benchmark_options o;
+    o.graph_name = argv[1];
+    o.programs = split("pagerank,sssp,cc", ',');
+    o.backends = split("csr,compressed,simple", ',');
+    o.engines = split("async,priority,sync", ',');
+    o.threads = vector<int>(1, 1);
+    o.distances = vector<int>(1, 10);
+    o.repeat = 1;
+    o.seed = 1;
+    o.pin = false;
+    o.inserts = 0;
+    o.checkpoint_interval = 0.001;
+    o.out_filename = out_default;
+    for (int i = 2; i < argc; i++) {
+        const string arg = argv[i];
+        const std::size_t eq = arg.find('=');
+        const string key = arg.substr(0, eq);
+        const string value = eq == string::npos ? "" : arg.substr(eq + 1);
+        if (key == "programs") {
+            o.programs = split(value, ',');
+        } else if (key == "backends") {
+            o.backends = split(value, ',');
+        } else if (key == "engines") {
+            o.engines = split(value, ',');
+        } else if (key == "threads") {
+            o.threads = split_ints(value);
+        } else if (key == "distances") {
+            o.distances = split_ints(value);
+        } else if (key == "repeat") {
+            o.repeat = atoi(value.c_str());
+        } else if (key == "seed") {
+            o.seed = strtoull(value.c_str(), NULL, 10);
+        } else if (key == "pin") {
+            o.pin = atoi(value.c_str()) != 0;
+        } else if (key == "inserts") {
+            o.inserts = atol(value.c_str());
+        } else if (key == "checkpoint") {
+            o.checkpoint_prefix = value;
+        } else if (key == "checkpoint_interval") {
+            o.checkpoint_interval = atof(value.c_str());
+        } else if (key == "out") {
+            o.out_filename = value;
+        } else {
+            cerr << "unknown option " << arg << endl;
+            return -1;
+        }
+    }
+    if (!all_known(o.programs, split("pagerank,sssp,cc", ','), "program")
+        || !all_known(o.backends, split("csr,compressed,simple", ','), "backend")
+        || !all_known(o.engines, split("async,priority,sync", ','), "engine")) {
+        return -1;
+    }
+
+    generated_graph input;
+    if (!load_graph(o.graph_name, input)) {
+        cout << "Can not open input file" << endl;
+        return -1;
+    }
+    // SSSP starts at the vertex with the most out edges, so that it reaches a large part of the graph.
+    vector<long> out_degree(input.num_vertices, 0);
+    for (const pair<long, long>& e : input.edges) {
+        out_degree[e.first]++;
+    }
+    const long source = input.num_vertices > 0 ? max_element(out_degree.begin(), out_degree.end()) - out_degree.begin() : 0;
+    cout << o.graph_name << ": " << input.num_vertices << " vertices, " << input.edges.size() << " edges" << endl;
+
+    vector<result_row> rows;
+    for (const string& program : o.programs) {
+        if (program == "pagerank") {
+            run_backends<pagerank_program, double, graphlab::empty>(input, program, source,
+                [](std::size_t i) { return graphlab::empty(); }, o, rows);
+        } else if (program == "sssp") {
+            const uint64_t seed = o.seed;
+            run_backends<sssp_program, long, long>(input, program, source,
+                [seed](std::size_t i) { return generated_weight(seed, i); }, o, rows);
+        } else {
+            run_backends<cc_program, long, graphlab::empty>(input, program, source,
+                [](std::size_t i) { return graphlab::empty(); }, o, rows);
+        }
+    }
+
+    ofstream out_file(o.out_filename);
+    if (!out_file.is_open()) {
+        cout << "Unable to open output file" << endl;
+        return -1;
+    }
+    if (o.out_filename.size() > 5 && o.out_filename.substr(o.out_filename.size() - 5) == ".json") {
+        write_json(out_file, o, rows);
+    } else {
+        write_csv(out_file, o, rows);
+    }
+    out_file.close();
+    if (num_mismatches > 0) {
+        cout << num_mismatches << " resumed runs failed or differ from uninterrupted runs" << endl;
+        return 1;
+    }
+}
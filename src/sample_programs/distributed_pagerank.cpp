@@ -0,0 +1,166 @@
+#include <iostream>
+#include <cmath>
+#include <fstream>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include "../GAS_framework/distributed_graph.hpp"
+#include "../GAS_framework/distributed_engine.hpp"
+#include "../GAS_framework/tcp_comm.hpp"
+#include "../graphlab/graphlab.hpp"
+
+using namespace std;
+
+typedef distributed_graph<double, graphlab::empty> graph_type;
+
+const string in_graph_filename = "generated_graph_pagerank.txt";
+
+/**
+ * The PageRank of pagerank.cpp, run by distributed_engine. Every process is
+ * started with its own id and the same list of processes, e.g. on one machine:
+ *
+ * \code
+ * ./distributed_pagerank 0 localhost:9000,localhost:9001 graph.txt &
+ * ./distributed_pagerank 1 localhost:9000,localhost:9001 graph.txt
+ * \endcode
+ *
+ * Each process writes the ranks of the vertices it is the master of to
+ * pagerank_output_<procid>.txt.
+ */
+class pagerank_program :
+             public graphlab::static_vertex_program<pagerank_program, graph_type, double> {
+
+private:
+  // a variable local to this program
+  double delta;
+public:
+  template<typename Context>
+  edge_dir_type gather_edges(Context& context, const vertex_type& vertex) const {
+    return graphlab::IN_EDGES;
+  }
+  template<typename Context>
+  double gather(Context& context, const vertex_type& vertex,
+               edge_type& edge) const {
+    return edge.source().data() / edge.source().num_out_edges();
+  }
+
+  // Use the total rank of adjacent pages to update this page
+  template<typename Context>
+  void apply(Context& context, vertex_type& vertex,
+             const gather_type& total) {
+    double newval = total * 0.85 + 0.15;
+    double prevval = vertex.data();
+    vertex.data() = newval;
+    delta = newval - prevval;
+  }
+
+  template<typename Context>
+  edge_dir_type scatter_edges(Context& context, const vertex_type& vertex) const {
+    return graphlab::OUT_EDGES;
+  }
+
+  template<typename Context>
+  void scatter(Context& context, const vertex_type& vertex,
+               edge_type& edge) const {
+    if ((std::fabs(delta) > 1E-3)) {
+      context.signal(edge.target());
+    }
+  }
+
+  // the mirrors scatter with the delta of the master's apply
+  void save(oarchive& oarc) const { oarc << delta; }
+  void load(iarchive& iarc) { iarc >> delta; }
+};
+
+int main(int argc, char** argv) {
+    if (argc < 3 || argc > 6) {
+        cerr << "usage: distributed_pagerank <procid> <host:port,host:port,...> [input graph (.txt)] [num_threads] [oblivious|random]" << endl;
+        return -1;
+    }
+    const int procid = atoi(argv[1]);
+    const string graph_filename = argc > 3 ? argv[3] : in_graph_filename;
+    const int num_threads = argc > 4 ? atoi(argv[4]) : 1;
+    const string cut_name = argc > 5 ? argv[5] : "oblivious";
+    if (cut_name != "oblivious" && cut_name != "random") {
+        cerr << "unknown vertex cut " << cut_name << ", expected oblivious or random" << endl;
+        return -1;
+    }
+
+    try {
+        tcp_comm comm(procid, tcp_comm::parse_hosts(argv[2]));
+
+        /**
+         *  ---- Parse the input file ----
+         * Each line is "vid neigh_vid neigh_vid ...", as for pagerank.cpp.
+         * Every process parses its share of the lines.
+         */
+        chrono::steady_clock::time_point ingress_start = chrono::steady_clock::now();
+        distributed_graph_builder<double, graphlab::empty> builder(comm,
+            cut_name == "random" ? RANDOM_CUT : OBLIVIOUS_CUT, 1.0, num_threads);
+        bool opened = builder.ingest_lines(graph_filename, [&](const char *line, const char *line_end) {
+            char *pos;
+            const long vid = strtol(line, &pos, 10);
+            if (pos == line) {
+                return;     // empty line
+            }
+            builder.add_vertex(vid, 1.0);
+            while (pos < line_end) {
+                char *next;
+                const long target = strtol(pos, &next, 10);
+                if (next == pos) {
+                    break;
+                }
+                builder.add_edge(vid, target);
+                pos = next;
+            }
+        });
+        if (!opened) {
+            cout << "Can not open input file" << endl;
+            return -1;
+        }
+        graph_type g = builder.finalize();
+        const double replication = g.replication_factor(comm);
+        if (comm.procid() == 0) {
+            cout << "Ingress time: "
+                 << chrono::duration<double>(chrono::steady_clock::now() - ingress_start).count() << " s" << endl;
+            cout << g.num_vertices() << " vertices, " << g.num_edges() << " edges on "
+                 << comm.num_procs() << " processes, replication factor " << replication << endl;
+        }
+        cout << "Process " << comm.procid() << ": " << g.num_local_vertices() << " replicas, "
+             << g.num_local_edges() << " edges" << endl;
+
+        // --- execute program
+        engine_options opts;
+        opts.num_threads = num_threads;
+        chrono::steady_clock::time_point engine_start = chrono::steady_clock::now();
+        distributed_engine<pagerank_program> engine(g, comm, opts);
+        engine.signal_all();
+        engine.start();
+        const long num_executed = comm.all_reduce_sum(engine.num_executed);
+        const long bytes_sent = comm.all_reduce_sum(engine.bytes_sent);
+        if (comm.procid() == 0) {
+            cout << "Engine run time: "
+                 << chrono::duration<double>(chrono::steady_clock::now() - engine_start).count() << " s" << endl;
+            cout << "Iterations: " << engine.iteration() << endl;
+            cout << "Vertex programs executed: " << num_executed << endl;
+            cout << "Bytes sent: " << bytes_sent << endl;
+        }
+
+        // --- write the output file
+        ofstream out_file("pagerank_output_" + to_string(comm.procid()) + ".txt");
+        if (!out_file.is_open()) {
+            cout << "Unable to open output file" << endl;
+            return -1;
+        }
+        for (int lvid = 0; lvid < g.num_local_vertices(); lvid++) {
+            if (g.is_master(lvid)) {
+                out_file << g.vertex(lvid).id() << "\t" << g.vertex(lvid).data() << endl;
+            }
+        }
+        out_file.close();
+        comm.barrier();
+    } catch (const std::exception& e) {
+        cerr << "Process " << procid << ": " << e.what() << endl;
+        return -1;
+    }
+}
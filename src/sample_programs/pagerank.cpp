@@ -1,35 +1,47 @@
 #include <iostream>
 #include <cmath>
 #include <fstream>
-#include <sstream>
-#include "../GAS_framework/simple_graph.hpp"
+#include <cstdlib>
+#include <chrono>
+#include "../GAS_framework/csr_graph.hpp"
+#include "../GAS_framework/graph_builder.hpp"
+#include "../GAS_framework/graph_file.hpp"
 #include "../GAS_framework/async_engine.hpp"
+#include "../GAS_framework/vertex_order.hpp"
 #include "../graphlab/graphlab.hpp"
 
 using namespace std;
 
-typedef Graph<double, graphlab::empty> graph_type;
+typedef csr_graph<double, graphlab::empty> graph_type;
 
 const string in_graph_filename = "generated_graph_pagerank.txt";
 const string out_filename = "pagerank_output.txt";
 
+/**
+ * The per-edge gather is a single division, so the program is a
+ * static_vertex_program: the engine calls its functions with its own context
+ * type, and they inline into the engine's gather and scatter loops.
+ */
 class pagerank_program :
-             public graphlab::ivertex_program<graph_type, double> {
+             public graphlab::static_vertex_program<pagerank_program, graph_type, double> {
 
 private:
   // a variable local to this program
   double delta;
 public:
-  edge_dir_type gather_edges(icontext_type& context, const vertex_type& vertex) const {
+  template<typename Context>
+  edge_dir_type gather_edges(Context& context, const vertex_type& vertex) const {
     return graphlab::IN_EDGES;
   }
-  double gather(icontext_type& context, const vertex_type& vertex,
+  template<typename Context>
+  double gather(Context& context, const vertex_type& vertex,
                edge_type& edge) const {
     return edge.source().data() / edge.source().num_out_edges();
   }
 
   // Use the total rank of adjacent pages to update this page 
-  void apply(icontext_type& context, vertex_type& vertex,
+  template<typename Context>
+  void apply(Context& context, vertex_type& vertex,
              const gather_type& total) {
     double newval = total * 0.85 + 0.15;
     double prevval = vertex.data();
@@ -37,11 +49,13 @@ public:
     delta = newval - prevval;
   }
   
-  edge_dir_type scatter_edges(icontext_type& context, const vertex_type& vertex) const {
+  template<typename Context>
+  edge_dir_type scatter_edges(Context& context, const vertex_type& vertex) const {
     return graphlab::OUT_EDGES;
   }
 
-  void scatter(icontext_type& context, const vertex_type& vertex,
+  template<typename Context>
+  void scatter(Context& context, const vertex_type& vertex,
                edge_type& edge) const {
     context.post_delta(edge.target(), delta / vertex.num_out_edges());
     if ((std::fabs(delta) > 1E-3)) {
@@ -50,42 +64,105 @@ public:
   }
 };
 
-int main() { 
-    graph_type g;
+/**
+ * The L1 norm of the change that one more update of every vertex would make
+ * (before the damping), i.e. how far the ranks are from a fixed point. The
+ * engine stops once an aggregator finds it below the tolerance.
+ */
+double residual(const graph_type::vertex_type& vertex) {
+    double total = 0;
+    for (int i = 0; i < vertex.num_in_edges(); i++) {
+        const graph_type::vertex_type source = vertex.in_edge(i).source();
+        total += source.data() / source.num_out_edges();
+    }
+    return std::fabs(total * 0.85 + 0.15 - vertex.data());
+}
 
-    /**
-     *  ---- Parse the input file ----
-     * The parsing method used here is very specific. It only works with input
-     * files that have the format used in the test I've run.
-     */
-    string line;
-    ifstream input_graph(in_graph_filename);
-    if (!input_graph.is_open()) {
-      cout << "Can not open input file" << endl;
-      return -1;
+int main(int argc, char** argv) { 
+    if (argc > 6) {
+        cerr << "usage: pagerank [input graph (.txt or .bin)] [num_threads] [cache|nocache] [original|degree|rcm] [tolerance]" << endl;
+        return -1;
     }
-    int line_no = 0;
-    while (getline(input_graph, line)) {
-      stringstream ss(line);
-      int cur_vid;
-      int neigh_vid;
-      ss >> cur_vid;
-      g.add_vertex(cur_vid, 1.0);
-      while (ss >> neigh_vid) {
-        if (line_no < neigh_vid) {
-          // need to add neighbour here so that add_edge does not fail.
-          g.add_vertex(neigh_vid, 1.0);
+    const string graph_filename = argc > 1 ? argv[1] : in_graph_filename;
+    const int num_threads = argc > 2 ? atoi(argv[2]) : 1;
+    const bool enable_caching = argc > 3 ? string(argv[3]) != "nocache" : true;
+    const string order_name = argc > 4 ? argv[4] : "original";
+    const double tolerance = argc > 5 ? atof(argv[5]) : 0;     // of the total residual, 0 to run until every delta is small
+    if (order_name != "original" && order_name != "degree" && order_name != "rcm") {
+        cerr << "unknown vertex order " << order_name << ", expected original, degree or rcm" << endl;
+        return -1;
+    }
+
+    graph_type g;
+    if (graph_filename.size() > 4 && graph_filename.substr(graph_filename.size() - 4) == ".bin") {
+        // binary graph files are written by testing_tools/text_to_binary.cpp
+        try {
+            g = graph_file::load<double, graphlab::empty>(graph_filename);
+        } catch (const std::runtime_error& e) {
+            cout << e.what() << endl;
+            return -1;
+        }
+    } else {
+        /**
+         *  ---- Parse the input file ----
+         * The parsing method used here is very specific. It only works with input
+         * files that have the format used in the test I've run.
+         * Each line is "vid neigh_vid neigh_vid ...".
+         */
+        const int num_build_threads = thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 1;
+        csr_graph_builder<double, graphlab::empty> builder(num_build_threads, 1.0);
+        bool opened = builder.ingest_lines(graph_filename,
+            [&](int thread_id, const char *line, const char *line_end) {
+                builder.add_adjacency_line(line, line_end, thread_id);
+            });
+        if (!opened) {
+          cout << "Can not open input file" << endl;
+          return -1;
         }
-        g.add_edge(cur_vid, neigh_vid);
-      }
-      line_no++;
+        g = builder.finalize();
+        builder.print_timings(cout);
+    }
+
+    // --- relabel the vertices for locality. The output is written with the ids of the input.
+    vertex_relabeling relabeling = compute_order(g, order_name == "degree" ? DEGREE_ORDER :
+                                                    order_name == "rcm" ? RCM_ORDER : ORIGINAL_ORDER);
+    if (order_name != "original") {
+        chrono::steady_clock::time_point relabel_start = chrono::steady_clock::now();
+        g = relabel(g, relabeling, num_threads);
+        cout << "Relabel time: "
+             << chrono::duration<double>(chrono::steady_clock::now() - relabel_start).count() << " s" << endl;
     }
-    input_graph.close();
 
     // --- execute program
-    async_engine<pagerank_program> engine(g, true); // the second argument enables gather caching.
+    engine_options opts;
+    opts.num_threads = num_threads;
+    opts.enable_caching = enable_caching;   // scatter keeps the neighbours' cached sums up to date with post_delta
+    opts.partition_vertices = order_name != "original";    // the relabeled id ranges are local
+    chrono::steady_clock::time_point engine_start = chrono::steady_clock::now();
+    async_engine<pagerank_program> engine(g, opts);
+    if (tolerance > 0) {
+        engine.add_vertex_aggregator<double>("residual",
+            [](pagerank_program::icontext_type& context, const graph_type::vertex_type& vertex) {
+                return residual(vertex);
+            },
+            [&](pagerank_program::icontext_type& context, const double& total) {
+                if (total < tolerance) {
+                    context.stop();
+                }
+            });
+        engine.aggregate_periodic("residual", 0.05);
+    }
     engine.signal_all();
     engine.start();
+    cout << "Engine run time: "
+         << chrono::duration<double>(chrono::steady_clock::now() - engine_start).count() << " s" << endl;
+    cout << "Vertex programs executed: " << engine.num_executed << endl;
+    cout << "SPM hits: " << engine.spm_hits << endl;
+    cout << "SPM misses: " << engine.spm_misses << endl;
+    cout << "Simulated cycles: " << engine.simulated_cycles << " (" << engine.stall_cycles << " stalled)" << endl;
+    ofstream metrics_file("pagerank_metrics.json");
+    engine.metrics.write_json(metrics_file);
+    metrics_file.close();
 
     // --- write the output file
     ofstream out_file(out_filename);
@@ -95,7 +172,7 @@ int main() {
     }
 
     for (int i = 0; i < g.num_vertices(); i++) {
-        out_file << i << "\t" << g.vertex(i).data() << endl;
+        out_file << i << "\t" << g.vertex(relabeling.new_id[i]).data() << endl;
     }
     out_file.close();
 }
\ No newline at end of file
@@ -0,0 +1,249 @@
+/**
+ * Runs SSSP with async_engine many times on a seeded R-MAT graph and checks
+ * every result against a sequential Dijkstra, to catch races and deadlocks of
+ * the consistency models (Chandy-Misra forks, neighbourhood locks) that only
+ * show up in a few runs out of hundreds:
+ *
+ * \code
+ * ./consistency_stress scale=11 threads=8 runs=400 consistency=edge
+ * taskset -c 0 ./consistency_stress threads=8 runs=400     # all workers on one core
+ * \endcode
+ *
+ * Options (defaults in brackets): scale=11 edge_factor=8 seed=1 threads=8
+ * runs=100 consistency=edge,monitor,vertex timeout=10 (seconds per run). The
+ * runs alternate between the WORK_STEALING and PRIORITY schedulers.
+ *
+ * Exits with 1 if a result differs, and with 2 right away if a run does not
+ * finish within the timeout (a deadlock: the workers sleep with vertices
+ * left to run).
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <functional>   // greater
+#include <utility>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include "../../GAS_framework/csr_graph.hpp"
+#include "../../GAS_framework/graph_builder.hpp"
+#include "../../GAS_framework/graph_generators.hpp"
+#include "../../GAS_framework/async_engine.hpp"
+#include "../../graphlab/graphlab.hpp"
+
+using namespace std;
+
+typedef csr_graph<long, long> graph_type;
+
+// the smallest distance gathered from the in edges, -1 if none.
+struct min_distance {
+    long value;
+    min_distance(): value(-1) {}
+    explicit min_distance(long value): value(value) {}
+    min_distance& operator+=(const min_distance& other) {
+        if (other.value >= 0 && (value < 0 || other.value < value)) {
+            value = other.value;
+        }
+        return *this;
+    }
+};
+
+// the smallest candidate distance, -1 (gather all in edges) wins, as distance_message in SSSP.cpp.
+struct distance_message {
+    long distance;
+    distance_message(): distance(-1) {}
+    explicit distance_message(long distance): distance(distance) {}
+    distance_message& operator+=(const distance_message& other) {
+        if (distance >= 0 && (other.distance < 0 || other.distance < distance)) {
+            distance = other.distance;
+        }
+        return *this;
+    }
+    double priority() const { return distance; }
+};
+
+class sssp_program :
+             public graphlab::static_vertex_program<sssp_program, graph_type, min_distance, distance_message> {
+    long candidate;
+    bool do_scatter;
+public:
+    template<typename Context>
+    void init(Context& context, const vertex_type& vertex, const distance_message& msg) {
+        candidate = msg.distance;
+    }
+    template<typename Context>
+    graphlab::edge_dir_type gather_edges(Context& context, const vertex_type& vertex) const {
+        return candidate >= 0 ? graphlab::NO_EDGES : graphlab::IN_EDGES;
+    }
+    template<typename Context>
+    min_distance gather(Context& context, const vertex_type& vertex, edge_type& edge) const {
+        return edge.source().data() >= 0 ? min_distance(edge.source().data() + edge.data()) : min_distance();
+    }
+    template<typename Context>
+    void apply(Context& context, vertex_type& vertex, const min_distance& gathered) {
+        const long total = candidate >= 0 ? candidate : gathered.value;
+        if (total > 0 && (vertex.data() < 0 || vertex.data() > total)) {
+            vertex.data() = total;
+            do_scatter = true;
+        } else {
+            do_scatter = vertex.data() == 0 && candidate < 0;  // the source, after signal_all
+        }
+    }
+    template<typename Context>
+    graphlab::edge_dir_type scatter_edges(Context& context, const vertex_type& vertex) const {
+        return do_scatter ? graphlab::OUT_EDGES : graphlab::NO_EDGES;
+    }
+    template<typename Context>
+    void scatter(Context& context, const vertex_type& vertex, edge_type& edge) const {
+        context.signal(edge.target(), distance_message(vertex.data() + edge.data()));
+    }
+};
+
+// distances from source, -1 for unreachable vertices.
+vector<long> dijkstra(graph_type& g, long source) {
+    vector<long> dist(g.num_vertices(), -1);
+    priority_queue<pair<long, long>, vector<pair<long, long> >, greater<pair<long, long> > > queue;
+    dist[source] = 0;
+    queue.push(make_pair(0L, source));
+    while (!queue.empty()) {
+        const pair<long, long> top = queue.top();
+        queue.pop();
+        if (top.first > dist[top.second]) {
+            continue;
+        }
+        auto&& v = g.vertex(top.second);
+        for (int i = 0; i < v.num_out_edges(); i++) {
+            auto&& e = v.out_edge(i);
+            const long target = e.target().id();
+            const long d = top.first + e.data();
+            if (dist[target] < 0 || d < dist[target]) {
+                dist[target] = d;
+                queue.push(make_pair(d, target));
+            }
+        }
+    }
+    return dist;
+}
+
+vector<string> split(const string& list) {
+    vector<string> ret;
+    stringstream in(list);
+    string item;
+    while (getline(in, item, ',')) {
+        ret.push_back(item);
+    }
+    return ret;
+}
+
+int main(int argc, char** argv) {
+    int scale = 11;
+    int edge_factor = 8;
+    uint64_t seed = 1;
+    int num_threads = 8;
+    int runs = 100;
+    vector<string> consistencies = split("edge,monitor,vertex");
+    double timeout = 10;
+    for (int i = 1; i < argc; i++) {
+        const string arg = argv[i];
+        const size_t eq = arg.find('=');
+        const string key = arg.substr(0, eq);
+        const string value = eq == string::npos ? "" : arg.substr(eq + 1);
+        if (key == "scale") {
+            scale = atoi(value.c_str());
+        } else if (key == "edge_factor") {
+            edge_factor = atoi(value.c_str());
+        } else if (key == "seed") {
+            seed = strtoull(value.c_str(), NULL, 10);
+        } else if (key == "threads") {
+            num_threads = atoi(value.c_str());
+        } else if (key == "runs") {
+            runs = atoi(value.c_str());
+        } else if (key == "consistency") {
+            consistencies = split(value);
+        } else if (key == "timeout") {
+            timeout = atof(value.c_str());
+        } else {
+            cerr << "usage: consistency_stress [scale=11] [edge_factor=8] [seed=1] [threads=8] [runs=100]"
+                 << " [consistency=edge,monitor,vertex] [timeout=10]" << endl;
+            return -1;
+        }
+    }
+    for (const string& c : consistencies) {
+        if (c != "edge" && c != "monitor" && c != "vertex") {
+            cerr << "unknown consistency " << c << ", expected edge, monitor or vertex" << endl;
+            return -1;
+        }
+    }
+
+    const generated_graph input = rmat_graph(scale, edge_factor, seed);
+    csr_graph_builder<long, long> builder;
+    for (long vid = 0; vid < input.num_vertices; vid++) {
+        builder.add_vertex(vid, -1);
+    }
+    for (std::size_t i = 0; i < input.edges.size(); i++) {
+        builder.add_edge(input.edges[i].first, input.edges[i].second, generated_weight(seed, i));
+    }
+    graph_type reference = builder.finalize();
+    const long source = input.edges.empty() ? 0 : input.edges[0].first;     // has out edges
+    const vector<long> expected = dijkstra(reference, source);
+    cout << "rmat:" << scale << ":" << edge_factor << ": " << reference.num_vertices() << " vertices, "
+         << reference.num_edges() << " edges, source " << source << endl;
+
+    // a run that takes longer than the timeout hangs, since the engine can not be interrupted.
+    atomic<long> run_started(0);    // steady_clock ticks of the start of the current run, 0 between runs
+    atomic<bool> done(false);
+    string current;     // written before run_started
+    thread watchdog([&] {
+        while (!done.load()) {
+            this_thread::sleep_for(chrono::milliseconds(100));
+            const long started = run_started.load();
+            const double seconds = chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()
+                                                            - chrono::steady_clock::duration(started)).count();
+            if (started != 0 && seconds > timeout) {
+                cout << current << ": no result after " << timeout << " s, deadlocked" << endl;
+                _Exit(2);
+            }
+        }
+    });
+
+    int num_failures = 0;
+    for (const string& c : consistencies) {
+        int failures = 0;
+        for (int run = 0; run < runs; run++) {
+            graph_type g = reference;
+            for (long vid = 0; vid < g.num_vertices(); vid++) {
+                g.vertex(vid).data() = vid == source ? 0 : -1;
+            }
+            engine_options opts;
+            opts.num_threads = num_threads;
+            opts.consistency = c == "edge" ? EDGE_CONSISTENCY : c == "monitor" ? MONITOR_EDGE_CONSISTENCY
+                                                                                : VERTEX_CONSISTENCY;
+            opts.scheduler = run % 2 == 0 ? WORK_STEALING : PRIORITY;
+            current = c + " run " + to_string(run) + (run % 2 == 0 ? " (work stealing)" : " (priority)");
+            run_started.store(chrono::steady_clock::now().time_since_epoch().count());
+            {
+                async_engine<sssp_program> engine(g, opts);
+                engine.signal_all();
+                engine.start();
+            }
+            run_started.store(0);
+            long mismatches = 0;
+            for (long vid = 0; vid < g.num_vertices(); vid++) {
+                mismatches += g.vertex(vid).data() != expected[vid];
+            }
+            if (mismatches > 0) {
+                cout << current << ": " << mismatches << " distances differ from Dijkstra's" << endl;
+                failures++;
+            }
+        }
+        cout << c << " consistency: " << runs - failures << " of " << runs << " runs correct" << endl;
+        num_failures += failures;
+    }
+    done.store(true);
+    watchdog.join();
+    return num_failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+/**
+ * Writes a synthetic graph of graph_generators.hpp in the text format of
+ * pagerank.cpp, or of SSSP.cpp with "weighted":
+ *
+ * \code
+ * ./graph_generator rmat graph.txt 16 16 1            # 2^16 vertices, 16 edges per vertex
+ * ./graph_generator ba graph.txt 100000 8 1 weighted  # 100000 vertices, 8 edges per new vertex
+ * ./graph_generator grid graph.txt 300 300            # 300 x 300 grid
+ * \endcode
+ *
+ * The same arguments always give the same file.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include "../../GAS_framework/graph_generators.hpp"
+using namespace std;
+
+int main(int argc, char** argv) {
+    if (argc < 5 || argc > 7) {
+        cerr << "usage: graph_generator <rmat|ba|grid> <output.txt> <a> <b> [seed] [unweighted|weighted]" << endl;
+        cerr << "  rmat: a = scale (2^a vertices), b = edges per vertex" << endl;
+        cerr << "  ba:   a = number of vertices, b = edges per new vertex" << endl;
+        cerr << "  grid: a = rows, b = columns" << endl;
+        return -1;
+    }
+    const string kind = argv[1];
+    const string out_filename = argv[2];
+    const long a = atol(argv[3]);
+    const long b = atol(argv[4]);
+    const uint64_t seed = argc > 5 ? strtoull(argv[5], NULL, 10) : 1;
+    const string weights = argc > 6 ? argv[6] : "unweighted";
+    if (weights != "unweighted" && weights != "weighted") {
+        cerr << "unknown weights " << weights << ", expected unweighted or weighted" << endl;
+        return -1;
+    }
+
+    generated_graph g;
+    if (kind == "rmat") {
+        g = rmat_graph(a, b, seed);
+    } else if (kind == "ba") {
+        g = barabasi_albert_graph(a, b, seed);
+    } else if (kind == "grid") {
+        g = grid_graph(a, b);
+    } else {
+        cerr << "unknown graph " << kind << ", expected rmat, ba or grid" << endl;
+        return -1;
+    }
+
+    ofstream graph_file(out_filename);
+    if (!graph_file.is_open()) {
+        cout << "Unable to open file" << endl;
+        return -1;
+    }
+    write_adjacency(graph_file, g, weights == "weighted", seed);
+    graph_file.close();
+    cout << "num nodes: " << g.num_vertices << endl;
+    cout << "num edges: " << g.edges.size() << endl;
+}
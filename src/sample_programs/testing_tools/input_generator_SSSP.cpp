@@ -10,7 +10,7 @@ const int min_nodes = 8000;
 const double max_neighs_proportion = 0.02;
 const int max_weight = 100;
 
-int main() {
+int main(int argc, char** argv) {
     ofstream graph_file("generated_graph_SSSP.txt");
     if (!graph_file.is_open()) {
         cout << "Unable to open file" << endl;
@@ -18,7 +18,8 @@ int main() {
     }
 
 
-    srand(time(NULL));    // seed rand()
+    // seed rand(). A seed argument makes the graph repeatable (with the same C library).
+    srand(argc > 1 ? strtoul(argv[1], NULL, 10) : time(NULL));
     const int num_nodes = min_nodes + (rand() % (max_nodes - min_nodes));
     cout << "num nodes: " << num_nodes << endl;
     const int max_neighs = max_nodes * max_neighs_proportion;
@@ -9,14 +9,15 @@ const int max_nodes = 100;
 const int min_nodes = 50;
 const double max_neighs_proportion = 0.3;
 
-int main() {
+int main(int argc, char** argv) {
     ofstream graph_file("generated_graph_pagerank.txt");
     if (!graph_file.is_open()) {
         cout << "Unable to open file" << endl;
         return -1;
     }
 
-    srand(time(NULL));    // seed rand()
+    // seed rand(). A seed argument makes the graph repeatable (with the same C library).
+    srand(argc > 1 ? strtoul(argv[1], NULL, 10) : time(NULL));
     const int num_nodes = min_nodes + (rand() % (max_nodes - min_nodes));
     cout << "num nodes: " << num_nodes << endl;
     const int max_neighs = max_nodes * max_neighs_proportion;
@@ -0,0 +1,73 @@
+/**
+ * Converts the text graphs written by input_generator_SSSP.cpp and
+ * input_generator_pagerank.cpp into the binary format of graph_file.hpp,
+ * which SSSP and pagerank can memory-map directly.
+ *
+ * The vertex and edge data types and the initial vertex data must match the
+ * ones in SSSP.cpp and pagerank.cpp.
+ */
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <stdexcept>
+#include "../../GAS_framework/graph_builder.hpp"
+#include "../../GAS_framework/graph_file.hpp"
+#include "../../graphlab/graphlab.hpp"
+using namespace std;
+
+int main(int argc, char** argv) {
+    if (argc < 4 || argc > 5) {
+        cerr << "usage: text_to_binary <SSSP|pagerank> <input.txt> <output.bin> [num_threads]" << endl;
+        return -1;
+    }
+    const string program = argv[1];
+    const string in_filename = argv[2];
+    const string out_filename = argv[3];
+    int num_threads = argc == 5 ? atoi(argv[4]) : thread::hardware_concurrency();
+
+    try {
+        if (program == "SSSP") {
+            typedef csr_graph_builder<long int, long int> builder_type;
+            builder_type builder(num_threads, -1);
+            bool opened = builder.ingest_lines(in_filename,
+                [&](int thread_id, const char *line, const char *line_end) {
+                    builder_type::vertex_id_type vid = builder.add_weighted_adjacency_line(line, line_end, thread_id);
+                    if (vid == 0) {
+                        builder.add_vertex(0, 0, thread_id);     // the source, the others get -1
+                    }
+                });
+            if (!opened) {
+                cerr << "Can not open input file" << endl;
+                return -1;
+            }
+            builder_type::graph_type g = builder.finalize();
+            builder.print_timings(cout);
+            graph_file::save(g, out_filename);
+            cout << "num vertices: " << g.num_vertices() << endl;
+            cout << "num edges: " << g.num_edges() << endl;
+        } else if (program == "pagerank") {
+            typedef csr_graph_builder<double, graphlab::empty> builder_type;
+            builder_type builder(num_threads, 1.0);
+            bool opened = builder.ingest_lines(in_filename,
+                [&](int thread_id, const char *line, const char *line_end) {
+                    builder.add_adjacency_line(line, line_end, thread_id);
+                });
+            if (!opened) {
+                cerr << "Can not open input file" << endl;
+                return -1;
+            }
+            builder_type::graph_type g = builder.finalize();
+            builder.print_timings(cout);
+            graph_file::save(g, out_filename);
+            cout << "num vertices: " << g.num_vertices() << endl;
+            cout << "num edges: " << g.num_edges() << endl;
+        } else {
+            cerr << "unknown program " << program << ", expected SSSP or pagerank" << endl;
+            return -1;
+        }
+    } catch (const std::runtime_error& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+}